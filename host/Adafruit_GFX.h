@@ -0,0 +1,31 @@
+#ifndef HOST_ADAFRUIT_GFX_H
+#define HOST_ADAFRUIT_GFX_H
+
+#include "Arduino.h"
+
+// Text-only subset of Adafruit_GFX. Glyphs are 6x8 cells whose column
+// patterns are derived from the character code, which is all the byte
+// counting needs.
+class Adafruit_GFX : public Print {
+protected:
+    int16_t width, height;
+    int16_t cursorX, cursorY;
+    uint16_t textColor;
+    bool wrap;
+
+public:
+    Adafruit_GFX(int16_t width, int16_t height)
+        : width(width), height(height), cursorX(0), cursorY(0), textColor(1), wrap(true) {}
+
+    virtual void drawPixel(int16_t x, int16_t y, uint16_t color) = 0;
+    void fillRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color);
+    void setCursor(int16_t x, int16_t y) { cursorX = x; cursorY = y; }
+    void setTextSize(uint8_t size) {}
+    void setTextColor(uint16_t color) { textColor = color; }
+    void setTextColor(uint16_t color, uint16_t background) { textColor = color; }
+    void setTextWrap(bool enabled) { wrap = enabled; }
+    size_t write(uint8_t c) override;
+    using Print::write;
+};
+
+#endif // HOST_ADAFRUIT_GFX_H
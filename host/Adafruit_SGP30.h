@@ -0,0 +1,26 @@
+#ifndef HOST_ADAFRUIT_SGP30_H
+#define HOST_ADAFRUIT_SGP30_H
+
+#include "Wire.h"
+
+// SGP30 that reports the simulated environment
+class Adafruit_SGP30 {
+private:
+    uint16_t eco2Baseline, tvocBaseline;
+
+public:
+    Adafruit_SGP30() : eco2Baseline(0), tvocBaseline(0), TVOC(0), eCO2(0), rawH2(0), rawEthanol(0) {}
+
+    bool begin(TwoWire* wire = &Wire, bool initSensor = true);
+    bool IAQinit();
+    bool IAQmeasure();
+    bool IAQmeasureRaw();
+    bool getIAQBaseline(uint16_t* eco2Base, uint16_t* tvocBase);
+    bool setIAQBaseline(uint16_t eco2Base, uint16_t tvocBase);
+    bool setHumidity(uint32_t absoluteHumidity);
+
+    uint16_t TVOC, eCO2;
+    uint16_t rawH2, rawEthanol;
+};
+
+#endif // HOST_ADAFRUIT_SGP30_H
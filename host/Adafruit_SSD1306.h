@@ -0,0 +1,35 @@
+#ifndef HOST_ADAFRUIT_SSD1306_H
+#define HOST_ADAFRUIT_SSD1306_H
+
+#include "Adafruit_GFX.h"
+#include "Wire.h"
+
+#define SSD1306_BLACK 0
+#define SSD1306_WHITE 1
+#define SSD1306_SWITCHCAPVCC 0x02
+#define SSD1306_DISPLAYOFF 0xAE
+#define SSD1306_DISPLAYON 0xAF
+#define SSD1306_COLUMNADDR 0x21
+#define SSD1306_PAGEADDR 0x22
+
+// Frame buffer and I2C traffic of the Adafruit driver: display() sends the
+// whole buffer, ssd1306_command() one command byte
+class Adafruit_SSD1306 : public Adafruit_GFX {
+private:
+    TwoWire* wire;
+    uint8_t address;
+    uint8_t* buffer;
+
+public:
+    Adafruit_SSD1306(uint8_t width, uint8_t height, TwoWire* wire, int8_t resetPin, uint32_t clockDuring = 400000,
+                     uint32_t clockAfter = 100000);
+
+    bool begin(uint8_t vccState, uint8_t address, bool reset = true, bool periphBegin = true);
+    void clearDisplay();
+    void display();
+    void drawPixel(int16_t x, int16_t y, uint16_t color) override;
+    uint8_t* getBuffer() { return buffer; }
+    void ssd1306_command(uint8_t c);
+};
+
+#endif // HOST_ADAFRUIT_SSD1306_H
@@ -0,0 +1,113 @@
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+// Host stand-in for the parts of the ESP32 Arduino core the firmware uses.
+// Time is virtual and only moves when the simulation advances it, see sim.h.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+#include <time.h>
+#include <algorithm>
+#include "freertos/FreeRTOS.h"
+
+#define IRAM_ATTR
+// RTC slow memory is kept apart from the rest of RAM, which a deep sleep
+// clears (see Sim::wakeFromSleep)
+#define RTC_DATA_ATTR __attribute__((section(".rtc.data")))
+#define RTC_NOINIT_ATTR __attribute__((section(".rtc_noinit")))
+#define __NOINIT_ATTR
+
+#define INPUT 0x01
+#define OUTPUT 0x03
+#define INPUT_PULLUP 0x05
+#define OUTPUT_OPEN_DRAIN 0x13
+#define LOW 0x0
+#define HIGH 0x1
+#define RISING 0x01
+#define FALLING 0x02
+#define CHANGE 0x03
+
+#define SERIAL_8N1 0x800001c
+
+static const uint8_t SDA = 21;
+static const uint8_t SCL = 22;
+
+using std::max;
+using std::min;
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+unsigned long millis();
+unsigned long micros();
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+#define digitalPinToInterrupt(pin) (pin)
+void attachInterrupt(uint8_t pin, void (*handler)(), int mode);
+
+uint32_t esp_random();
+bool setCpuFrequencyMhz(uint32_t mhz);
+void configTime(long gmtOffset, int daylightOffset, const char* server1, const char* server2 = nullptr,
+                const char* server3 = nullptr);
+
+class IPAddress {
+private:
+    uint32_t address;
+
+public:
+    IPAddress(uint32_t address = 0) : address(address) {}
+    operator uint32_t() const { return address; }
+};
+
+class Print {
+public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t c) = 0;
+    virtual size_t write(const uint8_t* buffer, size_t size);
+    size_t write(const char* text) { return write((const uint8_t*)text, strlen(text)); }
+
+    size_t printf(const char* format, ...) __attribute__((format(printf, 2, 3)));
+    size_t print(const char* text);
+    size_t print(char c);
+    size_t print(int value, int base = 10);
+    size_t print(unsigned int value, int base = 10);
+    size_t print(long value, int base = 10);
+    size_t print(unsigned long value, int base = 10);
+    size_t print(long long value, int base = 10);
+    size_t print(unsigned long long value, int base = 10);
+    size_t print(double value, int digits = 2);
+    size_t print(const IPAddress& address);
+
+    size_t println();
+    template <typename T>
+    size_t println(T value) { return print(value) + println(); }
+    size_t println(double value, int digits) { return print(value, digits) + println(); }
+};
+
+class Stream : public Print {
+public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+};
+
+#include "HardwareSerial.h"
+
+class EspClass {
+public:
+    void restart();
+    uint32_t getFreeHeap();
+    uint32_t getMinFreeHeap();
+    uint32_t getMaxAllocHeap();
+    uint32_t getHeapSize();
+};
+
+extern EspClass ESP;
+
+#endif // HOST_ARDUINO_H
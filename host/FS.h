@@ -0,0 +1,45 @@
+#ifndef HOST_FS_H
+#define HOST_FS_H
+
+#include <memory>
+#include "Arduino.h"
+
+namespace fs {
+
+enum SeekMode { SeekSet = 0, SeekCur = 1, SeekEnd = 2 };
+
+struct FileImpl;
+
+// Handle to a file in the in-memory flash; like the core's File it holds a
+// reference-counted implementation allocated on open
+class File {
+private:
+    std::shared_ptr<FileImpl> impl;
+
+public:
+    File() {}
+    explicit File(std::shared_ptr<FileImpl> impl) : impl(impl) {}
+
+    size_t write(const uint8_t* buffer, size_t size);
+    size_t read(uint8_t* buffer, size_t size);
+    bool seek(uint32_t position, SeekMode mode = SeekSet);
+    size_t position() const;
+    size_t size() const;
+    void flush() {}
+    void close();
+    operator bool() const { return impl != nullptr; }
+};
+
+class FS {
+public:
+    File open(const char* path, const char* mode = "r", bool create = false);
+    bool exists(const char* path);
+    bool remove(const char* path);
+};
+
+}  // namespace fs
+
+using fs::File;
+using fs::FS;
+
+#endif // HOST_FS_H
@@ -0,0 +1,55 @@
+#ifndef HOST_HARDWARE_SERIAL_H
+#define HOST_HARDWARE_SERIAL_H
+
+#include "Arduino.h"
+
+#define HOST_UART_RX_SIZE 1024
+
+// UART model. Transmitted bytes leave the transmit buffer at the configured
+// baud rate in virtual time, so availableForWrite() behaves like the real
+// driver. Received bytes are injected by the simulation, which then runs the
+// onReceive() callback as the UART event task would.
+class HardwareSerial : public Stream {
+private:
+    int number;
+    unsigned long baud;
+    size_t txBufferSize;
+    size_t txQueued;
+    uint64_t txDrainedAt;  // Virtual microseconds
+    uint8_t rx[HOST_UART_RX_SIZE];
+    size_t rxHead, rxTail;
+    void (*receiveHandler)();
+    void (*writeHandler)(const uint8_t* data, size_t length);
+
+    void drainTx();
+
+public:
+    explicit HardwareSerial(int port);
+
+    void begin(unsigned long baud, uint32_t config = SERIAL_8N1, int8_t rxPin = -1, int8_t txPin = -1);
+    void end() {}
+    void setRxBufferSize(size_t size) {}
+    void setTxBufferSize(size_t size);
+    void onReceive(void (*handler)(), bool onlyOnTimeout = false);
+    operator bool() const { return true; }
+
+    int available() override;
+    int read() override;
+    size_t read(uint8_t* buffer, size_t size);
+    int availableForWrite();
+    size_t write(uint8_t c) override;
+    size_t write(const uint8_t* buffer, size_t size) override;
+    using Print::write;
+    void flush();
+
+    // Simulation side
+    static HardwareSerial* port(int number);
+    void inject(const uint8_t* data, size_t length);  // Bytes from the wire; runs the onReceive callback
+    void onWrite(void (*handler)(const uint8_t* data, size_t length));  // Bytes to the wire
+    uint64_t bytesWritten;
+    uint64_t bytesBlocked;  // Had to wait for room in the transmit buffer
+};
+
+extern HardwareSerial Serial;
+
+#endif // HOST_HARDWARE_SERIAL_H
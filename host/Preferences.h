@@ -0,0 +1,24 @@
+#ifndef HOST_PREFERENCES_H
+#define HOST_PREFERENCES_H
+
+#include "Arduino.h"
+
+// NVS namespace backed by a process-wide in-memory table
+class Preferences {
+private:
+    char name[16];
+
+public:
+    Preferences() : name() {}
+
+    bool begin(const char* name, bool readOnly = false);
+    void end() {}
+    bool isKey(const char* key);
+    bool remove(const char* key);
+    uint16_t getUShort(const char* key, uint16_t defaultValue = 0);
+    size_t putUShort(const char* key, uint16_t value);
+    uint32_t getUInt(const char* key, uint32_t defaultValue = 0);
+    size_t putUInt(const char* key, uint32_t value);
+};
+
+#endif // HOST_PREFERENCES_H
@@ -0,0 +1,41 @@
+#ifndef HOST_SPARKFUN_SCD4X_H
+#define HOST_SPARKFUN_SCD4X_H
+
+#include "Wire.h"
+
+#define SCD4x_ADDRESS 0x62
+
+// SCD41 that reports the simulated environment. A started measurement
+// becomes ready after the mode's interval, like the real sensor.
+class SCD4x {
+private:
+    unsigned long interval;  // 0 while idle
+    unsigned long readyAt;
+    bool singleShot;
+    uint16_t co2;
+    float temperature, humidity;
+
+    void transfer(size_t bytes);
+
+public:
+    SCD4x() : interval(0), readyAt(0), singleShot(false), co2(0), temperature(0), humidity(0) {}
+
+    bool begin(bool measBegin = true, bool autoCalibrate = true, bool skipStopPeriodicMeasurements = false,
+               bool pollAndSetDeviceType = true);
+    bool startPeriodicMeasurement();
+    bool startLowPowerPeriodicMeasurement();
+    bool stopPeriodicMeasurement(uint16_t delayMillis = 500);
+    bool measureSingleShot();
+    bool getDataReadyStatus();
+    bool readMeasurement();
+    bool setAmbientPressure(float pressure);
+    bool setSensorAltitude(uint16_t altitude, uint16_t delayMillis = 1);
+    bool performForcedRecalibration(uint16_t concentration, float* correction);
+    bool reInit(uint16_t delayMillis = 20);
+    bool powerDown(uint16_t delayMillis = 1);
+    uint16_t getCO2() { return co2; }
+    float getTemperature() { return temperature; }
+    float getHumidity() { return humidity; }
+};
+
+#endif // HOST_SPARKFUN_SCD4X_H
@@ -0,0 +1,63 @@
+#ifndef HOST_WIFI_H
+#define HOST_WIFI_H
+
+#include <memory>
+#include "Arduino.h"
+#include "Client.h"
+
+typedef enum {
+    WL_IDLE_STATUS = 0,
+    WL_NO_SSID_AVAIL = 1,
+    WL_CONNECTED = 3,
+    WL_CONNECT_FAILED = 4,
+    WL_CONNECTION_LOST = 5,
+    WL_DISCONNECTED = 6,
+} wl_status_t;
+
+typedef int arduino_event_id_t;
+typedef void* arduino_event_info_t;
+#define ARDUINO_EVENT_WIFI_STA_CONNECTED 4
+#define ARDUINO_EVENT_WIFI_STA_DISCONNECTED 5
+#define ARDUINO_EVENT_WIFI_STA_GOT_IP 7
+
+#define WIFI_OFF 0
+#define WIFI_STA 1
+
+typedef void (*WiFiEventCb)(arduino_event_id_t event, arduino_event_info_t info);
+
+// Station that associates a fixed time after begin() and reports it through
+// the registered event handler, as the WiFi event task would
+class WiFiClass {
+public:
+    bool mode(int mode) { return true; }
+    bool setAutoReconnect(bool enabled) { return true; }
+    bool setSleep(bool enabled) { return true; }
+    int onEvent(WiFiEventCb handler);
+    void begin(const char* ssid, const char* password);
+    bool disconnect(bool wifiOff = false, bool eraseAp = false);
+    wl_status_t status();
+    bool isConnected();
+    IPAddress localIP();
+};
+
+extern WiFiClass WiFi;
+
+// TCP client connected to the simulation's in-process MQTT broker
+class WiFiClient : public Client {
+private:
+    std::shared_ptr<int> socket;  // Stands in for the core's per-connection handle
+
+public:
+    int connect(const char* host, uint16_t port) override;
+    size_t write(uint8_t c) override;
+    size_t write(const uint8_t* buffer, size_t size) override;
+    int available() override;
+    int read() override;
+    int read(uint8_t* buffer, size_t size) override;
+    void stop() override;
+    uint8_t connected() override;
+    int fd() const { return -1; }  // No lwIP socket on the host; the session falls back to write()
+    int setNoDelay(bool enabled) { return 0; }
+};
+
+#endif // HOST_WIFI_H
@@ -0,0 +1,38 @@
+#ifndef HOST_WIRE_H
+#define HOST_WIRE_H
+
+#include "Arduino.h"
+
+// I2C master that acknowledges every transfer and counts the bytes put on
+// the bus per device address, including the address byte
+class TwoWire : public Stream {
+private:
+    uint8_t address;
+    size_t pending;
+    bool transmitting;
+
+public:
+    TwoWire() : address(0), pending(0), transmitting(false), clock(100000) {}
+
+    bool begin(int sda = -1, int scl = -1, uint32_t frequency = 0);
+    bool end() { return true; }
+    void setClock(uint32_t frequency) { clock = frequency; }
+    void setTimeOut(uint16_t timeoutMillis) {}
+    void beginTransmission(uint8_t address);
+    uint8_t endTransmission(bool sendStop = true);
+    uint8_t requestFrom(uint8_t address, uint8_t quantity);
+    size_t write(uint8_t c) override;
+    size_t write(const uint8_t* buffer, size_t size) override;
+    using Print::write;
+    int available() override { return 0; }
+    int read() override { return -1; }
+
+    // Simulation side
+    uint32_t clock;
+    uint64_t busBytes[128] = {};  // Per 7-bit address, including address bytes
+    uint64_t transactions[128] = {};
+};
+
+extern TwoWire Wire;
+
+#endif // HOST_WIRE_H
@@ -0,0 +1,50 @@
+#include "alloc_counter.h"
+#include <stddef.h>
+
+// glibc's own entry points, so the overrides below can forward to them
+extern "C" void* __libc_malloc(size_t size);
+extern "C" void* __libc_calloc(size_t count, size_t size);
+extern "C" void* __libc_realloc(void* pointer, size_t size);
+
+// Plain zero-initialized globals: malloc runs before any constructor
+static uint64_t allocations;
+static uint64_t allocatedBytes;
+static int paused;
+
+static inline void record(size_t size) {
+    if (paused == 0) {
+        allocations++;
+        allocatedBytes += size;
+    }
+}
+
+extern "C" void* malloc(size_t size) {
+    record(size);
+    return __libc_malloc(size);
+}
+
+extern "C" void* calloc(size_t count, size_t size) {
+    record(count * size);
+    return __libc_calloc(count, size);
+}
+
+extern "C" void* realloc(void* pointer, size_t size) {
+    record(size);
+    return __libc_realloc(pointer, size);
+}
+
+uint64_t AllocCounter::count() {
+    return allocations;
+}
+
+uint64_t AllocCounter::bytes() {
+    return allocatedBytes;
+}
+
+AllocCounter::Pause::Pause() {
+    paused++;
+}
+
+AllocCounter::Pause::~Pause() {
+    paused--;
+}
@@ -0,0 +1,22 @@
+#ifndef HOST_ALLOC_COUNTER_H
+#define HOST_ALLOC_COUNTER_H
+
+#include <stdint.h>
+
+// Counts every malloc(), calloc() and realloc() in the process, and with them
+// every operator new. The simulated devices pause counting around their own
+// bookkeeping, so the totals are what the firmware would ask of the heap.
+class AllocCounter {
+public:
+    static uint64_t count();
+    static uint64_t bytes();
+
+    // Excludes the enclosing scope from the counts
+    class Pause {
+    public:
+        Pause();
+        ~Pause();
+    };
+};
+
+#endif // HOST_ALLOC_COUNTER_H
@@ -0,0 +1,229 @@
+#include <stdarg.h>
+#include "Arduino.h"
+#include "esp_heap_caps.h"
+#include "esp_sleep.h"
+#include "esp_system.h"
+#include "driver/gpio.h"
+#include "sim.h"
+
+#define HOST_PIN_COUNT 40
+#define HOST_HEAP_FREE 180000     // What the ESP32 typically has left after WiFi is up
+#define HOST_HEAP_LARGEST 110000
+
+EspClass ESP;
+
+static uint8_t pinLevel[HOST_PIN_COUNT];
+static bool pinsInitialized = false;
+static void (*pinHandler[HOST_PIN_COUNT])();
+static esp_reset_reason_t resetReason = ESP_RST_POWERON;
+static uint32_t randomState = 0x2545F491;
+static uint64_t wakeupTimer = 0;  // Microseconds; 0 sleeps until reset
+
+// Time since the board last booted; the simulated world keeps Sim::micros()
+unsigned long millis() {
+    return (unsigned long)((Sim::micros() - Sim::bootedAt()) / 1000);
+}
+
+unsigned long micros() {
+    return (unsigned long)(Sim::micros() - Sim::bootedAt());
+}
+
+// Idle I2C lines and inputs read high, as with the board's pull-ups
+static void initPins() {
+    if (!pinsInitialized) {
+        memset(pinLevel, HIGH, sizeof(pinLevel));
+        pinsInitialized = true;
+    }
+}
+
+void pinMode(uint8_t pin, uint8_t mode) {
+    initPins();
+    if (pin < HOST_PIN_COUNT && mode == INPUT_PULLUP) {
+        pinLevel[pin] = HIGH;
+    }
+}
+
+void digitalWrite(uint8_t pin, uint8_t value) {
+    initPins();
+    if (pin < HOST_PIN_COUNT) {
+        pinLevel[pin] = value;
+    }
+}
+
+int digitalRead(uint8_t pin) {
+    initPins();
+    return pin < HOST_PIN_COUNT ? pinLevel[pin] : LOW;
+}
+
+void attachInterrupt(uint8_t pin, void (*handler)(), int mode) {
+    if (pin < HOST_PIN_COUNT) {
+        pinHandler[pin] = handler;
+    }
+}
+
+// Deterministic, so every run sees the same backoff jitter
+uint32_t esp_random() {
+    randomState ^= randomState << 13;
+    randomState ^= randomState >> 17;
+    randomState ^= randomState << 5;
+    return randomState;
+}
+
+bool setCpuFrequencyMhz(uint32_t mhz) {
+    return true;
+}
+
+size_t Print::write(const uint8_t* buffer, size_t size) {
+    size_t n = 0;
+    while (n < size && write(buffer[n])) {
+        n++;
+    }
+    return n;
+}
+
+size_t Print::printf(const char* format, ...) {
+    char text[256];
+    va_list args;
+    va_start(args, format);
+    int n = vsnprintf(text, sizeof(text), format, args);
+    va_end(args);
+    if (n < 0) {
+        return 0;
+    }
+    return write((const uint8_t*)text, std::min((size_t)n, sizeof(text) - 1));
+}
+
+size_t Print::print(const char* text) {
+    return write((const uint8_t*)text, strlen(text));
+}
+
+size_t Print::print(char c) {
+    return write((uint8_t)c);
+}
+
+size_t Print::print(int value, int base) {
+    return print((long long)value, base);
+}
+
+size_t Print::print(unsigned int value, int base) {
+    return print((unsigned long long)value, base);
+}
+
+size_t Print::print(long value, int base) {
+    return print((long long)value, base);
+}
+
+size_t Print::print(unsigned long value, int base) {
+    return print((unsigned long long)value, base);
+}
+
+size_t Print::print(long long value, int base) {
+    if (base == 10 && value < 0) {
+        return print('-') + print((unsigned long long)(-(value + 1)) + 1, base);
+    }
+    return print((unsigned long long)value, base);
+}
+
+size_t Print::print(unsigned long long value, int base) {
+    char text[65];
+    char* p = text + sizeof(text) - 1;
+    *p = '\0';
+    if (base < 2) {
+        base = 10;
+    }
+    do {
+        uint8_t digit = value % base;
+        *--p = digit < 10 ? '0' + digit : 'A' + digit - 10;
+        value /= base;
+    } while (value > 0);
+    return print(p);
+}
+
+size_t Print::print(double value, int digits) {
+    char text[48];
+    int n = snprintf(text, sizeof(text), "%.*f", digits, value);
+    return write((const uint8_t*)text, std::min((size_t)std::max(n, 0), sizeof(text) - 1));
+}
+
+size_t Print::print(const IPAddress& address) {
+    uint32_t value = address;
+    char text[16];
+    snprintf(text, sizeof(text), "%u.%u.%u.%u", (unsigned)(value & 0xFF), (unsigned)((value >> 8) & 0xFF),
+             (unsigned)((value >> 16) & 0xFF), (unsigned)(value >> 24));
+    return print(text);
+}
+
+size_t Print::println() {
+    return print("\r\n");
+}
+
+void EspClass::restart() {
+    Sim::stop(false);
+}
+
+uint32_t EspClass::getFreeHeap() {
+    return HOST_HEAP_FREE;
+}
+
+uint32_t EspClass::getMinFreeHeap() {
+    return HOST_HEAP_FREE;
+}
+
+uint32_t EspClass::getMaxAllocHeap() {
+    return HOST_HEAP_LARGEST;
+}
+
+uint32_t EspClass::getHeapSize() {
+    return 320 * 1024;
+}
+
+size_t heap_caps_get_free_size(uint32_t caps) {
+    return HOST_HEAP_FREE;
+}
+
+size_t heap_caps_get_largest_free_block(uint32_t caps) {
+    return HOST_HEAP_LARGEST;
+}
+
+size_t heap_caps_get_minimum_free_size(uint32_t caps) {
+    return HOST_HEAP_FREE;
+}
+
+esp_reset_reason_t esp_reset_reason() {
+    return resetReason;
+}
+
+esp_sleep_wakeup_cause_t esp_sleep_get_wakeup_cause() {
+    return resetReason == ESP_RST_DEEPSLEEP ? ESP_SLEEP_WAKEUP_TIMER : ESP_SLEEP_WAKEUP_UNDEFINED;
+}
+
+int esp_sleep_enable_timer_wakeup(uint64_t micros) {
+    wakeupTimer = micros;
+    return 0;
+}
+
+void esp_deep_sleep_start() {
+    Sim::deepSleep(wakeupTimer);
+    abort();  // Only reached from the simulation's own context
+}
+
+int gpio_hold_en(gpio_num_t pin) {
+    return 0;
+}
+
+int gpio_hold_dis(gpio_num_t pin) {
+    return 0;
+}
+
+void gpio_deep_sleep_hold_en() {
+}
+
+void Sim::pressButton() {
+    if (pinHandler[0] != nullptr) {
+        pinHandler[0]();
+    }
+}
+
+void Sim::setResetReason(esp_reset_reason_t reason) {
+    resetReason = reason;
+}
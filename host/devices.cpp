@@ -0,0 +1,631 @@
+#include <string>
+#include "Arduino.h"
+#include "Wire.h"
+#include "Adafruit_SSD1306.h"
+#include "Adafruit_SGP30.h"
+#include "SparkFun_SCD4x_Arduino_Library.h"
+#include "sim.h"
+#include "alloc_counter.h"
+
+#define HOST_UART_COUNT 3
+#define HOST_UART_FIFO 128         // Hardware FIFO in front of the driver's transmit buffer
+#define HOST_I2C_CHUNK 32          // Adafruit driver's largest transfer, including the control byte
+#define SGP30_ADDRESS 0x58
+
+#define PMS_FRAME_INTERVAL 1000    // Active mode, stable air
+#define PMS_REPLY_DELAY 10         // Command to reply or requested frame
+#define PMS_WAKE_TIME 2500         // Fan spin-up before the first frame
+
+TwoWire Wire;
+HardwareSerial Serial(0);
+
+static HardwareSerial* uarts[HOST_UART_COUNT];
+static bool captureEnabled = false;
+static std::string captured;
+static AirTrace airTrace = Sim::typicalAir;
+
+// Air
+
+// Same value for the same second, in [-1, 1]
+static double noise(uint64_t millis, uint32_t salt) {
+    uint32_t x = (uint32_t)(millis / 1000) * 2654435761u ^ salt * 0x9E3779B9u;
+    x ^= x >> 15;
+    x *= 0x2C1B3C6Du;
+    x ^= x >> 12;
+    return (x % 2001) / 1000.0 - 1.0;
+}
+
+// Rises while the room is occupied and decays after
+static double occupancy(double hours, double start, double end, double amplitude) {
+    if (hours < start) {
+        return 0;
+    }
+    double built = amplitude * (1 - exp(-(std::min(hours, end) - start) / 0.75));
+    return hours < end ? built : built * exp(-(hours - end) / 1.0);
+}
+
+// A day in a living room: temperature and humidity follow the sun,
+// CO2 rises in the morning and evening while people are home, and cooking at
+// 19:00 puts particles and VOCs in the air. Every value carries sensor noise.
+Air Sim::typicalAir(uint64_t millis) {
+    double hours = fmod(millis / 3600000.0, 24.0);
+    double sun = sin(2 * M_PI * (hours - 9) / 24);
+    double co2 = 450 + occupancy(hours, 7.0, 8.5, 300) + occupancy(hours, 17.0, 23.5, 650);
+    double cooking = hours >= 19.0 && hours < 20.5 ? sin(M_PI * (hours - 19.0) / 1.5) : 0;
+    double pm25 = 6 + 55 * cooking + noise(millis, 4) * 1.2;
+
+    Air air;
+    air.temperature = 21.0 + 1.5 * sun + noise(millis, 1) * 0.04;
+    air.humidity = 45.0 - 5.0 * sun + noise(millis, 2) * 0.3;
+    air.co2 = (uint16_t)lround(co2 + noise(millis, 3) * 6);
+    air.pm2_5 = (uint16_t)lround(std::max(pm25, 0.0));
+    air.pm1_0 = (uint16_t)lround(air.pm2_5 * 0.7);
+    air.pm10 = (uint16_t)lround(air.pm2_5 * 1.3 + std::max(noise(millis, 5), 0.0));
+    air.tvoc = (uint16_t)lround(60 + 0.4 * (co2 - 450) + 250 * cooking + noise(millis, 6) * 8);
+    air.h2 = (uint16_t)lround(13600 - 0.5 * air.tvoc + noise(millis, 7) * 10);
+    air.ethanol = (uint16_t)lround(19000 - 2.0 * air.tvoc + noise(millis, 8) * 15);
+    return air;
+}
+
+void Sim::setAir(AirTrace trace) {
+    airTrace = trace;
+}
+
+Air Sim::air() {
+    return airTrace(Sim::micros() / 1000);
+}
+
+// UARTs
+
+HardwareSerial::HardwareSerial(int port)
+    : number(port), baud(115200), txBufferSize(0), txQueued(0), txDrainedAt(0), rxHead(0), rxTail(0),
+      receiveHandler(nullptr), writeHandler(nullptr), bytesWritten(0), bytesBlocked(0) {
+    if (port >= 0 && port < HOST_UART_COUNT) {
+        uarts[port] = this;
+    }
+}
+
+HardwareSerial* HardwareSerial::port(int number) {
+    return number >= 0 && number < HOST_UART_COUNT ? uarts[number] : nullptr;
+}
+
+static void attachPMS7003(HardwareSerial& uart);
+
+void HardwareSerial::begin(unsigned long rate, uint32_t config, int8_t rxPin, int8_t txPin) {
+    baud = rate;
+    txDrainedAt = Sim::micros();
+    if (number == 2) {
+        attachPMS7003(*this);
+    }
+}
+
+void HardwareSerial::setTxBufferSize(size_t size) {
+    txBufferSize = size;
+}
+
+void HardwareSerial::onReceive(void (*handler)(), bool onlyOnTimeout) {
+    receiveHandler = handler;
+}
+
+void HardwareSerial::onWrite(void (*handler)(const uint8_t* data, size_t length)) {
+    writeHandler = handler;
+}
+
+// Ten bits per byte leave the FIFO at the baud rate
+void HardwareSerial::drainTx() {
+    uint64_t now = Sim::micros();
+    uint64_t sent = (now - txDrainedAt) * baud / 10 / 1000000;
+    if (sent >= txQueued) {
+        txQueued = 0;
+        txDrainedAt = now;
+    } else {
+        txQueued -= sent;
+        txDrainedAt += sent * 10 * 1000000 / baud;
+    }
+}
+
+int HardwareSerial::availableForWrite() {
+    drainTx();
+    return (int)(HOST_UART_FIFO + txBufferSize - txQueued);
+}
+
+size_t HardwareSerial::write(uint8_t c) {
+    return write(&c, 1);
+}
+
+// Like the driver, waits for room when the buffer is full
+size_t HardwareSerial::write(const uint8_t* buffer, size_t size) {
+    size_t capacity = HOST_UART_FIFO + txBufferSize;
+    size_t written = 0;
+    while (written < size) {
+        drainTx();
+        size_t room = capacity - txQueued;
+        if (room == 0) {
+            bytesBlocked += size - written;
+            delay(1);
+            continue;
+        }
+        size_t n = std::min(room, size - written);
+        txQueued += n;
+        written += n;
+    }
+    bytesWritten += size;
+    if (writeHandler != nullptr) {
+        writeHandler(buffer, size);
+    }
+    if (captureEnabled && this == &Serial) {
+        AllocCounter::Pause pause;
+        captured.append((const char*)buffer, size);
+    }
+    return size;
+}
+
+void HardwareSerial::flush() {
+    while (txQueued > 0) {
+        delay(1);
+        drainTx();
+    }
+}
+
+int HardwareSerial::available() {
+    return (int)((rxTail - rxHead + HOST_UART_RX_SIZE) % HOST_UART_RX_SIZE);
+}
+
+int HardwareSerial::read() {
+    if (rxHead == rxTail) {
+        return -1;
+    }
+    uint8_t c = rx[rxHead];
+    rxHead = (rxHead + 1) % HOST_UART_RX_SIZE;
+    return c;
+}
+
+size_t HardwareSerial::read(uint8_t* buffer, size_t size) {
+    size_t n = 0;
+    int c;
+    while (n < size && (c = read()) >= 0) {
+        buffer[n++] = (uint8_t)c;
+    }
+    return n;
+}
+
+// Bytes beyond the driver's buffer are lost, as on the device
+void HardwareSerial::inject(const uint8_t* data, size_t length) {
+    for (size_t i = 0; i < length; i++) {
+        size_t next = (rxTail + 1) % HOST_UART_RX_SIZE;
+        if (next == rxHead) {
+            break;
+        }
+        rx[rxTail] = data[i];
+        rxTail = next;
+    }
+    if (receiveHandler != nullptr) {
+        receiveHandler();
+    }
+}
+
+void Sim::serialInput(const char* text) {
+    Serial.inject((const uint8_t*)text, strlen(text));
+}
+
+void Sim::captureSerial(bool enabled) {
+    captureEnabled = enabled;
+}
+
+const std::string& Sim::serialOutput() {
+    return captured;
+}
+
+// PMS7003: 32-byte data frames every second in active mode, or one per
+// read command in passive mode; mode and sleep commands are answered with
+// an 8-byte reply frame
+
+static struct {
+    HardwareSerial* uart;
+    bool awake, passive;
+    bool streaming;  // A frame event is pending
+    uint8_t command[7];
+    uint8_t commandLength;
+} pms;
+
+static void sendPMSFrame(uint16_t length, const uint16_t* words, uint8_t count) {
+    uint8_t frame[32] = {0x42, 0x4D, (uint8_t)(length >> 8), (uint8_t)length};
+    size_t n = 4;
+    for (uint8_t i = 0; i < count; i++) {
+        frame[n++] = words[i] >> 8;
+        frame[n++] = words[i];
+    }
+    uint16_t checksum = 0;
+    for (size_t i = 0; i < n; i++) {
+        checksum += frame[i];
+    }
+    frame[n++] = checksum >> 8;
+    frame[n++] = checksum;
+    pms.uart->inject(frame, n);
+}
+
+static void sendPMSData() {
+    Air air = Sim::air();
+    uint16_t words[13] = {air.pm1_0, air.pm2_5, air.pm10, air.pm1_0, air.pm2_5, air.pm10,
+                          (uint16_t)(air.pm2_5 * 170), (uint16_t)(air.pm2_5 * 50), (uint16_t)(air.pm2_5 * 9),
+                          (uint16_t)(air.pm10 * 2), (uint16_t)(air.pm10 / 2), (uint16_t)(air.pm10 / 4), 0};
+    sendPMSFrame(28, words, 13);
+}
+
+static void streamPMSData(void*) {
+    if (!pms.awake || pms.passive) {
+        pms.streaming = false;
+        return;
+    }
+    sendPMSData();
+    Sim::schedule(Sim::micros() + PMS_FRAME_INTERVAL * 1000ULL, streamPMSData, nullptr);
+}
+
+static void startPMSStream(unsigned long delayMillis) {
+    if (!pms.streaming && pms.awake && !pms.passive) {
+        pms.streaming = true;
+        Sim::schedule(Sim::micros() + delayMillis * 1000ULL, streamPMSData, nullptr);
+    }
+}
+
+static void requestedPMSData(void*) {
+    if (pms.awake) {
+        sendPMSData();
+    }
+}
+
+static void replyPMS(void* arg) {
+    uint16_t word = (uint16_t)(uintptr_t)arg;
+    sendPMSFrame(4, &word, 1);
+}
+
+static void handlePMSCommand(const uint8_t* c) {
+    uint16_t value = (c[3] << 8) | c[4];
+    uint64_t replyAt = Sim::micros() + PMS_REPLY_DELAY * 1000ULL;
+    switch (c[2]) {
+        case 0xE1:  // Mode: 0 passive, 1 active
+            pms.passive = value == 0;
+            Sim::schedule(replyAt, replyPMS, (void*)(uintptr_t)((0xE1 << 8) | value));
+            startPMSStream(PMS_FRAME_INTERVAL);
+            break;
+        case 0xE2:  // Read in passive mode
+            if (pms.passive) {
+                Sim::schedule(replyAt, requestedPMSData, nullptr);
+            }
+            break;
+        case 0xE4:  // Sleep 0, wake 1; only sleep is answered
+            if (value == 0) {
+                pms.awake = false;
+                Sim::schedule(replyAt, replyPMS, (void*)(uintptr_t)(0xE4 << 8));
+            } else if (!pms.awake) {
+                pms.awake = true;
+                startPMSStream(PMS_WAKE_TIME);
+            }
+            break;
+    }
+}
+
+static void pmsReceive(const uint8_t* data, size_t length) {
+    for (size_t i = 0; i < length; i++) {
+        if (pms.commandLength == 0 && data[i] != 0x42) {
+            continue;
+        }
+        pms.command[pms.commandLength++] = data[i];
+        if (pms.commandLength == sizeof(pms.command)) {
+            pms.commandLength = 0;
+            handlePMSCommand(pms.command);
+        }
+    }
+}
+
+static void attachPMS7003(HardwareSerial& uart) {
+    pms.uart = &uart;
+    pms.awake = true;
+    pms.passive = false;
+    uart.onWrite(pmsReceive);
+    startPMSStream(PMS_FRAME_INTERVAL);
+}
+
+// I2C
+
+static bool i2cSilent[128];  // Devices that NACK every transfer
+
+void Sim::setI2CResponding(uint8_t address, bool responding) {
+    i2cSilent[address & 0x7F] = !responding;
+}
+
+static bool answering(uint8_t address) {
+    return !i2cSilent[address & 0x7F];
+}
+
+static void countTransfer(uint8_t address, size_t bytes) {
+    Wire.busBytes[address & 0x7F] += bytes + 1;
+    Wire.transactions[address & 0x7F]++;
+}
+
+bool TwoWire::begin(int sda, int scl, uint32_t frequency) {
+    if (frequency != 0) {
+        clock = frequency;
+    }
+    return true;
+}
+
+void TwoWire::beginTransmission(uint8_t to) {
+    address = to;
+    pending = 0;
+    transmitting = true;
+}
+
+uint8_t TwoWire::endTransmission(bool sendStop) {
+    if (transmitting) {
+        countTransfer(address, pending);
+        transmitting = false;
+    }
+    return answering(address) ? 0 : 2;  // 2: address NACK
+}
+
+uint8_t TwoWire::requestFrom(uint8_t from, uint8_t quantity) {
+    countTransfer(from, quantity);
+    return answering(from) ? quantity : 0;
+}
+
+size_t TwoWire::write(uint8_t c) {
+    pending++;
+    return 1;
+}
+
+size_t TwoWire::write(const uint8_t* buffer, size_t size) {
+    pending += size;
+    return size;
+}
+
+// Display
+
+// Five columns of a glyph; blanks stay dark
+static uint8_t glyphColumn(uint8_t c, uint8_t column) {
+    if (c == ' ') {
+        return 0;
+    }
+    uint32_t x = (c * 2654435761u) >> (column * 5);
+    return (x & 0x7F) | 0x01;
+}
+
+void Adafruit_GFX::fillRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color) {
+    for (int16_t i = x; i < x + w; i++) {
+        for (int16_t j = y; j < y + h; j++) {
+            drawPixel(i, j, color);
+        }
+    }
+}
+
+// Transparent background, as with setTextColor(color)
+size_t Adafruit_GFX::write(uint8_t c) {
+    if (c == '\n') {
+        cursorX = 0;
+        cursorY += 8;
+        return 1;
+    }
+    if (c == '\r') {
+        return 1;
+    }
+    if (wrap && cursorX + 6 > width) {
+        cursorX = 0;
+        cursorY += 8;
+    }
+    for (uint8_t column = 0; column < 5; column++) {
+        uint8_t bits = glyphColumn(c, column);
+        for (uint8_t row = 0; row < 8; row++) {
+            if (bits & (1 << row)) {
+                drawPixel(cursorX + column, cursorY + row, textColor);
+            }
+        }
+    }
+    cursorX += 6;
+    return 1;
+}
+
+Adafruit_SSD1306::Adafruit_SSD1306(uint8_t width, uint8_t height, TwoWire* wire, int8_t resetPin,
+                                   uint32_t clockDuring, uint32_t clockAfter)
+    : Adafruit_GFX(width, height), wire(wire), address(0), buffer(nullptr) {
+}
+
+// Allocates the frame buffer on the first call, like the library
+bool Adafruit_SSD1306::begin(uint8_t vccState, uint8_t i2cAddress, bool reset, bool periphBegin) {
+    address = i2cAddress;
+    if (buffer == nullptr && (buffer = (uint8_t*)malloc(width * (height / 8))) == nullptr) {
+        return false;
+    }
+    clearDisplay();
+    countTransfer(address, 26);  // Initialization sequence
+    return true;
+}
+
+void Adafruit_SSD1306::clearDisplay() {
+    memset(buffer, 0, width * (height / 8));
+}
+
+void Adafruit_SSD1306::drawPixel(int16_t x, int16_t y, uint16_t color) {
+    if (x < 0 || y < 0 || x >= width || y >= height) {
+        return;
+    }
+    uint8_t& cell = buffer[x + (y / 8) * width];
+    if (color == SSD1306_WHITE) {
+        cell |= 1 << (y & 7);
+    } else {
+        cell &= ~(1 << (y & 7));
+    }
+}
+
+void Adafruit_SSD1306::display() {
+    countTransfer(address, 7);  // Page and column range
+    size_t total = width * (height / 8);
+    for (size_t sent = 0; sent < total; sent += HOST_I2C_CHUNK - 1) {
+        countTransfer(address, 1 + std::min(total - sent, (size_t)HOST_I2C_CHUNK - 1));
+    }
+}
+
+void Adafruit_SSD1306::ssd1306_command(uint8_t c) {
+    countTransfer(address, 2);
+}
+
+// SCD41
+
+void SCD4x::transfer(size_t bytes) {
+    countTransfer(SCD4x_ADDRESS, bytes);
+}
+
+bool SCD4x::begin(bool measBegin, bool autoCalibrate, bool skipStopPeriodicMeasurements, bool pollAndSetDeviceType) {
+    transfer(2);
+    if (measBegin) {
+        return startPeriodicMeasurement();
+    }
+    return true;
+}
+
+bool SCD4x::startPeriodicMeasurement() {
+    transfer(2);
+    interval = 5000;
+    readyAt = millis() + interval;
+    singleShot = false;
+    return true;
+}
+
+bool SCD4x::startLowPowerPeriodicMeasurement() {
+    transfer(2);
+    interval = 30000;
+    readyAt = millis() + interval;
+    singleShot = false;
+    return true;
+}
+
+bool SCD4x::stopPeriodicMeasurement(uint16_t delayMillis) {
+    transfer(2);
+    interval = 0;
+    if (delayMillis > 0) {
+        delay(delayMillis);
+    }
+    return true;
+}
+
+bool SCD4x::measureSingleShot() {
+    transfer(2);
+    interval = 5000;
+    readyAt = millis() + interval;
+    singleShot = true;
+    return true;
+}
+
+bool SCD4x::getDataReadyStatus() {
+    transfer(2 + 3);
+    return interval != 0 && (long)(millis() - readyAt) >= 0;
+}
+
+bool SCD4x::readMeasurement() {
+    transfer(2 + 9);
+    if (!getDataReadyStatus()) {
+        return false;
+    }
+    Air air = Sim::air();
+    co2 = air.co2;
+    temperature = air.temperature;
+    humidity = air.humidity;
+    if (singleShot) {
+        interval = 0;
+    } else {
+        while ((long)(millis() - readyAt) >= 0) {
+            readyAt += interval;
+        }
+    }
+    return true;
+}
+
+bool SCD4x::setAmbientPressure(float pressure) {
+    transfer(2 + 3);
+    return true;
+}
+
+bool SCD4x::setSensorAltitude(uint16_t altitude, uint16_t delayMillis) {
+    transfer(2 + 3);
+    return true;
+}
+
+bool SCD4x::performForcedRecalibration(uint16_t concentration, float* correction) {
+    transfer(2 + 3 + 3);
+    delay(400);
+    *correction = 0;
+    return true;
+}
+
+bool SCD4x::reInit(uint16_t delayMillis) {
+    transfer(2);
+    delay(delayMillis);
+    return true;
+}
+
+bool SCD4x::powerDown(uint16_t delayMillis) {
+    transfer(2);
+    interval = 0;
+    return true;
+}
+
+// SGP30; every command fails while Sim::setI2CResponding() has it silent
+
+bool Adafruit_SGP30::begin(TwoWire* wire, bool initSensor) {
+    countTransfer(SGP30_ADDRESS, 2 + 9);
+    if (!answering(SGP30_ADDRESS)) {
+        return false;
+    }
+    return !initSensor || IAQinit();
+}
+
+bool Adafruit_SGP30::IAQinit() {
+    countTransfer(SGP30_ADDRESS, 2);
+    return answering(SGP30_ADDRESS);
+}
+
+bool Adafruit_SGP30::IAQmeasure() {
+    countTransfer(SGP30_ADDRESS, 2 + 6);
+    if (!answering(SGP30_ADDRESS)) {
+        return false;
+    }
+    Air air = Sim::air();
+    TVOC = air.tvoc;
+    eCO2 = air.co2;
+    return true;
+}
+
+bool Adafruit_SGP30::IAQmeasureRaw() {
+    countTransfer(SGP30_ADDRESS, 2 + 6);
+    if (!answering(SGP30_ADDRESS)) {
+        return false;
+    }
+    Air air = Sim::air();
+    rawH2 = air.h2;
+    rawEthanol = air.ethanol;
+    return true;
+}
+
+bool Adafruit_SGP30::getIAQBaseline(uint16_t* eco2Base, uint16_t* tvocBase) {
+    countTransfer(SGP30_ADDRESS, 2 + 6);
+    if (!answering(SGP30_ADDRESS)) {
+        return false;
+    }
+    *eco2Base = eco2Baseline ? eco2Baseline : 0x8F4A;
+    *tvocBase = tvocBaseline ? tvocBaseline : 0x9102;
+    return true;
+}
+
+bool Adafruit_SGP30::setIAQBaseline(uint16_t eco2Base, uint16_t tvocBase) {
+    countTransfer(SGP30_ADDRESS, 2 + 6);
+    if (!answering(SGP30_ADDRESS)) {
+        return false;
+    }
+    eco2Baseline = eco2Base;
+    tvocBaseline = tvocBase;
+    return true;
+}
+
+bool Adafruit_SGP30::setHumidity(uint32_t absoluteHumidity) {
+    countTransfer(SGP30_ADDRESS, 2 + 3);
+    return answering(SGP30_ADDRESS);
+}
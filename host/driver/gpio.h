@@ -0,0 +1,10 @@
+#ifndef HOST_DRIVER_GPIO_H
+#define HOST_DRIVER_GPIO_H
+
+typedef int gpio_num_t;
+
+int gpio_hold_en(gpio_num_t pin);
+int gpio_hold_dis(gpio_num_t pin);
+void gpio_deep_sleep_hold_en();
+
+#endif // HOST_DRIVER_GPIO_H
@@ -0,0 +1,15 @@
+#ifndef HOST_ESP_SLEEP_H
+#define HOST_ESP_SLEEP_H
+
+#include <stdint.h>
+
+typedef enum {
+    ESP_SLEEP_WAKEUP_UNDEFINED = 0,
+    ESP_SLEEP_WAKEUP_TIMER = 4,
+} esp_sleep_wakeup_cause_t;
+
+esp_sleep_wakeup_cause_t esp_sleep_get_wakeup_cause();
+int esp_sleep_enable_timer_wakeup(uint64_t micros);
+[[noreturn]] void esp_deep_sleep_start();
+
+#endif // HOST_ESP_SLEEP_H
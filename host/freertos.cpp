@@ -0,0 +1,477 @@
+#include <ucontext.h>
+#include <chrono>
+#include "Arduino.h"
+#include "WiFi.h"
+#include "sim.h"
+#include "alloc_counter.h"
+
+#define SIM_MAX_TASKS 8
+#define SIM_STACK_SIZE (256 * 1024)  // Host frames are far larger than on the ESP32
+#define SIM_STACK_PAINT 0xA5
+#define SIM_MAX_MUTEXES 8
+#define SIM_MAX_EVENTS 64
+#define SIM_NEVER UINT64_MAX
+
+struct SimTask {
+    ucontext_t context;
+    uint8_t* stack;
+    void (*entry)(void*);
+    void* param;
+    uint32_t stackBytes;  // What the firmware asked for
+    UBaseType_t priority;
+    uint32_t notifications;
+    bool waitingForNotify;
+    bool deleted;
+    uint64_t wakeAt;
+
+    // Iteration in progress
+    uint64_t iterationNanos;
+    uint64_t iterationAllocations;
+    uint64_t iterationBytes;
+    TaskStats stats;
+};
+
+struct SimMutex {
+    bool taken;
+};
+
+struct SimEvent {
+    uint64_t at;
+    void (*run)(void*);
+    void* arg;
+};
+
+static uint64_t now = 0;  // Virtual microseconds
+static SimTask tasks[SIM_MAX_TASKS];
+static size_t taskTotal = 0;
+static SimTask* current = nullptr;  // nullptr in the simulation's own context
+static ucontext_t simContext;
+static SimMutex mutexes[SIM_MAX_MUTEXES];
+static size_t mutexCount = 0;
+static SimEvent events[SIM_MAX_EVENTS];
+static size_t eventCount = 0;
+static bool halted = false;
+static uint32_t restartCount = 0;
+static uint32_t sleepCount = 0;
+static uint64_t bootAt = 0;
+
+// Deep sleep
+static void (*bootFirmware)() = nullptr;  // Set by Sim::wakeFromSleep()
+static bool asleep = false;
+static bool poweredDown = false;
+static uint64_t wakeAt = SIM_NEVER;
+
+// The firmware's .data and .bss, between the markers in host/ram_begin.cpp
+// and host/ram_end.cpp. Only executables that link them can wake from sleep.
+extern "C" char simFirmwareDataBegin __attribute__((weak));
+extern "C" char simFirmwareDataEnd __attribute__((weak));
+extern "C" char simFirmwareBssBegin __attribute__((weak));
+extern "C" char simFirmwareBssEnd __attribute__((weak));
+static std::vector<uint8_t> dataAtReset, bssAtReset;
+
+// Host cost of the running slice
+static std::chrono::steady_clock::time_point sliceStart;
+static uint64_t sliceAllocations, sliceBytes;
+
+static void beginSlice() {
+    sliceStart = std::chrono::steady_clock::now();
+    sliceAllocations = AllocCounter::count();
+    sliceBytes = AllocCounter::bytes();
+}
+
+static void endSlice(SimTask* task) {
+    task->iterationNanos += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                std::chrono::steady_clock::now() - sliceStart).count();
+    task->iterationAllocations += AllocCounter::count() - sliceAllocations;
+    task->iterationBytes += AllocCounter::bytes() - sliceBytes;
+}
+
+// Called where the worker loop goes back to sleep
+static void endIteration(SimTask* task) {
+    endSlice(task);
+    {
+        AllocCounter::Pause pause;
+        TaskStats& stats = task->stats;
+        stats.iterationNanos.push_back((uint32_t)std::min<uint64_t>(task->iterationNanos, UINT32_MAX));
+        stats.allocations += task->iterationAllocations;
+        stats.allocatedBytes += task->iterationBytes;
+        if (task->iterationAllocations > 0) {
+            stats.allocatingIterations++;
+        }
+    }
+    task->iterationNanos = task->iterationAllocations = task->iterationBytes = 0;
+    beginSlice();
+}
+
+// Hands control back to the simulation until the task is picked again
+static void block(SimTask* task) {
+    endSlice(task);
+    swapcontext(&task->context, &simContext);
+    // Resumed; switchTo() has started a new slice
+}
+
+static void sleepFor(SimTask* task, uint64_t micros) {
+    task->waitingForNotify = false;
+    task->wakeAt = now + micros;
+    block(task);
+}
+
+static void taskEntry() {
+    SimTask* task = current;
+    task->entry(task->param);
+    task->deleted = true;
+    block(task);
+}
+
+static void switchTo(SimTask* task) {
+    current = task;
+    beginSlice();
+    swapcontext(&simContext, &task->context);
+    current = nullptr;
+}
+
+// The ready task with the earliest wake-up; ties go to the higher priority
+static SimTask* nextTask(uint64_t& at) {
+    SimTask* best = nullptr;
+    at = SIM_NEVER;
+    for (size_t i = 0; i < taskTotal; i++) {
+        SimTask* task = &tasks[i];
+        if (task->deleted) {
+            continue;
+        }
+        uint64_t ready = task->waitingForNotify && task->notifications > 0 ? now : task->wakeAt;
+        ready = std::max(ready, now);
+        if (ready < at || (ready == at && best != nullptr && task->priority > best->priority)) {
+            best = task;
+            at = ready;
+        }
+    }
+    return best;
+}
+
+static uint64_t nextEventAt() {
+    uint64_t at = SIM_NEVER;
+    for (size_t i = 0; i < eventCount; i++) {
+        at = std::min(at, events[i].at);
+    }
+    return at;
+}
+
+// Runs the earliest event due by limit; false if there is none
+static bool runNextEvent(uint64_t limit) {
+    size_t first = eventCount;
+    for (size_t i = 0; i < eventCount; i++) {
+        if (events[i].at <= limit && (first == eventCount || events[i].at < events[first].at)) {
+            first = i;
+        }
+    }
+    if (first == eventCount) {
+        return false;
+    }
+    SimEvent event = events[first];
+    events[first] = events[--eventCount];
+    now = std::max(now, event.at);
+    event.run(event.arg);
+    return true;
+}
+
+uint64_t Sim::micros() {
+    return now;
+}
+
+// The board loses power to everything but the RTC: the workers and every
+// firmware variable outside RTC memory go back to their state at reset, and
+// the peripherals drop what the firmware set up on them
+static void powerDown() {
+    WiFi.disconnect(true);
+    Serial.onReceive(nullptr);
+    {
+        AllocCounter::Pause pause;
+        for (size_t i = 0; i < taskTotal; i++) {
+            free(tasks[i].stack);
+            tasks[i] = SimTask();
+        }
+    }
+    taskTotal = 0;
+    mutexCount = 0;
+    memcpy(&simFirmwareDataBegin, dataAtReset.data(), dataAtReset.size());
+    memcpy(&simFirmwareBssBegin, bssAtReset.data(), bssAtReset.size());
+    poweredDown = true;
+}
+
+// The wake-up timer fires: the board boots again with RTC memory intact
+static void wake() {
+    now = wakeAt;
+    bootAt = now;
+    halted = asleep = poweredDown = false;
+    wakeAt = SIM_NEVER;
+    Sim::setResetReason(ESP_RST_DEEPSLEEP);
+    bootFirmware();
+}
+
+void Sim::runFor(unsigned long millis) {
+    uint64_t end = now + millis * 1000ULL;
+    while (true) {
+        if (halted) {
+            if (!asleep || bootFirmware == nullptr) {
+                return;
+            }
+            if (!poweredDown) {
+                powerDown();
+            }
+            // Device events go on while the board sleeps
+            while (runNextEvent(std::min(wakeAt, end))) {
+            }
+            if (wakeAt > end) {
+                now = end;
+                return;
+            }
+            wake();
+            continue;
+        }
+
+        uint64_t taskAt;
+        SimTask* task = nextTask(taskAt);
+        uint64_t eventAt = nextEventAt();
+        if (std::min(taskAt, eventAt) > end) {
+            now = end;
+            return;
+        }
+        if (eventAt <= taskAt) {
+            runNextEvent(eventAt);
+        } else {
+            now = std::max(now, taskAt);
+            switchTo(task);
+        }
+    }
+}
+
+void Sim::advance(unsigned long millis) {
+    uint64_t end = now + millis * 1000ULL;
+    while (runNextEvent(end)) {
+    }
+    now = end;
+}
+
+bool Sim::schedule(uint64_t atMicros, void (*event)(void*), void* arg) {
+    if (eventCount == SIM_MAX_EVENTS) {
+        return false;
+    }
+    events[eventCount++] = {atMicros, event, arg};
+    return true;
+}
+
+// A restart or deep sleep ends the simulated boot; the calling task never
+// runs again
+void Sim::stop(bool sleep) {
+    halted = true;
+    if (sleep) {
+        sleepCount++;
+    } else {
+        restartCount++;
+    }
+    if (current != nullptr) {
+        current->deleted = true;
+        block(current);
+    }
+}
+
+// Snapshots the firmware's RAM as reset left it, before setup() changes it
+void Sim::wakeFromSleep(void (*boot)()) {
+    if (&simFirmwareDataBegin == nullptr || &simFirmwareBssBegin == nullptr ||
+        &simFirmwareDataEnd < &simFirmwareDataBegin || &simFirmwareBssEnd < &simFirmwareBssBegin) {
+        fprintf(stderr, "Sim::wakeFromSleep: firmware not linked between the RAM markers\n");
+        abort();
+    }
+    AllocCounter::Pause pause;
+    dataAtReset.assign(&simFirmwareDataBegin, &simFirmwareDataEnd);
+    bssAtReset.assign(&simFirmwareBssBegin, &simFirmwareBssEnd);
+    bootFirmware = boot;
+}
+
+void Sim::deepSleep(uint64_t wakeAfterMicros) {
+    asleep = true;
+    wakeAt = wakeAfterMicros != 0 ? now + wakeAfterMicros : SIM_NEVER;
+    stop(true);
+}
+
+uint64_t Sim::bootedAt() {
+    return bootAt;
+}
+
+bool Sim::stopped() {
+    return halted;
+}
+
+uint32_t Sim::restarts() {
+    return restartCount;
+}
+
+uint32_t Sim::deepSleeps() {
+    return sleepCount;
+}
+
+size_t Sim::taskCount() {
+    return taskTotal;
+}
+
+TaskStats& Sim::taskStats(size_t index) {
+    return tasks[index].stats;
+}
+
+void Sim::resetTaskStats() {
+    AllocCounter::Pause pause;
+    for (size_t i = 0; i < taskTotal; i++) {
+        TaskStats& stats = tasks[i].stats;
+        stats.iterationNanos.clear();
+        stats.allocations = stats.allocatedBytes = 0;
+        stats.allocatingIterations = 0;
+    }
+}
+
+// delay() on a task blocks it; in the simulation's own context (setup())
+// it moves the clock
+void delay(uint32_t ms) {
+    if (current != nullptr) {
+        sleepFor(current, ms * 1000ULL);
+    } else {
+        Sim::advance(ms);
+    }
+}
+
+void delayMicroseconds(uint32_t us) {
+    now += us;
+}
+
+BaseType_t xTaskCreatePinnedToCore(void (*entry)(void*), const char* name, uint32_t stackBytes, void* param,
+                                   UBaseType_t priority, TaskHandle_t* handle, BaseType_t core) {
+    if (taskTotal == SIM_MAX_TASKS) {
+        return pdFAIL;
+    }
+    AllocCounter::Pause pause;
+    SimTask* task = &tasks[taskTotal++];
+    task->stack = (uint8_t*)malloc(SIM_STACK_SIZE);
+    memset(task->stack, SIM_STACK_PAINT, SIM_STACK_SIZE);
+    task->entry = entry;
+    task->param = param;
+    task->stackBytes = stackBytes;
+    task->priority = priority;
+    task->notifications = 0;
+    task->waitingForNotify = false;
+    task->deleted = false;
+    task->wakeAt = now;
+    task->stats.name = name;
+    task->stats.priority = priority;
+
+    getcontext(&task->context);
+    task->context.uc_stack.ss_sp = task->stack;
+    task->context.uc_stack.ss_size = SIM_STACK_SIZE;
+    task->context.uc_link = nullptr;
+    makecontext(&task->context, taskEntry, 0);
+    if (handle != nullptr) {
+        *handle = task;
+    }
+    return pdPASS;
+}
+
+// Deleting the calling task from the simulation's context is the Arduino
+// loop task handing over to the workers; there is nothing to stop
+void vTaskDelete(TaskHandle_t handle) {
+    SimTask* task = handle != nullptr ? static_cast<SimTask*>(handle) : current;
+    if (task == nullptr) {
+        return;
+    }
+    task->deleted = true;
+    if (task == current) {
+        block(task);
+    }
+}
+
+void vTaskDelay(TickType_t ticks) {
+    delay(ticks * portTICK_PERIOD_MS);
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle() {
+    return current;
+}
+
+// Bytes of the requested stack left over, judged by how much of the painted
+// host stack was ever touched
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t handle) {
+    SimTask* task = handle != nullptr ? static_cast<SimTask*>(handle) : current;
+    if (task == nullptr) {
+        return 0;
+    }
+    size_t untouched = 0;
+    while (untouched < SIM_STACK_SIZE && task->stack[untouched] == SIM_STACK_PAINT) {
+        untouched++;
+    }
+    size_t used = SIM_STACK_SIZE - untouched;
+    return used < task->stackBytes ? task->stackBytes - used : 0;
+}
+
+BaseType_t xPortGetCoreID() {
+    return 0;
+}
+
+BaseType_t xPortInIsrContext() {
+    return current == nullptr;
+}
+
+// The end of a worker iteration: the call that puts the loop to sleep
+uint32_t ulTaskNotifyTake(BaseType_t clearOnExit, TickType_t ticks) {
+    SimTask* task = current;
+    if (task == nullptr) {
+        return 0;
+    }
+    endIteration(task);
+    if (task->notifications == 0 && ticks != 0) {
+        task->waitingForNotify = true;
+        task->wakeAt = ticks == portMAX_DELAY ? SIM_NEVER : now + ticks * 1000ULL;
+        block(task);
+        task->waitingForNotify = false;
+    }
+    uint32_t value = task->notifications;
+    if (value > 0) {
+        task->notifications = clearOnExit ? 0 : value - 1;
+    }
+    return value;
+}
+
+void xTaskNotifyGive(TaskHandle_t handle) {
+    static_cast<SimTask*>(handle)->notifications++;
+}
+
+void vTaskNotifyGiveFromISR(TaskHandle_t handle, BaseType_t* higherPriorityWoken) {
+    xTaskNotifyGive(handle);
+    if (higherPriorityWoken != nullptr) {
+        *higherPriorityWoken = pdFALSE;
+    }
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex() {
+    if (mutexCount == SIM_MAX_MUTEXES) {
+        return nullptr;
+    }
+    return &mutexes[mutexCount++];
+}
+
+// Nothing preempts a task, so a mutex is only contended while its holder is
+// blocked; waiters poll it every tick
+BaseType_t xSemaphoreTake(SemaphoreHandle_t handle, TickType_t ticks) {
+    SimMutex* mutex = static_cast<SimMutex*>(handle);
+    uint64_t deadline = ticks == portMAX_DELAY ? SIM_NEVER : now + ticks * 1000ULL;
+    while (mutex->taken) {
+        if (current == nullptr || now >= deadline) {
+            return pdFALSE;
+        }
+        sleepFor(current, 1000);
+    }
+    mutex->taken = true;
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t handle) {
+    static_cast<SimMutex*>(handle)->taken = false;
+    return pdTRUE;
+}
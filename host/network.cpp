@@ -0,0 +1,401 @@
+#include <deque>
+#include <time.h>
+#include "Arduino.h"
+#include "WiFi.h"
+#include "sim.h"
+#include "alloc_counter.h"
+
+#define SIM_EPOCH 1760000000UL  // Unix time the simulated day starts at
+
+// MQTT 3.1.1 control packet types
+#define MQTT_CONNECT 0x10
+#define MQTT_CONNACK 0x20
+#define MQTT_PUBLISH 0x30
+#define MQTT_PUBACK 0x40
+#define MQTT_SUBSCRIBE 0x80
+#define MQTT_SUBACK 0x90
+#define MQTT_PINGREQ 0xC0
+#define MQTT_PINGRESP 0xD0
+#define MQTT_DISCONNECT 0xE0
+
+WiFiClass WiFi;
+
+// WiFi
+
+static struct {
+    WiFiEventCb handler;
+    bool available = true;
+    bool associated;
+    unsigned long associationTime = 2500;
+    uint32_t generation;  // Invalidates events of an abandoned attempt
+} wifi;
+
+static struct {
+    unsigned long delay = 1500;
+    bool requested;
+    uint64_t validAt;  // Virtual microseconds
+} ntp;
+
+static void dropConnection();
+
+static void wifiEvent(arduino_event_id_t event) {
+    if (wifi.handler != nullptr) {
+        wifi.handler(event, nullptr);
+    }
+}
+
+static void associate(void* arg) {
+    if ((uint32_t)(uintptr_t)arg != wifi.generation || !wifi.available) {
+        return;
+    }
+    wifi.associated = true;
+    wifiEvent(ARDUINO_EVENT_WIFI_STA_CONNECTED);
+    wifiEvent(ARDUINO_EVENT_WIFI_STA_GOT_IP);
+}
+
+int WiFiClass::onEvent(WiFiEventCb handler) {
+    wifi.handler = handler;
+    return 0;
+}
+
+void WiFiClass::begin(const char* ssid, const char* password) {
+    wifi.generation++;
+    wifi.associated = false;
+    Sim::schedule(Sim::micros() + wifi.associationTime * 1000ULL, associate, (void*)(uintptr_t)wifi.generation);
+}
+
+bool WiFiClass::disconnect(bool wifiOff, bool eraseAp) {
+    wifi.generation++;
+    if (wifi.associated) {
+        wifi.associated = false;
+        dropConnection();
+        wifiEvent(ARDUINO_EVENT_WIFI_STA_DISCONNECTED);
+    }
+    return true;
+}
+
+wl_status_t WiFiClass::status() {
+    return wifi.associated ? WL_CONNECTED : WL_DISCONNECTED;
+}
+
+bool WiFiClass::isConnected() {
+    return wifi.associated;
+}
+
+IPAddress WiFiClass::localIP() {
+    return IPAddress(wifi.associated ? 0x6401A8C0 : 0);  // 192.168.1.100
+}
+
+void FakeNetwork::setWiFiAvailable(bool available) {
+    wifi.available = available;
+    if (!available && wifi.associated) {
+        wifi.associated = false;
+        dropConnection();
+        wifiEvent(ARDUINO_EVENT_WIFI_STA_DISCONNECTED);
+    }
+}
+
+void FakeNetwork::setAssociationTime(unsigned long millis) {
+    wifi.associationTime = millis;
+}
+
+void FakeNetwork::setNTPDelay(unsigned long millis) {
+    ntp.delay = millis;
+}
+
+void configTime(long gmtOffset, int daylightOffset, const char* server1, const char* server2, const char* server3) {
+    if (!ntp.requested) {
+        ntp.requested = true;
+        ntp.validAt = Sim::micros() + ntp.delay * 1000ULL;
+    }
+}
+
+// Seconds since boot until SNTP has set the clock, then wall time on the
+// virtual clock
+extern "C" time_t time(time_t* out) __THROW {
+    uint64_t now = Sim::micros();
+    time_t value = ntp.requested && now >= ntp.validAt ? (time_t)(SIM_EPOCH + now / 1000000) : (time_t)(now / 1000000);
+    if (out != nullptr) {
+        *out = value;
+    }
+    return value;
+}
+
+// Broker
+
+struct Chunk {
+    uint64_t at;  // Virtual microseconds when the client can read it
+    std::vector<uint8_t> bytes;
+};
+
+static struct {
+    bool connected;
+    std::deque<Chunk> toClient;
+    std::vector<uint8_t> fromClient;  // Unparsed remainder
+    std::vector<MQTTMessage> messages;
+    unsigned long ackDelay = 20;
+    bool acknowledging = true;
+    size_t writeLimit;
+    uint32_t stalledWrites;
+    uint32_t connects, pubacks;
+    uint16_t lastPubackId;
+    uint64_t received, sent, packets;
+} broker;
+
+static void toClient(const uint8_t* bytes, size_t length, unsigned long delayMillis) {
+    broker.toClient.push_back({Sim::micros() + delayMillis * 1000ULL, std::vector<uint8_t>(bytes, bytes + length)});
+    broker.sent += length;
+}
+
+static void acknowledge(uint8_t type, const uint8_t* body, size_t length) {
+    uint8_t packet[4] = {type, 2, length > 0 ? body[0] : (uint8_t)0, length > 1 ? body[1] : (uint8_t)0};
+    toClient(packet, sizeof(packet), broker.ackDelay);
+}
+
+static void handlePacket(uint8_t header, const uint8_t* body, size_t length) {
+    broker.packets++;
+    switch (header & 0xF0) {
+        case MQTT_CONNECT: {
+            const uint8_t connack[4] = {MQTT_CONNACK, 2, 0, 0};
+            toClient(connack, sizeof(connack), broker.ackDelay);
+            broker.connects++;
+            break;
+        }
+
+        case MQTT_PUBLISH: {
+            uint8_t qos = (header >> 1) & 0x03;
+            size_t topicLength = (body[0] << 8) | body[1];
+            size_t offset = 2 + topicLength + (qos > 0 ? 2 : 0);
+            MQTTMessage message;
+            message.at = Sim::micros() / 1000;
+            message.topic.assign((const char*)body + 2, topicLength);
+            message.payload.assign(body + offset, body + length);
+            message.qos = qos;
+            message.retained = header & 0x01;
+            message.dup = header & 0x08;
+            broker.messages.push_back(std::move(message));
+            if (qos == 1 && broker.acknowledging) {
+                acknowledge(MQTT_PUBACK, body + 2 + topicLength, 2);
+            }
+            break;
+        }
+
+        case MQTT_PUBACK:
+            broker.pubacks++;
+            broker.lastPubackId = length >= 2 ? (body[0] << 8) | body[1] : 0;
+            break;
+
+        case MQTT_SUBSCRIBE: {
+            uint8_t suback[5] = {MQTT_SUBACK, 3, body[0], body[1], body[length - 1]};
+            toClient(suback, sizeof(suback), broker.ackDelay);
+            break;
+        }
+
+        case MQTT_PINGREQ: {
+            const uint8_t pong[2] = {MQTT_PINGRESP, 0};
+            toClient(pong, sizeof(pong), broker.ackDelay);
+            break;
+        }
+
+        case MQTT_DISCONNECT:
+            broker.connected = false;
+            break;
+    }
+}
+
+// Splits the client's byte stream into packets
+static void parse() {
+    std::vector<uint8_t>& in = broker.fromClient;
+    size_t start = 0;
+    while (in.size() - start >= 2) {
+        size_t remaining = 0, multiplier = 1, n = 1;
+        do {
+            if (start + n >= in.size()) {
+                goto incomplete;
+            }
+            remaining += (in[start + n] & 0x7F) * multiplier;
+            multiplier *= 128;
+        } while (in[start + n++] & 0x80);
+        if (in.size() - start - n < remaining) {
+            break;
+        }
+        handlePacket(in[start], in.data() + start + n, remaining);
+        start += n + remaining;
+    }
+incomplete:
+    in.erase(in.begin(), in.begin() + start);
+}
+
+static void dropConnection() {
+    AllocCounter::Pause pause;
+    broker.connected = false;
+    broker.toClient.clear();
+    broker.fromClient.clear();
+}
+
+const std::vector<MQTTMessage>& FakeBroker::messages() {
+    return broker.messages;
+}
+
+void FakeBroker::clearMessages() {
+    AllocCounter::Pause pause;
+    broker.messages.clear();
+}
+
+size_t FakeBroker::count(const char* topic) {
+    size_t n = 0;
+    for (const MQTTMessage& message : broker.messages) {
+        n += message.topic == topic;
+    }
+    return n;
+}
+
+void FakeBroker::setAckDelay(unsigned long millis) {
+    broker.ackDelay = millis;
+}
+
+void FakeBroker::setAcknowledging(bool enabled) {
+    broker.acknowledging = enabled;
+}
+
+void FakeBroker::setWriteLimit(size_t bytes) {
+    broker.writeLimit = bytes;
+}
+
+void FakeBroker::stallWrites(uint32_t writes) {
+    broker.stalledWrites = writes;
+}
+
+void FakeBroker::send(const char* topic, const uint8_t* payload, size_t length, uint8_t qos, uint16_t packetId) {
+    AllocCounter::Pause pause;
+    size_t topicLength = strlen(topic);
+    size_t remaining = 2 + topicLength + (qos > 0 ? 2 : 0) + length;
+    std::vector<uint8_t> packet = {(uint8_t)(MQTT_PUBLISH | (qos << 1))};
+    do {
+        uint8_t digit = remaining % 128;
+        remaining /= 128;
+        packet.push_back(remaining > 0 ? digit | 0x80 : digit);
+    } while (remaining > 0);
+    packet.push_back(topicLength >> 8);
+    packet.push_back(topicLength);
+    packet.insert(packet.end(), topic, topic + topicLength);
+    if (qos > 0) {
+        packet.push_back(packetId >> 8);
+        packet.push_back(packetId);
+    }
+    packet.insert(packet.end(), payload, payload + length);
+    toClient(packet.data(), packet.size(), 0);
+}
+
+void FakeBroker::disconnect() {
+    dropConnection();
+}
+
+bool FakeBroker::isConnected() {
+    return broker.connected;
+}
+
+uint32_t FakeBroker::connects() {
+    return broker.connects;
+}
+
+uint32_t FakeBroker::pubacksReceived() {
+    return broker.pubacks;
+}
+
+uint16_t FakeBroker::lastPubackId() {
+    return broker.lastPubackId;
+}
+
+uint64_t FakeBroker::bytesReceived() {
+    return broker.received;
+}
+
+uint64_t FakeBroker::bytesSent() {
+    return broker.sent;
+}
+
+uint64_t FakeBroker::packetsReceived() {
+    return broker.packets;
+}
+
+// Client side of the socket
+
+int WiFiClient::connect(const char* host, uint16_t port) {
+    if (!wifi.associated) {
+        return 0;
+    }
+    socket = std::make_shared<int>(0);
+    dropConnection();
+    broker.connected = true;
+    return 1;
+}
+
+size_t WiFiClient::write(uint8_t c) {
+    return write(&c, 1);
+}
+
+size_t WiFiClient::write(const uint8_t* buffer, size_t size) {
+    if (socket == nullptr || !broker.connected) {
+        return 0;
+    }
+    if (broker.stalledWrites > 0) {
+        broker.stalledWrites--;
+        return 0;
+    }
+    if (broker.writeLimit > 0) {
+        size = std::min(size, broker.writeLimit);
+    }
+    AllocCounter::Pause pause;
+    broker.fromClient.insert(broker.fromClient.end(), buffer, buffer + size);
+    broker.received += size;
+    parse();
+    return size;
+}
+
+int WiFiClient::available() {
+    size_t n = 0;
+    for (const Chunk& chunk : broker.toClient) {
+        if (chunk.at > Sim::micros()) {
+            break;
+        }
+        n += chunk.bytes.size();
+    }
+    return socket != nullptr ? (int)n : 0;
+}
+
+int WiFiClient::read() {
+    uint8_t c;
+    return read(&c, 1) == 1 ? c : -1;
+}
+
+int WiFiClient::read(uint8_t* buffer, size_t size) {
+    if (socket == nullptr) {
+        return -1;
+    }
+    AllocCounter::Pause pause;
+    size_t n = 0;
+    while (n < size && !broker.toClient.empty() && broker.toClient.front().at <= Sim::micros()) {
+        std::vector<uint8_t>& bytes = broker.toClient.front().bytes;
+        size_t take = std::min(size - n, bytes.size());
+        memcpy(buffer + n, bytes.data(), take);
+        bytes.erase(bytes.begin(), bytes.begin() + take);
+        n += take;
+        if (bytes.empty()) {
+            broker.toClient.pop_front();
+        }
+    }
+    return (int)n;
+}
+
+void WiFiClient::stop() {
+    if (socket != nullptr) {
+        dropConnection();
+        socket.reset();
+    }
+}
+
+// Data already received stays readable after the broker hangs up
+uint8_t WiFiClient::connected() {
+    return socket != nullptr && (broker.connected || available() > 0);
+}
@@ -0,0 +1,7 @@
+// Linked right before the firmware's objects in executables that sleep and
+// wake it, so the firmware's .data and .bss start here (see
+// Sim::wakeFromSleep). The linker keeps input files in command-line order.
+extern "C" {
+char simFirmwareDataBegin = 1;
+char simFirmwareBssBegin;
+}
@@ -0,0 +1,5 @@
+// Linked right after the firmware's objects; see host/ram_begin.cpp
+extern "C" {
+char simFirmwareDataEnd = 1;
+char simFirmwareBssEnd;
+}
@@ -0,0 +1,128 @@
+#ifndef HOST_SIM_H
+#define HOST_SIM_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <esp_system.h>
+#include "freertos/FreeRTOS.h"
+
+// Host simulation of the board: a virtual clock, the FreeRTOS workers as
+// cooperative tasks on that clock, and fake sensors, display, UARTs, flash,
+// WiFi and MQTT broker behind the library headers in this directory.
+//
+// A test calls setup() and loop() from sketch.ino like the Arduino core
+// would, then Sim::runFor() to let the workers run. Virtual time jumps from
+// one deadline to the next, so a simulated day takes seconds.
+
+// The air around the sensors at one instant
+struct Air {
+    float temperature;  // °C
+    float humidity;     // %RH
+    uint16_t co2;       // ppm
+    uint16_t pm1_0, pm2_5, pm10;  // µg/m³
+    uint16_t tvoc;      // ppb
+    uint16_t h2, ethanol;  // SGP30 raw signals
+};
+
+typedef Air (*AirTrace)(uint64_t millis);
+
+// Host cost of one worker iteration: from the worker waking up to it
+// waiting for its next deadline, virtual time spent blocked excluded
+struct TaskStats {
+    const char* name;
+    UBaseType_t priority;
+    std::vector<uint32_t> iterationNanos;
+    uint64_t allocations;          // Heap allocations made inside iterations
+    uint64_t allocatedBytes;
+    uint32_t allocatingIterations;
+};
+
+struct MQTTMessage {
+    uint64_t at;  // Virtual milliseconds when the broker received it
+    std::string topic;
+    std::vector<uint8_t> payload;
+    uint8_t qos;
+    bool retained;
+    bool dup;
+};
+
+class Sim {
+public:
+    // Clock
+    static uint64_t micros();
+    static void runFor(unsigned long millis);  // Stops early if the firmware restarts, or sleeps without wakeFromSleep()
+    static void advance(unsigned long millis);  // From the test's own context: device events only
+
+    // Environment
+    static void setAir(AirTrace trace);
+    static Air air();                      // At the current virtual time
+    static Air typicalAir(uint64_t millis);  // Default: a day in an occupied room
+
+    // Board
+    static void pressButton();
+    static void setI2CResponding(uint8_t address, bool responding);  // False: transfers to it are NACKed
+    static void serialInput(const char* text);  // Typed on the console
+    static void captureSerial(bool enabled);
+    static const std::string& serialOutput();
+    static void setResetReason(esp_reset_reason_t reason);
+    static uint32_t restarts();
+    static uint32_t deepSleeps();
+    static bool stopped();  // Restarted or asleep; runFor() returns at once
+    // Deep sleep then ends in a power-down and boot() runs again when the
+    // wake-up timer fires, with RTC memory kept and the rest of the
+    // firmware's RAM as reset left it. Call before the first setup(); the
+    // firmware must be linked between host/ram_begin.cpp and host/ram_end.cpp.
+    static void wakeFromSleep(void (*boot)());
+
+    // Workers
+    static size_t taskCount();
+    static TaskStats& taskStats(size_t index);
+    static void resetTaskStats();
+
+    // Internal: device events on the virtual clock, run from the simulation's
+    // own context like interrupts or the core's event tasks
+    static bool schedule(uint64_t atMicros, void (*event)(void*), void* arg);
+    static void stop(bool sleep);
+    static void deepSleep(uint64_t wakeAfterMicros);  // 0: until reset
+    static uint64_t bootedAt();  // Virtual microseconds; millis() counts from here
+};
+
+// MQTT 3.1.1 broker at the other end of every WiFiClient. It acknowledges
+// CONNECT, SUBSCRIBE, PINGREQ and QoS1 PUBLISH packets after a configurable
+// delay and records every message it receives.
+class FakeBroker {
+public:
+    static const std::vector<MQTTMessage>& messages();
+    static void clearMessages();
+    static size_t count(const char* topic);
+    static void setAckDelay(unsigned long millis);
+    static void setAcknowledging(bool enabled);  // Withhold PUBACKs while false
+    static void setWriteLimit(size_t bytes);  // Most bytes the socket takes per write(), 0 for no limit
+    static void stallWrites(uint32_t writes);  // The next writes take nothing, as on a full socket
+    static void send(const char* topic, const uint8_t* payload, size_t length, uint8_t qos, uint16_t packetId);
+    static void disconnect();  // Drops the TCP connection
+    static bool isConnected();
+    static uint32_t connects();
+    static uint32_t pubacksReceived();  // For QoS1 messages the broker sent
+    static uint16_t lastPubackId();
+    static uint64_t bytesReceived();
+    static uint64_t bytesSent();
+    static uint64_t packetsReceived();
+};
+
+// LittleFS and NVS held in memory
+class FakeFlash {
+public:
+    static void setFull(bool full);  // File writes take nothing, as on a full or failing partition
+    static uint32_t nvsWrites();
+};
+
+class FakeNetwork {
+public:
+    static void setWiFiAvailable(bool available);  // False drops the link and fails new attempts
+    static void setAssociationTime(unsigned long millis);
+    static void setNTPDelay(unsigned long millis);  // From configTime() to a valid clock
+};
+
+#endif // HOST_SIM_H
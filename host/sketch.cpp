@@ -0,0 +1,2 @@
+// The firmware's setup() and loop(), built as an ordinary translation unit
+#include "sketch.ino"
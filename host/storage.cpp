@@ -0,0 +1,158 @@
+#include <map>
+#include <string>
+#include <vector>
+#include "LittleFS.h"
+#include "Preferences.h"
+#include "sim.h"
+#include "alloc_counter.h"
+
+#define HOST_FLASH_SIZE (1536 * 1024)  // LittleFS partition of the default layout
+
+fs::LittleFSFS LittleFS;
+
+static std::map<std::string, std::vector<uint8_t>> files;
+static std::map<std::string, uint32_t> nvs;
+static bool flashFull;
+static uint32_t nvsWriteCount;
+
+void FakeFlash::setFull(bool full) {
+    flashFull = full;
+}
+
+uint32_t FakeFlash::nvsWrites() {
+    return nvsWriteCount;
+}
+
+namespace fs {
+
+struct FileImpl {
+    std::vector<uint8_t>* data;
+    size_t position;
+    bool writable;
+};
+
+size_t File::write(const uint8_t* buffer, size_t size) {
+    if (impl == nullptr || !impl->writable || flashFull) {
+        return 0;
+    }
+    AllocCounter::Pause pause;
+    std::vector<uint8_t>& data = *impl->data;
+    if (impl->position + size > data.size()) {
+        data.resize(impl->position + size);
+    }
+    memcpy(data.data() + impl->position, buffer, size);
+    impl->position += size;
+    return size;
+}
+
+size_t File::read(uint8_t* buffer, size_t size) {
+    if (impl == nullptr) {
+        return 0;
+    }
+    size_t n = std::min(size, impl->data->size() - std::min(impl->position, impl->data->size()));
+    memcpy(buffer, impl->data->data() + impl->position, n);
+    impl->position += n;
+    return n;
+}
+
+bool File::seek(uint32_t position, SeekMode mode) {
+    if (impl == nullptr) {
+        return false;
+    }
+    size_t base = mode == SeekSet ? 0 : mode == SeekCur ? impl->position : impl->data->size();
+    impl->position = base + position;
+    return true;
+}
+
+size_t File::position() const {
+    return impl != nullptr ? impl->position : 0;
+}
+
+size_t File::size() const {
+    return impl != nullptr ? impl->data->size() : 0;
+}
+
+void File::close() {
+    impl.reset();
+}
+
+// Each open allocates its handle on the heap, as the VFS layer does
+File FS::open(const char* path, const char* mode, bool create) {
+    auto found = files.find(path);
+    if (mode[0] == 'w') {
+        AllocCounter::Pause pause;
+        found = files.insert_or_assign(path, std::vector<uint8_t>()).first;
+    } else if (found == files.end()) {
+        return File();
+    }
+    return File(std::make_shared<FileImpl>(FileImpl{&found->second, 0, mode[0] == 'w' || mode[1] == '+'}));
+}
+
+bool FS::exists(const char* path) {
+    return files.count(path) > 0;
+}
+
+bool FS::remove(const char* path) {
+    AllocCounter::Pause pause;
+    return files.erase(path) > 0;
+}
+
+bool LittleFSFS::begin(bool formatOnFail, const char* basePath, uint8_t maxOpenFiles, const char* partitionLabel) {
+    return true;
+}
+
+size_t LittleFSFS::totalBytes() {
+    return HOST_FLASH_SIZE;
+}
+
+size_t LittleFSFS::usedBytes() {
+    size_t used = 0;
+    for (const auto& file : files) {
+        used += file.second.size();
+    }
+    return used;
+}
+
+}  // namespace fs
+
+// Preferences
+
+static std::string nvsKey(const char* name, const char* key) {
+    return std::string(name) + "/" + key;
+}
+
+bool Preferences::begin(const char* space, bool readOnly) {
+    strncpy(name, space, sizeof(name) - 1);
+    return true;
+}
+
+bool Preferences::isKey(const char* key) {
+    AllocCounter::Pause pause;
+    return nvs.count(nvsKey(name, key)) > 0;
+}
+
+bool Preferences::remove(const char* key) {
+    AllocCounter::Pause pause;
+    return nvs.erase(nvsKey(name, key)) > 0;
+}
+
+uint16_t Preferences::getUShort(const char* key, uint16_t defaultValue) {
+    return (uint16_t)getUInt(key, defaultValue);
+}
+
+size_t Preferences::putUShort(const char* key, uint16_t value) {
+    return putUInt(key, value) > 0 ? 2 : 0;
+}
+
+uint32_t Preferences::getUInt(const char* key, uint32_t defaultValue) {
+    AllocCounter::Pause pause;
+    auto found = nvs.find(nvsKey(name, key));
+    return found != nvs.end() ? found->second : defaultValue;
+}
+
+size_t Preferences::putUInt(const char* key, uint32_t value) {
+    AllocCounter::Pause pause;
+    nvs[nvsKey(name, key)] = value;
+    nvsWriteCount++;
+    return 4;
+}
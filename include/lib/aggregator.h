@@ -0,0 +1,82 @@
+#ifndef AGGREGATOR_H
+#define AGGREGATOR_H
+
+#include <Arduino.h>
+
+#define AGGREGATOR_BUCKETS 64  // Histogram buckets per metric and window
+
+enum AggregateMetric : uint8_t {
+    AGG_TEMPERATURE,
+    AGG_HUMIDITY,
+    AGG_CO2,
+    AGG_PM1_0,
+    AGG_PM2_5,
+    AGG_PM10,
+    AGG_TVOC,
+    AGG_METRIC_COUNT
+};
+
+enum AggregateWindow : uint8_t {
+    WINDOW_1M,
+    WINDOW_15M,
+    WINDOW_1H,
+    WINDOW_24H,
+    WINDOW_COUNT
+};
+
+struct WindowStats {
+    uint32_t count;
+    float min;
+    float max;
+    float mean;
+    float stddev;
+    float p95;
+};
+
+// Statistics of one closed window, copied out for another thread to publish
+struct AggregateReport {
+    AggregateWindow window;
+    WindowStats stats[AGG_METRIC_COUNT];
+};
+
+// Fixed-memory streaming statistics over tumbling 1 min, 15 min, 1 h and
+// 24 h windows. Every sample updates each window in constant time: Welford
+// mean/variance, min/max, and a 64-bucket histogram that approximates the
+// 95th percentile to within a few percent. Samples are accumulated in their
+// fixed-point SampleRecord units; a closed window's statistics are
+// converted to the published units. The running mean and variance are
+// single precision, which the ESP32 FPU handles in hardware;
+// test/bench_aggregator.cpp checks them against exact statistics over a
+// full 24 h window.
+class Aggregator {
+private:
+    struct Accumulator {
+        uint32_t count;
+        int32_t min, max;
+        float mean, m2;
+        uint16_t histogram[AGGREGATOR_BUCKETS];
+    };
+
+    static Accumulator current[WINDOW_COUNT][AGG_METRIC_COUNT];
+    static WindowStats completed[WINDOW_COUNT][AGG_METRIC_COUNT];
+    static unsigned long windowStart[WINDOW_COUNT];
+    static bool windowReady[WINDOW_COUNT];
+
+    static uint8_t bucketFor(AggregateMetric metric, int32_t value);
+    static float bucketUpperBound(AggregateMetric metric, uint8_t bucket);
+    static float percentile(AggregateMetric metric, const Accumulator& acc, uint8_t pct);
+    static void close(AggregateWindow window);
+
+public:
+    static void begin(bool resume = false);  // resume keeps the windows held through deep sleep
+    static void add(AggregateMetric metric, int32_t value);
+    static void roll(unsigned long now);
+    static bool takeCompleted(AggregateWindow window);
+    static const WindowStats& get(AggregateWindow window, AggregateMetric metric);
+    static void report(AggregateWindow window, AggregateReport& out);
+    static const char* windowName(AggregateWindow window);
+    static const char* metricName(AggregateMetric metric);
+    static size_t stateBytes();  // Windows kept in RTC memory in duty-cycled mode
+};
+
+#endif // AGGREGATOR_H
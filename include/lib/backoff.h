@@ -0,0 +1,25 @@
+#ifndef BACKOFF_H
+#define BACKOFF_H
+
+#include <Arduino.h>
+
+#define BACKOFF_JITTER_PERCENT 25  // Spread retries +/-25% so units don't reconnect in lockstep
+
+// Exponential backoff: initial * 2^failures, capped at maximum, with random jitter
+inline unsigned long jitteredBackoff(uint8_t failures, unsigned long initial, unsigned long maximum) {
+    unsigned long delayMs = initial;
+    while (failures-- > 0 && delayMs < maximum) {
+        delayMs *= 2;
+    }
+    if (delayMs > maximum) {
+        delayMs = maximum;
+    }
+
+    uint32_t span = (delayMs / 100) * BACKOFF_JITTER_PERCENT;
+    if (span == 0) {
+        return delayMs;
+    }
+    return delayMs - span + (esp_random() % (2 * span + 1));
+}
+
+#endif // BACKOFF_H
@@ -0,0 +1,40 @@
+#ifndef CONSOLE_H
+#define CONSOLE_H
+
+#include <Arduino.h>
+
+#define CONSOLE_LINE_SIZE 64     // Longer lines are discarded
+#define CONSOLE_MAX_COMMANDS 8
+
+// Receives the text after the command word; returns false to print the usage
+typedef bool (*ConsoleHandler)(const char* args);
+
+// Line-based command interface on the USB serial port. The UART receive
+// callback only wakes the owning worker, which calls poll() to read the
+// line and run the matching handler.
+class Console {
+private:
+    struct Command {
+        const char* name;
+        const char* usage;
+        ConsoleHandler handler;
+    };
+
+    static Command commands[CONSOLE_MAX_COMMANDS];
+    static uint8_t commandCount;
+    static char line[CONSOLE_LINE_SIZE];
+    static uint8_t length;
+    static bool overflow;
+    static void (*wakeHandler)();
+
+    static void onReceive();
+    static void printHelp();
+
+public:
+    static void begin(void (*wake)());
+    static bool addCommand(const char* name, const char* usage, ConsoleHandler handler);
+    static void poll();
+    static bool execute(const char* input);
+};
+
+#endif // CONSOLE_H
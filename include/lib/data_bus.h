@@ -0,0 +1,86 @@
+#ifndef DATA_BUS_H
+#define DATA_BUS_H
+
+#include <Arduino.h>
+#include <atomic>
+#include "include/lib/seqlock.h"
+#include "include/lib/sensor_snapshot.h"
+#include "include/lib/metrics.h"
+
+#define DATA_BUS_MAX_SUBSCRIBERS 4
+
+typedef uint16_t TopicMask;
+#define TOPIC_BIT(topic) ((TopicMask)1 << (topic))
+#define TOPIC_ALL ((TopicMask)((1U << TOPIC_COUNT) - 1))
+
+// Topics fed by each sensor
+#define SCD41_TOPICS (TOPIC_BIT(TOPIC_TEMPERATURE) | TOPIC_BIT(TOPIC_HUMIDITY) | TOPIC_BIT(TOPIC_CO2))
+#define SGP30_TOPICS (TOPIC_BIT(TOPIC_TVOC) | TOPIC_BIT(TOPIC_H2) | TOPIC_BIT(TOPIC_ETHANOL))
+#define PMS7003_TOPICS (TOPIC_BIT(TOPIC_PM1_0) | TOPIC_BIT(TOPIC_PM2_5) | TOPIC_BIT(TOPIC_PM10) | \
+                        TOPIC_BIT(TOPIC_AQI) | TOPIC_BIT(TOPIC_AQI_24H) | TOPIC_BIT(TOPIC_AQI_POLLUTANT))
+
+enum ReadingQuality : uint8_t {
+    QUALITY_NONE,     // Nothing published yet
+    QUALITY_GOOD,
+    QUALITY_DEGRADED, // Read succeeded, but the sensor is recovering from failures
+    QUALITY_INVALID,  // The last read failed or the sensor is down; value is the previous good one
+};
+
+struct Reading {
+    int32_t value;       // In the SampleRecord field's units
+    uint32_t timestamp;  // millis() of the measurement
+    ReadingQuality quality;
+};
+
+typedef void (*BusNotify)();
+
+struct DataBusStats {
+    uint32_t published;
+    uint32_t notifications;
+    uint32_t maxDispatchMicros;
+    uint64_t totalDispatchMicros;
+    uint32_t dispatches;
+};
+
+// Latest-value publish/subscribe bus between the acquisition worker and the
+// sinks. Each topic holds one Reading behind its own seqlock, so a sink reads
+// only the topics it needs without locking the writer. Subscribers register
+// a topic filter, a minimum interval between notifications and a hook that
+// wakes their worker; take() then reports which topics changed.
+//
+// Topics have a single writer (the acquisition worker). Subscriptions are
+// made before the workers start.
+class DataBus {
+private:
+    struct Subscriber {
+        TopicMask topics;
+        unsigned long minInterval;
+        BusNotify notify;
+        unsigned long lastNotified;   // Only touched by the writer
+        std::atomic<TopicMask> pending;
+    };
+
+    static Seqlock<Reading> latest[TOPIC_COUNT];
+    static Subscriber subscribers[DATA_BUS_MAX_SUBSCRIBERS];
+    static uint8_t subscriberCount;
+    static DataBusStats stats;
+
+public:
+    static int8_t subscribe(TopicMask topics, unsigned long minInterval, BusNotify notify);
+    static void publish(DataTopic topic, int32_t value, ReadingQuality quality, unsigned long timestamp);
+    static void dispatch();  // Wakes subscribers with pending topics, at most once per interval
+    static TopicMask take(int8_t subscriber);  // Topics published since the last call
+
+    static Reading read(DataTopic topic);
+    static int32_t value(DataTopic topic);
+    static void snapshot(SensorSnapshot& out);  // All topics, for whole-record sinks
+
+    // Per-topic quality bits to the record's per-sensor SAMPLE_SUSPECT_* bits and back
+    static uint8_t suspectSensors(TopicMask suspect);
+    static TopicMask suspectTopics(uint8_t sensors);
+
+    static const DataBusStats& getStats();
+    static void printStats();
+};
+
+#endif // DATA_BUS_H
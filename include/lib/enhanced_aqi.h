@@ -0,0 +1,69 @@
+#ifndef ENHANCED_AQI_H
+#define ENHANCED_AQI_H
+
+#include <Arduino.h>
+
+enum class AQIStandard : uint8_t {
+    US_EPA,      // 2024 PM2.5 revision, 0-500
+    EU_CAQI,     // Common Air Quality Index (hourly grid), 0-100
+    INDIA_NAQI   // National Air Quality Index, 0-500
+};
+
+enum class Pollutant : uint8_t {
+    None,
+    PM2_5,
+    PM10
+};
+
+#define AQI_STANDARD AQIStandard::US_EPA  // Standard used for the published AQI
+#define AQI_HISTORY_HOURS 24              // Hourly averages kept for NowCast and 24 h AQI
+#define AQI_NOWCAST_HOURS 12
+
+// One segment of a piecewise-linear concentration-to-index mapping
+struct AQIBreakpoint {
+    float concLow, concHigh;
+    uint16_t indexLow, indexHigh;
+};
+
+struct AQIResult {
+    uint16_t index;
+    Pollutant dominant;
+};
+
+// Air quality index from averaged PM concentrations rather than a single
+// 1-second reading. Samples accumulate into the current hour in O(1);
+// NowCast and the 24-hour average are refreshed once per hour.
+class EnhancedAQI {
+private:
+    struct HourAverage {
+        float pm2_5;
+        float pm10;
+        bool valid;
+    };
+
+    static HourAverage hours[AQI_HISTORY_HOURS];
+    static uint8_t head;  // Most recently completed hour
+    static float sumPM2_5, sumPM10;
+    static uint32_t sampleCount;
+    static unsigned long hourStart;
+    static float nowcastPM2_5, nowcastPM10;
+    static float dailyPM2_5, dailyPM10;
+    static bool nowcastValid, dailyValid;
+
+    static void closeHour();
+    static void advance(unsigned long now);
+    static const HourAverage& hoursAgo(uint8_t n);
+    static bool nowcast(float HourAverage::*field, float& result);
+    static bool dailyAverage(float HourAverage::*field, float& result);
+    static AQIResult combine(float pm2_5, float pm10, AQIStandard standard);
+
+public:
+    static void begin(bool resume = false);  // resume keeps the history held through deep sleep
+    static void addSample(float pm2_5, float pm10, unsigned long now);
+    static AQIResult nowcastAQI(AQIStandard standard = AQI_STANDARD);
+    static AQIResult dailyAQI(AQIStandard standard = AQI_STANDARD);
+    static uint16_t subIndex(Pollutant pollutant, float concentration, AQIStandard standard = AQI_STANDARD);
+    static const char* pollutantName(Pollutant pollutant);
+};
+
+#endif // ENHANCED_AQI_H
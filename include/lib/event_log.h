@@ -0,0 +1,224 @@
+#ifndef EVENT_LOG_H
+#define EVENT_LOG_H
+
+#include <Arduino.h>
+#include <atomic>
+
+#define LOG_RING_SIZE 256             // Records kept in RAM; must be a power of two
+#define LOG_MAX_ARGS 3
+#define LOG_DEFAULT_LEVEL LOG_LEVEL_INFO  // Per-module threshold at boot
+#define LOG_LINE_SIZE 128             // Longest rendered text line
+#define LOG_DRAIN_RETRY 10            // Pause while the UART transmit buffer is full
+#define LOG_FLUSH_TIMEOUT 200         // Longest blocking drain before a reset or deep sleep
+#define LOG_SERIAL_TX_BUFFER 1024     // UART transmit buffer, so output rarely waits on the FIFO
+
+// Serial output: binary frames for tools/log_decode.py, or rendered text
+#define LOG_OUTPUT_BINARY 0
+#define LOG_OUTPUT_TEXT 1
+#define LOG_OUTPUT LOG_OUTPUT_BINARY
+
+enum LogLevel : uint8_t {
+    LOG_LEVEL_OFF,  // Threshold only
+    LOG_LEVEL_ERROR,
+    LOG_LEVEL_WARN,
+    LOG_LEVEL_INFO,
+    LOG_LEVEL_DEBUG,
+};
+
+#define LOG_MODULES(X) \
+    X(SYSTEM, "system") \
+    X(SCD41, "scd41") \
+    X(SGP30, "sgp30") \
+    X(PMS7003, "pms7003") \
+    X(HEALTH, "health") \
+    X(I2C, "i2c") \
+    X(WIFI, "wifi") \
+    X(MQTT, "mqtt") \
+    X(STORE, "store") \
+    X(POWER, "power") \
+    X(DISPLAY, "display") \
+    X(REPORT, "report")
+
+// Every event the firmware logs. Records carry only the event id and up to
+// LOG_MAX_ARGS integer arguments; the format is rendered on output, by
+// EventLog in text mode and by tools/log_decode.py, which reads this table.
+// Append new events at the end so older captures still decode.
+//
+// Placeholders: %d signed, %u unsigned, %x hex, %i IPv4 address,
+// %{a|b|c} enum name by value, %m metric (DataTopic, fixed-point value in
+// SampleRecord units).
+#define LOG_EVENTS(X) \
+    X(BOOT, SYSTEM, INFO, "Boot, reset reason %{unknown|power-on|external|software|panic|interrupt watchdog|task watchdog|watchdog|deep sleep|brownout|sdio}, %u records kept") \
+    X(LOG_OVERWRITTEN, SYSTEM, WARN, "%u log records overwritten before output") \
+    X(SCHEDULER_READY, SYSTEM, INFO, "Scheduler initialized") \
+    X(REBOOT_SCHEDULED, SYSTEM, WARN, "Performing scheduled reboot") \
+    X(REBOOT_HEAP, SYSTEM, ERROR, "Largest free heap block %u B below threshold, rebooting") \
+    X(REBOOT_SENSORS, SYSTEM, ERROR, "All sensors failed despite recovery, rebooting") \
+    X(SCD41_BUS_BUSY, SCD41, WARN, "SCD41 init skipped, I2C bus busy") \
+    X(SCD41_NOT_FOUND, SCD41, ERROR, "Could not find a valid SCD41 sensor, check wiring") \
+    X(SCD41_READY, SCD41, INFO, "SCD41 sensor initialized, %{periodic|low-power|single-shot} mode") \
+    X(SCD41_POWER_DOWN_FAILED, SCD41, WARN, "SCD41 power down failed") \
+    X(SCD41_START_FAILED, SCD41, ERROR, "Failed to start SCD41 measurement") \
+    X(SCD41_REINIT_FAILED, SCD41, WARN, "SCD41 reinit failed") \
+    X(SCD41_ALTITUDE_REJECTED, SCD41, WARN, "SCD41 altitude rejected") \
+    X(SCD41_RECALIBRATED, SCD41, INFO, "SCD41 recalibrated to %u ppm, correction %d ppm") \
+    X(SCD41_FRC_FAILED, SCD41, WARN, "SCD41 forced recalibration failed") \
+    X(SCD41_MODE, SCD41, INFO, "SCD41 switched to %{periodic|low-power|single-shot} mode") \
+    X(SCD41_PRESSURE_REJECTED, SCD41, WARN, "SCD41 ambient pressure rejected") \
+    X(SCD41_OVERDUE, SCD41, WARN, "SCD41 sample overdue, restarting measurement") \
+    X(SCD41_READS_FAILING, SCD41, WARN, "SCD41 reads keep failing, restarting measurement") \
+    X(SGP30_BUS_BUSY, SGP30, WARN, "SGP30 init skipped, I2C bus busy") \
+    X(SGP30_NOT_FOUND, SGP30, ERROR, "SGP30 sensor not found") \
+    X(SGP30_READY, SGP30, INFO, "SGP30 sensor found") \
+    X(SGP30_NO_BASELINE, SGP30, INFO, "SGP30 has no saved baseline, 12 hour burn-in") \
+    X(SGP30_BASELINE, SGP30, INFO, "SGP30 baseline %{restore failed|restored}") \
+    X(SGP30_MEASURE_FAILED, SGP30, WARN, "SGP30 measurement failed") \
+    X(PMS7003_READY, PMS7003, INFO, "PMS7003 sensor initialized") \
+    X(HEALTH_RECOVERY, HEALTH, WARN, "Sensor %{scd41|sgp30|pms7003} recovery: %{none|retry|soft reset|power cycle|bus recovery|exhausted}") \
+    X(HEALTH_STATE, HEALTH, INFO, "Sensor %{scd41|sgp30|pms7003}: %{ok|degraded|recovering|failed}") \
+    X(I2C_CLEARED, I2C, WARN, "I2C bus cleared") \
+    X(WIFI_CONNECTING, WIFI, INFO, "Connecting to WiFi") \
+    X(WIFI_RETRY, WIFI, INFO, "WiFi retry in %u s") \
+    X(WIFI_CONNECTED, WIFI, INFO, "Connected to WiFi, IP %i in %u ms") \
+    X(WIFI_TIMEOUT, WIFI, WARN, "WiFi connection timed out") \
+    X(WIFI_LOST, WIFI, WARN, "WiFi connection lost") \
+    X(MQTT_NO_WIFI, MQTT, WARN, "Cannot initialize MQTT, WiFi not connected") \
+    X(MQTT_CONNECTED, MQTT, INFO, "MQTT connected in %u ms") \
+    X(MQTT_CONNECT_FAILED, MQTT, WARN, "MQTT connection failed, retry in %u s") \
+    X(MQTT_LOST, MQTT, WARN, "MQTT connection lost, will retry later") \
+    X(MQTT_DISCOVERY, MQTT, INFO, "Home Assistant discovery %{incomplete|published}") \
+    X(MQTT_STATE_TRUNCATED, MQTT, ERROR, "MQTT state document truncated") \
+    X(MQTT_STATS_TRUNCATED, MQTT, ERROR, "MQTT statistics document truncated") \
+    X(MQTT_UPLOAD_TIMEOUT, MQTT, WARN, "Upload timed out") \
+    X(MQTT_LOG_DUMP, MQTT, INFO, "Log dump requested, %u records") \
+    X(STORE_MOUNT_FAILED, STORE, ERROR, "LittleFS mount failed, offline buffering disabled") \
+    X(STORE_CREATE_FAILED, STORE, ERROR, "Could not create telemetry store") \
+    X(STORE_READY, STORE, INFO, "Telemetry store ready, backlog %u") \
+    X(POWER_WAKE, POWER, INFO, "Duty cycle %u (%{cold start|timer wake}), %u samples waiting") \
+    X(POWER_SLEEP, POWER, INFO, "Awake %u ms, sleeping %u s") \
+    X(POWER_SAMPLE_INCOMPLETE, POWER, WARN, "Duty cycle sample incomplete") \
+    X(DISPLAY_STATE, DISPLAY, INFO, "OLED turned %{off|on}") \
+    X(DISPLAY_TIMEOUT, DISPLAY, INFO, "OLED auto shutoff") \
+    X(REPORT_METRIC, REPORT, INFO, "%m") \
+    X(BUS_SUBSCRIBERS_FULL, SYSTEM, ERROR, "Data bus subscriber table full, %u subscribers") \
+    X(DISPLAY_INIT_FAILED, DISPLAY, ERROR, "SSD1306 OLED allocation failed")
+
+#define LOG_MODULE_ID(id, name) LOG_MODULE_##id,
+enum LogModule : uint8_t {
+    LOG_MODULES(LOG_MODULE_ID)
+    LOG_MODULE_COUNT
+};
+#undef LOG_MODULE_ID
+
+#define LOG_EVENT_ID(id, module, level, format) EVENT_##id,
+enum LogEvent : uint16_t {
+    LOG_EVENTS(LOG_EVENT_ID)
+    EVENT_COUNT
+};
+#undef LOG_EVENT_ID
+
+#define LOG_EVENT_MODULE_OF(id, module, level, format) LOG_MODULE_##module,
+static constexpr uint8_t LOG_EVENT_MODULE[EVENT_COUNT] = {LOG_EVENTS(LOG_EVENT_MODULE_OF)};
+#undef LOG_EVENT_MODULE_OF
+
+#define LOG_EVENT_LEVEL_OF(id, module, level, format) LOG_LEVEL_##level,
+static constexpr uint8_t LOG_EVENT_LEVEL[EVENT_COUNT] = {LOG_EVENTS(LOG_EVENT_LEVEL_OF)};
+#undef LOG_EVENT_LEVEL_OF
+
+struct LogRecord {
+    uint32_t timestamp;  // millis()
+    uint16_t event;
+    uint8_t argc;
+    uint8_t reserved;
+    int32_t args[LOG_MAX_ARGS];
+};
+
+// Serial and MQTT frame: sync bytes, timestamp, event, argc, the arguments
+// (all little-endian) and a CRC-8 over everything after the sync bytes
+#define LOG_FRAME_SYNC0 0x1E
+#define LOG_FRAME_SYNC1 0xA5
+#define LOG_FRAME_MAX (2 + 4 + 2 + 1 + 4 * LOG_MAX_ARGS + 1)
+
+struct EventLogStats {
+    uint32_t overwritten;   // Lost before serial output caught up
+    uint32_t bytesOut;
+    uint32_t deferred;      // Drain passes cut short by a full transmit buffer
+};
+
+#define LOG_EVENT(event, ...) \
+    do { \
+        if (EventLog::enabled(EVENT_##event)) { \
+            EventLog::write(EVENT_##event, ##__VA_ARGS__); \
+        } \
+    } while (0)
+
+// Flight recorder for firmware events. Any task may write: a record claims
+// its slot with one atomic increment and is published through the slot's
+// sequence number, so writers never block or take a lock. The oldest
+// records are overwritten when the ring is full. Serial output happens
+// later on the draining worker, a frame at a time and only as far as the
+// UART transmit buffer has room.
+//
+// The ring sits in memory that a software reset, panic or watchdog reset
+// leaves alone, so after a crash the records leading up to it can still be
+// read over MQTT. Power loss and deep sleep clear it.
+class EventLog {
+private:
+    struct Slot {
+        std::atomic<uint32_t> sequence;  // Record number + 1 once complete, 0 while being written
+        std::atomic<uint32_t> words[sizeof(LogRecord) / sizeof(uint32_t)];
+    };
+
+    static Slot slots[LOG_RING_SIZE];
+    static std::atomic<uint32_t> head;  // Next record number
+    static uint32_t magic;
+    static uint32_t bootHead;           // First record written since this boot
+    static std::atomic<uint8_t> levels[LOG_MODULE_COUNT];
+    static std::atomic<bool> wakePending;
+    static void (*wakeHandler)();
+
+    static uint32_t serialCursor;
+    static uint8_t pendingOutput[LOG_LINE_SIZE];  // Frame or line the UART has not taken yet
+    static size_t pendingLength, pendingOffset;
+    static EventLogStats stats;
+
+    static void append(LogEvent event, uint8_t argc, int32_t a, int32_t b, int32_t c);
+
+public:
+    // Keeps the records of the previous boot if the ring survived the reset.
+    // wake is called from the writing task when output is due.
+    static void begin(void (*wake)());
+
+    static inline bool enabled(LogEvent event) {
+        return LOG_EVENT_LEVEL[event] <= levels[LOG_EVENT_MODULE[event]].load(std::memory_order_relaxed);
+    }
+
+    static void write(LogEvent event);
+    static void write(LogEvent event, int32_t a);
+    static void write(LogEvent event, int32_t a, int32_t b);
+    static void write(LogEvent event, int32_t a, int32_t b, int32_t c);
+
+    // Readers keep their own cursor; records already overwritten are
+    // skipped and added to skipped. Returns false when nothing is ready.
+    static bool read(uint32_t& cursor, LogRecord& out, uint32_t& skipped);
+    static uint32_t oldest();
+    static uint32_t newest();  // One past the last record written
+
+    static size_t encode(const LogRecord& record, uint8_t* out);  // Binary frame, at most LOG_FRAME_MAX bytes
+    static size_t format(const LogRecord& record, char* out, size_t capacity);
+
+    // Writes what fits into the UART transmit buffer; true if more is waiting
+    static bool drain();
+    static void flush(unsigned long timeoutMillis);  // Blocking drain, before a reset or deep sleep
+
+    static void setLevel(LogModule module, LogLevel level);
+    static LogLevel getLevel(LogModule module);
+    static const char* moduleName(LogModule module);
+    static const char* levelName(LogLevel level);
+    static bool parseModule(const char* name, size_t length, LogModule& out);
+    static bool parseLevel(const char* name, LogLevel& out);
+    static const EventLogStats& getStats();
+    static void printStats();
+};
+
+#endif // EVENT_LOG_H
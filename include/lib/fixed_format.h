@@ -0,0 +1,60 @@
+#ifndef FIXED_FORMAT_H
+#define FIXED_FORMAT_H
+
+#include <Arduino.h>
+
+// Formats value with a fixed number of decimals into out and returns the
+// length. Unlike printf's float path this never touches the heap. NaN and
+// infinity are written as "nan".
+inline size_t formatFixed(char* out, size_t capacity, float value, uint8_t decimals) {
+    if (capacity == 0) {
+        return 0;
+    }
+    char text[32];
+    size_t len = 0;
+
+    if (isnan(value) || isinf(value)) {
+        memcpy(text, "nan", 3);
+        len = 3;
+    } else {
+        unsigned long long scale = 1;
+        for (uint8_t i = 0; i < decimals; i++) {
+            scale *= 10;
+        }
+
+        double scaled = (double)value * scale;
+        bool negative = scaled < 0;
+        unsigned long long magnitude = (unsigned long long)((negative ? -scaled : scaled) + 0.5);
+        if (negative && magnitude != 0) {
+            text[len++] = '-';
+        }
+
+        char digits[20];
+        uint8_t count = 0;
+        unsigned long long whole = magnitude / scale;
+        do {
+            digits[count++] = '0' + (whole % 10);
+            whole /= 10;
+        } while (whole > 0);
+        while (count > 0) {
+            text[len++] = digits[--count];
+        }
+
+        if (decimals > 0) {
+            text[len++] = '.';
+            unsigned long long fraction = magnitude % scale;
+            for (unsigned long long digit = scale / 10; digit > 0; digit /= 10) {
+                text[len++] = '0' + (fraction / digit) % 10;
+            }
+        }
+    }
+
+    if (len >= capacity) {
+        len = capacity - 1;
+    }
+    memcpy(out, text, len);
+    out[len] = '\0';
+    return len;
+}
+
+#endif // FIXED_FORMAT_H
@@ -0,0 +1,33 @@
+#ifndef HEAP_MONITOR_H
+#define HEAP_MONITOR_H
+
+#include <Arduino.h>
+#include <esp_heap_caps.h>
+
+#define HEAP_SAMPLE_INTERVAL 60000     // How often heap figures are refreshed
+#define HEAP_CRITICAL_BLOCK 8192       // Reboot once the largest free block drops below this
+
+struct HeapStats {
+    uint32_t freeBytes;
+    uint32_t largestBlock;         // Largest single allocation currently possible
+    uint32_t minimumFree;          // Lowest free heap since boot
+    uint32_t lowestLargestBlock;   // Lowest largestBlock seen since boot
+    uint8_t fragmentation;         // Percent of free heap outside the largest block
+};
+
+// Tracks free heap and fragmentation of the internal 8-bit capable heap, so
+// long-run degradation shows up in telemetry instead of being hidden by
+// periodic reboots.
+class HeapMonitor {
+private:
+    static HeapStats stats;
+
+public:
+    static void begin();
+    static void sample();
+    static const HeapStats& getStats();
+    static bool isCritical();
+    static void printStats();
+};
+
+#endif // HEAP_MONITOR_H
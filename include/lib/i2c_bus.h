@@ -0,0 +1,61 @@
+#ifndef I2C_BUS_H
+#define I2C_BUS_H
+
+#include <Arduino.h>
+#include <Wire.h>
+#include <atomic>
+
+#define I2C_SDA_PIN SDA
+#define I2C_SCL_PIN SCL
+#define I2C_BUS_CLOCK 400000     // Fast mode; every device on the bus supports it
+#define I2C_ACQUIRE_TIMEOUT 50   // ms a sensor waits for the bus before giving up
+#define I2C_WIRE_TIMEOUT 50      // ms before Wire abandons a stretched transaction
+
+// Devices sharing Wire
+enum I2CDevice : uint8_t {
+    I2C_DEVICE_SGP30,
+    I2C_DEVICE_SCD41,
+    I2C_DEVICE_OLED,
+    I2C_DEVICE_COUNT
+};
+
+struct I2CStats {
+    uint32_t transactions;
+    uint32_t errors;
+    uint32_t busyRejects;      // acquire() timed out or yielded to a more urgent device
+    uint32_t recoveries;       // Bus clears triggered by this device
+    uint64_t totalMicros;      // Bus held; 32 bits wrap within two days
+    uint32_t maxMicros;
+};
+
+// Owns the shared I2C bus. Drivers bracket each library call with
+// acquire()/release(); the bus is handed to the most urgent waiting device
+// first, so the display only gets it when no sensor is waiting.
+class I2CBus {
+private:
+    struct DeviceInfo {
+        const char* name;
+        uint8_t priority;  // Lower is more urgent
+        uint32_t clock;
+    };
+
+    static const DeviceInfo devices[I2C_DEVICE_COUNT];
+    static I2CStats stats[I2C_DEVICE_COUNT];
+    static std::atomic<uint8_t> waiting[I2C_DEVICE_COUNT];
+    static SemaphoreHandle_t mutex;
+    static uint32_t clock;
+    static unsigned long startedAt;
+
+    static bool moreUrgentWaiting(I2CDevice device);
+    static bool busStuck();
+
+public:
+    static void begin();
+    static bool acquire(I2CDevice device, uint32_t timeoutMs = I2C_ACQUIRE_TIMEOUT);
+    static void release(I2CDevice device, bool ok);
+    static void recoverBus();
+    static const I2CStats& getStats(I2CDevice device);
+    static void printStats();
+};
+
+#endif // I2C_BUS_H
@@ -0,0 +1,37 @@
+#ifndef JSON_WRITER_H
+#define JSON_WRITER_H
+
+#include <Arduino.h>
+#include "include/lib/fixed_format.h"
+
+// Minimal JSON object writer over a caller-supplied buffer. Never allocates;
+// if the buffer is too small the output is truncated and ok() returns false.
+class JsonWriter {
+private:
+    char* buffer;
+    size_t capacity;
+    size_t len;
+    bool overflow;
+    bool first;
+
+    void append(char c);
+    void append(const char* text);
+    void appendUnsigned(unsigned long long value);
+    void appendKey(const char* key);
+
+public:
+    JsonWriter(char* buffer, size_t capacity);
+
+    void beginObject();
+    void beginObject(const char* key);
+    void endObject();
+    void add(const char* key, long value);
+    void add(const char* key, float value, uint8_t decimals);
+    void add(const char* key, const char* value);
+
+    const char* c_str() const;
+    size_t length() const;
+    bool ok() const;
+};
+
+#endif // JSON_WRITER_H
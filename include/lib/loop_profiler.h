@@ -0,0 +1,34 @@
+#ifndef LOOP_PROFILER_H
+#define LOOP_PROFILER_H
+
+#include <Arduino.h>
+
+#define LOOP_PROFILER_REPORT_INTERVAL 3600000  // Report loop statistics every hour
+#define LOOP_PROFILER_BUCKETS 24               // log2(us) buckets, covers up to ~16 s
+
+// Measures the cost of each acquisition worker iteration so performance changes
+// can be compared on the device itself. Latencies go into a log2 histogram,
+// which keeps the profiler O(1) per iteration and allocation free.
+class LoopProfiler {
+private:
+    static uint32_t buckets[LOOP_PROFILER_BUCKETS];
+    static uint32_t iterations;
+    static uint32_t maxMicros;
+    static uint64_t totalMicros;
+    static uint32_t heapShrinks;      // Iterations that ended with less free heap
+    static uint32_t iterationStart;
+    static uint32_t heapAtStart;
+    static unsigned long windowStart;
+
+    static uint8_t bucketFor(uint32_t micros);
+    static void reset(unsigned long now);
+
+public:
+    static void begin();
+    static void beginIteration();
+    static void endIteration();
+    static uint32_t percentile(uint8_t pct);
+    static void report();
+};
+
+#endif // LOOP_PROFILER_H
@@ -0,0 +1,102 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <Arduino.h>
+#include "include/lib/sensor_snapshot.h"
+#include "include/lib/sample_record.h"
+
+// Every metric the station reports, in DataTopic order. Each consumer
+// expands the columns it needs, so discovery payloads, topics, display and
+// log formats are string literals assembled by the compiler and kept in
+// flash. Values travel as the fixed-point integers of SampleRecord and are
+// converted with the scale column only when shown or published.
+//
+//   id        DataTopic suffix
+//   key       JSON field and Home Assistant object id
+//   label     Home Assistant entity name
+//   short     OLED and serial log label
+//   unit      Home Assistant unit (UTF-8)
+//   ascii     Unit as the OLED font draws it
+//   decimals  Published and displayed precision
+//   row       OLED line, -1 if not shown
+//   rowLabel  OLED label when consecutive metrics share a row, "" otherwise
+//   kind      NUMBER, or TEXT for an enum stored as its value and reported by name
+//   report    FILTERED to report on change through a deadband, UNFILTERED with every report
+//   field     SensorSnapshot member
+//   scale     SAMPLE_SCALE_* suffix from the field's units to unit
+//   ha        Home Assistant device class, HA_CLASS("...") or HA_NO_CLASS
+#define METRIC_TABLE(X) \
+    X(TEMPERATURE, "temperature", "Temperature", "Temp", "°F", "F", 2, 0, "", NUMBER, FILTERED, sample.temperature, CENTI_CELSIUS_F, HA_CLASS("temperature")) \
+    X(HUMIDITY, "humidity", "Humidity", "Humidity", "%", "%", 2, 1, "", NUMBER, FILTERED, sample.humidity, CENTI, HA_CLASS("humidity")) \
+    X(CO2, "co2", "CO2", "CO2", "ppm", "ppm", 0, 2, "", NUMBER, FILTERED, sample.co2, UNIT, HA_CLASS("carbon_dioxide")) \
+    X(PM1_0, "pm1_0", "PM1.0", "PM1.0", "µg/m³", "ug", 0, 3, "PM", NUMBER, FILTERED, sample.pm1_0, UNIT, HA_CLASS("pm1")) \
+    X(PM2_5, "pm2_5", "PM2.5", "PM2.5", "µg/m³", "ug", 0, 3, "PM", NUMBER, FILTERED, sample.pm2_5, UNIT, HA_CLASS("pm25")) \
+    X(PM10, "pm10", "PM10", "PM10", "µg/m³", "ug", 0, 3, "PM", NUMBER, FILTERED, sample.pm10, UNIT, HA_CLASS("pm10")) \
+    X(AQI, "aqi", "AQI", "AQI", "AQI", "", 0, 4, "", NUMBER, FILTERED, sample.aqi, UNIT, HA_NO_CLASS) \
+    X(AQI_24H, "aqi_24h", "AQI 24h", "AQI 24h", "AQI", "", 0, -1, "", NUMBER, UNFILTERED, aqi24h, UNIT, HA_NO_CLASS) \
+    X(AQI_POLLUTANT, "aqi_pollutant", "AQI Pollutant", "Pollutant", "", "", 0, -1, "", TEXT, UNFILTERED, sample.pollutant, UNIT, HA_NO_CLASS) \
+    X(TVOC, "tvoc", "TVOC", "TVOC", "ppb", "ppb", 0, 5, "", NUMBER, FILTERED, sample.tvoc, UNIT, HA_CLASS("volatile_organic_compounds_parts")) \
+    X(H2, "h2", "H2", "H2", "res", "res", 0, 6, "", NUMBER, FILTERED, sample.h2, UNIT, HA_NO_CLASS) \
+    X(ETHANOL, "ethanol", "Ethanol", "Ethanol", "res", "res", 0, 7, "", NUMBER, FILTERED, sample.ethanol, UNIT, HA_NO_CLASS)
+
+#define HA_CLASS(deviceClass) ",\"dev_cla\":\"" deviceClass "\""
+#define HA_NO_CLASS ""
+
+#define METRIC_TOPIC(id, key, label, shortLabel, unit, ascii, decimals, row, rowLabel, kind, report, field, scale, ha) TOPIC_##id,
+enum DataTopic : uint8_t {
+    METRIC_TABLE(METRIC_TOPIC)
+    TOPIC_COUNT
+};
+#undef METRIC_TOPIC
+
+// Deadband-filtered metrics, in table order
+#define METRIC_IF_FILTERED(...) __VA_ARGS__
+#define METRIC_IF_UNFILTERED(...)
+#define METRIC_REPORT(id, key, label, shortLabel, unit, ascii, decimals, row, rowLabel, kind, report, field, scale, ha) \
+    METRIC_IF_##report(REPORT_##id,)
+enum ReportMetric : uint8_t {
+    METRIC_TABLE(METRIC_REPORT)
+    REPORT_METRIC_COUNT
+};
+#undef METRIC_REPORT
+
+#define REPORT_NONE REPORT_METRIC_COUNT
+
+enum MetricKind : uint8_t {
+    METRIC_NUMBER,
+    METRIC_TEXT,
+};
+
+struct MetricDescriptor {
+    const char* key;
+    const char* label;        // Short label for the OLED and serial log
+    const char* unit;
+    const char* displayUnit;
+    uint8_t decimals;
+    int8_t displayRow;
+    const char* rowLabel;     // Set when consecutive metrics share the row
+    MetricKind kind;
+    uint8_t report;           // ReportMetric, REPORT_NONE if not filtered
+    float scale;              // Fixed-point value * scale + offset = value in unit
+    float offset;
+};
+
+extern const MetricDescriptor METRICS[TOPIC_COUNT];
+
+#define METRIC_DISPLAY_BIT(id, key, label, shortLabel, unit, ascii, decimals, row, rowLabel, kind, report, field, scale, ha) \
+    | ((row) >= 0 ? 1U << TOPIC_##id : 0U)
+static constexpr uint16_t METRIC_DISPLAY_TOPICS = 0U METRIC_TABLE(METRIC_DISPLAY_BIT);
+#undef METRIC_DISPLAY_BIT
+
+inline float metricFromFixed(DataTopic topic, int32_t value) {
+    return fixedToFloat(value, METRICS[topic].scale, METRICS[topic].offset);
+}
+
+int32_t metricFixed(const SensorSnapshot& snapshot, DataTopic topic);  // In SampleRecord units
+float metricValue(const SensorSnapshot& snapshot, DataTopic topic);    // In the metric's unit
+// Value at the metric's precision, or the name for TEXT metrics
+size_t formatMetric(char* out, size_t capacity, DataTopic topic, float value);
+// "label: value unit", with the display unit when forDisplay is set
+size_t formatMetricLine(char* out, size_t capacity, DataTopic topic, float value, bool forDisplay);
+
+#endif // METRICS_H
@@ -2,25 +2,108 @@
 #define MQTT_CLIENT_H
 
 #include <Arduino.h>
-#include <PubSubClient.h>
 #include <WiFi.h>
 #include "secrets.h"
+#include "include/lib/sensor_snapshot.h"
+#include "include/lib/json_writer.h"
+#include "include/lib/payload_encoder.h"
+#include "include/lib/report_filter.h"
+#include "include/lib/telemetry_store.h"
+#include "include/lib/aggregator.h"
+#include "include/lib/heap_monitor.h"
+#include "include/lib/mqtt_session.h"
+#include "include/lib/sensor_health.h"
+#include "include/lib/metrics.h"
 
 #define MQTT_PORT 1883
 #define MQTT_CLIENT_ID "ESP32_AirQuality"
+#define MQTT_SOCKET_TIMEOUT 2  // Seconds; bounds how long a connect can block the loop
+#define MQTT_KEEPALIVE 15      // Seconds
+#define MQTT_STATE_QOS 1       // State and backfill documents wait for a PUBACK; the rest is QoS0
+
+// Home Assistant discovery. Configs and availability are retained and only
+// republished when Home Assistant announces itself on the birth topic.
+#define MQTT_DEVICE_ID "esp32_airquality"
+#define MQTT_DEVICE_NAME "ESP32 Air Quality"
+#define MQTT_AVAILABILITY_TOPIC "homeassistant/sensor/esp32_airquality/availability"
+#define MQTT_BIRTH_TOPIC "homeassistant/status"
+
+// Batched mode publishes one state document per interval, encoded as
+// PAYLOAD_FORMAT; Home Assistant picks each entity's field out of it with a
+// value_template. Set to 0 for the legacy one-topic-per-metric payloads.
+#ifndef MQTT_BATCHED_STATE
+#define MQTT_BATCHED_STATE 1
+#endif
+#define MQTT_STATE_TOPIC "homeassistant/sensor/esp32_airquality/state"
+#define MQTT_STATE_BUFFER_SIZE 320
+#define MQTT_BACKFILL_TOPIC "homeassistant/sensor/esp32_airquality/backfill"
+#define MQTT_STATS_TOPIC_PREFIX "homeassistant/sensor/esp32_airquality/stats/"
+#define MQTT_STATS_BUFFER_SIZE 768
+#define MQTT_HEALTH_TOPIC "homeassistant/sensor/esp32_airquality/health"
+#define MQTT_DIAGNOSTICS_TOPIC "homeassistant/sensor/esp32_airquality/diagnostics"
+#define MQTT_LEGACY_TOPIC(key) "homeassistant/sensor/esp32_" key "/state"
+
+// Any message on the request topic dumps the event log ring as binary frames
+// on the log topic, for tools/log_decode.py
+#define MQTT_LOG_TOPIC "homeassistant/sensor/esp32_airquality/log"
+#define MQTT_LOG_REQUEST_TOPIC "homeassistant/sensor/esp32_airquality/log/get"
+
+struct MQTTStats {
+    uint32_t publishes;
+    uint32_t failures;
+    uint32_t bytes;            // Topic + payload bytes handed to the client
+    uint32_t maxLatencyMicros;
+    uint64_t totalLatencyMicros;
+};
+
+struct TaskHealth {
+    const char* name;
+    uint32_t stackFree;
+};
 
 class MQTTClient {
 private:
     static WiFiClient espClient;
-    static PubSubClient client;
+    static MQTTSession session;
     static bool initialized;
+    static char stateBuffer[MQTT_STATE_BUFFER_SIZE];
+    static char statsBuffer[MQTT_STATS_BUFFER_SIZE];
+    static MQTTStats stats;
+    static uint32_t stateSequence;
+    static bool discoveryPublished;  // Kept through deep sleep
+    static bool discoveryRequested;
+    static bool logDumpRequested;
+    static uint32_t logDumpCursor, logDumpEnd;  // Event log records still to send
+
+    static bool publishDiscovery();
+    static bool publishConfig(const char* topic, const char* payload);
+    static void onMessage(const char* topic, const uint8_t* payload, size_t length);
+    static void publishLogChunk();
+#if !MQTT_BATCHED_STATE
+    static bool publishValue(DataTopic topic, float value);
+#endif
 
 public:
     static bool init();
     static bool isConnected();
-    static bool publish(const char* topic, const String& payload);
+    static bool publish(const char* topic, const char* payload);
+    static bool publish(const char* topic, const uint8_t* payload, size_t length, uint8_t qos = 0, bool retained = false,
+                        uint32_t sequence = 0);
+    // The batched document always carries every field; legacy mode only
+    // publishes the topics selected in metrics
+    static bool publishState(const SensorSnapshot& snapshot, uint32_t timestamp, uint16_t metrics = REPORT_ALL);
+    static bool publishBackfill(const StoredSample& sample, uint32_t timestamp, bool uptimeOnly);
+    static bool publishAggregates(const AggregateReport& report);
+    static bool publishHealth(const HeapStats& heap, const TaskHealth* tasks, uint8_t count);
+    static bool publishDiagnostics(const SensorHealthInfo* sensors, uint8_t count);
+    static bool publishAvailability(bool online);
+    static const MQTTStats& getStats();
+    static void printStats();
     static void disconnect();
     static void loop();
+    static bool hasPendingWrites();
+    static uint8_t inFlight();  // QoS1 publishes still waiting for their PUBACK
+    static uint32_t backfillAcked();  // Highest stored sequence the broker has confirmed
 };
 
 #endif // MQTT_CLIENT_H
@@ -0,0 +1,123 @@
+#ifndef MQTT_SESSION_H
+#define MQTT_SESSION_H
+
+#include <Arduino.h>
+#include <Client.h>
+
+#define MQTT_TX_BUFFER_SIZE 4096       // Bytes queued but not yet accepted by the socket
+#define MQTT_RX_BUFFER_SIZE 256        // Larger inbound packets are skipped, QoS1 ones still acknowledged
+#define MQTT_INFLIGHT_WINDOW 4         // Unacknowledged QoS1 publishes
+#define MQTT_INFLIGHT_SIZE 512         // Largest QoS1 packet, kept until its PUBACK
+#define MQTT_WRITE_CHUNK 512           // Bytes offered to the socket per write
+#define MQTT_WRITE_STALL_TIMEOUT 10000 // Drop the connection if the socket takes nothing for this long
+#define MQTT_TOPIC_MAX 128             // Longest inbound topic passed to the callback
+
+struct MQTTSessionStats {
+    uint32_t acked;            // QoS1 publishes confirmed by the broker
+    uint32_t retransmitted;    // Resent with DUP after a reconnect
+    uint32_t windowFull;       // QoS1 publishes refused because the window was full
+    uint32_t bufferFull;       // Publishes refused for lack of send buffer space
+    uint32_t stalls;           // Connections dropped because writes made no progress
+    uint32_t keepaliveTimeouts;
+    uint32_t maxAckMillis;
+    uint64_t totalAckMillis;
+    uint32_t txHighWater;      // Most bytes ever waiting in the send buffer
+};
+
+// Minimal MQTT 3.1.1 client over an Arduino Client. publish() only queues
+// the packet; loop() hands queued bytes to the socket without blocking,
+// reads acknowledgements and keeps the connection alive. QoS1 packets stay
+// in a small window until their PUBACK and are resent after a reconnect,
+// which uses a persistent session so the broker keeps its side too.
+class MQTTSession {
+public:
+    typedef void (*Callback)(const char* topic, const uint8_t* payload, size_t length);
+
+private:
+    struct InFlight {
+        uint16_t packetId;     // 0 when the slot is free
+        uint16_t length;
+        unsigned long sentAt;
+        uint32_t sequence;     // Caller's tag, 0 for none
+        uint32_t order;        // Send order, so a reconnect resends oldest first
+        uint8_t packet[MQTT_INFLIGHT_SIZE];
+    };
+
+    enum RxState : uint8_t { RX_HEADER, RX_LENGTH, RX_BODY };
+
+    Client& client;
+    int socket;                // lwIP descriptor for non-blocking sends, -1 to use client.write()
+    uint16_t keepAlive;        // Seconds
+    unsigned long socketTimeout;
+    bool active;
+    uint16_t nextPacketId;
+    uint32_t sendCount;        // QoS1 publishes queued, numbers InFlight::order
+
+    unsigned long lastSent;
+    unsigned long lastReceived;
+    unsigned long lastWriteProgress;
+    bool pingOutstanding;
+    int16_t connackCode;       // -1 until a CONNACK arrives
+
+    const char* willTopic;     // Sent with every CONNECT; nullptr for none
+    const char* willPayload;
+    bool willRetained;
+    Callback callback;
+
+    uint8_t tx[MQTT_TX_BUFFER_SIZE];
+    size_t txHead, txTail;
+
+    uint8_t rx[MQTT_RX_BUFFER_SIZE];
+    RxState rxState;
+    uint8_t rxHeader;
+    uint32_t rxRemaining;
+    uint32_t rxMultiplier;
+    uint32_t rxLength;
+
+    InFlight inflight[MQTT_INFLIGHT_WINDOW];
+    uint32_t ackedSequence;    // Highest tag whose PUBACK has arrived
+    MQTTSessionStats stats;
+
+    bool reserve(size_t length);
+    void append(const uint8_t* data, size_t length);
+    void appendString(const char* text);
+    void appendPacket(const uint8_t* data, size_t length);
+    static size_t encodeLength(uint8_t* out, size_t length);
+    int writeSome(const uint8_t* data, size_t length);
+    void writePending();
+    void receive();
+    void receiveByte(uint8_t byte);
+    void handlePacket(uint8_t header, const uint8_t* body, size_t length);
+    void acknowledgePublish(uint8_t header, const uint8_t* body, size_t length);
+    void resendInFlight();
+    void drop();
+
+public:
+    explicit MQTTSession(Client& client);
+
+    void setKeepAlive(uint16_t seconds);
+    void setSocketTimeout(unsigned long millis);
+    void setSocket(int fd);
+    // The strings must outlive the session; the will is published at QoS1
+    void setWill(const char* topic, const char* payload, bool retained);
+    void setCallback(Callback handler);  // Runs inside loop() for each inbound PUBLISH
+
+    // Blocks for at most the socket timeout while waiting for the CONNACK
+    bool connect(const char* host, uint16_t port, const char* clientId, const char* user, const char* pass);
+    bool connected();
+    // A QoS1 publish can carry a nonzero sequence tag, reported back by
+    // acknowledgedSequence() once the broker has it
+    bool publish(const char* topic, const uint8_t* payload, size_t length, uint8_t qos = 0, bool retained = false,
+                 uint32_t sequence = 0);
+    bool subscribe(const char* topic, uint8_t qos = 0);  // The SUBACK is not tracked
+    bool loop();
+    bool flush(unsigned long timeoutMillis);  // Waits until the send buffer is empty
+    void disconnect();
+
+    bool hasPendingWrites() const;
+    uint8_t inFlight() const;
+    uint32_t acknowledgedSequence() const;
+    const MQTTSessionStats& getStats() const;
+};
+
+#endif // MQTT_SESSION_H
@@ -5,26 +5,54 @@
 #include <Adafruit_GFX.h>
 #include <Adafruit_SSD1306.h>
 #include "scheduler.h"  // Add this include for isOledOn()
+#include "include/lib/i2c_bus.h"
+#include "include/lib/fixed_format.h"
+#include "include/lib/data_bus.h"
 
 #define SCREEN_WIDTH 128
 #define SCREEN_HEIGHT 64
 #define OLED_RESET    -1  // Reset pin (not used)
 #define SCREEN_ADDRESS 0x3C  // Default I2C address for 0.96" OLED
 
+#define OLED_PAGES (SCREEN_HEIGHT / 8)  // One text line per SSD1306 page
+#define OLED_CHAR_WIDTH 6               // Default 5x7 font plus spacing
+#define OLED_COLUMNS (SCREEN_WIDTH / OLED_CHAR_WIDTH)
+#define OLED_I2C_CHUNK 32               // Bytes per I2C transaction, including the control byte
+
 class Scheduler;  // Forward declaration
 
 // Declare function instead of calling it directly
 extern bool isOledOn();
 
+struct OLEDStats {
+    uint32_t updates;
+    uint32_t cellsRedrawn;   // Characters whose glyph changed
+    uint32_t pagesFlushed;
+    uint32_t bytesSent;      // Commands and pixel data put on the I2C bus
+};
+
+// Retained-mode text display: update() reads the latest values off the data
+// bus and only redraws characters whose formatted value changed, and flush() pushes the dirty column span of one
+// page at a time so callers can spread a frame over several loop passes.
 class OLEDDisplay {
 private:
     static Adafruit_SSD1306 display;
+    static char lines[OLED_PAGES][OLED_COLUMNS];  // What is currently drawn
+    static uint8_t dirtyStart[OLED_PAGES];        // First dirty column, SCREEN_WIDTH when clean
+    static uint8_t dirtyEnd[OLED_PAGES];
+    static OLEDStats stats;
+
+    static void setLine(uint8_t row, const char* text);
+    static void command(uint8_t c);
+    static bool flushPage(uint8_t page);
 
 public:
     static void init();
-    static void update(float temperatureF, float humidity, int co2, 
-                      int pm1_0, int pm2_5, int pm10, int aqi, 
-                      float tvoc, float h2, float ethanol);
+    static void update();
+    static bool isDirty();
+    static bool flush();     // Sends one dirty page; true while more remain
+    static const OLEDStats& getStats();
+    static void printStats();
 };
 
 #endif // OLED_DISPLAY_H
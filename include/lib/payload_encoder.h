@@ -0,0 +1,58 @@
+#ifndef PAYLOAD_ENCODER_H
+#define PAYLOAD_ENCODER_H
+
+#include <Arduino.h>
+#include "include/lib/json_writer.h"
+
+#define PAYLOAD_FORMAT_JSON 0
+#define PAYLOAD_FORMAT_CBOR 1     // RFC 8949
+#define PAYLOAD_FORMAT_MSGPACK 2
+
+// Encoding of the state and backfill documents. Home Assistant's
+// value_templates only understand JSON; the binary formats are for
+// collectors that decode the payload themselves.
+#ifndef PAYLOAD_FORMAT
+#define PAYLOAD_FORMAT PAYLOAD_FORMAT_JSON
+#endif
+
+// Flat key/value document writer over a caller-supplied buffer. The same
+// calls produce JSON, CBOR or MessagePack depending on PAYLOAD_FORMAT. Never
+// allocates; if the buffer is too small ok() returns false.
+class PayloadEncoder {
+private:
+#if PAYLOAD_FORMAT == PAYLOAD_FORMAT_JSON
+    JsonWriter json;
+#else
+    uint8_t* buffer;
+    size_t capacity;
+    size_t len;
+    size_t mapStart;   // Offset of the map header, patched with the field count
+    uint8_t fields;
+    bool overflow;
+
+    void put(uint8_t byte);
+    void putBigEndian(uint64_t value, uint8_t bytes);
+    void putInteger(long value);
+    void putFloat(float value);
+    void putString(const char* text);
+#if PAYLOAD_FORMAT == PAYLOAD_FORMAT_CBOR
+    void putHeader(uint8_t major, uint64_t argument);
+#endif
+#endif
+
+public:
+    PayloadEncoder(char* buffer, size_t capacity);
+
+    void begin();
+    void end();
+    void add(const char* key, long value);
+    void add(const char* key, float value, uint8_t decimals);  // decimals only affect JSON
+    void add(const char* key, const char* value);
+
+    const uint8_t* data() const;
+    size_t length() const;
+    bool ok() const;
+    static const char* formatName();
+};
+
+#endif // PAYLOAD_ENCODER_H
@@ -0,0 +1,76 @@
+#ifndef POWER_MANAGER_H
+#define POWER_MANAGER_H
+
+#include <Arduino.h>
+#include "include/lib/telemetry_store.h"
+
+// Continuous keeps WiFi, the PMS7003 fan and the OLED powered. Duty-cycled
+// wakes once per DUTY_CYCLE_PERIOD, takes one sample from every sensor,
+// uploads every DUTY_UPLOAD_EVERY samples in a single short WiFi session and
+// spends the rest of the period in deep sleep.
+#define POWER_MODE_CONTINUOUS 0
+#define POWER_MODE_DUTY_CYCLED 1
+#ifndef POWER_MODE
+#define POWER_MODE POWER_MODE_CONTINUOUS
+#endif
+
+#define DUTY_CYCLE_PERIOD 300000      // One sample every 5 minutes
+#define DUTY_UPLOAD_EVERY 6           // Samples per WiFi session
+#define DUTY_RTC_SAMPLES 24           // Samples held in RTC memory; later ones go to flash
+#define DUTY_SAMPLE_TIMEOUT 45000     // Longest awake time for one sample
+#define DUTY_UPLOAD_TIMEOUT 20000     // Longest WiFi + MQTT session
+#define DUTY_SGP30_WARMUP 15000       // The SGP30 reports fixed values for 15 s after IAQinit
+#define DUTY_MIN_SLEEP 1000           // Shorter sleeps skip to the following cycle
+#define DUTY_MAX_UPLOAD_BACKOFF 8     // Most cycles between upload attempts after failures
+#define DUTY_CPU_FREQUENCY 80         // MHz while awake; WiFi needs at least 80
+
+// State that must survive deep sleep lives in RTC slow memory. It is
+// initialized on power-up and kept across timer wake-ups.
+#if POWER_MODE == POWER_MODE_DUTY_CYCLED
+#define RTC_STATE_ATTR RTC_DATA_ATTR
+#else
+#define RTC_STATE_ATTR
+#endif
+
+struct DutyCycleStats {
+    uint32_t cycles;
+    uint32_t uploads;
+    uint32_t uploadFailures;
+    uint32_t samplesSpilled;     // Written to flash because RTC memory was full
+    uint32_t lastAwakeMillis;
+    uint32_t maxAwakeMillis;
+};
+
+// Keeps the duty-cycle schedule, a clock that keeps running through deep
+// sleep, and the samples waiting for the next upload.
+class PowerManager {
+private:
+    static bool resumedFromSleep;
+    static uint32_t elapsedAtBoot;     // elapsedMillis() when this boot started
+    static uint32_t nextCycleAt;       // On the elapsedMillis() clock
+    static StoredSample samples[DUTY_RTC_SAMPLES];
+    static uint8_t sampleCount;
+    static uint32_t nextSequence;
+    static uint8_t samplesSinceUpload;
+    static uint8_t cyclesUntilUpload;
+    static uint8_t uploadFailureStreak;
+    static DutyCycleStats stats;
+
+public:
+    static void begin();
+    static bool resumed();                // Woken by the timer with RTC state intact
+    static unsigned long elapsedMillis(); // Like millis(), but counts time asleep
+
+    static void recordSample(const SensorSnapshot& snapshot);
+    static bool uploadDue();
+    static uint8_t pendingSamples();
+    static StoredSample pendingSample(uint8_t index, uint32_t now);  // Uptime stamps mapped to Unix time when possible
+    static void uploadFinished(bool ok, uint8_t delivered);
+
+    static void holdAwake(bool hold);     // Blocks automatic light sleep while a UART reply is due
+    [[noreturn]] static void sleep();     // Deep sleep until the next cycle
+    static const DutyCycleStats& getStats();
+    static void printStats();
+};
+
+#endif // POWER_MANAGER_H
@@ -0,0 +1,48 @@
+#ifndef REPORT_FILTER_H
+#define REPORT_FILTER_H
+
+#include <Arduino.h>
+#include "include/lib/metrics.h"
+
+// Report by exception: a metric is published when it moves outside its
+// deadband, no more often than its minimum interval, and at least once per
+// heartbeat. Set to 0 to publish everything every MQTT_UPDATE_INTERVAL.
+#define REPORT_ON_CHANGE 1
+#define REPORT_MIN_INTERVAL 10000  // Rate limit for bursts of changes
+#define REPORT_HEARTBEAT 600000    // Unchanged metrics are still reported every 10 minutes
+
+// ReportMetric comes from the FILTERED rows of METRIC_TABLE
+#define REPORT_ALL ((1U << REPORT_METRIC_COUNT) - 1)
+
+// A change must exceed the larger of the absolute and relative thresholds
+struct Deadband {
+    float absolute;
+    float relative;            // Fraction of the last reported value
+    unsigned long minInterval;
+    unsigned long maxInterval;
+};
+
+struct ReportFilterStats {
+    uint32_t checks;
+    uint32_t reports;
+    uint32_t metricReports[REPORT_METRIC_COUNT];
+};
+
+class ReportFilter {
+private:
+    static float lastValue[REPORT_METRIC_COUNT];
+    static unsigned long lastReported[REPORT_METRIC_COUNT];
+    static bool reported[REPORT_METRIC_COUNT];
+    static ReportFilterStats stats;
+
+public:
+    static void begin();
+    static uint16_t due(const SensorSnapshot& snapshot, unsigned long now);  // Bitmask of metrics to report
+    static void commit(const SensorSnapshot& snapshot, uint16_t metrics, unsigned long now);
+    static void invalidate();  // Report everything on the next check
+    static float value(const SensorSnapshot& snapshot, ReportMetric metric);
+    static const ReportFilterStats& getStats();
+    static void printStats();
+};
+
+#endif // REPORT_FILTER_H
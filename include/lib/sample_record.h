@@ -0,0 +1,45 @@
+#ifndef SAMPLE_RECORD_H
+#define SAMPLE_RECORD_H
+
+#include <stdint.h>
+
+// Sensors whose readings in a record were degraded or invalid
+#define SAMPLE_SUSPECT_SCD41 0x01
+#define SAMPLE_SUSPECT_SGP30 0x02
+#define SAMPLE_SUSPECT_PMS7003 0x04
+
+// Fixed-point to presentation units: value * scale + offset. Each expands to
+// the two constants, so it can be passed straight to fixedToFloat().
+#define SAMPLE_SCALE_UNIT 1.0f, 0.0f
+#define SAMPLE_SCALE_CENTI 0.01f, 0.0f
+#define SAMPLE_SCALE_CENTI_CELSIUS_F 0.018f, 32.0f  // 0.01 °C to °F
+
+// One complete reading in the units the sensors deliver. Everything from
+// the drivers to the flash log, the RTC ring and the payload encoders
+// carries these integers; conversion to floats and display units happens
+// only where a value is shown or published. No Arduino dependency,
+// so host code can include it directly.
+struct __attribute__((packed)) SampleRecord {
+    uint32_t timestamp;      // Unix time, or uptime seconds when uptime is set; 0 in live snapshots
+    int16_t temperature;     // 0.01 °C
+    uint16_t humidity;       // 0.01 %RH
+    uint16_t co2;            // ppm
+    uint16_t pm1_0;          // µg/m³, atmospheric environment
+    uint16_t pm2_5;
+    uint16_t pm10;
+    uint16_t tvoc;           // ppb
+    uint16_t h2;             // Raw SGP30 ticks
+    uint16_t ethanol;
+    uint16_t aqi : 10;       // NowCast AQI, 0-500
+    uint16_t pollutant : 2;  // Pollutant behind the AQI
+    uint16_t suspect : 3;    // SAMPLE_SUSPECT_* bits
+    uint16_t uptime : 1;
+};
+
+static_assert(sizeof(SampleRecord) == 24, "SampleRecord must stay 24 bytes");
+
+inline float fixedToFloat(int32_t value, float scale, float offset) {
+    return value * scale + offset;
+}
+
+#endif // SAMPLE_RECORD_H
@@ -8,36 +8,143 @@
 #include "include/lib/mqtt_client.h"
 #include "include/lib/oled_display.h"
 #include "include/lib/wifi_manager.h"
+#include "include/lib/loop_profiler.h"
+#include "include/lib/task_queue.h"
+#include "include/lib/sensor_snapshot.h"
+#include "include/lib/telemetry_store.h"
+#include "include/lib/aggregator.h"
+#include "include/lib/enhanced_aqi.h"
+#include "include/lib/i2c_bus.h"
+#include "include/lib/worker.h"
+#include "include/lib/spsc_ring.h"
+#include "include/lib/heap_monitor.h"
+#include "include/lib/report_filter.h"
+#include "include/lib/data_bus.h"
+#include "include/lib/console.h"
+#include "include/lib/sensor_health.h"
+#include "include/lib/power_manager.h"
+#include "include/lib/event_log.h"
+#include <atomic>
 
 #define OLED_TIMEOUT 300000  // 5 minutes timeout in milliseconds
 #define BOOT_BUTTON_PIN 0    // ESP32 Boot Button (GPIO 0)
-#define MQTT_RETRY_INTERVAL 5000      // 5 seconds between immediate retries
-#define MQTT_MAX_RETRIES 3            // Maximum number of immediate retries
-#define MQTT_LONG_RETRY_INTERVAL 900000 // 15 minutes between long retry attempts
-#define WIFI_CONNECT_TIMEOUT 15000    // 15 seconds timeout for WiFi connection
+#define MQTT_BACKOFF_INITIAL 5000     // First MQTT retry after a failed connect
+#define MQTT_LONG_RETRY_INTERVAL 900000 // Upper bound for MQTT retry backoff (15 minutes)
+#define CONNECTION_CHECK_INTERVAL 60000 // Connection state is polled at least this often
+#define SCHEDULED_REBOOT_INTERVAL 0        // Periodic reboot in ms; 0 disables it
+#define OLED_UPDATE_INTERVAL 500      // Display refresh period
+#define OLED_FLUSH_GAP 2              // Gap between page flushes so sensors can use the bus
+#define SERIAL_UPDATE_INTERVAL 10000  // Serial report period
+#define MQTT_UPDATE_INTERVAL 60000    // MQTT publish period without REPORT_ON_CHANGE
+#define REPORT_CHECK_INTERVAL 5000    // Change-of-value evaluation period, one SCD41 sample
+#define MQTT_LOOP_INTERVAL 5000       // Well inside the 15 s MQTT keepalive
+#define MQTT_FLUSH_INTERVAL 20        // Service period while queued bytes wait for the socket
+#define REBOOT_CHECK_INTERVAL 10000   // How often reboot conditions are evaluated
+#define SCD41_SAMPLE_INTERVAL 5000    // Fallback poll period; SCD41Sensor sets the real one per mode
+#define SGP30_SAMPLE_INTERVAL SGP30_MEASURE_INTERVAL  // Fixed 1 Hz grid for the baseline algorithm
+#define DIAGNOSTICS_INTERVAL 3600000  // Hourly driver statistics on serial
+#define AGGREGATE_ROLL_INTERVAL 60000 // Shortest aggregation window
+#define HEALTH_PUBLISH_INTERVAL 300000 // Heap and stack telemetry period
+#define DUTY_CHECK_INTERVAL 1000      // Duty-cycled mode: how often the cycle checks for a full sample
+#define DUTY_CLOCK_WAIT 3000          // Duty-cycled mode: time after connecting allowed for NTP before uploading
+
+// Worker tasks. Networking shares core 0 with the WiFi/LwIP stack; sampling
+// and the display run on core 1 where the Arduino loop used to be.
+#define ACQUISITION_CORE 1
+#define ACQUISITION_PRIORITY 3
+#define ACQUISITION_STACK 4096
+#define DISPLAY_CORE 1
+#define DISPLAY_PRIORITY 1
+#define DISPLAY_STACK 4096
+#define NETWORK_CORE 0
+#define NETWORK_PRIORITY 2
+#define NETWORK_STACK 8192
 
 void IRAM_ATTR handleButtonPress();
 
 class Scheduler {
 private:
-    static float temperatureF, humidity, tvoc, h2, ethanol;
-    static int co2, pm1_0, pm2_5, pm10, aqi;
-    static unsigned long lastOLEDUpdate, lastSerialUpdate, lastMQTTUpdate, oledTimer;
+    // Acquisition publishes every reading on the DataBus; the display and
+    // network workers only read it
+    static SpscRing<AggregateReport, 4> aggregateReports;  // Acquisition -> network
+
+    static Worker acquisition, display, network;
+    static int8_t scd41Task, sgp30Task, cycleTask; // Acquisition worker
+    static int8_t oledTimeoutTask, oledFlushTask, logDrainTask;  // Display worker
+    static int8_t displaySubscription;
+    static int8_t connectionTask, drainTask, mqttServiceTask, uploadTask;  // Network worker
     static bool oledOn;
     static volatile bool oledToggleRequested;
     static bool mqttEnabled;
-    static unsigned long lastConnectionAttempt;
-    static int connectionRetryCount;
+    static unsigned long nextMQTTAttempt;
+    static uint8_t mqttFailures;
     static bool wifiConnected;
+    static volatile bool connectionEventPending;
+    static uint32_t diagnosticsVersion;  // SensorHealth::version() last published
+    static unsigned long lastReboot;
+    static volatile bool cycleSampled;   // Duty-cycled mode: acquisition -> network
+    static uint8_t uploadQueued;         // RTC samples handed to MQTT this session
+    static bool statePublished;
+    static unsigned long connectedAt;
+
+    static void connectMQTT();
+    static void onConnectionEvent();
+    static void wakeAcquisition();
+    static void wakeNetwork();
+    static void wakeDisplay();
+    static void checkAndReboot();
+    static void performReboot();
+
+    // Per-wake-up hooks
+    static void pollAcquisition();
+    static void pollDisplay();
+    static void pollNetwork();
+
+    // Acquisition tasks
+    static void sampleSCD41();
+    static void sampleSGP30();
+    static void samplePMS7003();
+    static void startPMS7003Sample();
+    static void rollAggregates();
+    static void reportAcquisition();
+    static void requestPMS7003Sample();
+    static void completeCycle();
+
+    // Display tasks
+    static void refreshDisplay();
+    static void flushDisplay();
+    static void drainLog();
+    static void oledAutoShutoff();
+    static void handleOledToggle();
+    static void setOledState(bool on);
+    static void reportDisplay();
+
+    // Network tasks
+    static void logSerial();
+    static void publishMQTT();
+    static void storeSample(const SensorSnapshot& s);
+    static void drainBacklog();
+    static void publishAggregates();
+    static void serviceMQTT();
+    static void flushMQTTSoon();
+    static void manageConnection();
+    static void reportDiagnostics();
+    static void publishHealth();
+    static void publishDiagnostics();
+    static void startUpload();
+    static void uploadSamples();
+    static void abortUpload();
+    [[noreturn]] static void enterSleep();
 
-    static int calculateAQI(int pm2_5, int pm10);
-    static void updateSensors();
-    static void attemptConnection();
+    // Console commands
+    static bool scd41Command(const char* args);
+    static bool logCommand(const char* args);
 
 public:
     static void init();
     static void run();
     static void setOledToggleRequested();
+    static void wakeDisplayFromISR();
     static bool isOledOn();
 };
 
@@ -0,0 +1,112 @@
+#ifndef SENSOR_HEALTH_H
+#define SENSOR_HEALTH_H
+
+#include <Arduino.h>
+#include <atomic>
+#include "include/lib/data_bus.h"
+#include "include/lib/i2c_bus.h"
+#include "include/lib/seqlock.h"
+
+#define SENSOR_HEALTH_CHECK_INTERVAL 5000
+#define SENSOR_STALE_PERIODS 3          // Missed sample periods before a sensor counts as down
+#define SENSOR_RECOVERED_SAMPLES 3      // Consecutive good samples before a sensor is OK again
+#define SENSOR_RECOVERY_STEP 30000      // Time each recovery stage gets before the next one
+#define SENSOR_POWER_OFF_TIME 1000      // Supply held off during a power cycle
+#define SENSOR_FAILED_RETRY 600000      // A failed sensor goes through recovery again after this
+#define SENSOR_REBOOT_TIMEOUT 300000    // Reboot only once every sensor exhausted recovery and stayed silent this long
+
+// GPIOs switching each sensor's supply (high = on); -1 when not wired
+#define SCD41_POWER_PIN -1
+#define SGP30_POWER_PIN -1
+#define PMS7003_POWER_PIN -1
+
+enum HealthSensor : uint8_t {
+    HEALTH_SCD41,
+    HEALTH_SGP30,
+    HEALTH_PMS7003,
+    HEALTH_SENSOR_COUNT
+};
+
+enum SensorState : uint8_t {
+    SENSOR_OK,
+    SENSOR_DEGRADED,    // Recent failures or missed samples; readings are flagged
+    SENSOR_RECOVERING,  // A reset, power cycle or bus recovery is in progress
+    SENSOR_FAILED,      // Every recovery stage was tried; retried after SENSOR_FAILED_RETRY
+};
+
+// Escalation order while a sensor stays down
+enum RecoveryStage : uint8_t {
+    STAGE_NONE,
+    STAGE_RETRY,         // The driver keeps retrying on its own schedule
+    STAGE_SOFT_RESET,
+    STAGE_POWER_CYCLE,
+    STAGE_BUS_RECOVERY,  // I2C bus clear, for sensors on the shared bus
+    STAGE_EXHAUSTED
+};
+
+struct SensorHealthInfo {
+    SensorState state;
+    RecoveryStage stage;
+    uint32_t failures;          // Failed reads reported by the driver
+    uint32_t outages;           // Times the sensor left SENSOR_OK
+    uint32_t resets;            // Recovery actions taken
+    uint32_t lastOutageMillis;  // Duration of the last completed outage
+    uint32_t maxOutageMillis;
+    uint32_t lastSuccess;       // millis() of the last good sample
+};
+
+struct SensorHealthConfig {
+    const char* name;
+    unsigned long (*sampleInterval)();
+    void (*reset)();
+    int8_t powerPin;
+    int8_t i2cDevice;   // I2CDevice, or -1 for sensors off the I2C bus
+    TopicMask topics;   // Flagged invalid on the DataBus when the sensor fails
+};
+
+// Tracks each sensor separately and walks a failing one through staged
+// recovery, so one flaky sensor no longer costs every metric. Drivers report
+// on the acquisition worker, which also runs check(); other workers read the
+// published copy.
+class SensorHealth {
+private:
+    struct Entry {
+        SensorHealthInfo info;
+        unsigned long outageStart;
+        unsigned long stageStartedAt;
+        uint8_t goodSamples;
+        bool powerOff;
+        bool exhausted;  // Every stage has been tried during this outage
+    };
+
+    static const SensorHealthConfig* config;
+    static Entry entries[HEALTH_SENSOR_COUNT];
+    static Seqlock<SensorHealthInfo> published[HEALTH_SENSOR_COUNT];
+    static std::atomic<uint32_t> changes;
+    static std::atomic<bool> rebootNeeded;
+    static void (*changeHandler)();
+
+    static void setState(HealthSensor sensor, SensorState state, unsigned long now);
+    static void advance(HealthSensor sensor, unsigned long now);
+    static void invalidateTopics(HealthSensor sensor);
+    static void publish(HealthSensor sensor);
+
+public:
+    static void begin(const SensorHealthConfig* sensors, void (*onChange)());
+    static void reportSuccess(HealthSensor sensor, unsigned long now);
+    static void reportFailure(HealthSensor sensor, unsigned long now);
+    static void check();
+    static ReadingQuality quality(HealthSensor sensor);
+    static void powerDown(HealthSensor sensor);  // Holds the supply off through deep sleep
+
+    // Safe from any worker
+    static SensorHealthInfo read(HealthSensor sensor);
+    static uint32_t version();  // Incremented on every state change
+    static bool rebootRequired();
+    static const char* name(HealthSensor sensor);
+    static const char* stateName(SensorState state);
+    static const char* stageName(RecoveryStage stage);
+    static void printStats();
+};
+
+#endif // SENSOR_HEALTH_H
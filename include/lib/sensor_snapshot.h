@@ -0,0 +1,22 @@
+#ifndef SENSOR_SNAPSHOT_H
+#define SENSOR_SNAPSHOT_H
+
+#include <Arduino.h>
+#include "include/lib/sample_record.h"
+
+// Latest value of every metric, assembled from the DataBus for consumers
+// that handle a whole record: serial, MQTT and the offline log. The record
+// is what gets stored; the rest only matters while the reading is live.
+struct SensorSnapshot {
+    SampleRecord sample = {};
+    uint16_t aqi24h = 0;   // 0 until 18 of the last 24 hours are covered
+
+    uint16_t suspect = 0;  // DataBus topic bits whose reading is not QUALITY_GOOD
+
+    // millis() of the last successful sample from each sensor
+    unsigned long scd41UpdatedAt = 0;
+    unsigned long sgp30UpdatedAt = 0;
+    unsigned long pms7003UpdatedAt = 0;
+};
+
+#endif // SENSOR_SNAPSHOT_H
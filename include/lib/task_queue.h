@@ -0,0 +1,49 @@
+#ifndef TASK_QUEUE_H
+#define TASK_QUEUE_H
+
+#include <Arduino.h>
+
+#define TASK_QUEUE_CAPACITY 16
+#define TASK_INVALID_ID -1
+
+typedef void (*TaskCallback)();
+
+// Deadline-ordered task queue backed by a fixed-size binary min-heap.
+// Periodic tasks are re-armed relative to their previous deadline so they do
+// not drift; one-shot tasks are removed after they fire.
+class TaskQueue {
+private:
+    struct Task {
+        unsigned long deadline;
+        unsigned long period;     // 0 for one-shot tasks
+        TaskCallback callback;
+        int8_t id;
+    };
+
+    Task heap[TASK_QUEUE_CAPACITY];
+    uint8_t count;
+    int8_t nextId;
+
+    static bool before(const Task& a, const Task& b);
+    void siftUp(uint8_t index);
+    void siftDown(uint8_t index);
+    void removeAt(uint8_t index);
+    int8_t push(unsigned long deadline, unsigned long period, TaskCallback callback);
+
+public:
+    TaskQueue();
+
+    int8_t every(unsigned long period, TaskCallback callback, unsigned long firstDelay = 0);
+    int8_t after(unsigned long delayMs, TaskCallback callback);
+    bool cancel(int8_t id);
+    bool reschedule(int8_t id, unsigned long delayMs);
+    bool isScheduled(int8_t id) const;
+
+    // Runs every task whose deadline has passed and returns the number of
+    // milliseconds until the next deadline.
+    unsigned long runDue(unsigned long now);
+    unsigned long timeUntilNext(unsigned long now) const;
+    uint8_t size() const;
+};
+
+#endif // TASK_QUEUE_H
@@ -0,0 +1,58 @@
+#ifndef TELEMETRY_STORE_H
+#define TELEMETRY_STORE_H
+
+#include <Arduino.h>
+#include <LittleFS.h>
+#include <Preferences.h>
+#include "include/lib/sensor_snapshot.h"
+
+#define TELEMETRY_STORE_PATH "/telemetry.bin"
+#define TELEMETRY_STORE_CAPACITY 4096    // Records; almost 3 days at one sample per minute
+#define TELEMETRY_WRITE_BATCH 10         // Samples buffered in RAM per flash write
+#define TELEMETRY_DRAIN_BATCH 10         // Records published per drain pass
+#define TELEMETRY_DRAIN_INTERVAL 2000    // Pause between drain passes
+
+// One stored reading: the record as sampled, numbered for delivery
+struct __attribute__((packed)) StoredSample {
+    uint32_t sequence;      // Monotonic; 0 and 0xFFFFFFFF mark an empty slot
+    SampleRecord record;
+};
+
+// Store-and-forward log for readings that could not be published.
+// Records live in a fixed-size ring file on LittleFS, which spreads writes
+// across flash blocks. Samples are batched in RAM so an outage costs one
+// flash write per TELEMETRY_WRITE_BATCH readings. The highest delivered
+// sequence number is kept in NVS.
+class TelemetryStore {
+private:
+    static bool mounted;
+    static uint32_t nextSequence;
+    static uint32_t sentSequence;
+    static uint32_t queuedSequence;  // Highest handed to MQTT and awaiting its PUBACK
+    static uint32_t bootSequence;  // First sequence written since power-up
+    static StoredSample pending[TELEMETRY_WRITE_BATCH];
+    static uint8_t pendingCount;
+    static uint32_t flashWrites, dropped;
+    static Preferences prefs;
+
+    static uint32_t slotFor(uint32_t sequence);
+    static bool createFile();
+    static void scan();
+    static void dropOverwritten();
+
+public:
+    static bool begin();
+    static void append(const SensorSnapshot& snapshot, uint32_t timestamp, bool uptime);
+    static void encode(const SensorSnapshot& snapshot, uint32_t timestamp, bool uptime, StoredSample& out);
+    static bool flush();
+    static uint32_t backlog();
+    static uint8_t peek(StoredSample* out, uint8_t maxCount);
+    static void markQueued(uint32_t sequence);
+    static void acknowledge(uint32_t sequence);
+    static bool isFromThisBoot(uint32_t sequence);
+    static uint32_t getFlashWrites();  // Batches written since boot
+    static uint32_t getDropped();      // Readings lost to a full ring or failing flash
+    static void printStats();
+};
+
+#endif // TELEMETRY_STORE_H
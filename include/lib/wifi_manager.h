@@ -4,13 +4,53 @@
 #include <Arduino.h>
 #include <WiFi.h>
 #include "secrets.h"  // Include secrets.h for WiFi credentials
+#include "include/lib/backoff.h"
 
+#define WIFI_CONNECT_TIMEOUT 15000    // 15 seconds timeout for each association attempt
+#define WIFI_BACKOFF_INITIAL 5000     // First retry after a failed attempt
+#define WIFI_BACKOFF_MAX 900000       // Never wait more than 15 minutes between attempts
+#define NTP_VALID_AFTER 1700000000UL  // Any clock earlier than this has not been set by NTP
+
+enum class WiFiState : uint8_t {
+    Idle,
+    Connecting,
+    Connected,
+    Backoff
+};
+
+// Non-blocking WiFi association driven by the ESP32 WiFi events.
+// poll() advances the state machine and returns immediately.
 class WiFiManager {
+private:
+    static WiFiState state;
+    static unsigned long stateSince;
+    static unsigned long nextAttemptAt;
+    static uint8_t failures;
+    static void (*eventHandler)();
+
+    // Set from the WiFi event task, consumed by poll()
+    static volatile bool gotIP;
+    static volatile bool linkLost;
+
+    // Metrics
+    static unsigned long lastTimeToConnect;
+    static uint32_t attempts, maxBlockedMicros;
+    static uint64_t totalBlockedMicros;
+
+    static void onEvent(arduino_event_id_t event, arduino_event_info_t info);
+    static void startAttempt(unsigned long now);
+    static void enterBackoff(unsigned long now);
+
 public:
-    static bool connect(unsigned long timeout);
+    static void begin(void (*handler)());
+    static unsigned long poll();
     static void disconnect();
     static bool isConnected();
+    static WiFiState getState();
+    static unsigned long getTimeToConnect();
+    static void printStats();
     static void syncNTP();
+    static uint32_t currentTime();
 };
 
 #endif // WIFI_MANAGER_H
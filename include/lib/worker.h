@@ -0,0 +1,44 @@
+#ifndef WORKER_H
+#define WORKER_H
+
+#include <Arduino.h>
+#include <atomic>
+#include "include/lib/task_queue.h"
+
+#define WORKER_MAX_SLEEP 900000  // Upper bound on one idle wait
+
+typedef void (*WorkerHook)();
+
+// A FreeRTOS task pinned to one core that runs its own TaskQueue. Tasks
+// registered on a worker only ever run on that worker's thread, so state
+// owned by one worker needs no locking. wake() cuts the current sleep short.
+class Worker {
+private:
+    const char* name;
+    uint32_t stackBytes;
+    UBaseType_t priority;
+    BaseType_t core;
+    WorkerHook poll;         // Runs on every wake-up before due tasks
+    bool profiled;           // Feed LoopProfiler from this worker
+    TaskHandle_t handle;
+    TaskQueue queue;
+    std::atomic<uint32_t> busyMicros;
+    unsigned long reportStart;
+
+    static void entry(void* param);
+    void loop();
+
+public:
+    Worker(const char* name, uint32_t stackBytes, UBaseType_t priority, BaseType_t core,
+           WorkerHook poll = nullptr, bool profiled = false);
+
+    bool start();
+    TaskQueue& tasks();
+    void wake();
+    void wakeFromISR();
+    const char* getName() const;
+    uint32_t stackHeadroom() const;  // Bytes of stack never used so far
+    void printStats();  // CPU share since the last call and stack headroom
+};
+
+#endif // WORKER_H
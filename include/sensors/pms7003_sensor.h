@@ -2,25 +2,96 @@
 #define PMS7003_SENSOR_H
 
 #include <HardwareSerial.h>
+#include "include/lib/spsc_ring.h"
 
 #define PMS7003_RX_PIN 14  // RX = D14 (ESP32 receives data)
 #define PMS7003_TX_PIN 27  // TX = D27 (ESP32 sends data)
 
+#define PMS7003_FRAME_LENGTH 32
+#define PMS7003_DATA_LENGTH 28      // Frame length field: 13 data words + checksum
+#define PMS7003_REPLY_LENGTH 4      // Frame length field of a command reply
+#define PMS7003_RX_RING_SIZE 1024   // ~32 frames, about half a minute of data
+#define PMS7003_BYTE_TIME_US 1042   // One 8N1 byte at 9600 baud
+
+// Passive mode: the fan and laser only run while a sample is being taken
+#define PMS7003_PASSIVE_MODE 0
+#define PMS7003_PASSIVE_INTERVAL 300000  // Time between passive samples
+#define PMS7003_ACTIVE_INTERVAL 2300     // Longest frame period in active mode
+#define PMS7003_WARMUP_TIME 30000        // Fan spin-up before readings are stable
+
+// PMS7003 command codes
+#define PMS7003_CMD_READ 0xE2
+#define PMS7003_CMD_MODE 0xE1
+#define PMS7003_CMD_SLEEP 0xE4
+
+// All 13 data words of a checksum-verified frame
+struct PMS7003Data {
+    uint16_t pm1_0_cf1;        // ug/m3, CF=1 standard particle
+    uint16_t pm2_5_cf1;
+    uint16_t pm10_cf1;
+    uint16_t pm1_0;            // ug/m3, atmospheric environment
+    uint16_t pm2_5;
+    uint16_t pm10;
+    uint16_t particles_0_3um;  // Particles beyond the given diameter per 0.1 L of air
+    uint16_t particles_0_5um;
+    uint16_t particles_1_0um;
+    uint16_t particles_2_5um;
+    uint16_t particles_5_0um;
+    uint16_t particles_10um;
+    uint8_t version;
+    uint8_t errorCode;
+    unsigned long timestamp;   // millis() when the last byte was received
+};
+
+struct PMS7003Stats {
+    uint32_t bytesReceived;
+    uint32_t framesDecoded;
+    uint32_t resyncs;
+    uint32_t overruns;
+    uint32_t corruptedFrames;  // Bad length field or checksum
+};
+
 class PMS7003Sensor {
 private:
     static HardwareSerial pmsSerial;
-    static int pm1_0, pm2_5, pm10; // Store sensor values
+    static SpscRing<uint8_t, PMS7003_RX_RING_SIZE> rxRing;
+    static uint8_t frame[PMS7003_FRAME_LENGTH];
+    static uint8_t frameIndex;
+    static bool hunting;  // Discarding bytes while looking for a frame header
+    static PMS7003Data data;
     static bool newDataAvailable;
+    static void (*dataHandler)();
+
+    // Written by the UART event task, read by the loop
+    static volatile unsigned long lastRxAt;
+    static volatile uint32_t bytesReceived, overruns;
+    static uint32_t framesDecoded, resyncs, corruptedFrames;
 
+    static void onReceive();
+    static void loseSync();
+    static bool decodeByte(uint8_t incomingByte);
+    static bool checksumValid(const uint8_t* buffer, uint16_t length);
     static void processPMSFrame(uint8_t* buffer);
+    static void sendCommand(uint8_t command, uint16_t value);
 
 public:
     static void begin();
+    static void onData(void (*handler)());
     static bool read();
     static bool hasNewData();
-    static int getPM1_0();
-    static int getPM2_5();
-    static int getPM10();
+    static const PMS7003Data& getData();
+    static unsigned long getTimestamp();
+    static void setPassiveMode(bool passive);
+    static void requestRead();
+    static void sleep();
+    static void wakeUp();
+    static void reset();  // Wakes the sensor and restores the configured mode
+    static unsigned long sampleInterval();
+    static PMS7003Stats getStats();
+    static void printStats();
+    static uint16_t getPM1_0();  // ug/m3
+    static uint16_t getPM2_5();
+    static uint16_t getPM10();
 };
 
 #endif // PMS7003_SENSOR_H
@@ -2,23 +2,108 @@
 #define SCD41_SENSOR_H
 
 #include <Wire.h>
+#include <atomic>
 #include "SparkFun_SCD4x_Arduino_Library.h"
+#include "include/lib/i2c_bus.h"
+#include "include/lib/power_manager.h"
 
+// Measurement modes. Average supply current from the datasheet at 3.3 V:
+// periodic 15 mA, low-power periodic 3.2 mA, one single shot per minute ~1.5 mA
+#define SCD41_MODE_PERIODIC 0     // New sample every 5 s
+#define SCD41_MODE_LOW_POWER 1    // New sample every 30 s
+#define SCD41_MODE_SINGLE_SHOT 2  // One 5 s measurement per SCD41_SINGLE_SHOT_INTERVAL, idle in between
+#if POWER_MODE == POWER_MODE_DUTY_CYCLED
+#define SCD41_MODE SCD41_MODE_SINGLE_SHOT
+#else
+#define SCD41_MODE SCD41_MODE_PERIODIC
+#endif
+
+#define SCD41_PERIODIC_INTERVAL 5000
+#define SCD41_LOW_POWER_INTERVAL 30000
+#define SCD41_SINGLE_SHOT_TIME 5000       // Single-shot measurement duration
+#define SCD41_SINGLE_SHOT_INTERVAL 60000  // Time between single shots
+#define SCD41_SENSOR_ALTITUDE 0           // Metres above sea level, applied at boot when nonzero
+#define SCD41_READY_MARGIN 100            // Data-ready is first polled this early so the sensor's clock is tracked
+#define SCD41_READY_RETRY 50              // Poll period while a due sample is not ready yet
+#define SCD41_STOP_TIME 500               // Idle time the sensor needs after stop_periodic_measurement
+#define SCD41_FAILURE_LIMIT 3             // Consecutive failed reads before the measurement is restarted
+#define SCD41_BUS_RETRY 50                // Retry delay when the I2C bus is busy
+#define SCD41_WAKE_TIME 20                // wake_up execution time after power_down
+
+struct SCD41Stats {
+    uint32_t measurements;
+    uint32_t notReady;          // Data-ready polls that found no new sample; a few are expected
+    uint32_t readFailures;      // readMeasurement() errors after data-ready was set
+    uint32_t timeouts;          // Samples that never became ready
+    uint32_t recoveries;        // Measurement restarts
+    uint32_t commandFailures;   // Rejected mode, compensation or recalibration commands
+    float lastFrcCorrection;    // ppm, from the last forced recalibration
+};
+
+// All sensor I/O happens in read() on the acquisition worker. The command
+// setters may be called from any task; they only queue the request, and
+// read() applies it at the next point the sensor accepts it.
 class SCD41Sensor {
 private:
+    enum Command : uint8_t {
+        COMMAND_MODE = 0x01,
+        COMMAND_PRESSURE = 0x02,
+        COMMAND_ALTITUDE = 0x04,
+        COMMAND_FRC = 0x08,
+        COMMAND_REINIT = 0x10,
+    };
+    static const uint8_t IDLE_COMMANDS = COMMAND_MODE | COMMAND_ALTITUDE | COMMAND_FRC | COMMAND_REINIT;
+
     static SCD4x scd41;
-    static int co2;
-    static float temperatureC;
-    static float humidity;
+    static uint16_t co2;         // ppm
+    static int16_t temperature;  // 0.01 °C
+    static uint16_t humidity;    // 0.01 %RH
+
+    static uint8_t mode;
+    static bool measuring;              // Periodic measurement running or single shot in progress
+    static unsigned long measurementDue;  // Next sample expected, or next single shot while idle
+    static unsigned long shotStartedAt;
+    static unsigned long stoppedAt;
+    static unsigned long pollDelay;
+    static uint8_t consecutiveFailures;
+    static uint8_t queuedCommands;
+    static bool poweredDown;            // Kept through deep sleep
+    static bool discardNext;            // First single shot after wake_up is not valid
+    static SCD41Stats stats;
 
-    static float celsiusToFahrenheit(float celsius);
+    static std::atomic<uint8_t> pendingCommands;
+    static uint8_t requestedMode;
+    static uint32_t requestedPressure;  // Pa
+    static uint16_t requestedAltitude;
+    static uint16_t requestedReference;
+
+    static unsigned long modeInterval();
+    static bool startMeasurement(unsigned long now);
+    static void stopMeasurement(unsigned long now);
+    static void applyIdleCommands();
+    static void queueCommand(Command command);
+    static void wakeUp();
 
 public:
     static void begin();
     static bool read();
-    static int getCO2();
-    static float getTemperatureF();
-    static float getHumidity();
+    static unsigned long nextPollDelay();  // When read() has something to do again
+    static unsigned long sampleInterval(); // Time between samples in the current mode
+    static void reset();                   // Stops the measurement and reloads the sensor settings
+    static void powerDown();               // Before deep sleep; begin() wakes the sensor again
+    static uint16_t getCO2();
+    static int16_t getTemperature();
+    static uint16_t getHumidity();
+
+    static void setMode(uint8_t newMode);
+    static void setAmbientPressure(float hPa);  // Overrides the altitude while set
+    static void setAltitude(uint16_t meters);
+    // Needs at least 3 minutes of measurement in fresh air near the reference
+    static void forceRecalibration(uint16_t referencePpm);
+    static uint8_t getMode();
+    static const char* modeName(uint8_t mode);
+    static const SCD41Stats& getStats();
+    static void printStats();
 };
 
 #endif // SCD41_SENSOR_H
\ No newline at end of file
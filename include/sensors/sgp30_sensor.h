@@ -3,21 +3,62 @@
 
 #include <Wire.h>
 #include <Adafruit_SGP30.h>
+#include <Preferences.h>
+#include "include/lib/i2c_bus.h"
+#include "include/lib/power_manager.h"
+
+#define SGP30_MEASURE_INTERVAL 1000          // IAQmeasure() period the baseline algorithm expects
+#define SGP30_TIMING_TOLERANCE 100           // Measurements further off the 1 s grid count as late
+#define SGP30_BASELINE_SAVE_INTERVAL 3600000 // Baseline written to NVS hourly
+#define SGP30_BASELINE_WARMUP 43200000       // A baseline learned from scratch is valid after 12 hours
+
+struct SGP30Stats {
+    uint32_t measurements;
+    uint32_t failures;
+    uint32_t lateMeasurements;
+    uint32_t maxJitterMillis;
+    uint32_t humidityUpdates;
+    uint32_t baselineSaves;
+};
 
 class SGP30Sensor {
 private:
     static Adafruit_SGP30 sgp;
-    static float tvoc;
-    static float h2;
-    static float ethanol;
+    static Preferences prefs;
+    static uint16_t tvoc;     // ppb
+    static uint16_t h2;       // Raw ticks
+    static uint16_t ethanol;
     static bool initialized;
+    static bool baselineRestored;
+    static unsigned long startedAt;
+    static unsigned long lastMeasurement;
+    static uint16_t humidityTicks;    // Absolute humidity in the sensor's 8.8 g/m³ format
+    static uint32_t pendingHumidity;  // mg/m³ to send before the next measurement, 0 if none
+    static uint16_t savedECO2Baseline;
+    static uint16_t savedTVOCBaseline;
+    static bool baselineHeld;            // RTC copies, kept through deep sleep
+    static bool heldBaselineValid;
+    static uint16_t heldECO2Baseline;
+    static uint16_t heldTVOCBaseline;
+    static uint32_t heldLearningMillis;  // Operating time behind a baseline still learning
+    static SGP30Stats stats;
+
+    static void restoreBaseline();
+    static bool baselineValid();
 
 public:
     static void begin();
-    static void read();
-    static float getTVOC();
-    static float getH2();
-    static float getEthanol();
+    static bool read();
+    static void reset();  // Restarts the IAQ algorithm and restores the saved baseline
+    static unsigned long sampleInterval();
+    static void setHumidity(int16_t temperature, uint16_t relativeHumidity);  // 0.01 °C, 0.01 %RH
+    static void saveBaseline();
+    static void holdBaseline();  // Before deep sleep, which cuts the sensor's supply
+    static uint16_t getTVOC();
+    static uint16_t getH2();
+    static uint16_t getEthanol();
+    static const SGP30Stats& getStats();
+    static void printStats();
 };
 
 #endif // SGP30_SENSOR_H 
\ No newline at end of file
@@ -8,6 +8,8 @@
 #include "secrets.h"
 
 void setup() {
+    // Room for the event log to drain without waiting on the FIFO
+    Serial.setTxBufferSize(LOG_SERIAL_TX_BUFFER);
     Serial.begin(115200);
     while (!Serial) {
         delay(100);
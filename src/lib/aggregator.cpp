@@ -0,0 +1,190 @@
+#include "include/lib/aggregator.h"
+#include "include/lib/power_manager.h"
+#include "include/lib/metrics.h"
+
+// Window lengths in milliseconds
+static const unsigned long WINDOW_LENGTHS[WINDOW_COUNT] = {60000UL, 900000UL, 3600000UL, 86400000UL};
+static const char* const WINDOW_NAMES[WINDOW_COUNT] = {"1m", "15m", "1h", "24h"};
+
+// Histogram range for each metric in SampleRecord units; values outside are
+// clamped into the end buckets. Concentrations span decades and use
+// log-spaced buckets.
+struct MetricRange {
+    const char* name;
+    DataTopic topic;
+    float low;
+    float high;
+    bool logarithmic;
+};
+
+static const MetricRange METRIC_RANGES[AGG_METRIC_COUNT] = {
+    {"temperature", TOPIC_TEMPERATURE, -2000.0f, 5000.0f, false},  // 0.01 °C
+    {"humidity", TOPIC_HUMIDITY, 0.0f, 10000.0f, false},           // 0.01 %
+    {"co2", TOPIC_CO2, 0.0f, 10000.0f, true},
+    {"pm1_0", TOPIC_PM1_0, 0.0f, 1000.0f, true},
+    {"pm2_5", TOPIC_PM2_5, 0.0f, 1000.0f, true},
+    {"pm10", TOPIC_PM10, 0.0f, 1000.0f, true},
+    {"tvoc", TOPIC_TVOC, 0.0f, 60000.0f, true},
+};
+
+// Initialize static members. About 5 KB, which still fits RTC memory in
+// duty-cycled mode next to the samples waiting for upload.
+RTC_STATE_ATTR Aggregator::Accumulator Aggregator::current[WINDOW_COUNT][AGG_METRIC_COUNT];
+RTC_STATE_ATTR WindowStats Aggregator::completed[WINDOW_COUNT][AGG_METRIC_COUNT];
+RTC_STATE_ATTR unsigned long Aggregator::windowStart[WINDOW_COUNT];
+RTC_STATE_ATTR bool Aggregator::windowReady[WINDOW_COUNT];
+
+// Window times are on the caller's clock, which must keep running through
+// deep sleep when resuming
+void Aggregator::begin(bool resume) {
+    if (resume) {
+        return;
+    }
+    unsigned long now = millis();
+    memset(current, 0, sizeof(current));
+    memset(completed, 0, sizeof(completed));
+    for (uint8_t w = 0; w < WINDOW_COUNT; w++) {
+        windowStart[w] = now;
+        windowReady[w] = false;
+    }
+}
+
+// Logarithmic buckets are spaced evenly in log(1 + value - low)
+uint8_t Aggregator::bucketFor(AggregateMetric metric, int32_t value) {
+    const MetricRange& range = METRIC_RANGES[metric];
+    float offset = value - range.low;
+    if (offset <= 0) {
+        return 0;
+    }
+    float span = range.high - range.low;
+    float position = range.logarithmic ? log1pf(offset) / log1pf(span) : offset / span;
+    int bucket = (int)(position * AGGREGATOR_BUCKETS);
+    return bucket >= AGGREGATOR_BUCKETS ? AGGREGATOR_BUCKETS - 1 : bucket;
+}
+
+float Aggregator::bucketUpperBound(AggregateMetric metric, uint8_t bucket) {
+    const MetricRange& range = METRIC_RANGES[metric];
+    float span = range.high - range.low;
+    float position = (float)(bucket + 1) / AGGREGATOR_BUCKETS;
+    return range.low + (range.logarithmic ? expm1f(position * log1pf(span)) : position * span);
+}
+
+void Aggregator::add(AggregateMetric metric, int32_t value) {
+    if (metric >= AGG_METRIC_COUNT) {
+        return;
+    }
+    uint8_t bucket = bucketFor(metric, value);
+
+    for (uint8_t w = 0; w < WINDOW_COUNT; w++) {
+        Accumulator& acc = current[w][metric];
+
+        acc.count++;
+        if (acc.count == 1 || value < acc.min) acc.min = value;
+        if (acc.count == 1 || value > acc.max) acc.max = value;
+
+        float delta = value - acc.mean;
+        acc.mean += delta / acc.count;
+        acc.m2 += delta * (value - acc.mean);
+
+        // Halve the whole histogram on saturation; the shape, and so the
+        // percentile estimate, is preserved
+        if (acc.histogram[bucket] == UINT16_MAX) {
+            for (uint8_t i = 0; i < AGGREGATOR_BUCKETS; i++) {
+                acc.histogram[i] >>= 1;
+            }
+        }
+        acc.histogram[bucket]++;
+    }
+}
+
+float Aggregator::percentile(AggregateMetric metric, const Accumulator& acc, uint8_t pct) {
+    uint32_t total = 0;
+    for (uint8_t i = 0; i < AGGREGATOR_BUCKETS; i++) {
+        total += acc.histogram[i];
+    }
+    if (total == 0) {
+        return 0;
+    }
+
+    float target = total * pct / 100.0f;
+    uint32_t seen = 0;
+    for (uint8_t i = 0; i < AGGREGATOR_BUCKETS; i++) {
+        if (acc.histogram[i] == 0 || seen + acc.histogram[i] < target) {
+            seen += acc.histogram[i];
+            continue;
+        }
+
+        // Interpolate inside the bucket, then clamp to what was actually observed
+        float lower = i == 0 ? METRIC_RANGES[metric].low : bucketUpperBound(metric, i - 1);
+        float upper = bucketUpperBound(metric, i);
+        float value = lower + (upper - lower) * (target - seen) / acc.histogram[i];
+        if (value < acc.min) value = acc.min;
+        if (value > acc.max) value = acc.max;
+        return value;
+    }
+    return acc.max;
+}
+
+// Values go out in the published units; the spread only scales
+void Aggregator::close(AggregateWindow window) {
+    for (uint8_t m = 0; m < AGG_METRIC_COUNT; m++) {
+        Accumulator& acc = current[window][m];
+        WindowStats& stats = completed[window][m];
+        const MetricDescriptor& metric = METRICS[METRIC_RANGES[m].topic];
+
+        stats.count = acc.count;
+        if (acc.count == 0) {
+            stats.min = stats.max = stats.mean = stats.stddev = stats.p95 = 0;
+        } else {
+            stats.min = fixedToFloat(acc.min, metric.scale, metric.offset);
+            stats.max = fixedToFloat(acc.max, metric.scale, metric.offset);
+            stats.mean = acc.mean * metric.scale + metric.offset;
+            stats.stddev = acc.count > 1 ? sqrtf(acc.m2 / (acc.count - 1)) * metric.scale : 0;
+            stats.p95 = percentile((AggregateMetric)m, acc, 95) * metric.scale + metric.offset;
+        }
+
+        memset(&acc, 0, sizeof(acc));
+    }
+    windowReady[window] = true;
+}
+
+// Closes every window whose period has elapsed
+void Aggregator::roll(unsigned long now) {
+    for (uint8_t w = 0; w < WINDOW_COUNT; w++) {
+        if (now - windowStart[w] >= WINDOW_LENGTHS[w]) {
+            close((AggregateWindow)w);
+            windowStart[w] += WINDOW_LENGTHS[w];
+            if (now - windowStart[w] >= WINDOW_LENGTHS[w]) {
+                windowStart[w] = now;  // Fell behind; realign rather than emit empty windows
+            }
+        }
+    }
+}
+
+// Returns true once for each newly completed window
+bool Aggregator::takeCompleted(AggregateWindow window) {
+    bool ready = windowReady[window];
+    windowReady[window] = false;
+    return ready;
+}
+
+const WindowStats& Aggregator::get(AggregateWindow window, AggregateMetric metric) {
+    return completed[window][metric];
+}
+
+void Aggregator::report(AggregateWindow window, AggregateReport& out) {
+    out.window = window;
+    memcpy(out.stats, completed[window], sizeof(out.stats));
+}
+
+const char* Aggregator::windowName(AggregateWindow window) {
+    return WINDOW_NAMES[window];
+}
+
+const char* Aggregator::metricName(AggregateMetric metric) {
+    return METRIC_RANGES[metric].name;
+}
+
+size_t Aggregator::stateBytes() {
+    return sizeof(current) + sizeof(completed) + sizeof(windowStart) + sizeof(windowReady);
+}
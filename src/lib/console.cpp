@@ -0,0 +1,86 @@
+#include "include/lib/console.h"
+
+// Initialize static members
+Console::Command Console::commands[CONSOLE_MAX_COMMANDS];
+uint8_t Console::commandCount = 0;
+char Console::line[CONSOLE_LINE_SIZE];
+uint8_t Console::length = 0;
+bool Console::overflow = false;
+void (*Console::wakeHandler)() = nullptr;
+
+void Console::begin(void (*wake)()) {
+    wakeHandler = wake;
+    Serial.onReceive(onReceive);
+}
+
+bool Console::addCommand(const char* name, const char* usage, ConsoleHandler handler) {
+    if (commandCount >= CONSOLE_MAX_COMMANDS) {
+        return false;
+    }
+    commands[commandCount++] = {name, usage, handler};
+    return true;
+}
+
+// Called from the UART event task
+void Console::onReceive() {
+    if (wakeHandler) {
+        wakeHandler();
+    }
+}
+
+void Console::poll() {
+    while (Serial.available() > 0) {
+        char c = Serial.read();
+        if (c == '\r' || c == '\n') {
+            if (length > 0 && !overflow) {
+                line[length] = '\0';
+                execute(line);
+            } else if (overflow) {
+                Serial.println("Command too long");
+            }
+            length = 0;
+            overflow = false;
+        } else if (length < CONSOLE_LINE_SIZE - 1) {
+            line[length++] = c;
+        } else {
+            overflow = true;
+        }
+    }
+}
+
+bool Console::execute(const char* input) {
+    while (*input == ' ') {
+        input++;
+    }
+    size_t nameLength = strcspn(input, " ");
+    const char* args = input + nameLength;
+    while (*args == ' ') {
+        args++;
+    }
+
+    for (uint8_t i = 0; i < commandCount; i++) {
+        const Command& command = commands[i];
+        if (strlen(command.name) == nameLength && strncmp(command.name, input, nameLength) == 0) {
+            if (command.handler(args)) {
+                return true;
+            }
+            Serial.print("Usage: ");
+            Serial.print(command.name);
+            Serial.print(" ");
+            Serial.println(command.usage);
+            return false;
+        }
+    }
+    printHelp();
+    return false;
+}
+
+void Console::printHelp() {
+    Serial.println("Commands:");
+    for (uint8_t i = 0; i < commandCount; i++) {
+        Serial.print("  ");
+        Serial.print(commands[i].name);
+        Serial.print(" ");
+        Serial.println(commands[i].usage);
+    }
+}
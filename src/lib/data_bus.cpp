@@ -0,0 +1,133 @@
+#include "include/lib/data_bus.h"
+#include "include/lib/event_log.h"
+
+// Initialize static members
+Seqlock<Reading> DataBus::latest[TOPIC_COUNT];
+DataBus::Subscriber DataBus::subscribers[DATA_BUS_MAX_SUBSCRIBERS];
+uint8_t DataBus::subscriberCount = 0;
+DataBusStats DataBus::stats = {};
+
+int8_t DataBus::subscribe(TopicMask topics, unsigned long minInterval, BusNotify notify) {
+    if (subscriberCount >= DATA_BUS_MAX_SUBSCRIBERS) {
+        LOG_EVENT(BUS_SUBSCRIBERS_FULL, DATA_BUS_MAX_SUBSCRIBERS);
+        return -1;
+    }
+    Subscriber& s = subscribers[subscriberCount];
+    s.topics = topics;
+    s.minInterval = minInterval;
+    s.notify = notify;
+    s.lastNotified = millis() - minInterval;
+    s.pending = 0;
+    return subscriberCount++;
+}
+
+void DataBus::publish(DataTopic topic, int32_t value, ReadingQuality quality, unsigned long timestamp) {
+    latest[topic].write(Reading{value, (uint32_t)timestamp, quality});
+    stats.published++;
+
+    TopicMask bit = TOPIC_BIT(topic);
+    for (uint8_t i = 0; i < subscriberCount; i++) {
+        if (subscribers[i].topics & bit) {
+            subscribers[i].pending.fetch_or(bit, std::memory_order_release);
+        }
+    }
+}
+
+// Called by the writer after a batch of publishes. A subscriber held back by
+// its interval is retried on the next dispatch, so no change is lost.
+void DataBus::dispatch() {
+    uint32_t started = micros();
+    unsigned long now = millis();
+    for (uint8_t i = 0; i < subscriberCount; i++) {
+        Subscriber& s = subscribers[i];
+        if (s.notify == nullptr || s.pending.load(std::memory_order_relaxed) == 0) {
+            continue;
+        }
+        if (now - s.lastNotified >= s.minInterval) {
+            s.lastNotified = now;
+            stats.notifications++;
+            s.notify();
+        }
+    }
+
+    uint32_t elapsed = micros() - started;
+    stats.dispatches++;
+    stats.totalDispatchMicros += elapsed;
+    if (elapsed > stats.maxDispatchMicros) {
+        stats.maxDispatchMicros = elapsed;
+    }
+}
+
+TopicMask DataBus::take(int8_t subscriber) {
+    if (subscriber < 0 || subscriber >= subscriberCount) {
+        return 0;
+    }
+    return subscribers[subscriber].pending.exchange(0, std::memory_order_acquire);
+}
+
+Reading DataBus::read(DataTopic topic) {
+    return latest[topic].read();
+}
+
+int32_t DataBus::value(DataTopic topic) {
+    return latest[topic].read().value;
+}
+
+void DataBus::snapshot(SensorSnapshot& out) {
+    Reading r[TOPIC_COUNT];
+    out.suspect = 0;
+    for (uint8_t t = 0; t < TOPIC_COUNT; t++) {
+        r[t] = read((DataTopic)t);
+        if (r[t].quality != QUALITY_GOOD) {
+            out.suspect |= TOPIC_BIT(t);
+        }
+    }
+
+    SampleRecord& sample = out.sample;
+    sample = {};
+    sample.temperature = r[TOPIC_TEMPERATURE].value;
+    sample.humidity = r[TOPIC_HUMIDITY].value;
+    sample.co2 = r[TOPIC_CO2].value;
+    sample.pm1_0 = r[TOPIC_PM1_0].value;
+    sample.pm2_5 = r[TOPIC_PM2_5].value;
+    sample.pm10 = r[TOPIC_PM10].value;
+    sample.aqi = r[TOPIC_AQI].value;
+    sample.pollutant = r[TOPIC_AQI_POLLUTANT].value;
+    sample.tvoc = r[TOPIC_TVOC].value;
+    sample.h2 = r[TOPIC_H2].value;
+    sample.ethanol = r[TOPIC_ETHANOL].value;
+    sample.suspect = suspectSensors(out.suspect);
+    out.aqi24h = r[TOPIC_AQI_24H].value;
+
+    out.scd41UpdatedAt = r[TOPIC_TEMPERATURE].timestamp;
+    out.sgp30UpdatedAt = r[TOPIC_TVOC].timestamp;
+    out.pms7003UpdatedAt = r[TOPIC_PM2_5].timestamp;
+}
+
+uint8_t DataBus::suspectSensors(TopicMask suspect) {
+    return (suspect & SCD41_TOPICS ? SAMPLE_SUSPECT_SCD41 : 0) |
+           (suspect & SGP30_TOPICS ? SAMPLE_SUSPECT_SGP30 : 0) |
+           (suspect & PMS7003_TOPICS ? SAMPLE_SUSPECT_PMS7003 : 0);
+}
+
+TopicMask DataBus::suspectTopics(uint8_t sensors) {
+    return (sensors & SAMPLE_SUSPECT_SCD41 ? SCD41_TOPICS : 0) |
+           (sensors & SAMPLE_SUSPECT_SGP30 ? SGP30_TOPICS : 0) |
+           (sensors & SAMPLE_SUSPECT_PMS7003 ? PMS7003_TOPICS : 0);
+}
+
+const DataBusStats& DataBus::getStats() {
+    return stats;
+}
+
+void DataBus::printStats() {
+    Serial.print("Data bus: ");
+    Serial.print(stats.published);
+    Serial.print(" readings | ");
+    Serial.print(stats.notifications);
+    Serial.print(" notifications | dispatch avg ");
+    Serial.print(stats.dispatches ? (uint32_t)(stats.totalDispatchMicros / stats.dispatches) : 0);
+    Serial.print(" us, max ");
+    Serial.print(stats.maxDispatchMicros);
+    Serial.println(" us");
+}
@@ -0,0 +1,283 @@
+#include "include/lib/enhanced_aqi.h"
+#include "include/lib/power_manager.h"
+
+// Breakpoint tables, evaluated at compile time. Concentrations in ug/m3.
+
+// US EPA, PM2.5 as revised in February 2024
+static constexpr AQIBreakpoint EPA_PM2_5[] = {
+    {0.0f, 9.0f, 0, 50},
+    {9.1f, 35.4f, 51, 100},
+    {35.5f, 55.4f, 101, 150},
+    {55.5f, 125.4f, 151, 200},
+    {125.5f, 225.4f, 201, 300},
+    {225.5f, 325.4f, 301, 500},
+};
+
+static constexpr AQIBreakpoint EPA_PM10[] = {
+    {0, 54, 0, 50},
+    {55, 154, 51, 100},
+    {155, 254, 101, 150},
+    {255, 354, 151, 200},
+    {355, 424, 201, 300},
+    {425, 604, 301, 500},
+};
+
+// EU CAQI hourly background grid; the top class is open-ended at 100
+static constexpr AQIBreakpoint CAQI_PM2_5[] = {
+    {0, 15, 0, 25},
+    {15, 30, 25, 50},
+    {30, 55, 50, 75},
+    {55, 110, 75, 100},
+};
+
+static constexpr AQIBreakpoint CAQI_PM10[] = {
+    {0, 25, 0, 25},
+    {25, 50, 25, 50},
+    {50, 90, 50, 75},
+    {90, 180, 75, 100},
+};
+
+// India NAQI
+static constexpr AQIBreakpoint NAQI_PM2_5[] = {
+    {0, 30, 0, 50},
+    {31, 60, 51, 100},
+    {61, 90, 101, 200},
+    {91, 120, 201, 300},
+    {121, 250, 301, 400},
+    {251, 380, 401, 500},
+};
+
+static constexpr AQIBreakpoint NAQI_PM10[] = {
+    {0, 50, 0, 50},
+    {51, 100, 51, 100},
+    {101, 250, 101, 200},
+    {251, 350, 201, 300},
+    {351, 430, 301, 400},
+    {431, 510, 401, 500},
+};
+
+// Compile-time sanity check: segments ascend and never overlap
+template <size_t N>
+constexpr bool ascending(const AQIBreakpoint (&table)[N], size_t i = 1) {
+    return i >= N || (table[i].concLow >= table[i - 1].concHigh &&
+                      table[i].indexLow >= table[i - 1].indexHigh &&
+                      table[i].concHigh > table[i].concLow &&
+                      ascending(table, i + 1));
+}
+
+static_assert(ascending(EPA_PM2_5) && ascending(EPA_PM10), "EPA breakpoints must ascend");
+static_assert(ascending(CAQI_PM2_5) && ascending(CAQI_PM10), "CAQI breakpoints must ascend");
+static_assert(ascending(NAQI_PM2_5) && ascending(NAQI_PM10), "NAQI breakpoints must ascend");
+
+struct BreakpointTable {
+    const AQIBreakpoint* rows;
+    uint8_t count;
+    float truncation;  // Concentrations are truncated to this resolution first; 0 for none
+};
+
+template <size_t N>
+static constexpr BreakpointTable tableOf(const AQIBreakpoint (&rows)[N], float truncation) {
+    return {rows, N, truncation};
+}
+
+static BreakpointTable tableFor(Pollutant pollutant, AQIStandard standard) {
+    bool pm2_5 = pollutant == Pollutant::PM2_5;
+    switch (standard) {
+        case AQIStandard::EU_CAQI:
+            return pm2_5 ? tableOf(CAQI_PM2_5, 0) : tableOf(CAQI_PM10, 0);
+        case AQIStandard::INDIA_NAQI:
+            return pm2_5 ? tableOf(NAQI_PM2_5, 1) : tableOf(NAQI_PM10, 1);
+        case AQIStandard::US_EPA:
+        default:
+            return pm2_5 ? tableOf(EPA_PM2_5, 0.1f) : tableOf(EPA_PM10, 1);
+    }
+}
+
+// Initialize static members
+RTC_STATE_ATTR EnhancedAQI::HourAverage EnhancedAQI::hours[AQI_HISTORY_HOURS];
+RTC_STATE_ATTR uint8_t EnhancedAQI::head = 0;
+RTC_STATE_ATTR float EnhancedAQI::sumPM2_5 = 0;
+RTC_STATE_ATTR float EnhancedAQI::sumPM10 = 0;
+RTC_STATE_ATTR uint32_t EnhancedAQI::sampleCount = 0;
+RTC_STATE_ATTR unsigned long EnhancedAQI::hourStart = 0;
+RTC_STATE_ATTR float EnhancedAQI::nowcastPM2_5 = 0;
+RTC_STATE_ATTR float EnhancedAQI::nowcastPM10 = 0;
+RTC_STATE_ATTR float EnhancedAQI::dailyPM2_5 = 0;
+RTC_STATE_ATTR float EnhancedAQI::dailyPM10 = 0;
+RTC_STATE_ATTR bool EnhancedAQI::nowcastValid = false;
+RTC_STATE_ATTR bool EnhancedAQI::dailyValid = false;
+
+void EnhancedAQI::begin(bool resume) {
+    if (resume) {
+        return;
+    }
+    memset(hours, 0, sizeof(hours));
+    head = 0;
+    sumPM2_5 = sumPM10 = 0;
+    sampleCount = 0;
+    hourStart = millis();
+    nowcastValid = dailyValid = false;
+}
+
+uint16_t EnhancedAQI::subIndex(Pollutant pollutant, float concentration, AQIStandard standard) {
+    if (pollutant == Pollutant::None || concentration < 0 || isnan(concentration)) {
+        return 0;
+    }
+
+    BreakpointTable table = tableFor(pollutant, standard);
+    if (table.truncation > 0) {
+        // Small epsilon keeps values like 35.4 from truncating to 35.3 in float
+        concentration = floorf(concentration / table.truncation + 1e-3f) * table.truncation;
+    }
+    // A truncated value and the breakpoints are both multiples of the
+    // truncation step, but 2254 * 0.1f lands just above 225.4f; compare
+    // with half a step of slack so it stays in its row
+    float slack = table.truncation / 2;
+
+    for (uint8_t i = 0; i < table.count; i++) {
+        const AQIBreakpoint& bp = table.rows[i];
+        if (concentration <= bp.concHigh + slack) {
+            // Values in the gap between two rows belong to the upper row
+            float c = concentration < bp.concLow ? bp.concLow : concentration;
+            float index = (float)(bp.indexHigh - bp.indexLow) / (bp.concHigh - bp.concLow) *
+                          (c - bp.concLow) + bp.indexLow;
+            return (uint16_t)lroundf(index);
+        }
+    }
+    return table.rows[table.count - 1].indexHigh;  // Beyond the scale
+}
+
+AQIResult EnhancedAQI::combine(float pm2_5, float pm10, AQIStandard standard) {
+    uint16_t aqiPM2_5 = subIndex(Pollutant::PM2_5, pm2_5, standard);
+    uint16_t aqiPM10 = subIndex(Pollutant::PM10, pm10, standard);
+
+    if (aqiPM2_5 == 0 && aqiPM10 == 0) {
+        return {0, Pollutant::None};
+    }
+    if (aqiPM2_5 >= aqiPM10) {
+        return {aqiPM2_5, Pollutant::PM2_5};
+    }
+    return {aqiPM10, Pollutant::PM10};
+}
+
+const EnhancedAQI::HourAverage& EnhancedAQI::hoursAgo(uint8_t n) {
+    return hours[(head + AQI_HISTORY_HOURS - n) % AQI_HISTORY_HOURS];
+}
+
+// EPA NowCast: weighted average of the last 12 hourly means, where the weight
+// factor follows how much the concentration has been changing (min 0.5 for PM).
+// Needs at least two of the three most recent hours.
+bool EnhancedAQI::nowcast(float HourAverage::*field, float& result) {
+    uint8_t recent = 0;
+    for (uint8_t i = 0; i < 3; i++) {
+        recent += hoursAgo(i).valid ? 1 : 0;
+    }
+    if (recent < 2) {
+        return false;
+    }
+
+    float lowest = INFINITY, highest = 0;
+    for (uint8_t i = 0; i < AQI_NOWCAST_HOURS; i++) {
+        const HourAverage& hour = hoursAgo(i);
+        if (hour.valid) {
+            lowest = min(lowest, hour.*field);
+            highest = max(highest, hour.*field);
+        }
+    }
+
+    float weight = highest > 0 ? lowest / highest : 1.0f;
+    if (weight < 0.5f) {
+        weight = 0.5f;
+    }
+
+    float numerator = 0, denominator = 0, factor = 1;
+    for (uint8_t i = 0; i < AQI_NOWCAST_HOURS; i++) {
+        const HourAverage& hour = hoursAgo(i);
+        if (hour.valid) {
+            numerator += factor * hour.*field;
+            denominator += factor;
+        }
+        factor *= weight;
+    }
+    result = numerator / denominator;
+    return true;
+}
+
+// 24-hour average; EPA requires at least 75% of the hours to be present
+bool EnhancedAQI::dailyAverage(float HourAverage::*field, float& result) {
+    float sum = 0;
+    uint8_t count = 0;
+    for (uint8_t i = 0; i < AQI_HISTORY_HOURS; i++) {
+        if (hours[i].valid) {
+            sum += hours[i].*field;
+            count++;
+        }
+    }
+    if (count < (AQI_HISTORY_HOURS * 3) / 4) {
+        return false;
+    }
+    result = sum / count;
+    return true;
+}
+
+void EnhancedAQI::closeHour() {
+    head = (head + 1) % AQI_HISTORY_HOURS;
+    HourAverage& hour = hours[head];
+    hour.valid = sampleCount > 0;
+    hour.pm2_5 = hour.valid ? sumPM2_5 / sampleCount : 0;
+    hour.pm10 = hour.valid ? sumPM10 / sampleCount : 0;
+
+    sumPM2_5 = sumPM10 = 0;
+    sampleCount = 0;
+
+    nowcastValid = nowcast(&HourAverage::pm2_5, nowcastPM2_5) &&
+                   nowcast(&HourAverage::pm10, nowcastPM10);
+    dailyValid = dailyAverage(&HourAverage::pm2_5, dailyPM2_5) &&
+                 dailyAverage(&HourAverage::pm10, dailyPM10);
+}
+
+void EnhancedAQI::advance(unsigned long now) {
+    uint8_t closed = 0;
+    while (now - hourStart >= 3600000UL && closed < AQI_HISTORY_HOURS) {
+        closeHour();
+        hourStart += 3600000UL;
+        closed++;
+    }
+    if (now - hourStart >= 3600000UL) {
+        hourStart = now;  // Gap longer than the whole history
+    }
+}
+
+void EnhancedAQI::addSample(float pm2_5, float pm10, unsigned long now) {
+    advance(now);
+    sumPM2_5 += pm2_5;
+    sumPM10 += pm10;
+    sampleCount++;
+}
+
+// Real-time AQI. Until NowCast has two hours of data the running average of
+// the current hour is used instead.
+AQIResult EnhancedAQI::nowcastAQI(AQIStandard standard) {
+    if (nowcastValid) {
+        return combine(nowcastPM2_5, nowcastPM10, standard);
+    }
+    if (sampleCount > 0) {
+        return combine(sumPM2_5 / sampleCount, sumPM10 / sampleCount, standard);
+    }
+    return {0, Pollutant::None};
+}
+
+AQIResult EnhancedAQI::dailyAQI(AQIStandard standard) {
+    if (!dailyValid) {
+        return {0, Pollutant::None};
+    }
+    return combine(dailyPM2_5, dailyPM10, standard);
+}
+
+const char* EnhancedAQI::pollutantName(Pollutant pollutant) {
+    switch (pollutant) {
+        case Pollutant::PM2_5: return "pm2_5";
+        case Pollutant::PM10: return "pm10";
+        default: return "none";
+    }
+}
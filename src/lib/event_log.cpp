@@ -0,0 +1,348 @@
+#include "include/lib/event_log.h"
+#include "include/lib/metrics.h"
+#include <esp_system.h>
+
+#define LOG_MAGIC 0x4C4F4731  // Marks a ring that survived the reset
+#define LOG_RECORD_WORDS (sizeof(LogRecord) / sizeof(uint32_t))
+
+static_assert((LOG_RING_SIZE & (LOG_RING_SIZE - 1)) == 0, "LOG_RING_SIZE must be a power of two");
+static_assert(sizeof(LogRecord) % sizeof(uint32_t) == 0, "LogRecord must be whole words");
+
+#define LOG_MODULE_NAME(id, name) name,
+static const char* const MODULE_NAMES[LOG_MODULE_COUNT] = {LOG_MODULES(LOG_MODULE_NAME)};
+#undef LOG_MODULE_NAME
+
+#define LOG_EVENT_FORMAT(id, module, level, format) format,
+static const char* const EVENT_FORMATS[EVENT_COUNT] = {LOG_EVENTS(LOG_EVENT_FORMAT)};
+#undef LOG_EVENT_FORMAT
+
+static const char* const LEVEL_NAMES[] = {"off", "error", "warn", "info", "debug"};
+
+// Initialize static members
+__NOINIT_ATTR EventLog::Slot EventLog::slots[LOG_RING_SIZE];
+__NOINIT_ATTR std::atomic<uint32_t> EventLog::head;
+__NOINIT_ATTR uint32_t EventLog::magic;
+uint32_t EventLog::bootHead = 0;
+std::atomic<uint8_t> EventLog::levels[LOG_MODULE_COUNT];
+std::atomic<bool> EventLog::wakePending{false};
+void (*EventLog::wakeHandler)() = nullptr;
+uint32_t EventLog::serialCursor = 0;
+uint8_t EventLog::pendingOutput[LOG_LINE_SIZE];
+size_t EventLog::pendingLength = 0;
+size_t EventLog::pendingOffset = 0;
+EventLogStats EventLog::stats = {};
+
+void EventLog::begin(void (*wake)()) {
+    wakeHandler = wake;
+    for (uint8_t m = 0; m < LOG_MODULE_COUNT; m++) {
+        levels[m].store(LOG_DEFAULT_LEVEL, std::memory_order_relaxed);
+    }
+
+    // RAM keeps its contents through software and watchdog resets only
+    esp_reset_reason_t reason = esp_reset_reason();
+    bool kept = magic == LOG_MAGIC && reason != ESP_RST_UNKNOWN && reason != ESP_RST_POWERON &&
+                reason != ESP_RST_BROWNOUT && reason != ESP_RST_DEEPSLEEP;
+    if (!kept) {
+        for (size_t i = 0; i < LOG_RING_SIZE; i++) {
+            slots[i].sequence.store(0, std::memory_order_relaxed);
+        }
+        head.store(0, std::memory_order_relaxed);
+        magic = LOG_MAGIC;
+    }
+    bootHead = head.load(std::memory_order_relaxed);
+    serialCursor = bootHead;  // Earlier records are only sent on request over MQTT
+    LOG_EVENT(BOOT, reason, bootHead - oldest());
+}
+
+void EventLog::append(LogEvent event, uint8_t argc, int32_t a, int32_t b, int32_t c) {
+    LogRecord record = {(uint32_t)millis(), (uint16_t)event, argc, 0, {a, b, c}};
+    uint32_t words[LOG_RECORD_WORDS];
+    memcpy(words, &record, sizeof(record));
+
+    uint32_t n = head.fetch_add(1, std::memory_order_relaxed);
+    Slot& slot = slots[n & (LOG_RING_SIZE - 1)];
+    slot.sequence.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    for (size_t i = 0; i < LOG_RECORD_WORDS; i++) {
+        slot.words[i].store(words[i], std::memory_order_relaxed);
+    }
+    slot.sequence.store(n + 1, std::memory_order_release);
+
+    if (wakeHandler != nullptr && !wakePending.exchange(true, std::memory_order_acq_rel)) {
+        wakeHandler();
+    }
+}
+
+void EventLog::write(LogEvent event) {
+    append(event, 0, 0, 0, 0);
+}
+
+void EventLog::write(LogEvent event, int32_t a) {
+    append(event, 1, a, 0, 0);
+}
+
+void EventLog::write(LogEvent event, int32_t a, int32_t b) {
+    append(event, 2, a, b, 0);
+}
+
+void EventLog::write(LogEvent event, int32_t a, int32_t b, int32_t c) {
+    append(event, 3, a, b, c);
+}
+
+bool EventLog::read(uint32_t& cursor, LogRecord& out, uint32_t& skipped) {
+    uint32_t end = head.load(std::memory_order_acquire);
+    if (end - cursor > LOG_RING_SIZE) {
+        skipped += end - cursor - LOG_RING_SIZE;
+        cursor = end - LOG_RING_SIZE;
+    }
+
+    while (cursor != end) {
+        const Slot& slot = slots[cursor & (LOG_RING_SIZE - 1)];
+        uint32_t before = slot.sequence.load(std::memory_order_acquire);
+        if (before == cursor + 1) {
+            uint32_t words[LOG_RECORD_WORDS];
+            for (size_t i = 0; i < LOG_RECORD_WORDS; i++) {
+                words[i] = slot.words[i].load(std::memory_order_relaxed);
+            }
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (slot.sequence.load(std::memory_order_relaxed) == before) {
+                memcpy(&out, words, sizeof(out));
+                cursor++;
+                return true;
+            }
+            continue;  // Overwritten during the copy; look again
+        }
+        // A newer record took the slot, or a reset interrupted the write
+        if ((int32_t)(before - (cursor + 1)) > 0 || (int32_t)(cursor - bootHead) < 0) {
+            skipped++;
+            cursor++;
+            continue;
+        }
+        return false;  // Still being written
+    }
+    return false;
+}
+
+uint32_t EventLog::oldest() {
+    uint32_t end = head.load(std::memory_order_acquire);
+    return end - min(end, (uint32_t)LOG_RING_SIZE);
+}
+
+uint32_t EventLog::newest() {
+    return head.load(std::memory_order_acquire);
+}
+
+// CRC-8, polynomial 0x07
+static uint8_t crc8(const uint8_t* data, size_t length) {
+    uint8_t crc = 0;
+    for (size_t i = 0; i < length; i++) {
+        crc ^= data[i];
+        for (uint8_t bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x80) ? (crc << 1) ^ 0x07 : crc << 1;
+        }
+    }
+    return crc;
+}
+
+static uint8_t* putLE(uint8_t* p, uint32_t value, uint8_t bytes) {
+    for (uint8_t i = 0; i < bytes; i++) {
+        *p++ = value >> (8 * i);
+    }
+    return p;
+}
+
+size_t EventLog::encode(const LogRecord& record, uint8_t* out) {
+    uint8_t argc = min(record.argc, (uint8_t)LOG_MAX_ARGS);
+    uint8_t* p = out;
+    *p++ = LOG_FRAME_SYNC0;
+    *p++ = LOG_FRAME_SYNC1;
+    p = putLE(p, record.timestamp, 4);
+    p = putLE(p, record.event, 2);
+    *p++ = argc;
+    for (uint8_t i = 0; i < argc; i++) {
+        p = putLE(p, (uint32_t)record.args[i], 4);
+    }
+    *p = crc8(out + 2, p - (out + 2));
+    return p + 1 - out;
+}
+
+// Renders "[seconds] L module: message" with the event's placeholders filled in
+size_t EventLog::format(const LogRecord& record, char* out, size_t capacity) {
+    if (capacity == 0) {
+        return 0;
+    }
+    size_t n;
+    if (record.event >= EVENT_COUNT) {
+        n = snprintf(out, capacity, "[%lu.%03lu] ? unknown event %u", (unsigned long)(record.timestamp / 1000),
+                     (unsigned long)(record.timestamp % 1000), record.event);
+        return min(n, capacity - 1);
+    }
+
+    n = snprintf(out, capacity, "[%lu.%03lu] %c %s: ", (unsigned long)(record.timestamp / 1000),
+                 (unsigned long)(record.timestamp % 1000), "-EWID"[LOG_EVENT_LEVEL[record.event]],
+                 MODULE_NAMES[LOG_EVENT_MODULE[record.event]]);
+    n = min(n, capacity - 1);
+    uint8_t arg = 0;
+    for (const char* f = EVENT_FORMATS[record.event]; *f != '\0' && n + 1 < capacity; f++) {
+        if (*f != '%' || f[1] == '\0') {
+            out[n++] = *f;
+            continue;
+        }
+        int32_t value = arg < record.argc ? record.args[arg] : 0;
+        switch (*++f) {
+            case 'd':
+                n += snprintf(out + n, capacity - n, "%ld", (long)value);
+                arg++;
+                break;
+            case 'u':
+                n += snprintf(out + n, capacity - n, "%lu", (unsigned long)(uint32_t)value);
+                arg++;
+                break;
+            case 'x':
+                n += snprintf(out + n, capacity - n, "%lx", (unsigned long)(uint32_t)value);
+                arg++;
+                break;
+            case 'i':
+                // lwIP order: the first octet is the lowest byte
+                n += snprintf(out + n, capacity - n, "%u.%u.%u.%u", (unsigned)(value & 0xFF),
+                              (unsigned)((value >> 8) & 0xFF), (unsigned)((value >> 16) & 0xFF),
+                              (unsigned)((value >> 24) & 0xFF));
+                arg++;
+                break;
+            case 'm': {
+                int32_t fixed = arg + 1 < record.argc ? record.args[arg + 1] : 0;
+                if ((uint32_t)value < TOPIC_COUNT) {
+                    n += formatMetricLine(out + n, capacity - n, (DataTopic)value,
+                                          metricFromFixed((DataTopic)value, fixed), false);
+                }
+                arg += 2;
+                break;
+            }
+            case '{': {
+                // Pick the value-th of the '|'-separated names
+                const char* name = f + 1;
+                for (int32_t i = 0; i < value && *name != '}' && *name != '\0'; name++) {
+                    if (*name == '|') {
+                        i++;
+                    }
+                }
+                while (*name != '|' && *name != '}' && *name != '\0' && n + 1 < capacity) {
+                    out[n++] = *name++;
+                }
+                while (*f != '}' && f[1] != '\0') {
+                    f++;
+                }
+                arg++;
+                break;
+            }
+            default:
+                out[n++] = *f;
+                break;
+        }
+        n = min(n, capacity - 1);
+    }
+    out[n] = '\0';
+    return n;
+}
+
+bool EventLog::drain() {
+    wakePending.store(false, std::memory_order_release);
+    while (true) {
+        if (pendingOffset < pendingLength) {
+            int room = Serial.availableForWrite();
+            size_t left = pendingLength - pendingOffset;
+#if LOG_OUTPUT == LOG_OUTPUT_BINARY
+            // Frames go out whole so other Serial writers cannot split one
+            if (room < (int)left) {
+                room = 0;
+            }
+#endif
+            if (room <= 0) {
+                stats.deferred++;
+                return true;
+            }
+            size_t n = min(left, (size_t)room);
+            Serial.write(pendingOutput + pendingOffset, n);
+            pendingOffset += n;
+            stats.bytesOut += n;
+            if (pendingOffset < pendingLength) {
+                stats.deferred++;
+                return true;
+            }
+        }
+
+        LogRecord record;
+        uint32_t skipped = 0;
+        bool ready = read(serialCursor, record, skipped);
+        if (skipped > 0) {
+            stats.overwritten += skipped;
+            LOG_EVENT(LOG_OVERWRITTEN, skipped);
+        }
+        if (!ready) {
+            return false;
+        }
+#if LOG_OUTPUT == LOG_OUTPUT_BINARY
+        pendingLength = encode(record, pendingOutput);
+#else
+        pendingLength = format(record, reinterpret_cast<char*>(pendingOutput), sizeof(pendingOutput) - 2);
+        pendingOutput[pendingLength++] = '\r';
+        pendingOutput[pendingLength++] = '\n';
+#endif
+        pendingOffset = 0;
+    }
+}
+
+void EventLog::flush(unsigned long timeoutMillis) {
+    unsigned long started = millis();
+    while (drain() && millis() - started < timeoutMillis) {
+        delay(1);
+    }
+    Serial.flush();
+}
+
+void EventLog::setLevel(LogModule module, LogLevel level) {
+    levels[module].store(level, std::memory_order_relaxed);
+}
+
+LogLevel EventLog::getLevel(LogModule module) {
+    return (LogLevel)levels[module].load(std::memory_order_relaxed);
+}
+
+const char* EventLog::moduleName(LogModule module) {
+    return module < LOG_MODULE_COUNT ? MODULE_NAMES[module] : "unknown";
+}
+
+const char* EventLog::levelName(LogLevel level) {
+    return level <= LOG_LEVEL_DEBUG ? LEVEL_NAMES[level] : "unknown";
+}
+
+bool EventLog::parseModule(const char* name, size_t length, LogModule& out) {
+    for (uint8_t m = 0; m < LOG_MODULE_COUNT; m++) {
+        if (strlen(MODULE_NAMES[m]) == length && strncmp(MODULE_NAMES[m], name, length) == 0) {
+            out = (LogModule)m;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool EventLog::parseLevel(const char* name, LogLevel& out) {
+    for (uint8_t l = LOG_LEVEL_OFF; l <= LOG_LEVEL_DEBUG; l++) {
+        if (strcmp(LEVEL_NAMES[l], name) == 0) {
+            out = (LogLevel)l;
+            return true;
+        }
+    }
+    return false;
+}
+
+const EventLogStats& EventLog::getStats() {
+    return stats;
+}
+
+void EventLog::printStats() {
+    Serial.print("Event log: "); Serial.print(newest() - bootHead); Serial.print(" written | ");
+    Serial.print(stats.overwritten); Serial.print(" overwritten | ");
+    Serial.print(stats.bytesOut); Serial.print(" bytes out | ");
+    Serial.print(stats.deferred); Serial.println(" deferred");
+}
@@ -0,0 +1,35 @@
+#include "include/lib/heap_monitor.h"
+
+// Initialize static members
+HeapStats HeapMonitor::stats = {};
+
+void HeapMonitor::begin() {
+    stats.lowestLargestBlock = UINT32_MAX;
+    sample();
+}
+
+void HeapMonitor::sample() {
+    stats.freeBytes = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    stats.largestBlock = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+    stats.minimumFree = heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT);
+    stats.lowestLargestBlock = min(stats.lowestLargestBlock, stats.largestBlock);
+    stats.fragmentation = stats.freeBytes
+        ? 100 - (uint8_t)((uint64_t)stats.largestBlock * 100 / stats.freeBytes)
+        : 0;
+}
+
+const HeapStats& HeapMonitor::getStats() {
+    return stats;
+}
+
+bool HeapMonitor::isCritical() {
+    return stats.largestBlock < HEAP_CRITICAL_BLOCK;
+}
+
+void HeapMonitor::printStats() {
+    Serial.print("Heap: "); Serial.print(stats.freeBytes); Serial.print(" B free | largest block ");
+    Serial.print(stats.largestBlock); Serial.print(" B (lowest ");
+    Serial.print(stats.lowestLargestBlock); Serial.print(" B) | min free ");
+    Serial.print(stats.minimumFree); Serial.print(" B | fragmentation ");
+    Serial.print(stats.fragmentation); Serial.println("%");
+}
@@ -0,0 +1,148 @@
+#include "include/lib/i2c_bus.h"
+#include "include/lib/event_log.h"
+
+// Initialize static members
+const I2CBus::DeviceInfo I2CBus::devices[I2C_DEVICE_COUNT] = {
+    {"SGP30", 0, 400000},  // Baseline algorithm needs its 1 Hz cadence
+    {"SCD41", 1, 400000},
+    {"OLED", 2, 400000},
+};
+I2CStats I2CBus::stats[I2C_DEVICE_COUNT] = {};
+std::atomic<uint8_t> I2CBus::waiting[I2C_DEVICE_COUNT];
+SemaphoreHandle_t I2CBus::mutex = nullptr;
+uint32_t I2CBus::clock = I2C_BUS_CLOCK;
+unsigned long I2CBus::startedAt = 0;
+
+void I2CBus::begin() {
+    mutex = xSemaphoreCreateMutex();
+    for (uint8_t i = 0; i < I2C_DEVICE_COUNT; i++) {
+        waiting[i] = 0;
+    }
+
+    // A device may still be holding SDA from before a reset
+    if (busStuck()) {
+        recoverBus();
+    }
+    Wire.begin(I2C_SDA_PIN, I2C_SCL_PIN, clock);
+    Wire.setTimeOut(I2C_WIRE_TIMEOUT);
+}
+
+bool I2CBus::moreUrgentWaiting(I2CDevice device) {
+    for (uint8_t i = 0; i < I2C_DEVICE_COUNT; i++) {
+        if (devices[i].priority < devices[device].priority && waiting[i] > 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool I2CBus::acquire(I2CDevice device, uint32_t timeoutMs) {
+    unsigned long start = millis();
+    bool acquired = false;
+
+    waiting[device]++;
+    while (true) {
+        unsigned long elapsed = millis() - start;
+        TickType_t wait = elapsed < timeoutMs ? pdMS_TO_TICKS(timeoutMs - elapsed) : 0;
+
+        if (xSemaphoreTake(mutex, wait) == pdTRUE) {
+            if (!moreUrgentWaiting(device)) {
+                acquired = true;
+                break;
+            }
+            // Step aside and let the more urgent device take it first
+            xSemaphoreGive(mutex);
+            if (timeoutMs == 0) {
+                break;
+            }
+            vTaskDelay(1);
+        }
+        if (millis() - start >= timeoutMs) {
+            break;
+        }
+    }
+    waiting[device]--;
+
+    if (!acquired) {
+        stats[device].busyRejects++;
+        return false;
+    }
+
+    if (clock != devices[device].clock) {
+        clock = devices[device].clock;
+        Wire.setClock(clock);
+    }
+    startedAt = micros();
+    return true;
+}
+
+void I2CBus::release(I2CDevice device, bool ok) {
+    I2CStats& s = stats[device];
+    uint32_t elapsed = micros() - startedAt;
+    s.transactions++;
+    s.totalMicros += elapsed;
+    s.maxMicros = max(s.maxMicros, elapsed);
+
+    if (!ok) {
+        s.errors++;
+        // Only clear the bus if a device is actually holding SDA low; a
+        // single misbehaving sensor otherwise recovers on its own
+        if (busStuck()) {
+            s.recoveries++;
+            recoverBus();
+        }
+    }
+    xSemaphoreGive(mutex);
+}
+
+bool I2CBus::busStuck() {
+    return digitalRead(I2C_SDA_PIN) == LOW && digitalRead(I2C_SCL_PIN) == HIGH;
+}
+
+// Standard bus clear: clock SCL up to nine times until the slave holding SDA
+// finishes its byte, then issue a STOP. Takes about 100 us.
+void I2CBus::recoverBus() {
+    Wire.end();
+
+    pinMode(I2C_SDA_PIN, INPUT_PULLUP);
+    pinMode(I2C_SCL_PIN, OUTPUT_OPEN_DRAIN);
+    digitalWrite(I2C_SCL_PIN, HIGH);
+
+    for (uint8_t i = 0; i < 9 && digitalRead(I2C_SDA_PIN) == LOW; i++) {
+        digitalWrite(I2C_SCL_PIN, LOW);
+        delayMicroseconds(5);
+        digitalWrite(I2C_SCL_PIN, HIGH);
+        delayMicroseconds(5);
+    }
+
+    // STOP condition: SDA rises while SCL is high
+    pinMode(I2C_SDA_PIN, OUTPUT_OPEN_DRAIN);
+    digitalWrite(I2C_SCL_PIN, LOW);
+    digitalWrite(I2C_SDA_PIN, LOW);
+    delayMicroseconds(5);
+    digitalWrite(I2C_SCL_PIN, HIGH);
+    delayMicroseconds(5);
+    digitalWrite(I2C_SDA_PIN, HIGH);
+    delayMicroseconds(5);
+
+    Wire.begin(I2C_SDA_PIN, I2C_SCL_PIN, clock);
+    Wire.setTimeOut(I2C_WIRE_TIMEOUT);
+    LOG_EVENT(I2C_CLEARED);
+}
+
+const I2CStats& I2CBus::getStats(I2CDevice device) {
+    return stats[device];
+}
+
+void I2CBus::printStats() {
+    for (uint8_t i = 0; i < I2C_DEVICE_COUNT; i++) {
+        const I2CStats& s = stats[i];
+        Serial.print("I2C "); Serial.print(devices[i].name); Serial.print(": ");
+        Serial.print(s.transactions); Serial.print(" transactions | ");
+        Serial.print(s.errors); Serial.print(" errors | ");
+        Serial.print(s.busyRejects); Serial.print(" busy | ");
+        Serial.print(s.recoveries); Serial.print(" bus clears | mean ");
+        Serial.print(s.transactions ? (unsigned long)(s.totalMicros / s.transactions) : 0UL); Serial.print(" us | max ");
+        Serial.print(s.maxMicros); Serial.println(" us");
+    }
+}
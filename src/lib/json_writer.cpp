@@ -0,0 +1,115 @@
+#include "include/lib/json_writer.h"
+
+JsonWriter::JsonWriter(char* buffer, size_t capacity)
+    : buffer(buffer), capacity(capacity), len(0), overflow(false), first(true) {
+    if (capacity > 0) {
+        buffer[0] = '\0';
+    }
+}
+
+void JsonWriter::append(char c) {
+    if (len + 1 >= capacity) {
+        overflow = true;
+        return;
+    }
+    buffer[len++] = c;
+    buffer[len] = '\0';
+}
+
+void JsonWriter::append(const char* text) {
+    while (*text) {
+        append(*text++);
+    }
+}
+
+void JsonWriter::appendUnsigned(unsigned long long value) {
+    char digits[20];
+    uint8_t count = 0;
+    do {
+        digits[count++] = '0' + (value % 10);
+        value /= 10;
+    } while (value > 0);
+    while (count > 0) {
+        append(digits[--count]);
+    }
+}
+
+void JsonWriter::appendKey(const char* key) {
+    if (!first) {
+        append(',');
+    }
+    first = false;
+    append('"');
+    append(key);
+    append("\":");
+}
+
+void JsonWriter::beginObject() {
+    append('{');
+    first = true;
+}
+
+void JsonWriter::beginObject(const char* key) {
+    appendKey(key);
+    beginObject();
+}
+
+void JsonWriter::endObject() {
+    append('}');
+    first = false;
+}
+
+void JsonWriter::add(const char* key, long value) {
+    appendKey(key);
+    if (value < 0) {
+        append('-');
+        appendUnsigned((unsigned long long)(-(long long)value));
+    } else {
+        appendUnsigned((unsigned long long)value);
+    }
+}
+
+// Fixed-point formatting avoids printf's float path, which can allocate
+void JsonWriter::add(const char* key, float value, uint8_t decimals) {
+    appendKey(key);
+    if (isnan(value) || isinf(value)) {
+        append("null");
+        return;
+    }
+
+    char number[32];
+    formatFixed(number, sizeof(number), value, decimals);
+    append(number);
+}
+
+void JsonWriter::add(const char* key, const char* value) {
+    appendKey(key);
+    append('"');
+    for (; *value; value++) {
+        char c = *value;
+        if (c == '"' || c == '\\') {
+            append('\\');
+            append(c);
+        } else if ((uint8_t)c < 0x20) {
+            static const char hex[] = "0123456789abcdef";
+            append("\\u00");
+            append(hex[(c >> 4) & 0x0F]);
+            append(hex[c & 0x0F]);
+        } else {
+            append(c);
+        }
+    }
+    append('"');
+}
+
+const char* JsonWriter::c_str() const {
+    return buffer;
+}
+
+size_t JsonWriter::length() const {
+    return len;
+}
+
+bool JsonWriter::ok() const {
+    return !overflow;
+}
@@ -0,0 +1,85 @@
+#include "include/lib/loop_profiler.h"
+
+// Initialize static members
+uint32_t LoopProfiler::buckets[LOOP_PROFILER_BUCKETS] = {0};
+uint32_t LoopProfiler::iterations = 0;
+uint32_t LoopProfiler::maxMicros = 0;
+uint64_t LoopProfiler::totalMicros = 0;
+uint32_t LoopProfiler::heapShrinks = 0;
+uint32_t LoopProfiler::iterationStart = 0;
+uint32_t LoopProfiler::heapAtStart = 0;
+unsigned long LoopProfiler::windowStart = 0;
+
+uint8_t LoopProfiler::bucketFor(uint32_t micros) {
+    uint8_t bucket = 0;
+    while (micros > 1 && bucket < LOOP_PROFILER_BUCKETS - 1) {
+        micros >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+void LoopProfiler::reset(unsigned long now) {
+    memset(buckets, 0, sizeof(buckets));
+    iterations = 0;
+    maxMicros = 0;
+    totalMicros = 0;
+    heapShrinks = 0;
+    windowStart = now;
+}
+
+void LoopProfiler::begin() {
+    reset(millis());
+}
+
+void LoopProfiler::beginIteration() {
+    heapAtStart = ESP.getFreeHeap();
+    iterationStart = micros();
+}
+
+void LoopProfiler::endIteration() {
+    uint32_t elapsed = micros() - iterationStart;
+
+    buckets[bucketFor(elapsed)]++;
+    iterations++;
+    totalMicros += elapsed;
+    if (elapsed > maxMicros) {
+        maxMicros = elapsed;
+    }
+    if (ESP.getFreeHeap() < heapAtStart) {
+        heapShrinks++;
+    }
+
+    unsigned long now = millis();
+    if (now - windowStart >= LOOP_PROFILER_REPORT_INTERVAL) {
+        report();
+        reset(now);
+    }
+}
+
+// Returns the upper bound (in microseconds) of the bucket holding the given percentile
+uint32_t LoopProfiler::percentile(uint8_t pct) {
+    if (iterations == 0) {
+        return 0;
+    }
+
+    uint64_t target = ((uint64_t)iterations * pct + 99) / 100;
+    uint64_t seen = 0;
+    for (uint8_t i = 0; i < LOOP_PROFILER_BUCKETS; i++) {
+        seen += buckets[i];
+        if (seen >= target) {
+            return 1UL << (i + 1);
+        }
+    }
+    return maxMicros;
+}
+
+void LoopProfiler::report() {
+    Serial.print("Loop: "); Serial.print(iterations); Serial.print(" wake-ups | ");
+    Serial.print("mean: "); Serial.print(iterations ? (unsigned long)(totalMicros / iterations) : 0UL); Serial.print(" us | ");
+    Serial.print("p50: <"); Serial.print(percentile(50)); Serial.print(" us | ");
+    Serial.print("p95: <"); Serial.print(percentile(95)); Serial.print(" us | ");
+    Serial.print("p99: <"); Serial.print(percentile(99)); Serial.print(" us | ");
+    Serial.print("max: "); Serial.print(maxMicros); Serial.print(" us | ");
+    Serial.print("heap shrinks: "); Serial.println(heapShrinks);
+}
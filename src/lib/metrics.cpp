@@ -0,0 +1,45 @@
+#include "include/lib/metrics.h"
+#include "include/lib/fixed_format.h"
+#include "include/lib/enhanced_aqi.h"
+
+#define METRIC_REPORT_INDEX_FILTERED(id) REPORT_##id
+#define METRIC_REPORT_INDEX_UNFILTERED(id) REPORT_NONE
+#define METRIC_DESCRIPTOR(id, key, label, shortLabel, unit, ascii, decimals, row, rowLabel, kind, report, field, scale, ha) \
+    {key, shortLabel, unit, ascii, decimals, row, rowLabel, METRIC_##kind, METRIC_REPORT_INDEX_##report(id), SAMPLE_SCALE_##scale},
+const MetricDescriptor METRICS[TOPIC_COUNT] = {
+    METRIC_TABLE(METRIC_DESCRIPTOR)
+};
+#undef METRIC_DESCRIPTOR
+#undef METRIC_REPORT_INDEX_FILTERED
+#undef METRIC_REPORT_INDEX_UNFILTERED
+
+int32_t metricFixed(const SensorSnapshot& s, DataTopic topic) {
+    switch (topic) {
+#define METRIC_FIXED(id, key, label, shortLabel, unit, ascii, decimals, row, rowLabel, kind, report, field, scale, ha) \
+        case TOPIC_##id: return s.field;
+        METRIC_TABLE(METRIC_FIXED)
+#undef METRIC_FIXED
+        default: return 0;
+    }
+}
+
+float metricValue(const SensorSnapshot& s, DataTopic topic) {
+    return metricFromFixed(topic, metricFixed(s, topic));
+}
+
+size_t formatMetric(char* out, size_t capacity, DataTopic topic, float value) {
+    const MetricDescriptor& metric = METRICS[topic];
+    if (metric.kind == METRIC_TEXT) {
+        // Pollutant is the only TEXT metric
+        return snprintf(out, capacity, "%s", EnhancedAQI::pollutantName((Pollutant)(int)value));
+    }
+    return formatFixed(out, capacity, value, metric.decimals);
+}
+
+size_t formatMetricLine(char* out, size_t capacity, DataTopic topic, float value, bool forDisplay) {
+    const MetricDescriptor& metric = METRICS[topic];
+    const char* unit = forDisplay ? metric.displayUnit : metric.unit;
+    char number[16];
+    formatMetric(number, sizeof(number), topic, value);
+    return snprintf(out, capacity, unit[0] != '\0' ? "%s: %s %s" : "%s: %s", metric.label, number, unit);
+}
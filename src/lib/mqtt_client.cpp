@@ -1,78 +1,403 @@
 #include "include/lib/mqtt_client.h"
+#include "include/lib/power_manager.h"
+#include "include/lib/event_log.h"
+#include "include/lib/enhanced_aqi.h"
+
+// Discovery configs are expanded from METRIC_TABLE by the preprocessor, so
+// each one is a single string literal in flash
+#define HA_CONFIG_TOPIC(key) "homeassistant/sensor/esp32_" key "/config"
+#define HA_UNIQUE_ID(key) ",\"uniq_id\":\"esp32_aq_" key "\""
+#define HA_AVAILABILITY ",\"avty_t\":\"" MQTT_AVAILABILITY_TOPIC "\""
+#define HA_DEVICE ",\"dev\":{\"ids\":[\"" MQTT_DEVICE_ID "\"],\"name\":\"" MQTT_DEVICE_NAME "\",\"mf\":\"DIY\",\"mdl\":\"SCD41 SGP30 PMS7003\"}"
+#define HA_KIND_NUMBER(unit, decimals) ",\"unit_of_meas\":\"" unit "\",\"stat_cla\":\"measurement\",\"sug_dsp_prc\":" #decimals
+#define HA_KIND_TEXT(unit, decimals) ""
+#if MQTT_BATCHED_STATE
+#define HA_STATE(key) ",\"stat_t\":\"" MQTT_STATE_TOPIC "\",\"val_tpl\":\"{{ value_json." key " }}\""
+#else
+#define HA_STATE(key) ",\"stat_t\":\"" MQTT_LEGACY_TOPIC(key) "\""
+#endif
+
+#define DISCOVERY_CONFIG(id, key, label, shortLabel, unit, ascii, decimals, row, rowLabel, kind, report, field, scale, ha) \
+    {HA_CONFIG_TOPIC(key), "{\"name\":\"" label "\"" HA_UNIQUE_ID(key) HA_STATE(key) HA_KIND_##kind(unit, decimals) \
+                           ha HA_AVAILABILITY HA_DEVICE "}"},
+#define HEAP_CONFIG(key, label) \
+    {HA_CONFIG_TOPIC(key), "{\"name\":\"" label "\"" HA_UNIQUE_ID(key) ",\"stat_t\":\"" MQTT_HEALTH_TOPIC "\"," \
+                           "\"val_tpl\":\"{{ value_json." key " }}\",\"unit_of_meas\":\"B\",\"ent_cat\":\"diagnostic\"" \
+                           HA_AVAILABILITY HA_DEVICE "}"},
+
+struct DiscoveryConfig {
+    const char* topic;
+    const char* payload;
+};
+
+static const DiscoveryConfig DISCOVERY[] = {
+    METRIC_TABLE(DISCOVERY_CONFIG)
+    HEAP_CONFIG("heap_free", "Free Heap")
+    HEAP_CONFIG("heap_largest", "Largest Free Block")
+};
+
+#if !MQTT_BATCHED_STATE
+#define LEGACY_TOPIC(id, key, label, shortLabel, unit, ascii, decimals, row, rowLabel, kind, report, field, scale, ha) MQTT_LEGACY_TOPIC(key),
+static const char* const LEGACY_TOPICS[TOPIC_COUNT] = {
+    METRIC_TABLE(LEGACY_TOPIC)
+};
+#endif
 
 // Initialize static members
 WiFiClient MQTTClient::espClient;
-PubSubClient MQTTClient::client(MQTTClient::espClient);
+MQTTSession MQTTClient::session(MQTTClient::espClient);
 bool MQTTClient::initialized = false;
+char MQTTClient::stateBuffer[MQTT_STATE_BUFFER_SIZE];
+uint32_t MQTTClient::stateSequence = 0;
+RTC_STATE_ATTR bool MQTTClient::discoveryPublished = false;
+bool MQTTClient::discoveryRequested = false;
+bool MQTTClient::logDumpRequested = false;
+uint32_t MQTTClient::logDumpCursor = 0;
+uint32_t MQTTClient::logDumpEnd = 0;
+char MQTTClient::statsBuffer[MQTT_STATS_BUFFER_SIZE];
+MQTTStats MQTTClient::stats = {};
 
 bool MQTTClient::init() {
     if (!WiFi.isConnected()) {
-        Serial.println("Cannot initialize MQTT - WiFi not connected");
+        LOG_EVENT(MQTT_NO_WIFI);
         return false;
     }
 
     if (!initialized) {
-        client.setClient(espClient);
-        client.setServer(MQTT_SERVER, MQTT_PORT);
+        session.setKeepAlive(MQTT_KEEPALIVE);
+        session.setSocketTimeout(MQTT_SOCKET_TIMEOUT * 1000UL);
+        session.setWill(MQTT_AVAILABILITY_TOPIC, "offline", true);
+        session.setCallback(onMessage);
         initialized = true;
     }
 
-    if (client.connected()) {
+    if (session.connected()) {
         return true;
     }
 
-    Serial.print("Connecting to MQTT...");
-    
-    if (client.connect(MQTT_CLIENT_ID, MQTT_USER, MQTT_PASS)) {
-        Serial.println("connected");
-        // Register MQTT topics with correct state_topic
-        client.publish("homeassistant/sensor/esp32_temperature/config", 
-            "{\"name\":\"ESP32 Temperature\",\"state_topic\":\"homeassistant/sensor/esp32_temperature/state\",\"unit_of_measurement\":\"°F\",\"device_class\":\"temperature\"}");
-        client.publish("homeassistant/sensor/esp32_humidity/config", 
-            "{\"name\":\"ESP32 Humidity\",\"state_topic\":\"homeassistant/sensor/esp32_humidity/state\",\"unit_of_measurement\":\"%\",\"device_class\":\"humidity\"}");
-        client.publish("homeassistant/sensor/esp32_pressure/config", 
-            "{\"name\":\"ESP32 CO2\",\"state_topic\":\"homeassistant/sensor/esp32_co2/state\",\"unit_of_measurement\":\"ppm\",\"device_class\":\"carbon_dioxide\"}");
-        client.publish("homeassistant/sensor/esp32_pm1_0/config", 
-            "{\"name\":\"ESP32 PM1.0\",\"state_topic\":\"homeassistant/sensor/esp32_pm1_0/state\",\"unit_of_measurement\":\"µg/m³\"}");
-        client.publish("homeassistant/sensor/esp32_pm2_5/config", 
-            "{\"name\":\"ESP32 PM2.5\",\"state_topic\":\"homeassistant/sensor/esp32_pm2_5/state\",\"unit_of_measurement\":\"µg/m³\"}");
-        client.publish("homeassistant/sensor/esp32_pm10/config", 
-            "{\"name\":\"ESP32 PM10\",\"state_topic\":\"homeassistant/sensor/esp32_pm10/state\",\"unit_of_measurement\":\"µg/m³\"}");
-        client.publish("homeassistant/sensor/esp32_aqi/config", 
-            "{\"name\":\"ESP32 AQI\",\"state_topic\":\"homeassistant/sensor/esp32_aqi/state\",\"unit_of_measurement\":\"AQI\"}");
-        client.publish("homeassistant/sensor/esp32_tvoc/config",
-            "{\"name\":\"ESP32 TVOC\",\"state_topic\":\"homeassistant/sensor/esp32_tvoc/state\",\"unit_of_measurement\":\"ppb\"}");
-        client.publish("homeassistant/sensor/esp32_h2/config",
-            "{\"name\":\"ESP32 H2\",\"state_topic\":\"homeassistant/sensor/esp32_h2/state\",\"unit_of_measurement\":\"res\"}");
-        client.publish("homeassistant/sensor/esp32_ethanol/config",
-            "{\"name\":\"ESP32 Ethanol\",\"state_topic\":\"homeassistant/sensor/esp32_ethanol/state\",\"unit_of_measurement\":\"res\"}");
+    session.setSocket(-1);
+    if (session.connect(MQTT_SERVER, MQTT_PORT, MQTT_CLIENT_ID, MQTT_USER, MQTT_PASS)) {
+        espClient.setNoDelay(true);
+        session.setSocket(espClient.fd());
+        publishAvailability(true);
+        session.subscribe(MQTT_BIRTH_TOPIC, 1);
+        session.subscribe(MQTT_LOG_REQUEST_TOPIC, 1);
+        // The configs are retained, so after the first complete burst only
+        // a Home Assistant restart brings them out again
+        if (!discoveryPublished) {
+            discoveryPublished = publishDiscovery();
+        }
         return true;
     } else {
-        Serial.print("failed, rc=");
-        Serial.println(client.state());
         return false;
     }
 }
 
+// Discovery goes out as one burst, so wait for send buffer space rather
+// than drop a config
+bool MQTTClient::publishConfig(const char* topic, const char* payload) {
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(payload);
+    size_t length = strlen(payload);
+    if (session.publish(topic, bytes, length, 0, true)) {
+        return true;
+    }
+    session.flush(MQTT_SOCKET_TIMEOUT * 1000UL);
+    return session.publish(topic, bytes, length, 0, true);
+}
+
+bool MQTTClient::publishDiscovery() {
+    bool sent = true;
+    for (size_t i = 0; i < sizeof(DISCOVERY) / sizeof(DISCOVERY[0]); i++) {
+        sent &= publishConfig(DISCOVERY[i].topic, DISCOVERY[i].payload);
+    }
+    LOG_EVENT(MQTT_DISCOVERY, sent);
+    return sent;
+}
+
+// Retained, and replaced by the broker with the "offline" will if the
+// connection drops without a DISCONNECT
+bool MQTTClient::publishAvailability(bool online) {
+    const char* payload = online ? "online" : "offline";
+    return publish(MQTT_AVAILABILITY_TOPIC, reinterpret_cast<const uint8_t*>(payload), strlen(payload), 0, true);
+}
+
+// Home Assistant publishes "online" on the birth topic each time it starts
+void MQTTClient::onMessage(const char* topic, const uint8_t* payload, size_t length) {
+    if (strcmp(topic, MQTT_BIRTH_TOPIC) == 0 && length == 6 && memcmp(payload, "online", 6) == 0) {
+        discoveryRequested = true;
+    } else if (strcmp(topic, MQTT_LOG_REQUEST_TOPIC) == 0) {
+        logDumpRequested = true;
+    }
+}
+
+// One publish of whole frames per call, so a dump never holds up the state
+// documents; a failed publish is retried from the same record
+void MQTTClient::publishLogChunk() {
+    uint8_t* chunk = reinterpret_cast<uint8_t*>(statsBuffer);
+    size_t length = 0;
+    uint32_t cursor = logDumpCursor;
+    uint32_t skipped = 0;
+    LogRecord record;
+    while ((int32_t)(logDumpEnd - cursor) > 0 && length + LOG_FRAME_MAX <= sizeof(statsBuffer) &&
+           EventLog::read(cursor, record, skipped)) {
+        length += EventLog::encode(record, chunk + length);
+    }
+    if (length == 0) {
+        logDumpEnd = cursor;  // Nothing left, or the rest was overwritten
+        return;
+    }
+    if (publish(MQTT_LOG_TOPIC, chunk, length)) {
+        logDumpCursor = cursor;
+    }
+}
+
 bool MQTTClient::isConnected() {
-    return client.connected();
+    return session.connected();
 }
 
-bool MQTTClient::publish(const char* topic, const String& payload) {
-    if (!client.connected()) {
+bool MQTTClient::publish(const char* topic, const char* payload) {
+    return publish(topic, reinterpret_cast<const uint8_t*>(payload), strlen(payload));
+}
+
+// Queues the packet; false means it was not accepted (disconnected, send
+// buffer full or QoS1 window full) and the caller still owns the data
+bool MQTTClient::publish(const char* topic, const uint8_t* payload, size_t length, uint8_t qos, bool retained,
+                         uint32_t sequence) {
+    if (!session.connected()) {
         return false;
     }
-    return client.publish(topic, payload.c_str());
+
+    uint32_t started = micros();
+    bool sent = session.publish(topic, payload, length, qos, retained, sequence);
+    uint32_t elapsed = micros() - started;
+
+    stats.publishes++;
+    if (!sent) {
+        stats.failures++;
+    }
+    stats.bytes += strlen(topic) + length;
+    stats.totalLatencyMicros += elapsed;
+    if (elapsed > stats.maxLatencyMicros) {
+        stats.maxLatencyMicros = elapsed;
+    }
+    return sent;
 }
 
-void MQTTClient::disconnect() {
-    if (client.connected()) {
-        client.disconnect();
+// Adds one metric at its published precision
+static void addMetric(PayloadEncoder& doc, DataTopic topic, float value) {
+    const MetricDescriptor& metric = METRICS[topic];
+    if (metric.kind == METRIC_TEXT) {
+        doc.add(metric.key, EnhancedAQI::pollutantName((Pollutant)(int)value));
+    } else if (metric.decimals == 0) {
+        doc.add(metric.key, lroundf(value));
+    } else {
+        doc.add(metric.key, value, metric.decimals);
+    }
+}
+
+#if !MQTT_BATCHED_STATE
+// Legacy per-topic payload: the bare value, formatted into the static state buffer
+bool MQTTClient::publishValue(DataTopic topic, float value) {
+    formatMetric(stateBuffer, sizeof(stateBuffer), topic, value);
+    return publish(LEGACY_TOPICS[topic], stateBuffer);
+}
+#endif
+
+bool MQTTClient::publishState(const SensorSnapshot& s, uint32_t timestamp, uint16_t metrics) {
+#if MQTT_BATCHED_STATE
+    // One document per interval, serialized into a static buffer. Without
+    // wall-clock time the reading is stamped with uptime instead.
+    PayloadEncoder doc(stateBuffer, sizeof(stateBuffer));
+    doc.begin();
+    if (timestamp != 0) {
+        doc.add("ts", (long)timestamp);
+    } else {
+        doc.add("uptime", (long)(millis() / 1000));
+    }
+    doc.add("seq", (long)++stateSequence);
+    for (uint8_t t = 0; t < TOPIC_COUNT; t++) {
+        addMetric(doc, (DataTopic)t, metricValue(s, (DataTopic)t));
+    }
+    if (s.suspect != 0) {
+        doc.add("suspect", (long)s.suspect);  // DataTopic bits of degraded or invalid readings
+    }
+    doc.end();
+
+    if (!doc.ok()) {
+        LOG_EVENT(MQTT_STATE_TRUNCATED);
+        return false;
+    }
+    return publish(MQTT_STATE_TOPIC, doc.data(), doc.length(), MQTT_STATE_QOS);
+#else
+    // Metrics the filter does not track go out alongside every report
+    bool sent = true;
+    for (uint8_t t = 0; t < TOPIC_COUNT; t++) {
+        uint8_t report = METRICS[t].report;
+        if (report == REPORT_NONE || (metrics & (1U << report))) {
+            sent &= publishValue((DataTopic)t, metricValue(s, (DataTopic)t));
+        }
+    }
+    return sent;
+#endif
+}
+
+// Replays a stored reading with its original timestamp
+bool MQTTClient::publishBackfill(const StoredSample& sample, uint32_t timestamp, bool uptimeOnly) {
+    PayloadEncoder doc(stateBuffer, sizeof(stateBuffer));
+    doc.begin();
+    doc.add(uptimeOnly ? "uptime" : "ts", (long)timestamp);
+    doc.add("seq", (long)sample.sequence);
+    // Stored records carry every metric but the 24 h AQI
+    SensorSnapshot s;
+    s.sample = sample.record;
+    for (uint8_t t = 0; t < TOPIC_COUNT; t++) {
+        if (t != TOPIC_AQI_24H) {
+            addMetric(doc, (DataTopic)t, metricValue(s, (DataTopic)t));
+        }
+    }
+    if (sample.record.suspect != 0) {
+        doc.add("suspect", (long)DataBus::suspectTopics(sample.record.suspect));
+    }
+    doc.end();
+
+    return doc.ok() && publish(MQTT_BACKFILL_TOPIC, doc.data(), doc.length(), MQTT_STATE_QOS, false, sample.sequence);
+}
+
+// Publishes the statistics of a completed window, one object per metric
+bool MQTTClient::publishAggregates(const AggregateReport& report) {
+    JsonWriter json(statsBuffer, sizeof(statsBuffer));
+    json.beginObject();
+    for (uint8_t m = 0; m < AGG_METRIC_COUNT; m++) {
+        const WindowStats& stats = report.stats[m];
+        json.beginObject(Aggregator::metricName((AggregateMetric)m));
+        json.add("n", (long)stats.count);
+        json.add("min", stats.min, 2);
+        json.add("max", stats.max, 2);
+        json.add("mean", stats.mean, 2);
+        json.add("sd", stats.stddev, 2);
+        json.add("p95", stats.p95, 2);
+        json.endObject();
+    }
+    json.endObject();
+
+    if (!json.ok()) {
+        LOG_EVENT(MQTT_STATS_TRUNCATED);
+        return false;
+    }
+
+    char topic[sizeof(MQTT_STATS_TOPIC_PREFIX) + 4];
+    snprintf(topic, sizeof(topic), "%s%s", MQTT_STATS_TOPIC_PREFIX, Aggregator::windowName(report.window));
+    return publish(topic, json.c_str());
+}
+
+// Heap and stack headroom, so long-run degradation is visible remotely
+bool MQTTClient::publishHealth(const HeapStats& heap, const TaskHealth* tasks, uint8_t count) {
+    JsonWriter json(statsBuffer, sizeof(statsBuffer));
+    json.beginObject();
+    json.add("uptime", (long)(millis() / 1000));
+    json.add("heap_free", (long)heap.freeBytes);
+    json.add("heap_largest", (long)heap.largestBlock);
+    json.add("heap_largest_min", (long)heap.lowestLargestBlock);
+    json.add("heap_min", (long)heap.minimumFree);
+    json.add("heap_frag", (long)heap.fragmentation);
+    json.beginObject("stack_free");
+    for (uint8_t i = 0; i < count; i++) {
+        json.add(tasks[i].name, (long)tasks[i].stackFree);
     }
+    json.endObject();
+    json.endObject();
+
+    return json.ok() && publish(MQTT_HEALTH_TOPIC, json.c_str());
+}
+
+// Retained, so a subscriber sees the current sensor states right away
+bool MQTTClient::publishDiagnostics(const SensorHealthInfo* sensors, uint8_t count) {
+    JsonWriter json(statsBuffer, sizeof(statsBuffer));
+    unsigned long now = millis();
+    json.beginObject();
+    json.add("uptime", (long)(now / 1000));
+    for (uint8_t i = 0; i < count; i++) {
+        const SensorHealthInfo& info = sensors[i];
+        json.beginObject(SensorHealth::name((HealthSensor)i));
+        json.add("state", SensorHealth::stateName(info.state));
+        json.add("stage", SensorHealth::stageName(info.stage));
+        json.add("failures", (long)info.failures);
+        json.add("outages", (long)info.outages);
+        json.add("resets", (long)info.resets);
+        json.add("last_outage_s", (long)(info.lastOutageMillis / 1000));
+        json.add("max_outage_s", (long)(info.maxOutageMillis / 1000));
+        json.add("since_sample_s", (long)((now - info.lastSuccess) / 1000));
+        json.endObject();
+    }
+    json.endObject();
+
+    return json.ok() && publish(MQTT_DIAGNOSTICS_TOPIC, (const uint8_t*)json.c_str(), strlen(json.c_str()), 0, true);
+}
+
+const MQTTStats& MQTTClient::getStats() {
+    return stats;
+}
+
+void MQTTClient::printStats() {
+    Serial.print("MQTT: "); Serial.print(stats.publishes); Serial.print(" publishes | ");
+    Serial.print(stats.failures); Serial.print(" failed | ");
+    Serial.print(stats.bytes); Serial.print(" bytes | ");
+    Serial.print("mean latency: ");
+    Serial.print(stats.publishes ? (unsigned long)(stats.totalLatencyMicros / stats.publishes) : 0UL);
+    Serial.print(" us | ");
+    Serial.print("max latency: "); Serial.print(stats.maxLatencyMicros); Serial.println(" us");
+
+    const MQTTSessionStats& qos = session.getStats();
+    Serial.print("MQTT QoS1: "); Serial.print(qos.acked); Serial.print(" acked | ");
+    Serial.print(session.inFlight()); Serial.print(" in flight | ");
+    Serial.print(qos.retransmitted); Serial.print(" resent | ");
+    Serial.print("ack RTT mean: ");
+    Serial.print(qos.acked ? (unsigned long)(qos.totalAckMillis / qos.acked) : 0UL);
+    Serial.print(" ms, max: "); Serial.print(qos.maxAckMillis); Serial.print(" ms | ");
+    Serial.print(qos.windowFull); Serial.print(" window full | ");
+    Serial.print(qos.bufferFull); Serial.print(" buffer full | ");
+    Serial.print("send buffer peak: "); Serial.print(qos.txHighWater); Serial.print(" B | ");
+    Serial.print(qos.stalls); Serial.print(" stalls | ");
+    Serial.print(qos.keepaliveTimeouts); Serial.println(" keepalive timeouts");
+}
+
+// Flushes anything queued before closing, so a last message before a
+// reboot still goes out
+void MQTTClient::disconnect() {
+    session.disconnect();
 }
 
 void MQTTClient::loop() {
-    if (client.connected()) {
-        client.loop();
+    session.loop();
+    // Not done from onMessage, which runs while the receive buffer is being
+    // parsed and a full send buffer would recurse into it
+    if (discoveryRequested && session.connected()) {
+        discoveryRequested = false;
+        discoveryPublished = publishDiscovery();
+        publishAvailability(true);
+        ReportFilter::invalidate();  // Fresh states for the rebuilt entities
+    }
+    if (logDumpRequested) {
+        // Only what is in the ring now; records logged during the dump
+        // are left for the next request
+        logDumpRequested = false;
+        logDumpCursor = EventLog::oldest();
+        logDumpEnd = EventLog::newest();
+        LOG_EVENT(MQTT_LOG_DUMP, logDumpEnd - logDumpCursor);
+    }
+    if (logDumpCursor != logDumpEnd && session.connected()) {
+        publishLogChunk();
     }
-} 
\ No newline at end of file
+}
+
+bool MQTTClient::hasPendingWrites() {
+    return session.hasPendingWrites();
+}
+
+uint8_t MQTTClient::inFlight() {
+    return session.inFlight();
+}
+
+uint32_t MQTTClient::backfillAcked() {
+    return session.acknowledgedSequence();
+} 
@@ -0,0 +1,561 @@
+#include "include/lib/mqtt_session.h"
+
+#if defined(ESP32)
+#include <lwip/sockets.h>
+#endif
+
+// MQTT 3.1.1 control packet types (upper nibble of the fixed header)
+#define MQTT_CONNECT 0x10
+#define MQTT_CONNACK 0x20
+#define MQTT_PUBLISH 0x30
+#define MQTT_PUBACK 0x40
+#define MQTT_SUBSCRIBE 0x82  // Includes the reserved flag bits
+#define MQTT_PINGREQ 0xC0
+#define MQTT_PINGRESP 0xD0
+#define MQTT_DISCONNECT 0xE0
+
+#define MQTT_PUBLISH_DUP 0x08
+
+// CONNECT flags
+#define MQTT_CONNECT_USER 0x80
+#define MQTT_CONNECT_PASS 0x40
+#define MQTT_CONNECT_WILL_RETAIN 0x20
+#define MQTT_CONNECT_WILL_QOS1 0x08
+#define MQTT_CONNECT_WILL 0x04
+
+MQTTSession::MQTTSession(Client& client)
+    : client(client), socket(-1), keepAlive(15), socketTimeout(2000), active(false), nextPacketId(1), sendCount(0),
+      lastSent(0), lastReceived(0), lastWriteProgress(0), pingOutstanding(false), connackCode(-1),
+      willTopic(nullptr), willPayload(nullptr), willRetained(false), callback(nullptr),
+      txHead(0), txTail(0), rxState(RX_HEADER), rxHeader(0), rxRemaining(0), rxMultiplier(1), rxLength(0),
+      ackedSequence(0), stats() {
+    for (uint8_t i = 0; i < MQTT_INFLIGHT_WINDOW; i++) {
+        inflight[i].packetId = 0;
+    }
+}
+
+void MQTTSession::setKeepAlive(uint16_t seconds) {
+    keepAlive = seconds;
+}
+
+void MQTTSession::setSocketTimeout(unsigned long millis) {
+    socketTimeout = millis;
+}
+
+// Lets writes bypass Client::write(), which on ESP32 waits up to ten
+// seconds for a congested socket
+void MQTTSession::setSocket(int fd) {
+    socket = fd;
+}
+
+void MQTTSession::setWill(const char* topic, const char* payload, bool retained) {
+    willTopic = topic;
+    willPayload = payload;
+    willRetained = retained;
+}
+
+void MQTTSession::setCallback(Callback handler) {
+    callback = handler;
+}
+
+size_t MQTTSession::encodeLength(uint8_t* out, size_t length) {
+    size_t n = 0;
+    do {
+        uint8_t digit = length % 128;
+        length /= 128;
+        out[n++] = length > 0 ? digit | 0x80 : digit;
+    } while (length > 0 && n < 4);
+    return n;
+}
+
+// Makes room for a whole packet at the tail, compacting if needed
+bool MQTTSession::reserve(size_t length) {
+    if (MQTT_TX_BUFFER_SIZE - txTail >= length) {
+        return true;
+    }
+    if (txHead > 0) {
+        memmove(tx, tx + txHead, txTail - txHead);
+        txTail -= txHead;
+        txHead = 0;
+    }
+    return MQTT_TX_BUFFER_SIZE - txTail >= length;
+}
+
+void MQTTSession::append(const uint8_t* data, size_t length) {
+    // The stall timer only runs while something waits; after an idle
+    // stretch it starts from the first byte queued
+    if (txHead == txTail) {
+        lastWriteProgress = millis();
+    }
+    memcpy(tx + txTail, data, length);
+    txTail += length;
+    if (txTail - txHead > stats.txHighWater) {
+        stats.txHighWater = txTail - txHead;
+    }
+}
+
+void MQTTSession::appendString(const char* text) {
+    size_t length = strlen(text);
+    uint8_t prefix[2] = {(uint8_t)(length >> 8), (uint8_t)length};
+    append(prefix, 2);
+    append(reinterpret_cast<const uint8_t*>(text), length);
+}
+
+void MQTTSession::appendPacket(const uint8_t* data, size_t length) {
+    if (reserve(length)) {
+        append(data, length);
+    }
+}
+
+// Returns the bytes accepted, 0 if the socket is full, -1 on error
+int MQTTSession::writeSome(const uint8_t* data, size_t length) {
+#if defined(ESP32)
+    if (socket >= 0) {
+        int sent = send(socket, data, length, MSG_DONTWAIT);
+        if (sent < 0) {
+            return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+        }
+        return sent;
+    }
+#endif
+    return client.write(data, length);
+}
+
+void MQTTSession::writePending() {
+    unsigned long now = millis();
+    while (txHead < txTail) {
+        int written = writeSome(tx + txHead, min((size_t)MQTT_WRITE_CHUNK, txTail - txHead));
+        if (written < 0) {
+            drop();
+            return;
+        }
+        if (written == 0) {
+            break;
+        }
+        txHead += written;
+        lastWriteProgress = lastSent = now;
+    }
+    if (txHead == txTail) {
+        txHead = txTail = 0;
+    }
+}
+
+void MQTTSession::receive() {
+    uint8_t chunk[64];
+    while (client.available() > 0) {
+        int n = client.read(chunk, sizeof(chunk));
+        if (n <= 0) {
+            break;
+        }
+        lastReceived = millis();
+        for (int i = 0; i < n; i++) {
+            receiveByte(chunk[i]);
+        }
+    }
+}
+
+// Packets longer than the receive buffer are consumed but ignored, except
+// that a QoS1 PUBLISH is still acknowledged from the bytes kept, or the
+// broker would redeliver it on every reconnect
+void MQTTSession::receiveByte(uint8_t byte) {
+    switch (rxState) {
+        case RX_HEADER:
+            rxHeader = byte;
+            rxRemaining = 0;
+            rxMultiplier = 1;
+            rxState = RX_LENGTH;
+            break;
+
+        case RX_LENGTH:
+            rxRemaining += (byte & 0x7F) * rxMultiplier;
+            rxMultiplier *= 128;
+            if (byte & 0x80) {
+                if (rxMultiplier > 128UL * 128 * 128) {
+                    drop();  // Malformed length
+                }
+                break;
+            }
+            rxLength = 0;
+            if (rxRemaining == 0) {
+                handlePacket(rxHeader, rx, 0);
+                rxState = RX_HEADER;
+            } else {
+                rxState = RX_BODY;
+            }
+            break;
+
+        case RX_BODY:
+            if (rxLength < MQTT_RX_BUFFER_SIZE) {
+                rx[rxLength] = byte;
+            }
+            if (++rxLength == rxRemaining) {
+                if (rxRemaining <= MQTT_RX_BUFFER_SIZE) {
+                    handlePacket(rxHeader, rx, rxLength);
+                } else if ((rxHeader & 0xF0) == MQTT_PUBLISH) {
+                    acknowledgePublish(rxHeader, rx, MQTT_RX_BUFFER_SIZE);
+                }
+                rxState = RX_HEADER;
+            }
+            break;
+    }
+}
+
+void MQTTSession::handlePacket(uint8_t header, const uint8_t* body, size_t length) {
+    switch (header & 0xF0) {
+        case MQTT_CONNACK:
+            connackCode = length >= 2 ? body[1] : 0xFF;
+            break;
+
+        case MQTT_PUBACK: {
+            if (length < 2) {
+                break;
+            }
+            uint16_t id = (body[0] << 8) | body[1];
+            for (uint8_t i = 0; i < MQTT_INFLIGHT_WINDOW; i++) {
+                if (inflight[i].packetId == id) {
+                    inflight[i].packetId = 0;
+                    if (inflight[i].sequence > ackedSequence) {
+                        ackedSequence = inflight[i].sequence;
+                    }
+                    uint32_t rtt = millis() - inflight[i].sentAt;
+                    stats.acked++;
+                    stats.totalAckMillis += rtt;
+                    if (rtt > stats.maxAckMillis) {
+                        stats.maxAckMillis = rtt;
+                    }
+                    break;
+                }
+            }
+            break;
+        }
+
+        case MQTT_PINGRESP:
+            pingOutstanding = false;
+            break;
+
+        case MQTT_PUBLISH: {
+            if (length < 2) {
+                break;
+            }
+            uint8_t qos = (header >> 1) & 0x03;
+            uint16_t topicLength = (body[0] << 8) | body[1];
+            size_t offset = 2 + topicLength + (qos > 0 ? 2 : 0);
+            if (offset > length) {
+                break;
+            }
+            // A QoS1 delivery is acknowledged whether or not anyone handles it
+            acknowledgePublish(header, body, length);
+            if (callback != nullptr && topicLength < MQTT_TOPIC_MAX) {
+                char topic[MQTT_TOPIC_MAX];
+                memcpy(topic, body + 2, topicLength);
+                topic[topicLength] = '\0';
+                callback(topic, body + offset, length - offset);
+            }
+            break;
+        }
+
+        default:
+            break;
+    }
+}
+
+// Queues the PUBACK for a QoS1 PUBLISH; the packet id follows the topic,
+// so length only needs to cover those
+void MQTTSession::acknowledgePublish(uint8_t header, const uint8_t* body, size_t length) {
+    if (((header >> 1) & 0x03) != 1 || length < 2) {
+        return;
+    }
+    uint16_t topicLength = (body[0] << 8) | body[1];
+    if (4 + (size_t)topicLength > length) {
+        return;
+    }
+    uint8_t ack[4] = {MQTT_PUBACK, 2, body[2 + topicLength], body[3 + topicLength]};
+    appendPacket(ack, sizeof(ack));
+}
+
+// Unacknowledged QoS1 packets go out again with the DUP flag set, in the
+// order they were first sent (MQTT 3.1.1 section 4.6); slots are reused, so
+// slot order is not send order
+void MQTTSession::resendInFlight() {
+    unsigned long now = millis();
+    uint32_t resent = 0;
+    while (true) {
+        InFlight* next = nullptr;
+        for (uint8_t i = 0; i < MQTT_INFLIGHT_WINDOW; i++) {
+            InFlight& slot = inflight[i];
+            if (slot.packetId != 0 && slot.order > resent && (next == nullptr || slot.order < next->order)) {
+                next = &slot;
+            }
+        }
+        // Stop at the first that does not fit so none overtakes it
+        if (next == nullptr || !reserve(next->length)) {
+            break;
+        }
+        next->packet[0] |= MQTT_PUBLISH_DUP;
+        next->sentAt = now;
+        append(next->packet, next->length);
+        stats.retransmitted++;
+        resent = next->order;
+    }
+}
+
+// Closes the socket; whatever was half-sent is discarded, while in-flight
+// QoS1 packets are kept for the next connection
+void MQTTSession::drop() {
+    client.stop();
+    active = false;
+    txHead = txTail = 0;
+    rxState = RX_HEADER;
+    pingOutstanding = false;
+}
+
+bool MQTTSession::connect(const char* host, uint16_t port, const char* clientId, const char* user, const char* pass) {
+    if (active) {
+        drop();
+    }
+    if (!client.connect(host, port)) {
+        return false;
+    }
+    txHead = txTail = 0;
+    rxState = RX_HEADER;
+    connackCode = -1;
+
+    // Persistent session (clean session flag clear) so unacknowledged QoS1
+    // publishes survive the reconnect on both sides
+    uint8_t flags = 0;
+    size_t remaining = 10 + 2 + strlen(clientId);
+    if (willTopic != nullptr) {
+        flags |= MQTT_CONNECT_WILL | MQTT_CONNECT_WILL_QOS1 | (willRetained ? MQTT_CONNECT_WILL_RETAIN : 0);
+        remaining += 2 + strlen(willTopic) + 2 + strlen(willPayload);
+    }
+    if (user != nullptr) {
+        flags |= MQTT_CONNECT_USER;
+        remaining += 2 + strlen(user);
+    }
+    if (pass != nullptr) {
+        flags |= MQTT_CONNECT_PASS;
+        remaining += 2 + strlen(pass);
+    }
+
+    uint8_t header[5] = {MQTT_CONNECT};
+    size_t headerLength = 1 + encodeLength(header + 1, remaining);
+    if (!reserve(headerLength + remaining)) {
+        drop();
+        return false;
+    }
+    const uint8_t variable[10] = {0, 4, 'M', 'Q', 'T', 'T', 4, flags, (uint8_t)(keepAlive >> 8), (uint8_t)keepAlive};
+    append(header, headerLength);
+    append(variable, sizeof(variable));
+    appendString(clientId);
+    if (willTopic != nullptr) {
+        appendString(willTopic);
+        appendString(willPayload);
+    }
+    if (user != nullptr) {
+        appendString(user);
+    }
+    if (pass != nullptr) {
+        appendString(pass);
+    }
+
+    unsigned long started = millis();
+    lastWriteProgress = started;
+    while (connackCode < 0 && millis() - started < socketTimeout && client.connected()) {
+        writePending();
+        receive();
+        delay(10);
+    }
+    if (connackCode != 0) {
+        drop();
+        return false;
+    }
+
+    active = true;
+    lastSent = lastReceived = millis();
+    resendInFlight();
+    writePending();
+    return active;
+}
+
+bool MQTTSession::connected() {
+    if (active && !client.connected()) {
+        drop();
+    }
+    return active;
+}
+
+bool MQTTSession::publish(const char* topic, const uint8_t* payload, size_t length, uint8_t qos, bool retained,
+                          uint32_t sequence) {
+    if (!connected()) {
+        return false;
+    }
+
+    size_t topicLength = strlen(topic);
+    size_t remaining = 2 + topicLength + (qos > 0 ? 2 : 0) + length;
+    uint8_t header[5] = {(uint8_t)(MQTT_PUBLISH | (qos > 0 ? 0x02 : 0) | (retained ? 0x01 : 0))};
+    size_t headerLength = 1 + encodeLength(header + 1, remaining);
+    size_t total = headerLength + remaining;
+
+    if (!reserve(total)) {
+        stats.bufferFull++;
+        return false;
+    }
+
+    if (qos == 0) {
+        append(header, headerLength);
+        appendString(topic);
+        append(payload, length);
+        writePending();
+        return true;
+    }
+
+    InFlight* slot = nullptr;
+    for (uint8_t i = 0; i < MQTT_INFLIGHT_WINDOW && slot == nullptr; i++) {
+        if (inflight[i].packetId == 0) {
+            slot = &inflight[i];
+        }
+    }
+    if (slot == nullptr) {
+        stats.windowFull++;
+        return false;
+    }
+    if (total > MQTT_INFLIGHT_SIZE) {
+        stats.bufferFull++;
+        return false;
+    }
+
+    uint16_t id = nextPacketId;
+    nextPacketId = nextPacketId == 0xFFFF ? 1 : nextPacketId + 1;
+
+    uint8_t* p = slot->packet;
+    memcpy(p, header, headerLength);
+    p += headerLength;
+    *p++ = topicLength >> 8;
+    *p++ = topicLength;
+    memcpy(p, topic, topicLength);
+    p += topicLength;
+    *p++ = id >> 8;
+    *p++ = id;
+    memcpy(p, payload, length);
+
+    slot->packetId = id;
+    slot->length = total;
+    slot->sentAt = millis();
+    slot->sequence = sequence;
+    slot->order = ++sendCount;
+    append(slot->packet, total);
+    writePending();
+    return true;
+}
+
+bool MQTTSession::subscribe(const char* topic, uint8_t qos) {
+    if (!connected()) {
+        return false;
+    }
+
+    size_t remaining = 2 + 2 + strlen(topic) + 1;
+    uint8_t header[5] = {MQTT_SUBSCRIBE};
+    size_t headerLength = 1 + encodeLength(header + 1, remaining);
+    if (!reserve(headerLength + remaining)) {
+        stats.bufferFull++;
+        return false;
+    }
+
+    uint16_t id = nextPacketId;
+    nextPacketId = nextPacketId == 0xFFFF ? 1 : nextPacketId + 1;
+    const uint8_t packetId[2] = {(uint8_t)(id >> 8), (uint8_t)id};
+    append(header, headerLength);
+    append(packetId, sizeof(packetId));
+    appendString(topic);
+    append(&qos, 1);
+    writePending();
+    return true;
+}
+
+bool MQTTSession::loop() {
+    if (!connected()) {
+        return false;
+    }
+    receive();
+    writePending();
+    if (!active) {
+        return false;
+    }
+
+    unsigned long now = millis();
+    if (txHead < txTail && now - lastWriteProgress >= MQTT_WRITE_STALL_TIMEOUT) {
+        stats.stalls++;
+        drop();
+        return false;
+    }
+
+    // A broker that has been silent for 1.5 keepalive periods is gone
+    unsigned long interval = keepAlive * 1000UL;
+    if (interval == 0) {
+        return true;
+    }
+    if (now - lastReceived >= interval + interval / 2) {
+        stats.keepaliveTimeouts++;
+        drop();
+        return false;
+    }
+    if (!pingOutstanding && (now - lastSent >= interval || now - lastReceived >= interval)) {
+        const uint8_t ping[2] = {MQTT_PINGREQ, 0};
+        if (reserve(sizeof(ping))) {
+            append(ping, sizeof(ping));
+            pingOutstanding = true;
+            writePending();
+        }
+    }
+    return active;
+}
+
+bool MQTTSession::flush(unsigned long timeoutMillis) {
+    unsigned long started = millis();
+    while (active && txHead < txTail && millis() - started < timeoutMillis) {
+        loop();
+        delay(1);
+    }
+    return txHead == txTail;
+}
+
+void MQTTSession::disconnect() {
+    if (!active) {
+        return;
+    }
+    const uint8_t packet[2] = {MQTT_DISCONNECT, 0};
+    appendPacket(packet, sizeof(packet));
+    flush(socketTimeout);
+    drop();
+}
+
+bool MQTTSession::hasPendingWrites() const {
+    return txHead < txTail;
+}
+
+uint8_t MQTTSession::inFlight() const {
+    uint8_t count = 0;
+    for (uint8_t i = 0; i < MQTT_INFLIGHT_WINDOW; i++) {
+        if (inflight[i].packetId != 0) {
+            count++;
+        }
+    }
+    return count;
+}
+
+// The highest tag acknowledged with no lower tag still waiting, so the
+// caller can treat everything up to it as delivered
+uint32_t MQTTSession::acknowledgedSequence() const {
+    uint32_t sequence = ackedSequence;
+    for (uint8_t i = 0; i < MQTT_INFLIGHT_WINDOW; i++) {
+        const InFlight& slot = inflight[i];
+        if (slot.packetId != 0 && slot.sequence != 0 && slot.sequence <= sequence) {
+            sequence = slot.sequence - 1;
+        }
+    }
+    return sequence;
+}
+
+const MQTTSessionStats& MQTTSession::getStats() const {
+    return stats;
+}
@@ -1,41 +1,183 @@
 #include "include/lib/oled_display.h"
+#include "include/lib/event_log.h"
 
 // Initialize static member
-Adafruit_SSD1306 OLEDDisplay::display(SCREEN_WIDTH, SCREEN_HEIGHT, &Wire, OLED_RESET);
+// Keep the library from dropping the shared bus back to 100 kHz after each transfer
+Adafruit_SSD1306 OLEDDisplay::display(SCREEN_WIDTH, SCREEN_HEIGHT, &Wire, OLED_RESET, I2C_BUS_CLOCK, I2C_BUS_CLOCK);
+char OLEDDisplay::lines[OLED_PAGES][OLED_COLUMNS];
+uint8_t OLEDDisplay::dirtyStart[OLED_PAGES];
+uint8_t OLEDDisplay::dirtyEnd[OLED_PAGES];
+OLEDStats OLEDDisplay::stats = {};
 
 void OLEDDisplay::init() {
-    if (!display.begin(SSD1306_SWITCHCAPVCC, SCREEN_ADDRESS)) {
-        Serial.println("SSD1306 OLED allocation failed");
+    if (!I2CBus::acquire(I2C_DEVICE_OLED)) {
+        return;
+    }
+    // I2CBus has already started Wire
+    if (!display.begin(SSD1306_SWITCHCAPVCC, SCREEN_ADDRESS, true, false)) {
+        I2CBus::release(I2C_DEVICE_OLED, false);
+        LOG_EVENT(DISPLAY_INIT_FAILED);
         return;
     }
     display.clearDisplay();
     display.setTextSize(1);
     display.setTextColor(SSD1306_WHITE);
+    display.setTextWrap(false);
     display.display();
+    I2CBus::release(I2C_DEVICE_OLED, true);
+
+    // The panel is blank now, which is what a screen of spaces looks like
+    memset(lines, ' ', sizeof(lines));
+    memset(dirtyStart, SCREEN_WIDTH, sizeof(dirtyStart));
+    memset(dirtyEnd, 0, sizeof(dirtyEnd));
+}
+
+// Redraws the changed span of one text line into the framebuffer
+void OLEDDisplay::setLine(uint8_t row, const char* text) {
+    char* current = lines[row];
+    uint8_t first = OLED_COLUMNS, last = 0;
+
+    for (uint8_t i = 0; i < OLED_COLUMNS; i++) {
+        char wanted = *text ? *text++ : ' ';
+        if (current[i] != wanted) {
+            if (first == OLED_COLUMNS) {
+                first = i;
+            }
+            last = i;
+            current[i] = wanted;
+        }
+    }
+    if (first == OLED_COLUMNS) {
+        return;  // Nothing changed
+    }
+
+    int16_t x = first * OLED_CHAR_WIDTH;
+    int16_t width = (last - first + 1) * OLED_CHAR_WIDTH;
+    display.fillRect(x, row * 8, width, 8, SSD1306_BLACK);
+    display.setCursor(x, row * 8);
+    for (uint8_t i = first; i <= last; i++) {
+        display.write(current[i]);
+    }
+    stats.cellsRedrawn += last - first + 1;
+
+    dirtyStart[row] = min<uint8_t>(dirtyStart[row], x);
+    dirtyEnd[row] = max<uint8_t>(dirtyEnd[row], x + width - 1);
 }
 
-void OLEDDisplay::update(float temperatureF, float humidity, int co2, 
-                        int pm1_0, int pm2_5, int pm10, int aqi, 
-                        float tvoc, float h2, float ethanol) {
+void OLEDDisplay::update() {
     if (!isOledOn()) {
         return;  // Don't do anything if display is off
     }
 
-    display.clearDisplay();
-    display.setCursor(0, 0);
-
-    // Format and display sensor data
-    display.print("Temp: "); display.print(temperatureF, 1); display.println(" F");
-    display.print("Humidity: "); display.print(humidity, 1); display.println(" %");
-    display.print("CO2: "); display.print(co2); display.println(" ppm");
-    display.print("PM: ");
-    display.print(pm1_0); display.print("/");
-    display.print(pm2_5); display.print("/");
-    display.print(pm10); display.println(" ug");
-    display.print("AQI: "); display.println(aqi);
-    display.print("TVOC: "); display.print(tvoc, 0); display.println(" ppb");
-    display.print("H2: "); display.print(h2, 0); display.println(" res");
-    display.print("Ethanol: "); display.print(ethanol, 0); display.println(" res");
+    char text[OLED_COLUMNS + 1];
+    stats.updates++;
 
-    display.display();
-} 
+    // One line per metric with a display row, or one for a run of metrics
+    // sharing a row ("PM: 5/8/11 ug"). Values go through formatMetric
+    // rather than printf's float path so a refresh never touches the heap.
+    for (uint8_t t = 0; t < TOPIC_COUNT; t++) {
+        const MetricDescriptor& metric = METRICS[t];
+        if (metric.displayRow < 0) {
+            continue;
+        }
+        if (metric.rowLabel[0] == '\0') {
+            formatMetricLine(text, sizeof(text), (DataTopic)t, metricFromFixed((DataTopic)t, DataBus::value((DataTopic)t)),
+                             true);
+            setLine(metric.displayRow, text);
+            continue;
+        }
+
+        size_t length = min(sizeof(text) - 1, (size_t)snprintf(text, sizeof(text), "%s: ", metric.rowLabel));
+        uint8_t last = t;
+        for (uint8_t s = t; s < TOPIC_COUNT && METRICS[s].displayRow == metric.displayRow; s++) {
+            if (s > t && length < sizeof(text) - 1) {
+                text[length++] = '/';
+            }
+            length += formatMetric(text + length, sizeof(text) - length, (DataTopic)s,
+                                   metricFromFixed((DataTopic)s, DataBus::value((DataTopic)s)));
+            length = min(sizeof(text) - 1, length);
+            last = s;
+        }
+        snprintf(text + length, sizeof(text) - length, " %s", METRICS[last].displayUnit);
+        setLine(metric.displayRow, text);
+        t = last;
+    }
+}
+
+void OLEDDisplay::command(uint8_t c) {
+    display.ssd1306_command(c);
+    stats.bytesSent += 2;  // Control byte plus command
+}
+
+bool OLEDDisplay::flushPage(uint8_t page) {
+    uint8_t start = dirtyStart[page];
+    uint8_t end = dirtyEnd[page];
+    dirtyStart[page] = SCREEN_WIDTH;
+    dirtyEnd[page] = 0;
+
+    command(SSD1306_PAGEADDR);
+    command(page);
+    command(page);
+    command(SSD1306_COLUMNADDR);
+    command(start);
+    command(end);
+
+    const uint8_t* pixels = display.getBuffer() + page * SCREEN_WIDTH;
+    bool ok = true;
+    for (uint16_t column = start; column <= end;) {
+        uint16_t n = min<uint16_t>(OLED_I2C_CHUNK - 1, end - column + 1);
+        Wire.beginTransmission(SCREEN_ADDRESS);
+        Wire.write((uint8_t)0x40);  // Data stream
+        Wire.write(pixels + column, n);
+        ok &= Wire.endTransmission() == 0;
+        column += n;
+        stats.bytesSent += n + 1;
+    }
+    stats.pagesFlushed++;
+    // The panel may not have the span; send it again on the next flush
+    if (!ok) {
+        dirtyStart[page] = min(dirtyStart[page], start);
+        dirtyEnd[page] = max(dirtyEnd[page], end);
+    }
+    return ok;
+}
+
+bool OLEDDisplay::isDirty() {
+    for (uint8_t page = 0; page < OLED_PAGES; page++) {
+        if (dirtyStart[page] < SCREEN_WIDTH) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// The display is the least urgent device: if a sensor holds or is waiting
+// for the bus, the page stays dirty and is retried on the next call
+bool OLEDDisplay::flush() {
+    for (uint8_t page = 0; page < OLED_PAGES; page++) {
+        if (dirtyStart[page] < SCREEN_WIDTH) {
+            if (!I2CBus::acquire(I2C_DEVICE_OLED, 0)) {
+                return true;
+            }
+            I2CBus::release(I2C_DEVICE_OLED, flushPage(page));
+            return isDirty();
+        }
+    }
+    return false;
+}
+
+const OLEDStats& OLEDDisplay::getStats() {
+    return stats;
+}
+
+void OLEDDisplay::printStats() {
+    // A full-frame display() sends 1024 pixel bytes plus a control byte per chunk
+    uint32_t fullFrame = SCREEN_WIDTH * OLED_PAGES;
+    fullFrame += (fullFrame + OLED_I2C_CHUNK - 2) / (OLED_I2C_CHUNK - 1) + 12;
+
+    Serial.print("OLED: "); Serial.print(stats.updates); Serial.print(" updates | ");
+    Serial.print(stats.cellsRedrawn); Serial.print(" chars redrawn | ");
+    Serial.print(stats.pagesFlushed); Serial.print(" pages | ");
+    Serial.print(stats.bytesSent); Serial.print(" bytes sent (full redraw: ");
+    Serial.print(stats.updates * fullFrame); Serial.println(")");
+}
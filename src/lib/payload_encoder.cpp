@@ -0,0 +1,230 @@
+#include "include/lib/payload_encoder.h"
+
+#if PAYLOAD_FORMAT == PAYLOAD_FORMAT_JSON
+
+PayloadEncoder::PayloadEncoder(char* buffer, size_t capacity) : json(buffer, capacity) {
+}
+
+void PayloadEncoder::begin() {
+    json.beginObject();
+}
+
+void PayloadEncoder::end() {
+    json.endObject();
+}
+
+void PayloadEncoder::add(const char* key, long value) {
+    json.add(key, value);
+}
+
+void PayloadEncoder::add(const char* key, float value, uint8_t decimals) {
+    json.add(key, value, decimals);
+}
+
+void PayloadEncoder::add(const char* key, const char* value) {
+    json.add(key, value);
+}
+
+const uint8_t* PayloadEncoder::data() const {
+    return reinterpret_cast<const uint8_t*>(json.c_str());
+}
+
+size_t PayloadEncoder::length() const {
+    return json.length();
+}
+
+bool PayloadEncoder::ok() const {
+    return json.ok();
+}
+
+const char* PayloadEncoder::formatName() {
+    return "json";
+}
+
+#else
+
+PayloadEncoder::PayloadEncoder(char* buffer, size_t capacity)
+    : buffer(reinterpret_cast<uint8_t*>(buffer)), capacity(capacity), len(0), mapStart(0),
+      fields(0), overflow(false) {
+}
+
+void PayloadEncoder::put(uint8_t byte) {
+    if (len >= capacity) {
+        overflow = true;
+        return;
+    }
+    buffer[len++] = byte;
+}
+
+void PayloadEncoder::putBigEndian(uint64_t value, uint8_t bytes) {
+    while (bytes-- > 0) {
+        put((uint8_t)(value >> (bytes * 8)));
+    }
+}
+
+void PayloadEncoder::putFloat(float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+#if PAYLOAD_FORMAT == PAYLOAD_FORMAT_CBOR
+    put(0xFA);  // Single-precision float
+#else
+    put(0xCA);  // float 32
+#endif
+    putBigEndian(bits, 4);
+}
+
+void PayloadEncoder::begin() {
+    mapStart = len;
+    fields = 0;
+    put(0);  // Map header, written by end() once the field count is known
+}
+
+void PayloadEncoder::add(const char* key, long value) {
+    putString(key);
+    putInteger(value);
+    fields++;
+}
+
+void PayloadEncoder::add(const char* key, float value, uint8_t decimals) {
+    putString(key);
+    putFloat(value);
+    fields++;
+}
+
+void PayloadEncoder::add(const char* key, const char* value) {
+    putString(key);
+    putString(value);
+    fields++;
+}
+
+const uint8_t* PayloadEncoder::data() const {
+    return buffer;
+}
+
+size_t PayloadEncoder::length() const {
+    return len;
+}
+
+bool PayloadEncoder::ok() const {
+    return !overflow;
+}
+
+#if PAYLOAD_FORMAT == PAYLOAD_FORMAT_CBOR
+
+// Major type plus the shortest encoding of its argument
+void PayloadEncoder::putHeader(uint8_t major, uint64_t argument) {
+    major <<= 5;
+    if (argument < 24) {
+        put(major | argument);
+    } else if (argument <= 0xFF) {
+        put(major | 24);
+        putBigEndian(argument, 1);
+    } else if (argument <= 0xFFFF) {
+        put(major | 25);
+        putBigEndian(argument, 2);
+    } else if (argument <= 0xFFFFFFFFULL) {
+        put(major | 26);
+        putBigEndian(argument, 4);
+    } else {
+        put(major | 27);
+        putBigEndian(argument, 8);
+    }
+}
+
+void PayloadEncoder::putInteger(long value) {
+    if (value >= 0) {
+        putHeader(0, (uint64_t)value);
+    } else {
+        putHeader(1, (uint64_t)(-1 - (long long)value));
+    }
+}
+
+void PayloadEncoder::putString(const char* text) {
+    size_t n = strlen(text);
+    putHeader(3, n);
+    for (size_t i = 0; i < n; i++) {
+        put((uint8_t)text[i]);
+    }
+}
+
+// Single-byte map header holds up to 23 pairs
+void PayloadEncoder::end() {
+    if (fields > 23 || mapStart >= capacity) {
+        overflow = true;
+        return;
+    }
+    buffer[mapStart] = 0xA0 | fields;
+}
+
+const char* PayloadEncoder::formatName() {
+    return "cbor";
+}
+
+#else  // PAYLOAD_FORMAT_MSGPACK
+
+void PayloadEncoder::putInteger(long value) {
+    long long v = value;
+    if (v >= 0) {
+        if (v < 128) {
+            put((uint8_t)v);                      // positive fixint
+        } else if (v <= 0xFF) {
+            put(0xCC);
+            putBigEndian(v, 1);
+        } else if (v <= 0xFFFF) {
+            put(0xCD);
+            putBigEndian(v, 2);
+        } else if (v <= 0xFFFFFFFFLL) {
+            put(0xCE);
+            putBigEndian(v, 4);
+        } else {
+            put(0xCF);
+            putBigEndian(v, 8);
+        }
+    } else if (v >= -32) {
+        put((uint8_t)(int8_t)v);                  // negative fixint
+    } else if (v >= INT8_MIN) {
+        put(0xD0);
+        putBigEndian((uint8_t)(int8_t)v, 1);
+    } else if (v >= INT16_MIN) {
+        put(0xD1);
+        putBigEndian((uint16_t)(int16_t)v, 2);
+    } else if (v >= INT32_MIN) {
+        put(0xD2);
+        putBigEndian((uint32_t)(int32_t)v, 4);
+    } else {
+        put(0xD3);
+        putBigEndian((uint64_t)v, 8);
+    }
+}
+
+void PayloadEncoder::putString(const char* text) {
+    size_t n = strlen(text);
+    if (n < 32) {
+        put(0xA0 | n);                            // fixstr
+    } else if (n <= 0xFF) {
+        put(0xD9);
+        putBigEndian(n, 1);
+    } else {
+        put(0xDA);
+        putBigEndian(n, 2);
+    }
+    for (size_t i = 0; i < n; i++) {
+        put((uint8_t)text[i]);
+    }
+}
+
+// fixmap header holds up to 15 pairs
+void PayloadEncoder::end() {
+    if (fields > 15 || mapStart >= capacity) {
+        overflow = true;
+        return;
+    }
+    buffer[mapStart] = 0x80 | fields;
+}
+
+const char* PayloadEncoder::formatName() {
+    return "msgpack";
+}
+
+#endif
+#endif
@@ -0,0 +1,190 @@
+#include "include/lib/power_manager.h"
+#include <esp_sleep.h>
+#include "include/lib/wifi_manager.h"
+#include "include/lib/event_log.h"
+
+// Automatic light sleep needs power management and tickless idle in the
+// SDK configuration; without them the CPU only idles between deadlines
+#if CONFIG_PM_ENABLE && CONFIG_FREERTOS_USE_TICKLESS_IDLE
+#include <esp_pm.h>
+#define LIGHT_SLEEP_AVAILABLE 1
+static esp_pm_lock_handle_t awakeLock = nullptr;
+#else
+#define LIGHT_SLEEP_AVAILABLE 0
+#endif
+static bool awakeHeld = false;
+
+// Initialize static members. Everything but resumedFromSleep survives deep
+// sleep in duty-cycled mode.
+bool PowerManager::resumedFromSleep = false;
+RTC_STATE_ATTR uint32_t PowerManager::elapsedAtBoot = 0;
+RTC_STATE_ATTR uint32_t PowerManager::nextCycleAt = 0;
+RTC_STATE_ATTR StoredSample PowerManager::samples[DUTY_RTC_SAMPLES];
+RTC_STATE_ATTR uint8_t PowerManager::sampleCount = 0;
+RTC_STATE_ATTR uint32_t PowerManager::nextSequence = 1;
+RTC_STATE_ATTR uint8_t PowerManager::samplesSinceUpload = 0;
+RTC_STATE_ATTR uint8_t PowerManager::cyclesUntilUpload = 0;
+RTC_STATE_ATTR uint8_t PowerManager::uploadFailureStreak = 0;
+RTC_STATE_ATTR DutyCycleStats PowerManager::stats = {};
+
+void PowerManager::begin() {
+#if POWER_MODE == POWER_MODE_DUTY_CYCLED
+    resumedFromSleep = esp_sleep_get_wakeup_cause() == ESP_SLEEP_WAKEUP_TIMER;
+    if (!resumedFromSleep) {
+        // Power-on or reset: RTC memory may hold a previous run's state
+        elapsedAtBoot = 0;
+        nextCycleAt = 0;
+        sampleCount = 0;
+        samplesSinceUpload = 0;
+        cyclesUntilUpload = 0;
+        uploadFailureStreak = 0;
+        stats = {};
+    }
+    stats.cycles++;
+#if LIGHT_SLEEP_AVAILABLE
+    // The workers block between deadlines, so the idle task sleeps through
+    // most of the PMS7003 warm-up
+    esp_pm_config_esp32_t pm = {DUTY_CPU_FREQUENCY, 40, true};
+    esp_pm_configure(&pm);
+    esp_pm_lock_create(ESP_PM_NO_LIGHT_SLEEP, 0, "awake", &awakeLock);
+#else
+    setCpuFrequencyMhz(DUTY_CPU_FREQUENCY);
+#endif
+    LOG_EVENT(POWER_WAKE, stats.cycles, resumedFromSleep, sampleCount);
+#endif
+}
+
+bool PowerManager::resumed() {
+    return resumedFromSleep;
+}
+
+// The RTC timer keeps running in deep sleep, so adding the planned sleep to
+// the clock at sleep time keeps this continuous to within the RTC's accuracy
+unsigned long PowerManager::elapsedMillis() {
+    return elapsedAtBoot + millis();
+}
+
+// Samples are stamped with Unix time once NTP has set the clock, which also
+// survives deep sleep; before that with elapsed seconds
+void PowerManager::recordSample(const SensorSnapshot& snapshot) {
+    uint32_t now = WiFiManager::currentTime();
+    uint32_t timestamp = now != 0 ? now : elapsedMillis() / 1000;
+    bool uptime = now == 0;
+
+    if (sampleCount < DUTY_RTC_SAMPLES) {
+        StoredSample& sample = samples[sampleCount++];
+        TelemetryStore::encode(snapshot, timestamp, uptime, sample);
+        sample.sequence = nextSequence++;
+    } else {
+        // A long outage overflows into the offline log; its RAM batch would
+        // not survive deep sleep, so it is written out right away
+        TelemetryStore::append(snapshot, timestamp, uptime);
+        TelemetryStore::flush();
+        stats.samplesSpilled++;
+    }
+    if (samplesSinceUpload < 255) {
+        samplesSinceUpload++;
+    }
+    if (cyclesUntilUpload > 0) {
+        cyclesUntilUpload--;
+    }
+}
+
+// Uploads are due every DUTY_UPLOAD_EVERY samples; after failed sessions the
+// gap doubles up to DUTY_MAX_UPLOAD_BACKOFF cycles. A power-on uploads its
+// first sample at once, so a new install announces itself to Home Assistant
+// and sets the clock instead of staying silent for half an hour.
+bool PowerManager::uploadDue() {
+    if (!resumedFromSleep) {
+        return true;
+    }
+    return cyclesUntilUpload == 0 && (samplesSinceUpload >= DUTY_UPLOAD_EVERY || uploadFailureStreak > 0);
+}
+
+uint8_t PowerManager::pendingSamples() {
+    return sampleCount;
+}
+
+StoredSample PowerManager::pendingSample(uint8_t index, uint32_t now) {
+    StoredSample sample = samples[index];
+    if (sample.record.uptime && now != 0) {
+        sample.record.timestamp = now - (elapsedMillis() / 1000 - sample.record.timestamp);
+        sample.record.uptime = false;
+    }
+    return sample;
+}
+
+// Delivered samples leave RTC memory; a session that never reached the
+// broker backs off
+void PowerManager::uploadFinished(bool ok, uint8_t delivered) {
+    if (delivered > sampleCount) {
+        delivered = sampleCount;
+    }
+    memmove(samples, samples + delivered, (sampleCount - delivered) * sizeof(StoredSample));
+    sampleCount -= delivered;
+
+    if (ok) {
+        stats.uploads++;
+        samplesSinceUpload = 0;
+        uploadFailureStreak = 0;
+        cyclesUntilUpload = 0;
+    } else {
+        stats.uploadFailures++;
+        uploadFailureStreak = uploadFailureStreak < 8 ? uploadFailureStreak + 1 : uploadFailureStreak;
+        cyclesUntilUpload = min(1 << uploadFailureStreak, DUTY_MAX_UPLOAD_BACKOFF);
+    }
+}
+
+void PowerManager::holdAwake(bool hold) {
+    if (hold == awakeHeld) {
+        return;
+    }
+    awakeHeld = hold;
+#if LIGHT_SLEEP_AVAILABLE
+    if (awakeLock != nullptr) {
+        if (hold) {
+            esp_pm_lock_acquire(awakeLock);
+        } else {
+            esp_pm_lock_release(awakeLock);
+        }
+    }
+#endif
+}
+
+// Wakes on the fixed cycle grid, so the time spent awake does not stretch
+// the sampling period
+void PowerManager::sleep() {
+    uint32_t now = elapsedMillis();
+    uint32_t awake = millis();
+    stats.lastAwakeMillis = awake;
+    stats.maxAwakeMillis = max(stats.maxAwakeMillis, awake);
+
+    if (nextCycleAt == 0) {
+        nextCycleAt = now - awake;
+    }
+    do {
+        nextCycleAt += DUTY_CYCLE_PERIOD;
+    } while ((long)(nextCycleAt - now) < DUTY_MIN_SLEEP);
+
+    uint32_t sleepMillis = nextCycleAt - now;
+    elapsedAtBoot = nextCycleAt;
+
+    LOG_EVENT(POWER_SLEEP, awake, sleepMillis / 1000);
+    EventLog::flush(LOG_FLUSH_TIMEOUT);
+
+    esp_sleep_enable_timer_wakeup((uint64_t)sleepMillis * 1000ULL);
+    esp_deep_sleep_start();
+}
+
+const DutyCycleStats& PowerManager::getStats() {
+    return stats;
+}
+
+void PowerManager::printStats() {
+    Serial.print("Duty cycle: "); Serial.print(stats.cycles); Serial.print(" cycles | ");
+    Serial.print(stats.uploads); Serial.print(" uploads | ");
+    Serial.print(stats.uploadFailures); Serial.print(" failed | ");
+    Serial.print(stats.samplesSpilled); Serial.print(" spilled to flash | awake ");
+    Serial.print(stats.lastAwakeMillis); Serial.print(" ms, max ");
+    Serial.print(stats.maxAwakeMillis); Serial.println(" ms");
+}
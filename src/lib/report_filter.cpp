@@ -0,0 +1,112 @@
+#include "include/lib/report_filter.h"
+
+#define METRIC_REPORT_TOPIC(id, key, label, shortLabel, unit, ascii, decimals, row, rowLabel, kind, report, field, scale, ha) \
+    METRIC_IF_##report(TOPIC_##id,)
+static const DataTopic REPORT_TOPICS[REPORT_METRIC_COUNT] = {
+    METRIC_TABLE(METRIC_REPORT_TOPIC)
+};
+#undef METRIC_REPORT_TOPIC
+
+// Thresholds sit just above each sensor's noise so flat air stays quiet while
+// a real change, such as CO2 from cooking, goes out within one check. One per
+// FILTERED row of METRIC_TABLE, in table order.
+static const Deadband DEADBANDS[] = {
+    {0.5f, 0.0f, REPORT_MIN_INTERVAL, REPORT_HEARTBEAT},    // temperature, °F
+    {2.0f, 0.0f, REPORT_MIN_INTERVAL, REPORT_HEARTBEAT},    // humidity, %
+    {25.0f, 0.05f, REPORT_MIN_INTERVAL, REPORT_HEARTBEAT},  // co2, ppm
+    // The PMS7003 counts jump by 1-2 µg/m³ in clean air and PM10 by more;
+    // see test/bench_report_filter.cpp
+    {3.0f, 0.05f, REPORT_MIN_INTERVAL, REPORT_HEARTBEAT},   // pm1_0, µg/m³
+    {3.0f, 0.05f, REPORT_MIN_INTERVAL, REPORT_HEARTBEAT},   // pm2_5, µg/m³
+    {5.0f, 0.05f, REPORT_MIN_INTERVAL, REPORT_HEARTBEAT},   // pm10, µg/m³
+    {5.0f, 0.0f, REPORT_MIN_INTERVAL, REPORT_HEARTBEAT},    // aqi
+    {20.0f, 0.10f, REPORT_MIN_INTERVAL, REPORT_HEARTBEAT},  // tvoc, ppb
+    {0.0f, 0.01f, REPORT_MIN_INTERVAL, REPORT_HEARTBEAT},   // h2, raw
+    {0.0f, 0.01f, REPORT_MIN_INTERVAL, REPORT_HEARTBEAT},   // ethanol, raw
+};
+static_assert(sizeof(DEADBANDS) / sizeof(DEADBANDS[0]) == REPORT_METRIC_COUNT, "One deadband per filtered metric");
+
+// Initialize static members
+float ReportFilter::lastValue[REPORT_METRIC_COUNT];
+unsigned long ReportFilter::lastReported[REPORT_METRIC_COUNT];
+bool ReportFilter::reported[REPORT_METRIC_COUNT];
+ReportFilterStats ReportFilter::stats;
+
+void ReportFilter::begin() {
+    memset(&stats, 0, sizeof(stats));
+    invalidate();
+}
+
+void ReportFilter::invalidate() {
+    for (uint8_t m = 0; m < REPORT_METRIC_COUNT; m++) {
+        reported[m] = false;
+    }
+}
+
+// Deadbands are in the published units
+float ReportFilter::value(const SensorSnapshot& s, ReportMetric metric) {
+    return metric < REPORT_METRIC_COUNT ? metricValue(s, REPORT_TOPICS[metric]) : 0;
+}
+
+uint16_t ReportFilter::due(const SensorSnapshot& s, unsigned long now) {
+    stats.checks++;
+    uint16_t metrics = 0;
+    for (uint8_t m = 0; m < REPORT_METRIC_COUNT; m++) {
+        if (!reported[m]) {
+            metrics |= 1U << m;
+            continue;
+        }
+
+        const Deadband& band = DEADBANDS[m];
+        unsigned long elapsed = now - lastReported[m];
+        if (elapsed >= band.maxInterval) {
+            metrics |= 1U << m;
+            continue;
+        }
+        if (elapsed < band.minInterval) {
+            continue;
+        }
+
+        float threshold = max(band.absolute, band.relative * fabsf(lastValue[m]));
+        if (fabsf(value(s, (ReportMetric)m) - lastValue[m]) >= threshold) {
+            metrics |= 1U << m;
+        }
+    }
+    return metrics;
+}
+
+// Records what the consumer has now seen, whether published live or stored
+// for backfill
+void ReportFilter::commit(const SensorSnapshot& s, uint16_t metrics, unsigned long now) {
+    if (metrics == 0) {
+        return;
+    }
+    stats.reports++;
+    for (uint8_t m = 0; m < REPORT_METRIC_COUNT; m++) {
+        if (metrics & (1U << m)) {
+            lastValue[m] = value(s, (ReportMetric)m);
+            lastReported[m] = now;
+            reported[m] = true;
+            stats.metricReports[m]++;
+        }
+    }
+}
+
+const ReportFilterStats& ReportFilter::getStats() {
+    return stats;
+}
+
+void ReportFilter::printStats() {
+    Serial.print("Reports: ");
+    Serial.print(stats.reports);
+    Serial.print(" of ");
+    Serial.print(stats.checks);
+    Serial.print(" checks |");
+    for (uint8_t m = 0; m < REPORT_METRIC_COUNT; m++) {
+        Serial.print(" ");
+        Serial.print(METRICS[REPORT_TOPICS[m]].key);
+        Serial.print(" ");
+        Serial.print(stats.metricReports[m]);
+    }
+    Serial.println();
+}
@@ -1,231 +1,787 @@
 #include "include/lib/scheduler.h"
 
 // Define static member variables
-float Scheduler::temperatureF = 0;
-float Scheduler::humidity = 0;
-float Scheduler::tvoc = 0;
-float Scheduler::h2 = 0;
-float Scheduler::ethanol = 0;
-int Scheduler::co2 = 0;
-int Scheduler::pm1_0 = 0;
-int Scheduler::pm2_5 = 0;
-int Scheduler::pm10 = 0;
-int Scheduler::aqi = 0;
+SpscRing<AggregateReport, 4> Scheduler::aggregateReports;
+Worker Scheduler::acquisition("acquisition", ACQUISITION_STACK, ACQUISITION_PRIORITY, ACQUISITION_CORE,
+                              Scheduler::pollAcquisition, true);
+Worker Scheduler::display("display", DISPLAY_STACK, DISPLAY_PRIORITY, DISPLAY_CORE, Scheduler::pollDisplay);
+Worker Scheduler::network("network", NETWORK_STACK, NETWORK_PRIORITY, NETWORK_CORE, Scheduler::pollNetwork);
 bool Scheduler::oledOn = true;
 volatile bool Scheduler::oledToggleRequested = false;
-unsigned long Scheduler::lastOLEDUpdate = 0;
-unsigned long Scheduler::lastSerialUpdate = 0;
-unsigned long Scheduler::lastMQTTUpdate = 0;
-unsigned long Scheduler::oledTimer = 0;
+int8_t Scheduler::scd41Task = TASK_INVALID_ID;
+int8_t Scheduler::sgp30Task = TASK_INVALID_ID;
+int8_t Scheduler::cycleTask = TASK_INVALID_ID;
+int8_t Scheduler::oledTimeoutTask = TASK_INVALID_ID;
+int8_t Scheduler::oledFlushTask = TASK_INVALID_ID;
+int8_t Scheduler::logDrainTask = TASK_INVALID_ID;
+int8_t Scheduler::displaySubscription = -1;
+int8_t Scheduler::connectionTask = TASK_INVALID_ID;
+int8_t Scheduler::drainTask = TASK_INVALID_ID;
+int8_t Scheduler::mqttServiceTask = TASK_INVALID_ID;
+int8_t Scheduler::uploadTask = TASK_INVALID_ID;
 bool Scheduler::mqttEnabled = false;
-unsigned long Scheduler::lastConnectionAttempt = 0;
-int Scheduler::connectionRetryCount = 0;
+unsigned long Scheduler::nextMQTTAttempt = 0;
+uint8_t Scheduler::mqttFailures = 0;
 bool Scheduler::wifiConnected = false;
-unsigned long Scheduler::lastSuccessfulRead = 0;
+volatile bool Scheduler::connectionEventPending = false;
+uint32_t Scheduler::diagnosticsVersion = 0;
 unsigned long Scheduler::lastReboot = 0;
+volatile bool Scheduler::cycleSampled = false;
+uint8_t Scheduler::uploadQueued = 0;
+bool Scheduler::statePublished = false;
+unsigned long Scheduler::connectedAt = 0;
 
-int Scheduler::calculateAQI(int pm2_5, int pm10) {
-    const int pm25Breakpoints[] = {0, 12, 35, 55, 150, 250, 500};
-    const int pm25AQIValues[]   = {0, 50, 100, 150, 200, 300, 500};
-
-    const int pm10Breakpoints[] = {0, 54, 154, 254, 354, 424, 604};
-    const int pm10AQIValues[]   = {0, 50, 100, 150, 200, 300, 500};
-
-    auto calculatePollutantAQI = [](int concentration, const int breakpoints[], const int aqiValues[]) {
-        for (int i = 1; i < 7; i++) {
-            if (concentration <= breakpoints[i]) {
-                return ((aqiValues[i] - aqiValues[i - 1]) * (concentration - breakpoints[i - 1])) /
-                       (breakpoints[i] - breakpoints[i - 1]) + aqiValues[i - 1];
-            }
-        }
-        return 500;
-    };
-
-    int aqi_pm2_5 = calculatePollutantAQI(pm2_5, pm25Breakpoints, pm25AQIValues);
-    int aqi_pm10  = calculatePollutantAQI(pm10, pm10Breakpoints, pm10AQIValues);
-
-    return max(aqi_pm2_5, aqi_pm10);
-}
+// Recovery actions and the DataBus topics each supervised sensor feeds
+static const SensorHealthConfig sensorHealthConfig[HEALTH_SENSOR_COUNT] = {
+    {"scd41", SCD41Sensor::sampleInterval, SCD41Sensor::reset, SCD41_POWER_PIN, I2C_DEVICE_SCD41, SCD41_TOPICS},
+    {"sgp30", SGP30Sensor::sampleInterval, SGP30Sensor::reset, SGP30_POWER_PIN, I2C_DEVICE_SGP30, SGP30_TOPICS},
+    {"pms7003", PMS7003Sensor::sampleInterval, PMS7003Sensor::reset, PMS7003_POWER_PIN, -1, PMS7003_TOPICS},
+};
 
 void Scheduler::init() {
-    Serial.println("Scheduler initialized");
+    // Records are drained to the UART by the display worker, the lowest
+    // priority one, so logging never waits on the serial port
+    EventLog::begin(wakeDisplay);
+    LOG_EVENT(SCHEDULER_READY);
+
+    // The wake cause decides whether RTC state is kept, and the sensor
+    // supplies must be on before any driver starts
+    PowerManager::begin();
+    SensorHealth::begin(sensorHealthConfig, wakeNetwork);
     
-    // Start core functionality first
+    // Start core functionality first; the bus must be up before any I2C driver
+    I2CBus::begin();
     SGP30Sensor::begin();
     SCD41Sensor::begin();
     PMS7003Sensor::begin();
+#if POWER_MODE != POWER_MODE_DUTY_CYCLED
     OLEDDisplay::init();
-    
-    oledTimer = millis();
-    oledOn = true;
+#endif
+    TelemetryStore::begin();
+    Aggregator::begin(PowerManager::resumed());
+    EnhancedAQI::begin(PowerManager::resumed());
+    LoopProfiler::begin();
+    HeapMonitor::begin();
+    ReportFilter::begin();
+
     lastReboot = millis();
-    lastSuccessfulRead = millis();
     
+    PMS7003Sensor::onData(wakeAcquisition);
+#if POWER_MODE != POWER_MODE_DUTY_CYCLED
     pinMode(BOOT_BUTTON_PIN, INPUT_PULLUP);
     attachInterrupt(digitalPinToInterrupt(BOOT_BUTTON_PIN), handleButtonPress, FALLING);
+#endif
 
-    lastOLEDUpdate = lastSerialUpdate = lastMQTTUpdate = millis();
-    lastConnectionAttempt = 0;
-    connectionRetryCount = 0;
+    nextMQTTAttempt = 0;
+    mqttFailures = 0;
     wifiConnected = false;
     mqttEnabled = false;
 
-    // Try initial connection
-    attemptConnection();
-}
-
-void Scheduler::attemptConnection() {
-    if (!wifiConnected) {
-        Serial.println("Attempting WiFi connection...");
-        if (WiFiManager::connect(WIFI_CONNECT_TIMEOUT)) {
-            wifiConnected = true;
-            Serial.println("WiFi connected successfully");
-            if (MQTTClient::init()) {
-                mqttEnabled = true;
-                Serial.println("MQTT connected successfully");
-                connectionRetryCount = 0;
-            } else {
-                mqttEnabled = false;
-                connectionRetryCount++;
-                Serial.println("MQTT connection failed");
-            }
-        } else {
-            wifiConnected = false;
-            connectionRetryCount++;
-            Serial.println("WiFi connection failed");
+    // Register periodic work on each worker; workers sleep between deadlines.
+    // Each sensor is sampled once on its own cadence and consumers only read the snapshot.
+    // PMS7003 frames are consumed whenever the UART receive callback wakes acquisition.
+    TaskQueue& acquisitionTasks = acquisition.tasks();
+    scd41Task = acquisitionTasks.every(SCD41_SAMPLE_INTERVAL, sampleSCD41);
+    sgp30Task = acquisitionTasks.every(SGP30_SAMPLE_INTERVAL, sampleSGP30);
+#if POWER_MODE == POWER_MODE_DUTY_CYCLED
+    // One sample per sensor, then the cycle ends. The PMS7003 warm-up is the
+    // longest step and sets the awake time; the SCD41 single shot and the
+    // SGP30 warm-up fit inside it.
+    acquisitionTasks.after(0, startPMS7003Sample);
+    cycleTask = acquisitionTasks.every(DUTY_CHECK_INTERVAL, completeCycle, DUTY_CHECK_INTERVAL);
+#else
+    acquisitionTasks.every(SGP30_BASELINE_SAVE_INTERVAL, SGP30Sensor::saveBaseline, SGP30_BASELINE_SAVE_INTERVAL);
+#if PMS7003_PASSIVE_MODE
+    acquisitionTasks.every(PMS7003_PASSIVE_INTERVAL, startPMS7003Sample);
+#endif
+#endif
+    acquisitionTasks.every(SENSOR_HEALTH_CHECK_INTERVAL, SensorHealth::check, SENSOR_HEALTH_CHECK_INTERVAL);
+#if POWER_MODE != POWER_MODE_DUTY_CYCLED
+    acquisitionTasks.every(AGGREGATE_ROLL_INTERVAL, rollAggregates, AGGREGATE_ROLL_INTERVAL);
+    acquisitionTasks.every(DIAGNOSTICS_INTERVAL, reportAcquisition, DIAGNOSTICS_INTERVAL);
+
+    // The display redraws when a shown value changes, at most every OLED_UPDATE_INTERVAL
+    displaySubscription = DataBus::subscribe(METRIC_DISPLAY_TOPICS, OLED_UPDATE_INTERVAL, wakeDisplay);
+    oledOn = false;
+    setOledState(true);
+    display.tasks().every(DIAGNOSTICS_INTERVAL, reportDisplay, DIAGNOSTICS_INTERVAL);
+#else
+    // The panel is never initialized and stays in its power-on (off) state
+    oledOn = false;
+#endif
+
+    TaskQueue& networkTasks = network.tasks();
+#if POWER_MODE == POWER_MODE_DUTY_CYCLED
+    // WiFi only comes up for an upload, see startUpload()
+    mqttServiceTask = networkTasks.every(MQTT_LOOP_INTERVAL, serviceMQTT, MQTT_LOOP_INTERVAL);
+#else
+    networkTasks.every(SERIAL_UPDATE_INTERVAL, logSerial, SERIAL_UPDATE_INTERVAL);
+#if REPORT_ON_CHANGE
+    networkTasks.every(REPORT_CHECK_INTERVAL, publishMQTT, REPORT_CHECK_INTERVAL);
+#else
+    networkTasks.every(MQTT_UPDATE_INTERVAL, publishMQTT, MQTT_UPDATE_INTERVAL);
+#endif
+    mqttServiceTask = networkTasks.every(MQTT_LOOP_INTERVAL, serviceMQTT, MQTT_LOOP_INTERVAL);
+    networkTasks.every(REBOOT_CHECK_INTERVAL, checkAndReboot, REBOOT_CHECK_INTERVAL);
+    networkTasks.every(DIAGNOSTICS_INTERVAL, reportDiagnostics, DIAGNOSTICS_INTERVAL);
+    networkTasks.every(HEAP_SAMPLE_INTERVAL, HeapMonitor::sample, HEAP_SAMPLE_INTERVAL);
+    networkTasks.every(HEALTH_PUBLISH_INTERVAL, publishHealth, HEALTH_PUBLISH_INTERVAL);
+#endif
+
+    // Serial commands are read on the network worker when the UART wakes it
+    Console::begin(wakeNetwork);
+    Console::addCommand("scd41", "mode periodic|low-power|single-shot | pressure <hPa> | altitude <m> | frc <ppm>",
+                        scd41Command);
+    Console::addCommand("log", "[<module>|all <off|error|warn|info|debug>]", logCommand);
+
+#if POWER_MODE != POWER_MODE_DUTY_CYCLED
+    // WiFi association runs in the background; manageConnection() only polls its state
+    WiFiManager::begin(onConnectionEvent);
+    connectionTask = networkTasks.every(CONNECTION_CHECK_INTERVAL, manageConnection, 0);
+#endif
+
+    acquisition.start();
+    display.start();
+    network.start();
+}
+
+void Scheduler::connectMQTT() {
+    unsigned long started = millis();
+    if (MQTTClient::init()) {
+        mqttEnabled = true;
+        mqttFailures = 0;
+        LOG_EVENT(MQTT_CONNECTED, millis() - started);
+
+        // Whatever happened while disconnected is reported again right away
+        ReportFilter::invalidate();
+
+        // Replay anything recorded while offline
+        if (TelemetryStore::backlog() > 0 && !network.tasks().isScheduled(drainTask)) {
+            drainTask = network.tasks().after(0, drainBacklog);
         }
-    } else if (!mqttEnabled) {
-        if (MQTTClient::init()) {
-            mqttEnabled = true;
-            Serial.println("MQTT connected successfully");
-            connectionRetryCount = 0;
-        } else {
-            mqttEnabled = false;
-            connectionRetryCount++;
-            Serial.println("MQTT connection failed");
+#if POWER_MODE == POWER_MODE_DUTY_CYCLED
+        connectedAt = millis();
+        if (!network.tasks().isScheduled(uploadTask)) {
+            uploadTask = network.tasks().after(0, uploadSamples);
         }
+#endif
+        return;
     }
 
-    if (connectionRetryCount >= MQTT_MAX_RETRIES) {
-        Serial.println("Maximum connection attempts reached. Will retry in 15 minutes.");
-        lastConnectionAttempt = millis();
-        connectionRetryCount = 0;
+    mqttEnabled = false;
+    unsigned long wait = jitteredBackoff(mqttFailures, MQTT_BACKOFF_INITIAL, MQTT_LONG_RETRY_INTERVAL);
+    mqttFailures = mqttFailures < 16 ? mqttFailures + 1 : mqttFailures;
+    nextMQTTAttempt = millis() + wait;
+    LOG_EVENT(MQTT_CONNECT_FAILED, wait / 1000);
+}
+
+// Called from the WiFi event task
+void Scheduler::onConnectionEvent() {
+    connectionEventPending = true;
+    network.wake();
+}
+
+// Called from the UART receive task for every decoded PMS7003 frame
+void Scheduler::wakeAcquisition() {
+    acquisition.wake();
+}
+
+// Called from the UART event task when console input arrives
+void Scheduler::wakeNetwork() {
+    network.wake();
+}
+
+// Called by DataBus::dispatch() on the acquisition worker
+void Scheduler::wakeDisplay() {
+    display.wake();
+}
+
+void Scheduler::manageConnection() {
+    unsigned long nextPoll = WiFiManager::poll();
+    bool connected = WiFiManager::isConnected();
+
+    if (connected != wifiConnected) {
+        wifiConnected = connected;
+        mqttEnabled = false;
+        nextMQTTAttempt = millis();
+        if (connected) {
+            WiFiManager::syncNTP();
+        }
+    }
+
+    if (wifiConnected && !mqttEnabled) {
+        unsigned long now = millis();
+        if ((long)(now - nextMQTTAttempt) >= 0) {
+            connectMQTT();
+        }
+        if (!mqttEnabled) {
+            unsigned long mqttWait = nextMQTTAttempt - millis();
+            if ((long)mqttWait < 0) {
+                mqttWait = 0;
+            }
+            nextPoll = min(nextPoll, mqttWait);
+        }
     }
+
+    network.tasks().reschedule(connectionTask, min(nextPoll, (unsigned long)CONNECTION_CHECK_INTERVAL));
 }
 
-void Scheduler::updateSensors() {
-    bool allSensorsWorking = true;
-    
-    // Update SCD41 sensor
-    if (SCD41Sensor::read()) {
-        temperatureF = SCD41Sensor::getTemperatureF();
-        humidity = SCD41Sensor::getHumidity();
-        co2 = SCD41Sensor::getCO2();
-        lastSuccessfulRead = millis();
-    } else {
-        allSensorsWorking = false;
+// The driver decides when it next needs the bus: at the next expected
+// sample, or sooner while polling data-ready or applying a command
+void Scheduler::sampleSCD41() {
+    // read() also returns false while no sample is due, so failures are
+    // taken from the driver's counters
+    const SCD41Stats& stats = SCD41Sensor::getStats();
+    uint32_t errors = stats.readFailures + stats.timeouts;
+    bool updated = SCD41Sensor::read();
+    acquisition.tasks().reschedule(scd41Task, SCD41Sensor::nextPollDelay());
+
+    unsigned long now = millis();
+    if (stats.readFailures + stats.timeouts != errors) {
+        SensorHealth::reportFailure(HEALTH_SCD41, now);
     }
-    
-    // Update SGP30 sensor
-    SGP30Sensor::read();
-    tvoc = SGP30Sensor::getTVOC();
-    h2 = SGP30Sensor::getH2();
-    ethanol = SGP30Sensor::getEthanol();
-    
-    // Update PMS7003 sensor
-    if (PMS7003Sensor::read()) {
-        pm1_0 = PMS7003Sensor::getPM1_0();
-        pm2_5 = PMS7003Sensor::getPM2_5();
-        pm10 = PMS7003Sensor::getPM10();
-        aqi = calculateAQI(pm2_5, pm10);
-        lastSuccessfulRead = millis();
+    if (updated) {
+        int16_t temperature = SCD41Sensor::getTemperature();
+        uint16_t humidity = SCD41Sensor::getHumidity();
+        uint16_t co2 = SCD41Sensor::getCO2();
+        SensorHealth::reportSuccess(HEALTH_SCD41, now);
+        SGP30Sensor::setHumidity(temperature, humidity);
+
+        ReadingQuality quality = SensorHealth::quality(HEALTH_SCD41);
+        DataBus::publish(TOPIC_TEMPERATURE, temperature, quality, now);
+        DataBus::publish(TOPIC_HUMIDITY, humidity, quality, now);
+        DataBus::publish(TOPIC_CO2, co2, quality, now);
+        DataBus::dispatch();
+
+        Aggregator::add(AGG_TEMPERATURE, temperature);
+        Aggregator::add(AGG_HUMIDITY, humidity);
+        Aggregator::add(AGG_CO2, co2);
+    }
+}
+
+// A failed read republishes the previous values flagged invalid
+void Scheduler::sampleSGP30() {
+    bool ok = SGP30Sensor::read();
+    unsigned long now = millis();
+    if (ok) {
+        SensorHealth::reportSuccess(HEALTH_SGP30, now);
     } else {
-        allSensorsWorking = false;
+        SensorHealth::reportFailure(HEALTH_SGP30, now);
     }
-    
-    // If all sensors are working, update the last successful read time
-    if (allSensorsWorking) {
-        lastSuccessfulRead = millis();
+#if POWER_MODE == POWER_MODE_DUTY_CYCLED
+    // Readings are fixed at 0 ppb for the first seconds after IAQinit
+    if (millis() < DUTY_SGP30_WARMUP) {
+        return;
+    }
+#endif
+    ReadingQuality quality = ok ? SensorHealth::quality(HEALTH_SGP30) : QUALITY_INVALID;
+    uint16_t tvoc = SGP30Sensor::getTVOC();
+    DataBus::publish(TOPIC_TVOC, tvoc, quality, now);
+    DataBus::publish(TOPIC_H2, SGP30Sensor::getH2(), quality, now);
+    DataBus::publish(TOPIC_ETHANOL, SGP30Sensor::getEthanol(), quality, now);
+    DataBus::dispatch();
+    Aggregator::add(AGG_TVOC, tvoc);
+}
+
+void Scheduler::samplePMS7003() {
+    // Consume every buffered frame in arrival order
+    bool updated = false;
+    while (PMS7003Sensor::read()) {
+        uint16_t pm1_0 = PMS7003Sensor::getPM1_0();
+        uint16_t pm2_5 = PMS7003Sensor::getPM2_5();
+        uint16_t pm10 = PMS7003Sensor::getPM10();
+        unsigned long measuredAt = PMS7003Sensor::getTimestamp();
+        // The hourly history runs on the clock that continues through deep sleep
+        EnhancedAQI::addSample(pm2_5, pm10, measuredAt + (PowerManager::elapsedMillis() - millis()));
+        AQIResult aqi = EnhancedAQI::nowcastAQI();
+        SensorHealth::reportSuccess(HEALTH_PMS7003, millis());
+        updated = true;
+
+        ReadingQuality quality = SensorHealth::quality(HEALTH_PMS7003);
+        DataBus::publish(TOPIC_PM1_0, pm1_0, quality, measuredAt);
+        DataBus::publish(TOPIC_PM2_5, pm2_5, quality, measuredAt);
+        DataBus::publish(TOPIC_PM10, pm10, quality, measuredAt);
+        DataBus::publish(TOPIC_AQI, aqi.index, quality, measuredAt);
+        DataBus::publish(TOPIC_AQI_POLLUTANT, (int32_t)aqi.dominant, quality, measuredAt);
+        DataBus::publish(TOPIC_AQI_24H, EnhancedAQI::dailyAQI().index, quality, measuredAt);
+
+        Aggregator::add(AGG_PM1_0, pm1_0);
+        Aggregator::add(AGG_PM2_5, pm2_5);
+        Aggregator::add(AGG_PM10, pm10);
+#if PMS7003_PASSIVE_MODE || POWER_MODE == POWER_MODE_DUTY_CYCLED
+        PMS7003Sensor::sleep();
+#endif
+    }
+    if (updated) {
+        DataBus::dispatch();
+    }
+}
+
+// Passive mode: spin the fan up, then request a single frame once readings are stable
+void Scheduler::startPMS7003Sample() {
+    PMS7003Sensor::wakeUp();
+    PMS7003Sensor::setPassiveMode(true);
+    acquisition.tasks().after(PMS7003_WARMUP_TIME, requestPMS7003Sample);
+}
+
+// The reply arrives over the UART, which automatic light sleep would miss
+void Scheduler::requestPMS7003Sample() {
+    PowerManager::holdAwake(true);
+    PMS7003Sensor::requestRead();
+}
+
+// Closes finished aggregation windows and hands their statistics to the
+// network worker, which owns the MQTT client
+void Scheduler::rollAggregates() {
+    Aggregator::roll(PowerManager::elapsedMillis());
+
+    bool queued = false;
+    for (uint8_t w = 0; w < WINDOW_COUNT; w++) {
+        AggregateWindow window = (AggregateWindow)w;
+        if (Aggregator::takeCompleted(window)) {
+            AggregateReport report;
+            Aggregator::report(window, report);
+            queued |= aggregateReports.push(report);
+        }
+    }
+    if (queued) {
+        network.wake();
+    }
+}
+
+// Duty-cycled mode: ends the sampling part of the cycle once every sensor
+// has reported, or at DUTY_SAMPLE_TIMEOUT with whatever arrived, and hands
+// over to the network worker
+void Scheduler::completeCycle() {
+    SensorSnapshot s;
+    DataBus::snapshot(s);
+    bool complete = s.scd41UpdatedAt != 0 && s.sgp30UpdatedAt != 0 && s.pms7003UpdatedAt != 0;
+    if (!complete && millis() < DUTY_SAMPLE_TIMEOUT) {
+        return;
+    }
+
+    TaskQueue& tasks = acquisition.tasks();
+    tasks.cancel(cycleTask);
+    tasks.cancel(scd41Task);
+    tasks.cancel(sgp30Task);
+    PMS7003Sensor::sleep();
+    PowerManager::holdAwake(false);
+    SCD41Sensor::powerDown();
+    SGP30Sensor::holdBaseline();
+    if (PowerManager::getStats().cycles % (SGP30_BASELINE_SAVE_INTERVAL / DUTY_CYCLE_PERIOD) == 0) {
+        SGP30Sensor::saveBaseline();
+    }
+    if (PowerManager::getStats().cycles % (DIAGNOSTICS_INTERVAL / DUTY_CYCLE_PERIOD) == 0) {
+        PowerManager::printStats();
+    }
+    rollAggregates();
+
+    if (!complete) {
+        LOG_EVENT(POWER_SAMPLE_INCOMPLETE);
     }
+    PowerManager::recordSample(s);
+    cycleSampled = true;
+    network.wake();
 }
 
+void Scheduler::pollAcquisition() {
+    samplePMS7003();
+}
+
+void Scheduler::pollDisplay() {
+    if (oledToggleRequested) {
+        oledToggleRequested = false;
+        handleOledToggle();
+    }
+    // Always drain the changes so a dark display is not woken again for them
+    if (DataBus::take(displaySubscription) != 0 && oledOn) {
+        refreshDisplay();
+    }
+    if (logDrainTask == TASK_INVALID_ID) {
+        drainLog();
+    }
+}
+
+void Scheduler::pollNetwork() {
+    if (connectionEventPending) {
+        connectionEventPending = false;
+        network.tasks().reschedule(connectionTask, 0);
+    }
+    Console::poll();
+#if POWER_MODE == POWER_MODE_DUTY_CYCLED
+    if (cycleSampled) {
+        cycleSampled = false;
+        startUpload();
+    }
+#endif
+    if (SensorHealth::version() != diagnosticsVersion) {
+        publishDiagnostics();
+    }
+    publishAggregates();
+}
+
+// All work runs on the pinned workers started by init(), so the Arduino
+// loop task has nothing left to do
 void Scheduler::run() {
-    // Check for reboot conditions
-    checkAndReboot();
-    
+    vTaskDelete(nullptr);
+}
+
+void Scheduler::setOledState(bool on) {
+    if (on == oledOn) {
+        return;
+    }
+    oledOn = on;
+
+    TaskQueue& tasks = display.tasks();
+    if (on) {
+        refreshDisplay();
+        oledTimeoutTask = tasks.after(OLED_TIMEOUT, oledAutoShutoff);
+    } else {
+        tasks.cancel(oledTimeoutTask);
+        tasks.cancel(oledFlushTask);
+        oledTimeoutTask = oledFlushTask = TASK_INVALID_ID;
+        OLEDDisplay::init();
+    }
+}
+
+void Scheduler::handleOledToggle() {
+    setOledState(!oledOn);
+    LOG_EVENT(DISPLAY_STATE, oledOn);
+}
+
+void Scheduler::oledAutoShutoff() {
+    oledTimeoutTask = TASK_INVALID_ID;
+    setOledState(false);
+    LOG_EVENT(DISPLAY_TIMEOUT);
+}
+
+void Scheduler::refreshDisplay() {
+    OLEDDisplay::update();
+
+    if (OLEDDisplay::isDirty() && !display.tasks().isScheduled(oledFlushTask)) {
+        oledFlushTask = display.tasks().after(0, flushDisplay);
+    }
+}
+
+// Pushes one dirty page per call so a changed frame never holds the I2C bus
+// for a full 1 KB transfer
+void Scheduler::flushDisplay() {
+    oledFlushTask = OLEDDisplay::flush() ? display.tasks().after(OLED_FLUSH_GAP, flushDisplay) : TASK_INVALID_ID;
+}
+
+// Writes only what fits in the UART transmit buffer and comes back once it
+// has emptied
+void Scheduler::drainLog() {
+    logDrainTask = EventLog::drain() ? display.tasks().after(LOG_DRAIN_RETRY, drainLog) : TASK_INVALID_ID;
+}
+
+void Scheduler::logSerial() {
+    SensorSnapshot s;
+    DataBus::snapshot(s);
+    for (uint8_t t = 0; t < TOPIC_COUNT; t++) {
+        LOG_EVENT(REPORT_METRIC, t, metricFixed(s, (DataTopic)t));
+    }
+}
+
+void Scheduler::publishMQTT() {
+    if (mqttEnabled && wifiConnected && !MQTTClient::isConnected()) {
+        mqttEnabled = false;
+        LOG_EVENT(MQTT_LOST);
+        network.tasks().reschedule(connectionTask, 0);
+    }
+
+    SensorSnapshot s;
+    DataBus::snapshot(s);
     unsigned long now = millis();
+#if REPORT_ON_CHANGE
+    uint16_t metrics = ReportFilter::due(s, now);
+    if (metrics == 0) {
+        return;
+    }
+#if MQTT_BATCHED_STATE
+    metrics = REPORT_ALL;  // The document carries every field, so all of them are reported
+#endif
+#else
+    uint16_t metrics = REPORT_ALL;
+#endif
 
-    // Handle connection retries
-    if (!mqttEnabled && (now - lastConnectionAttempt >= MQTT_LONG_RETRY_INTERVAL)) {
-        Serial.println("Attempting periodic reconnection...");
-        lastConnectionAttempt = now;
-        attemptConnection();
+    // Only attempt MQTT updates if MQTT is enabled and connected; offline or
+    // failed readings are kept for backfill
+    if (!(mqttEnabled && wifiConnected && MQTTClient::publishState(s, WiFiManager::currentTime(), metrics))) {
+        storeSample(s);
     }
+    ReportFilter::commit(s, metrics, now);
+    flushMQTTSoon();
+}
+
+void Scheduler::storeSample(const SensorSnapshot& s) {
+    uint32_t now = WiFiManager::currentTime();
+    if (now != 0) {
+        TelemetryStore::append(s, now, false);
+    } else {
+        TelemetryStore::append(s, millis() / 1000, true);
+    }
+}
+
+// Publishes the offline backlog in small batches so a long outage does not
+// flood the broker or stall the loop. Records leave the offline log only
+// once the broker has acknowledged them; until then they sit in the QoS1
+// window, which is retransmitted across reconnects but not reboots.
+void Scheduler::drainBacklog() {
+    drainTask = TASK_INVALID_ID;
+    if (!mqttEnabled || TelemetryStore::backlog() == 0) {
+        return;
+    }
+    TelemetryStore::acknowledge(MQTTClient::backfillAcked());
+
+    StoredSample batch[TELEMETRY_DRAIN_BATCH];
+    uint8_t count = TelemetryStore::peek(batch, TELEMETRY_DRAIN_BATCH);
+    uint32_t now = WiFiManager::currentTime();
+    uint32_t uptime = millis() / 1000;
 
+    for (uint8_t i = 0; i < count; i++) {
+        const StoredSample& sample = batch[i];
+        uint32_t timestamp = sample.record.timestamp;
+        bool uptimeOnly = sample.record.uptime;
+
+        // Uptime stamps from this boot can be mapped onto wall-clock time now
+        if (uptimeOnly && now != 0 && TelemetryStore::isFromThisBoot(sample.sequence)) {
+            timestamp = now - (uptime - timestamp);
+            uptimeOnly = false;
+        }
+
+        if (!MQTTClient::publishBackfill(sample, timestamp, uptimeOnly)) {
+            break;
+        }
+        TelemetryStore::markQueued(sample.sequence);
+    }
+    flushMQTTSoon();
+
+    if (TelemetryStore::backlog() > 0) {
+        drainTask = network.tasks().after(TELEMETRY_DRAIN_INTERVAL, drainBacklog);
+    }
+}
+
+// Publishes window statistics queued by the acquisition worker
+void Scheduler::publishAggregates() {
+    AggregateReport report;
+    while (aggregateReports.pop(report)) {
+        if (mqttEnabled && wifiConnected) {
+            MQTTClient::publishAggregates(report);
+        }
+    }
+    flushMQTTSoon();
+}
+
+void Scheduler::serviceMQTT() {
     // Handle MQTT client loop if connected
     if (mqttEnabled && wifiConnected) {
         MQTTClient::loop();
     }
+    flushMQTTSoon();
+}
 
-    if (oledToggleRequested) {
-        oledToggleRequested = false;
-        oledOn = !oledOn;
-        if (oledOn) {
-            oledTimer = now;
-            Serial.println("OLED turned ON.");
-        } else {
-            OLEDDisplay::init();
-            Serial.println("OLED turned OFF.");
+// Publishing only queues bytes; while the socket has not taken them all,
+// the MQTT service task comes back on a short period
+void Scheduler::flushMQTTSoon() {
+    if (mqttEnabled && MQTTClient::hasPendingWrites()) {
+        network.tasks().reschedule(mqttServiceTask, MQTT_FLUSH_INTERVAL);
+    }
+}
+
+// Each worker reports the drivers it owns
+void Scheduler::reportAcquisition() {
+    SensorHealth::printStats();
+    SCD41Sensor::printStats();
+    PMS7003Sensor::printStats();
+    SGP30Sensor::printStats();
+    I2CBus::printStats();
+    DataBus::printStats();
+}
+
+void Scheduler::reportDisplay() {
+    OLEDDisplay::printStats();
+}
+
+void Scheduler::reportDiagnostics() {
+    HeapMonitor::printStats();
+    WiFiManager::printStats();
+    MQTTClient::printStats();
+    ReportFilter::printStats();
+    TelemetryStore::printStats();
+    EventLog::printStats();
+    acquisition.printStats();
+    display.printStats();
+    network.printStats();
+}
+
+void Scheduler::publishHealth() {
+    if (!mqttEnabled || !wifiConnected) {
+        return;
+    }
+    const TaskHealth health[] = {
+        {acquisition.getName(), acquisition.stackHeadroom()},
+        {display.getName(), display.stackHeadroom()},
+        {network.getName(), network.stackHeadroom()},
+    };
+    MQTTClient::publishHealth(HeapMonitor::getStats(), health, sizeof(health) / sizeof(health[0]));
+    publishDiagnostics();
+}
+
+// Sent on every sensor state change and with the periodic health report;
+// a change while offline is sent once the connection is back
+void Scheduler::publishDiagnostics() {
+    if (!mqttEnabled || !wifiConnected) {
+        return;
+    }
+    uint32_t version = SensorHealth::version();
+    SensorHealthInfo sensors[HEALTH_SENSOR_COUNT];
+    for (uint8_t i = 0; i < HEALTH_SENSOR_COUNT; i++) {
+        sensors[i] = SensorHealth::read((HealthSensor)i);
+    }
+    if (MQTTClient::publishDiagnostics(sensors, HEALTH_SENSOR_COUNT)) {
+        diagnosticsVersion = version;
+    }
+    flushMQTTSoon();
+}
+
+// Duty-cycled mode: one short WiFi session every DUTY_UPLOAD_EVERY samples,
+// otherwise straight back to sleep
+void Scheduler::startUpload() {
+    if (!PowerManager::uploadDue()) {
+        enterSleep();
+    }
+    uploadQueued = 0;
+    statePublished = false;
+    WiFiManager::begin(onConnectionEvent);
+    connectionTask = network.tasks().every(CONNECTION_CHECK_INTERVAL, manageConnection, 0);
+    network.tasks().after(DUTY_UPLOAD_TIMEOUT, abortUpload);
+}
+
+// Queues the samples held in RTC memory and then the latest state as the
+// QoS1 window frees up. The device only sleeps once the broker has
+// acknowledged everything, because the window does not survive deep sleep.
+void Scheduler::uploadSamples() {
+    uploadTask = TASK_INVALID_ID;
+    if (!mqttEnabled) {
+        return;  // Rescheduled by connectMQTT()
+    }
+    MQTTClient::loop();
+
+    uint32_t now = WiFiManager::currentTime();
+    if (now == 0 && millis() - connectedAt < DUTY_CLOCK_WAIT) {
+        uploadTask = network.tasks().after(MQTT_FLUSH_INTERVAL, uploadSamples);
+        return;
+    }
+
+    uint8_t pending = PowerManager::pendingSamples();
+    while (uploadQueued < pending) {
+        StoredSample sample = PowerManager::pendingSample(uploadQueued, now);
+        if (!MQTTClient::publishBackfill(sample, sample.record.timestamp, sample.record.uptime)) {
+            break;
+        }
+        uploadQueued++;
+    }
+    if (uploadQueued == pending && !statePublished) {
+        SensorSnapshot s;
+        DataBus::snapshot(s);
+        statePublished = MQTTClient::publishState(s, now, REPORT_ALL);
+        if (statePublished) {
+            publishAggregates();
+            publishDiagnostics();
         }
     }
 
-    if (oledOn && now - oledTimer >= OLED_TIMEOUT) {
-        oledOn = false;
-        OLEDDisplay::init();
-        Serial.println("OLED Auto Shutoff.");
+    if (statePublished && MQTTClient::inFlight() == 0 && !MQTTClient::hasPendingWrites()) {
+        PowerManager::uploadFinished(true, uploadQueued);
+        enterSleep();
     }
+    uploadTask = network.tasks().after(MQTT_FLUSH_INTERVAL, uploadSamples);
+}
+
+// Unacknowledged samples stay in RTC memory for the next session
+void Scheduler::abortUpload() {
+    LOG_EVENT(MQTT_UPLOAD_TIMEOUT);
+    PowerManager::uploadFinished(false, 0);
+    enterSleep();
+}
 
-    if (oledOn && now - lastOLEDUpdate >= 500) {
-        lastOLEDUpdate = now;
-        updateSensors();
-        OLEDDisplay::update(temperatureF, humidity, co2, pm1_0, pm2_5, pm10, aqi, tvoc, h2, ethanol);
+// Ends this boot; the next cycle starts again from setup()
+void Scheduler::enterSleep() {
+    if (connectionTask != TASK_INVALID_ID) {
+        if (mqttEnabled) {
+            MQTTClient::disconnect();
+        }
+        WiFiManager::disconnect();
     }
-    
-    if (now - lastSerialUpdate >= 10000) {
-        lastSerialUpdate = now;
-        updateSensors();
-        Serial.print("Temp: "); Serial.print(temperatureF, 2); Serial.print(" °F | ");
-        Serial.print("Humidity: "); Serial.print(humidity, 2); Serial.print(" % | ");
-        Serial.print("CO2: "); Serial.print(co2); Serial.print(" ppm | ");
-        Serial.print("PM1.0: "); Serial.print(pm1_0); Serial.print(" µg/m³ | ");
-        Serial.print("PM2.5: "); Serial.print(pm2_5); Serial.print(" µg/m³ | ");
-        Serial.print("PM10: "); Serial.print(pm10); Serial.print(" µg/m³ | ");
-        Serial.print("AQI: "); Serial.print(aqi);
-        Serial.print(" | TVOC: "); Serial.print(tvoc, 0); Serial.print(" ppb");
-        Serial.print(" | H2: "); Serial.print(h2, 0); Serial.print(" res");
-        Serial.print(" | Ethanol: "); Serial.print(ethanol, 0); Serial.println(" res");
-    }
-
-    // Only attempt MQTT updates if MQTT is enabled and connected
-    if (mqttEnabled && wifiConnected && now - lastMQTTUpdate >= 60000) {
-        if (!MQTTClient::isConnected()) {
-            mqttEnabled = false;
-            Serial.println("MQTT connection lost - will retry later");
-        } else {
-            lastMQTTUpdate = now;
-            updateSensors();
-            MQTTClient::publish("homeassistant/sensor/esp32_temperature/state", "{ \"temperature\": " + String(temperatureF) + " }");
-            MQTTClient::publish("homeassistant/sensor/esp32_humidity/state", "{ \"humidity\": " + String(humidity) + " }");
-            MQTTClient::publish("homeassistant/sensor/esp32_co2/state", String(co2));
-            MQTTClient::publish("homeassistant/sensor/esp32_pm1_0/state", String(pm1_0));
-            MQTTClient::publish("homeassistant/sensor/esp32_pm2_5/state", String(pm2_5));
-            MQTTClient::publish("homeassistant/sensor/esp32_pm10/state", String(pm10));
-            MQTTClient::publish("homeassistant/sensor/esp32_aqi/state", String(aqi));
-            MQTTClient::publish("homeassistant/sensor/esp32_tvoc/state", String(tvoc));
-            MQTTClient::publish("homeassistant/sensor/esp32_h2/state", String(h2));
-            MQTTClient::publish("homeassistant/sensor/esp32_ethanol/state", String(ethanol));
+    TelemetryStore::flush();
+    SensorHealth::powerDown(HEALTH_SGP30);
+    SensorHealth::powerDown(HEALTH_PMS7003);
+    PowerManager::sleep();
+}
+
+// Commands are queued in the driver and applied at its next poll on the
+// acquisition worker
+bool Scheduler::scd41Command(const char* args) {
+    char verb[12], name[16];
+    float value;
+    if (sscanf(args, "mode %15s", name) == 1) {
+        for (uint8_t mode = SCD41_MODE_PERIODIC; mode <= SCD41_MODE_SINGLE_SHOT; mode++) {
+            if (strcmp(name, SCD41Sensor::modeName(mode)) == 0) {
+                SCD41Sensor::setMode(mode);
+                return true;
+            }
+        }
+        return false;
+    }
+    if (sscanf(args, "%11s %f", verb, &value) != 2) {
+        return false;
+    }
+
+    if (strcmp(verb, "pressure") == 0 && value >= 700 && value <= 1200) {
+        SCD41Sensor::setAmbientPressure(value);
+    } else if (strcmp(verb, "altitude") == 0 && value >= 0 && value <= 3000) {
+        SCD41Sensor::setAltitude((uint16_t)value);
+    } else if (strcmp(verb, "frc") == 0 && value >= 400 && value <= 2000) {
+        SCD41Sensor::forceRecalibration((uint16_t)value);
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// "log" lists the thresholds, "log <module>|all <level>" changes them
+bool Scheduler::logCommand(const char* args) {
+    if (args[0] == '\0') {
+        for (uint8_t m = 0; m < LOG_MODULE_COUNT; m++) {
+            Serial.print(EventLog::moduleName((LogModule)m));
+            Serial.print(": ");
+            Serial.println(EventLog::levelName(EventLog::getLevel((LogModule)m)));
+        }
+        return true;
+    }
+
+    size_t nameLength = strcspn(args, " ");
+    const char* levelText = args + nameLength;
+    while (*levelText == ' ') {
+        levelText++;
+    }
+    LogLevel level;
+    if (!EventLog::parseLevel(levelText, level)) {
+        return false;
+    }
+    if (nameLength == 3 && strncmp(args, "all", 3) == 0) {
+        for (uint8_t m = 0; m < LOG_MODULE_COUNT; m++) {
+            EventLog::setLevel((LogModule)m, level);
         }
+        return true;
     }
+    LogModule module;
+    if (!EventLog::parseModule(args, nameLength, module)) {
+        return false;
+    }
+    EventLog::setLevel(module, level);
+    return true;
 }
 
 void Scheduler::setOledToggleRequested() {
@@ -236,33 +792,50 @@ bool Scheduler::isOledOn() {
     return oledOn;
 }
 
+void IRAM_ATTR Scheduler::wakeDisplayFromISR() {
+    display.wakeFromISR();
+}
+
 // Interrupt Service Routine (ISR) for button press
 void IRAM_ATTR handleButtonPress() {
     Scheduler::setOledToggleRequested();
+    Scheduler::wakeDisplayFromISR();
 }
 
 void Scheduler::checkAndReboot() {
-    unsigned long currentTime = millis();
-    
-    // Check for scheduled reboot (every 6 hours)
-    if (currentTime - lastReboot >= SCHEDULED_REBOOT_INTERVAL) {
-        Serial.println("Performing scheduled reboot...");
+#if SCHEDULED_REBOOT_INTERVAL > 0
+    // Optional scheduled reboot; steady state no longer allocates, so it is off by default
+    if (millis() - lastReboot >= SCHEDULED_REBOOT_INTERVAL) {
+        LOG_EVENT(REBOOT_SCHEDULED);
+        performReboot();
+        return;
+    }
+#endif
+
+    // Reboot only if the heap has actually degraded
+    if (HeapMonitor::isCritical()) {
+        LOG_EVENT(REBOOT_HEAP, HeapMonitor::getStats().largestBlock);
         performReboot();
         return;
     }
     
-    // Check for emergency reboot (no readings for 5 minutes)
-    if (currentTime - lastSuccessfulRead >= EMERGENCY_REBOOT_TIMEOUT) {
-        Serial.println("No sensor readings for 5 minutes, performing emergency reboot...");
+    // Last resort: every sensor has been through all recovery stages and
+    // stayed silent; a single failed sensor never reboots the device
+    if (SensorHealth::rebootRequired()) {
+        LOG_EVENT(REBOOT_SENSORS);
         performReboot();
         return;
     }
 }
 
 void Scheduler::performReboot() {
-    // Try to send a message to MQTT before rebooting
+    // Keep buffered offline samples
+    TelemetryStore::flush();
+
+    // Mark the entities unavailable now rather than when the broker's
+    // keepalive for the dropped connection runs out
     if (mqttEnabled) {
-        MQTTClient::publish("homeassistant/sensor/esp32_status/state", "rebooting");
+        MQTTClient::publishAvailability(false);
         delay(1000);  // Give time for the message to be sent
     }
     
@@ -271,12 +844,7 @@ void Scheduler::performReboot() {
         MQTTClient::disconnect();
     }
     
-    // Display reboot message on OLED if it's on
-    if (oledOn) {
-        OLEDDisplay::update(temperatureF, humidity, co2, pm1_0, pm2_5, pm10, aqi, tvoc, h2, ethanol);
-        delay(1000);
-    }
-    
-    // Perform the reboot
+    // Perform the reboot; the records stay in RAM for the next boot
+    EventLog::flush(LOG_FLUSH_TIMEOUT);
     ESP.restart();
 } 
@@ -0,0 +1,245 @@
+#include "include/lib/sensor_health.h"
+#include "include/lib/event_log.h"
+#include <driver/gpio.h>
+
+// Initialize static members
+const SensorHealthConfig* SensorHealth::config = nullptr;
+SensorHealth::Entry SensorHealth::entries[HEALTH_SENSOR_COUNT] = {};
+Seqlock<SensorHealthInfo> SensorHealth::published[HEALTH_SENSOR_COUNT];
+std::atomic<uint32_t> SensorHealth::changes(0);
+std::atomic<bool> SensorHealth::rebootNeeded(false);
+void (*SensorHealth::changeHandler)() = nullptr;
+
+void SensorHealth::begin(const SensorHealthConfig* sensors, void (*onChange)()) {
+    config = sensors;
+    changeHandler = onChange;
+    unsigned long now = millis();
+    for (uint8_t i = 0; i < HEALTH_SENSOR_COUNT; i++) {
+        if (config[i].powerPin >= 0) {
+            gpio_hold_dis((gpio_num_t)config[i].powerPin);  // Set by powerDown() before deep sleep
+            pinMode(config[i].powerPin, OUTPUT);
+            digitalWrite(config[i].powerPin, HIGH);
+        }
+        entries[i].info.lastSuccess = now;
+        publish((HealthSensor)i);
+    }
+}
+
+void SensorHealth::reportSuccess(HealthSensor sensor, unsigned long now) {
+    Entry& e = entries[sensor];
+    e.info.lastSuccess = now;
+    if (e.info.state == SENSOR_OK) {
+        return;
+    }
+
+    if (++e.goodSamples < SENSOR_RECOVERED_SAMPLES) {
+        if (e.info.state == SENSOR_FAILED) {
+            e.info.stage = STAGE_RETRY;  // Escalate from the start if it drops out again
+            e.stageStartedAt = now;
+        }
+        if (e.info.state != SENSOR_DEGRADED) {
+            setState(sensor, SENSOR_DEGRADED, now);
+        }
+        return;
+    }
+    uint32_t outage = now - e.outageStart;
+    e.info.lastOutageMillis = outage;
+    e.info.maxOutageMillis = max(e.info.maxOutageMillis, outage);
+    e.info.stage = STAGE_NONE;
+    e.exhausted = false;
+    setState(sensor, SENSOR_OK, now);
+}
+
+void SensorHealth::reportFailure(HealthSensor sensor, unsigned long now) {
+    Entry& e = entries[sensor];
+    e.info.failures++;
+    e.goodSamples = 0;
+    if (e.info.state == SENSOR_OK) {
+        e.outageStart = now;
+        e.info.outages++;
+        e.info.stage = STAGE_RETRY;
+        e.stageStartedAt = now;
+        setState(sensor, SENSOR_DEGRADED, now);
+    }
+}
+
+// Escalates sensors that stopped producing samples, one stage per
+// SENSOR_RECOVERY_STEP. A sensor that still delivers between failures stays
+// degraded and is left to its driver.
+void SensorHealth::check() {
+    unsigned long now = millis();
+    bool allFailed = true;
+
+    for (uint8_t i = 0; i < HEALTH_SENSOR_COUNT; i++) {
+        HealthSensor sensor = (HealthSensor)i;
+        Entry& e = entries[i];
+
+        if (e.powerOff && now - e.stageStartedAt >= SENSOR_POWER_OFF_TIME) {
+            digitalWrite(config[i].powerPin, HIGH);
+            e.powerOff = false;
+            config[i].reset();
+        }
+
+        bool down = now - e.info.lastSuccess > SENSOR_STALE_PERIODS * config[i].sampleInterval();
+        if (down) {
+            if (e.info.state == SENSOR_OK) {
+                e.outageStart = e.info.lastSuccess;
+                e.info.outages++;
+                e.info.stage = STAGE_RETRY;
+                e.stageStartedAt = now;
+                e.goodSamples = 0;
+                setState(sensor, SENSOR_DEGRADED, now);
+            } else if (e.info.state == SENSOR_FAILED) {
+                if (now - e.stageStartedAt >= SENSOR_FAILED_RETRY) {
+                    e.info.stage = STAGE_RETRY;
+                    advance(sensor, now);
+                }
+            } else if (now - e.stageStartedAt >= SENSOR_RECOVERY_STEP) {
+                advance(sensor, now);
+            }
+        }
+
+        allFailed &= e.exhausted && e.info.state != SENSOR_OK && now - e.info.lastSuccess >= SENSOR_REBOOT_TIMEOUT;
+        publish(sensor);
+    }
+    rebootNeeded = allFailed;
+}
+
+void SensorHealth::advance(HealthSensor sensor, unsigned long now) {
+    Entry& e = entries[sensor];
+    const SensorHealthConfig& c = config[sensor];
+
+    uint8_t stage = e.info.stage + 1;
+    if (stage == STAGE_POWER_CYCLE && c.powerPin < 0) {
+        stage++;
+    }
+    if (stage == STAGE_BUS_RECOVERY && c.i2cDevice < 0) {
+        stage++;
+    }
+    e.info.stage = (RecoveryStage)min(stage, (uint8_t)STAGE_EXHAUSTED);
+    e.stageStartedAt = now;
+
+    switch (e.info.stage) {
+        case STAGE_SOFT_RESET:
+            e.info.resets++;
+            c.reset();
+            break;
+        case STAGE_POWER_CYCLE:
+            e.info.resets++;
+            digitalWrite(c.powerPin, LOW);
+            e.powerOff = true;
+            break;
+        case STAGE_BUS_RECOVERY:
+            e.info.resets++;
+            if (I2CBus::acquire((I2CDevice)c.i2cDevice)) {
+                I2CBus::recoverBus();
+                I2CBus::release((I2CDevice)c.i2cDevice, true);
+            }
+            break;
+        default:
+            e.exhausted = true;
+            setState(sensor, SENSOR_FAILED, now);
+            invalidateTopics(sensor);
+            return;
+    }
+
+    LOG_EVENT(HEALTH_RECOVERY, sensor, e.info.stage);
+    setState(sensor, SENSOR_RECOVERING, now);
+}
+
+// The last values stay on the bus but are marked invalid for every sink
+void SensorHealth::invalidateTopics(HealthSensor sensor) {
+    for (uint8_t t = 0; t < TOPIC_COUNT; t++) {
+        if (config[sensor].topics & TOPIC_BIT(t)) {
+            Reading last = DataBus::read((DataTopic)t);
+            DataBus::publish((DataTopic)t, last.value, QUALITY_INVALID, last.timestamp);
+        }
+    }
+    DataBus::dispatch();
+}
+
+void SensorHealth::setState(HealthSensor sensor, SensorState state, unsigned long now) {
+    Entry& e = entries[sensor];
+    if (e.info.state == state) {
+        return;
+    }
+    e.info.state = state;
+    publish(sensor);
+    changes.fetch_add(1, std::memory_order_release);
+
+    LOG_EVENT(HEALTH_STATE, sensor, state);
+    if (changeHandler) {
+        changeHandler();
+    }
+}
+
+void SensorHealth::publish(HealthSensor sensor) {
+    published[sensor].write(entries[sensor].info);
+}
+
+ReadingQuality SensorHealth::quality(HealthSensor sensor) {
+    return entries[sensor].info.state == SENSOR_OK ? QUALITY_GOOD : QUALITY_DEGRADED;
+}
+
+// Pads are released at boot, so the supply would float back on in deep
+// sleep without the hold
+void SensorHealth::powerDown(HealthSensor sensor) {
+    int8_t pin = config[sensor].powerPin;
+    if (pin < 0) {
+        return;
+    }
+    digitalWrite(pin, LOW);
+    gpio_hold_en((gpio_num_t)pin);
+    gpio_deep_sleep_hold_en();
+}
+
+SensorHealthInfo SensorHealth::read(HealthSensor sensor) {
+    return published[sensor].read();
+}
+
+uint32_t SensorHealth::version() {
+    return changes.load(std::memory_order_acquire);
+}
+
+bool SensorHealth::rebootRequired() {
+    return rebootNeeded;
+}
+
+const char* SensorHealth::name(HealthSensor sensor) {
+    return config ? config[sensor].name : "";
+}
+
+const char* SensorHealth::stateName(SensorState state) {
+    switch (state) {
+        case SENSOR_OK: return "ok";
+        case SENSOR_DEGRADED: return "degraded";
+        case SENSOR_RECOVERING: return "recovering";
+        case SENSOR_FAILED: return "failed";
+        default: return "unknown";
+    }
+}
+
+const char* SensorHealth::stageName(RecoveryStage stage) {
+    switch (stage) {
+        case STAGE_NONE: return "none";
+        case STAGE_RETRY: return "retry";
+        case STAGE_SOFT_RESET: return "soft reset";
+        case STAGE_POWER_CYCLE: return "power cycle";
+        case STAGE_BUS_RECOVERY: return "bus recovery";
+        case STAGE_EXHAUSTED: return "exhausted";
+        default: return "unknown";
+    }
+}
+
+void SensorHealth::printStats() {
+    for (uint8_t i = 0; i < HEALTH_SENSOR_COUNT; i++) {
+        SensorHealthInfo info = read((HealthSensor)i);
+        Serial.print("Sensor "); Serial.print(name((HealthSensor)i)); Serial.print(": ");
+        Serial.print(stateName(info.state)); Serial.print(" | ");
+        Serial.print(info.failures); Serial.print(" failures | ");
+        Serial.print(info.outages); Serial.print(" outages | ");
+        Serial.print(info.resets); Serial.print(" resets | last outage ");
+        Serial.print(info.lastOutageMillis / 1000); Serial.print(" s, max ");
+        Serial.print(info.maxOutageMillis / 1000); Serial.println(" s");
+    }
+}
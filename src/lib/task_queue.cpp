@@ -0,0 +1,147 @@
+#include "include/lib/task_queue.h"
+
+TaskQueue::TaskQueue() : count(0), nextId(0) {}
+
+// Deadlines are compared as signed differences so millis() rollover is harmless
+bool TaskQueue::before(const Task& a, const Task& b) {
+    return (long)(a.deadline - b.deadline) < 0;
+}
+
+void TaskQueue::siftUp(uint8_t index) {
+    while (index > 0) {
+        uint8_t parent = (index - 1) / 2;
+        if (!before(heap[index], heap[parent])) {
+            break;
+        }
+        Task tmp = heap[index];
+        heap[index] = heap[parent];
+        heap[parent] = tmp;
+        index = parent;
+    }
+}
+
+void TaskQueue::siftDown(uint8_t index) {
+    while (true) {
+        uint8_t left = 2 * index + 1;
+        uint8_t right = left + 1;
+        uint8_t smallest = index;
+
+        if (left < count && before(heap[left], heap[smallest])) smallest = left;
+        if (right < count && before(heap[right], heap[smallest])) smallest = right;
+        if (smallest == index) {
+            break;
+        }
+        Task tmp = heap[index];
+        heap[index] = heap[smallest];
+        heap[smallest] = tmp;
+        index = smallest;
+    }
+}
+
+void TaskQueue::removeAt(uint8_t index) {
+    count--;
+    if (index == count) {
+        return;
+    }
+    heap[index] = heap[count];
+    siftDown(index);
+    siftUp(index);
+}
+
+int8_t TaskQueue::push(unsigned long deadline, unsigned long period, TaskCallback callback) {
+    if (count >= TASK_QUEUE_CAPACITY || callback == nullptr) {
+        return TASK_INVALID_ID;
+    }
+
+    // Ids wrap, so skip any still held by a queued task; with at most
+    // TASK_QUEUE_CAPACITY of them queued a free one is always close
+    int8_t id;
+    do {
+        id = nextId;
+        nextId = (nextId == INT8_MAX) ? 0 : nextId + 1;
+    } while (isScheduled(id));
+
+    heap[count] = {deadline, period, callback, id};
+    siftUp(count);
+    count++;
+    return id;
+}
+
+int8_t TaskQueue::every(unsigned long period, TaskCallback callback, unsigned long firstDelay) {
+    if (period == 0) {
+        return TASK_INVALID_ID;
+    }
+    return push(millis() + firstDelay, period, callback);
+}
+
+int8_t TaskQueue::after(unsigned long delayMs, TaskCallback callback) {
+    return push(millis() + delayMs, 0, callback);
+}
+
+bool TaskQueue::cancel(int8_t id) {
+    for (uint8_t i = 0; i < count; i++) {
+        if (heap[i].id == id) {
+            removeAt(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool TaskQueue::reschedule(int8_t id, unsigned long delayMs) {
+    for (uint8_t i = 0; i < count; i++) {
+        if (heap[i].id == id) {
+            heap[i].deadline = millis() + delayMs;
+            siftDown(i);
+            siftUp(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool TaskQueue::isScheduled(int8_t id) const {
+    for (uint8_t i = 0; i < count; i++) {
+        if (heap[i].id == id) {
+            return true;
+        }
+    }
+    return false;
+}
+
+unsigned long TaskQueue::runDue(unsigned long now) {
+    // Bound the pass so a task that keeps re-arming itself cannot starve the caller
+    uint8_t budget = count;
+
+    while (count > 0 && budget-- > 0 && (long)(now - heap[0].deadline) >= 0) {
+        Task task = heap[0];
+
+        if (task.period == 0) {
+            removeAt(0);
+        } else {
+            heap[0].deadline = task.deadline + task.period;
+            // Skip missed periods instead of firing a burst of catch-up calls
+            if ((long)(now - heap[0].deadline) >= 0) {
+                heap[0].deadline = now + task.period;
+            }
+            siftDown(0);
+        }
+
+        task.callback();
+        now = millis();
+    }
+
+    return timeUntilNext(now);
+}
+
+unsigned long TaskQueue::timeUntilNext(unsigned long now) const {
+    if (count == 0) {
+        return ULONG_MAX;
+    }
+    long remaining = (long)(heap[0].deadline - now);
+    return remaining > 0 ? (unsigned long)remaining : 0;
+}
+
+uint8_t TaskQueue::size() const {
+    return count;
+}
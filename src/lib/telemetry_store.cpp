@@ -0,0 +1,240 @@
+#include "include/lib/telemetry_store.h"
+#include "include/lib/event_log.h"
+
+// Initialize static members
+bool TelemetryStore::mounted = false;
+uint32_t TelemetryStore::nextSequence = 1;
+uint32_t TelemetryStore::sentSequence = 0;
+uint32_t TelemetryStore::queuedSequence = 0;
+uint32_t TelemetryStore::bootSequence = 1;
+StoredSample TelemetryStore::pending[TELEMETRY_WRITE_BATCH];
+uint8_t TelemetryStore::pendingCount = 0;
+uint32_t TelemetryStore::flashWrites = 0;
+uint32_t TelemetryStore::dropped = 0;
+Preferences TelemetryStore::prefs;
+
+uint32_t TelemetryStore::slotFor(uint32_t sequence) {
+    return sequence % TELEMETRY_STORE_CAPACITY;
+}
+
+bool TelemetryStore::createFile() {
+    File file = LittleFS.open(TELEMETRY_STORE_PATH, "w");
+    if (!file) {
+        return false;
+    }
+
+    uint8_t empty[256];
+    memset(empty, 0, sizeof(empty));
+    size_t remaining = TELEMETRY_STORE_CAPACITY * sizeof(StoredSample);
+    while (remaining > 0) {
+        size_t chunk = remaining < sizeof(empty) ? remaining : sizeof(empty);
+        if (file.write(empty, chunk) != chunk) {
+            file.close();
+            return false;
+        }
+        remaining -= chunk;
+    }
+    file.close();
+    return true;
+}
+
+// Recovers the write position from the highest sequence number on flash
+void TelemetryStore::scan() {
+    File file = LittleFS.open(TELEMETRY_STORE_PATH, "r");
+    if (!file) {
+        return;
+    }
+
+    uint32_t highest = 0;
+    StoredSample sample;
+    while (file.read((uint8_t*)&sample, sizeof(sample)) == sizeof(sample)) {
+        if (sample.sequence != 0xFFFFFFFF && sample.sequence > highest) {
+            highest = sample.sequence;
+        }
+    }
+    file.close();
+
+    nextSequence = bootSequence = highest + 1;
+    if (sentSequence > highest) {
+        sentSequence = highest;
+    }
+    dropOverwritten();
+}
+
+bool TelemetryStore::begin() {
+    if (!LittleFS.begin(true)) {
+        LOG_EVENT(STORE_MOUNT_FAILED);
+        return false;
+    }
+
+    File file = LittleFS.open(TELEMETRY_STORE_PATH, "r");
+    bool valid = file && file.size() == TELEMETRY_STORE_CAPACITY * sizeof(StoredSample);
+    if (file) {
+        file.close();
+    }
+    if (!valid && !createFile()) {
+        LOG_EVENT(STORE_CREATE_FAILED);
+        return false;
+    }
+
+    prefs.begin("telemetry", false);
+    sentSequence = prefs.getUInt("sent", 0);
+    mounted = true;
+    scan();
+
+    LOG_EVENT(STORE_READY, backlog());
+    return true;
+}
+
+// Oldest records are overwritten once the ring is full
+void TelemetryStore::dropOverwritten() {
+    uint32_t newest = nextSequence - 1;
+    if (newest - sentSequence > TELEMETRY_STORE_CAPACITY) {
+        uint32_t oldestKept = newest - TELEMETRY_STORE_CAPACITY;
+        dropped += oldestKept - sentSequence;
+        sentSequence = oldestKept;
+    }
+}
+
+void TelemetryStore::append(const SensorSnapshot& s, uint32_t timestamp, bool uptime) {
+    // A full batch that still cannot be flushed means flash is unavailable
+    if (pendingCount >= TELEMETRY_WRITE_BATCH) {
+        flush();
+    }
+    if (!mounted || pendingCount >= TELEMETRY_WRITE_BATCH) {
+        dropped++;
+        return;
+    }
+
+    StoredSample& sample = pending[pendingCount++];
+    encode(s, timestamp, uptime, sample);
+    sample.sequence = nextSequence++;
+
+    dropOverwritten();
+    if (pendingCount >= TELEMETRY_WRITE_BATCH) {
+        flush();
+    }
+}
+
+// Stamps the snapshot's record; the caller assigns the sequence number
+void TelemetryStore::encode(const SensorSnapshot& s, uint32_t timestamp, bool uptime, StoredSample& sample) {
+    sample.sequence = 0;
+    sample.record = s.sample;
+    sample.record.timestamp = timestamp;
+    sample.record.uptime = uptime;
+}
+
+// Writes buffered samples to flash; contiguous slots go out in one write.
+// Whatever flash did not take stays buffered for the next attempt.
+bool TelemetryStore::flush() {
+    if (!mounted || pendingCount == 0) {
+        return true;
+    }
+
+    File file = LittleFS.open(TELEMETRY_STORE_PATH, "r+");
+    if (!file) {
+        return false;
+    }
+
+    uint8_t written = 0;
+    while (written < pendingCount) {
+        uint32_t slot = slotFor(pending[written].sequence);
+        uint8_t run = 1;
+        while (written + run < pendingCount && slot + run < TELEMETRY_STORE_CAPACITY) {
+            run++;
+        }
+        size_t bytes = run * sizeof(StoredSample);
+        if (!file.seek(slot * sizeof(StoredSample)) ||
+            file.write((const uint8_t*)&pending[written], bytes) != bytes) {
+            break;
+        }
+        written += run;
+    }
+    file.close();
+
+    if (written > 0) {
+        flashWrites++;
+    }
+    pendingCount -= written;
+    if (pendingCount > 0) {
+        memmove(pending, pending + written, pendingCount * sizeof(StoredSample));
+        return false;
+    }
+    return true;
+}
+
+uint32_t TelemetryStore::backlog() {
+    return (nextSequence - 1) - sentSequence;
+}
+
+// Reads up to maxCount of the oldest records not yet handed to MQTT, without
+// consuming them
+uint8_t TelemetryStore::peek(StoredSample* out, uint8_t maxCount) {
+    uint32_t sequence = max(sentSequence, queuedSequence) + 1;
+    if (!mounted || sequence >= nextSequence) {
+        return 0;
+    }
+    flush();
+
+    File file = LittleFS.open(TELEMETRY_STORE_PATH, "r");
+    if (!file) {
+        return 0;
+    }
+
+    // Only records that reached flash can be read back
+    uint32_t end = nextSequence - pendingCount;
+    uint8_t count = 0;
+    while (count < maxCount && sequence < end) {
+        file.seek(slotFor(sequence) * sizeof(StoredSample));
+        if (file.read((uint8_t*)&out[count], sizeof(StoredSample)) != sizeof(StoredSample)) {
+            break;
+        }
+        if (out[count].sequence == sequence) {
+            count++;
+        } else if (count == 0 && sequence == sentSequence + 1) {
+            // Slot was lost or corrupted; skip it so the drain cannot stall
+            dropped++;
+            acknowledge(sequence);
+        } else {
+            break;  // Skipped once everything before it is acknowledged
+        }
+        sequence++;
+    }
+    file.close();
+    return count;
+}
+
+// Records handed to MQTT are not peeked again while their PUBACKs are
+// outstanding; after a reboot they are sent again from the last acknowledged
+void TelemetryStore::markQueued(uint32_t sequence) {
+    if (sequence > queuedSequence) {
+        queuedSequence = sequence;
+    }
+}
+
+// Marks every record up to and including sequence as delivered
+void TelemetryStore::acknowledge(uint32_t sequence) {
+    if (sequence <= sentSequence) {
+        return;
+    }
+    sentSequence = sequence;
+    prefs.putUInt("sent", sentSequence);
+}
+
+bool TelemetryStore::isFromThisBoot(uint32_t sequence) {
+    return sequence >= bootSequence;
+}
+
+uint32_t TelemetryStore::getFlashWrites() {
+    return flashWrites;
+}
+
+uint32_t TelemetryStore::getDropped() {
+    return dropped;
+}
+
+void TelemetryStore::printStats() {
+    Serial.print("Telemetry store: "); Serial.print(backlog()); Serial.print(" queued | ");
+    Serial.print(flashWrites); Serial.print(" flash writes | ");
+    Serial.print(dropped); Serial.println(" dropped");
+}
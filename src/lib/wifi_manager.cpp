@@ -1,49 +1,151 @@
 #include "include/lib/wifi_manager.h"
+#include "include/lib/event_log.h"
 
-bool WiFiManager::connect(unsigned long timeout) {
-    // If already connected, return true
-    if (WiFi.status() == WL_CONNECTED) {
-        return true;
+// Initialize static members
+WiFiState WiFiManager::state = WiFiState::Idle;
+unsigned long WiFiManager::stateSince = 0;
+unsigned long WiFiManager::nextAttemptAt = 0;
+uint8_t WiFiManager::failures = 0;
+void (*WiFiManager::eventHandler)() = nullptr;
+volatile bool WiFiManager::gotIP = false;
+volatile bool WiFiManager::linkLost = false;
+unsigned long WiFiManager::lastTimeToConnect = 0;
+uint32_t WiFiManager::attempts = 0;
+uint32_t WiFiManager::maxBlockedMicros = 0;
+uint64_t WiFiManager::totalBlockedMicros = 0;
+
+void WiFiManager::begin(void (*handler)()) {
+    eventHandler = handler;
+    WiFi.mode(WIFI_STA);
+    WiFi.setAutoReconnect(false);  // Retries are paced by our own backoff
+    WiFi.onEvent(onEvent);
+    state = WiFiState::Idle;
+}
+
+// Runs in the WiFi event task
+void WiFiManager::onEvent(arduino_event_id_t event, arduino_event_info_t info) {
+    if (event == ARDUINO_EVENT_WIFI_STA_GOT_IP) {
+        gotIP = true;
+    } else if (event == ARDUINO_EVENT_WIFI_STA_DISCONNECTED) {
+        linkLost = true;
+    } else {
+        return;
     }
 
-    Serial.print("Connecting to WiFi: ");
-    Serial.println(WIFI_SSID);  // Print which network we're connecting to
-    WiFi.begin(WIFI_SSID, WIFI_PASSWORD);  // Use WIFI_PASS from secrets.h
-
-    unsigned long startAttempt = millis();
-
-    // Try to connect until timeout
-    while (millis() - startAttempt < timeout) {
-        if (WiFi.status() == WL_CONNECTED) {
-            Serial.println();
-            Serial.print("Connected to WiFi. IP: ");
-            Serial.println(WiFi.localIP());
-            return true;
-        }
-        Serial.print(".");
-        delay(500);
+    if (eventHandler) {
+        eventHandler();
     }
+}
 
-    Serial.println();
-    Serial.println("WiFi connection timed out");
-    WiFi.disconnect();
-    return false;
+void WiFiManager::startAttempt(unsigned long now) {
+    LOG_EVENT(WIFI_CONNECTING);
+
+    gotIP = false;
+    linkLost = false;
+    attempts++;
+    WiFi.begin(WIFI_SSID, WIFI_PASSWORD);
+    state = WiFiState::Connecting;
+    stateSince = now;
+}
+
+void WiFiManager::enterBackoff(unsigned long now) {
+    unsigned long wait = jitteredBackoff(failures, WIFI_BACKOFF_INITIAL, WIFI_BACKOFF_MAX);
+    failures = failures < 16 ? failures + 1 : failures;
+    state = WiFiState::Backoff;
+    stateSince = now;
+    nextAttemptAt = now + wait;
+
+    LOG_EVENT(WIFI_RETRY, wait / 1000);
+}
+
+// Advances the connection state machine without blocking and returns the
+// number of milliseconds until it next needs to be polled
+unsigned long WiFiManager::poll() {
+    uint32_t started = micros();
+    unsigned long now = millis();
+    unsigned long nextPoll = WIFI_BACKOFF_MAX;
+
+    switch (state) {
+        case WiFiState::Idle:
+            startAttempt(now);
+            nextPoll = WIFI_CONNECT_TIMEOUT;
+            break;
+
+        case WiFiState::Connecting:
+            if (gotIP) {
+                state = WiFiState::Connected;
+                lastTimeToConnect = now - stateSince;
+                stateSince = now;
+                failures = 0;
+                LOG_EVENT(WIFI_CONNECTED, (uint32_t)WiFi.localIP(), lastTimeToConnect);
+            } else if (now - stateSince >= WIFI_CONNECT_TIMEOUT) {
+                LOG_EVENT(WIFI_TIMEOUT);
+                WiFi.disconnect();
+                enterBackoff(now);
+                nextPoll = nextAttemptAt - now;
+            } else {
+                nextPoll = WIFI_CONNECT_TIMEOUT - (now - stateSince);
+            }
+            break;
+
+        case WiFiState::Connected:
+            if (linkLost || WiFi.status() != WL_CONNECTED) {
+                LOG_EVENT(WIFI_LOST);
+                enterBackoff(now);
+                nextPoll = nextAttemptAt - now;
+            }
+            break;
+
+        case WiFiState::Backoff:
+            if ((long)(now - nextAttemptAt) >= 0) {
+                startAttempt(now);
+                nextPoll = WIFI_CONNECT_TIMEOUT;
+            } else {
+                nextPoll = nextAttemptAt - now;
+            }
+            break;
+    }
+
+    uint32_t blocked = micros() - started;
+    totalBlockedMicros += blocked;
+    if (blocked > maxBlockedMicros) {
+        maxBlockedMicros = blocked;
+    }
+    return nextPoll;
 }
 
 void WiFiManager::disconnect() {
     WiFi.disconnect();
+    state = WiFiState::Idle;
 }
 
 bool WiFiManager::isConnected() {
-    return WiFi.status() == WL_CONNECTED;
+    return state == WiFiState::Connected;
+}
+
+WiFiState WiFiManager::getState() {
+    return state;
+}
+
+unsigned long WiFiManager::getTimeToConnect() {
+    return lastTimeToConnect;
 }
 
+void WiFiManager::printStats() {
+    Serial.print("WiFi: "); Serial.print(attempts); Serial.print(" attempts | ");
+    Serial.print("last connect: "); Serial.print(lastTimeToConnect); Serial.print(" ms | ");
+    Serial.print("blocked total: "); Serial.print((unsigned long)(totalBlockedMicros / 1000)); Serial.print(" ms | ");
+    Serial.print("blocked max: "); Serial.print(maxBlockedMicros); Serial.println(" us");
+}
+
+// Starts SNTP in the background; currentTime() reports once the clock is set
 void WiFiManager::syncNTP() {
     configTime(-8 * 3600, 0, "pool.ntp.org"); // PST Timezone
-    struct tm timeinfo;
-    if (!getLocalTime(&timeinfo)) {
-        Serial.println("Failed to obtain NTP time");
-        return;
-    }
-    Serial.println("NTP time synchronized");
-} 
\ No newline at end of file
+}
+
+// Unix time in seconds, or 0 if the clock has not been synchronized yet
+uint32_t WiFiManager::currentTime() {
+    time_t now = time(nullptr);
+    return now >= (time_t)NTP_VALID_AFTER ? (uint32_t)now : 0;
+}
+
@@ -0,0 +1,88 @@
+#include "include/lib/worker.h"
+#include "include/lib/loop_profiler.h"
+
+Worker::Worker(const char* name, uint32_t stackBytes, UBaseType_t priority, BaseType_t core,
+               WorkerHook poll, bool profiled)
+    : name(name), stackBytes(stackBytes), priority(priority), core(core), poll(poll),
+      profiled(profiled), handle(nullptr), busyMicros(0), reportStart(0) {
+}
+
+bool Worker::start() {
+    reportStart = millis();
+    if (xTaskCreatePinnedToCore(entry, name, stackBytes, this, priority, &handle, core) != pdPASS) {
+        Serial.print("Failed to start task "); Serial.println(name);
+        handle = nullptr;
+        return false;
+    }
+    return true;
+}
+
+void Worker::entry(void* param) {
+    static_cast<Worker*>(param)->loop();
+}
+
+void Worker::loop() {
+    while (true) {
+        uint32_t started = micros();
+        if (profiled) {
+            LoopProfiler::beginIteration();
+        }
+
+        if (poll != nullptr) {
+            poll();
+        }
+        unsigned long wait = queue.runDue(millis());
+
+        if (profiled) {
+            LoopProfiler::endIteration();
+        }
+        busyMicros.fetch_add(micros() - started, std::memory_order_relaxed);
+
+        // Sleep until the next deadline; wake() ends the wait early
+        if (wait > WORKER_MAX_SLEEP) {
+            wait = WORKER_MAX_SLEEP;
+        }
+        if (wait > 0) {
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(wait));
+        }
+    }
+}
+
+TaskQueue& Worker::tasks() {
+    return queue;
+}
+
+void Worker::wake() {
+    if (handle != nullptr) {
+        xTaskNotifyGive(handle);
+    }
+}
+
+void IRAM_ATTR Worker::wakeFromISR() {
+    if (handle == nullptr) {
+        return;
+    }
+    BaseType_t higherPriorityWoken = pdFALSE;
+    vTaskNotifyGiveFromISR(handle, &higherPriorityWoken);
+    portYIELD_FROM_ISR(higherPriorityWoken);
+}
+
+const char* Worker::getName() const {
+    return name;
+}
+
+uint32_t Worker::stackHeadroom() const {
+    return handle ? uxTaskGetStackHighWaterMark(handle) : 0;
+}
+
+void Worker::printStats() {
+    unsigned long now = millis();
+    uint32_t busy = busyMicros.exchange(0, std::memory_order_relaxed);
+    unsigned long elapsed = now - reportStart;
+    reportStart = now;
+
+    Serial.print("Task "); Serial.print(name);
+    Serial.print(" (core "); Serial.print((int)core); Serial.print("): cpu ");
+    Serial.print(elapsed ? busy / 10.0f / elapsed : 0.0f, 2); Serial.print("% | stack free ");
+    Serial.print(stackHeadroom()); Serial.println(" B");
+}
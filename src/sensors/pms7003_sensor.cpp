@@ -1,75 +1,233 @@
 #include "include/sensors/pms7003_sensor.h"
+#include "include/lib/event_log.h"
 
 // Initialize static members
 HardwareSerial PMS7003Sensor::pmsSerial(2);
-int PMS7003Sensor::pm1_0 = 0;
-int PMS7003Sensor::pm2_5 = 0;
-int PMS7003Sensor::pm10 = 0;
+SpscRing<uint8_t, PMS7003_RX_RING_SIZE> PMS7003Sensor::rxRing;
+uint8_t PMS7003Sensor::frame[PMS7003_FRAME_LENGTH];
+uint8_t PMS7003Sensor::frameIndex = 0;
+bool PMS7003Sensor::hunting = false;
+PMS7003Data PMS7003Sensor::data = {};
 bool PMS7003Sensor::newDataAvailable = false;
+void (*PMS7003Sensor::dataHandler)() = nullptr;
+volatile unsigned long PMS7003Sensor::lastRxAt = 0;
+volatile uint32_t PMS7003Sensor::bytesReceived = 0;
+volatile uint32_t PMS7003Sensor::overruns = 0;
+uint32_t PMS7003Sensor::framesDecoded = 0;
+uint32_t PMS7003Sensor::resyncs = 0;
+uint32_t PMS7003Sensor::corruptedFrames = 0;
 
 void PMS7003Sensor::begin() {
+    pmsSerial.setRxBufferSize(256);
     pmsSerial.begin(9600, SERIAL_8N1, PMS7003_RX_PIN, PMS7003_TX_PIN);
-    Serial.println("PMS7003 sensor initialized");
+    // Bytes are moved into rxRing from the UART event task as they arrive,
+    // so nothing is lost no matter how rarely read() is called
+    pmsSerial.onReceive(onReceive);
+    LOG_EVENT(PMS7003_READY);
 
-    // Force PMS7003 to enter Active Mode
-    uint8_t cmd[] = {0x42, 0x4D, 0xE1, 0x00, 0x01, 0x70};
-    pmsSerial.write(cmd, sizeof(cmd));
+    // Passive mode is driven by the scheduler: wake, warm up, request, sleep
+    setPassiveMode(PMS7003_PASSIVE_MODE);
     delay(1000);
 }
 
-bool PMS7003Sensor::read() {
-    static uint8_t buffer[32];
-    static int index = 0;
-    newDataAvailable = false;
+void PMS7003Sensor::sendCommand(uint8_t command, uint16_t value) {
+    uint8_t cmd[] = {0x42, 0x4D, command, (uint8_t)(value >> 8), (uint8_t)value, 0x00, 0x00};
+    uint16_t checksum = 0;
+    for (uint8_t i = 0; i < 5; i++) {
+        checksum += cmd[i];
+    }
+    cmd[5] = checksum >> 8;
+    cmd[6] = checksum & 0xFF;
+    pmsSerial.write(cmd, sizeof(cmd));
+}
+
+void PMS7003Sensor::setPassiveMode(bool passive) {
+    sendCommand(PMS7003_CMD_MODE, passive ? 0 : 1);
+}
+
+void PMS7003Sensor::requestRead() {
+    sendCommand(PMS7003_CMD_READ, 0);
+}
+
+void PMS7003Sensor::sleep() {
+    sendCommand(PMS7003_CMD_SLEEP, 0);
+}
+
+void PMS7003Sensor::wakeUp() {
+    sendCommand(PMS7003_CMD_SLEEP, 1);
+}
 
-    while (pmsSerial.available() && !newDataAvailable) {
-        uint8_t incomingByte = pmsSerial.read();
+void PMS7003Sensor::reset() {
+    wakeUp();
+    setPassiveMode(PMS7003_PASSIVE_MODE);
+}
+
+unsigned long PMS7003Sensor::sampleInterval() {
+    return PMS7003_PASSIVE_MODE ? PMS7003_PASSIVE_INTERVAL : PMS7003_ACTIVE_INTERVAL;
+}
 
-        // Ensure frame starts with 0x42 0x4D
-        if (index == 0 && incomingByte != 0x42) continue;
-        if (index == 1 && incomingByte != 0x4D) {
-            index = 0;  // Reset if second byte isn't 0x4D
-            continue;
+void PMS7003Sensor::onData(void (*handler)()) {
+    dataHandler = handler;
+}
+
+// Runs in the UART event task; the only producer for rxRing
+void PMS7003Sensor::onReceive() {
+    uint8_t chunk[64];
+    size_t count;
+
+    while ((count = pmsSerial.read(chunk, sizeof(chunk))) > 0) {
+        for (size_t i = 0; i < count; i++) {
+            if (!rxRing.push(chunk[i])) {
+                overruns++;
+            }
         }
+        bytesReceived += count;
+    }
+    lastRxAt = millis();
 
-        buffer[index++] = incomingByte;
+    if (dataHandler) {
+        dataHandler();
+    }
+}
 
-        // Full frame received (32 bytes)
-        if (index >= 32) {
-            processPMSFrame(buffer);
-            index = 0;  // Reset index for next frame
-            newDataAvailable = true; // Mark new data available
-            return true;  // Return true when we have new data
+void PMS7003Sensor::loseSync() {
+    frameIndex = 0;
+    if (!hunting) {
+        hunting = true;
+        resyncs++;
+    }
+}
+
+// Streaming frame decoder; returns true when the byte completes a valid frame
+bool PMS7003Sensor::decodeByte(uint8_t incomingByte) {
+    // Ensure frame starts with 0x42 0x4D; count each loss of sync once
+    if (frameIndex == 0 && incomingByte != 0x42) {
+        loseSync();
+        return false;
+    }
+    if (frameIndex == 1 && incomingByte != 0x4D) {
+        loseSync();
+        frameIndex = (incomingByte == 0x42) ? 1 : 0;
+        return false;
+    }
+
+    frame[frameIndex++] = incomingByte;
+
+    // Validate the length field as soon as it is complete; only a header
+    // followed by a valid length ends a hunt, so a stray 0x42 0x4D in the
+    // noise does not count as a second resync
+    if (frameIndex == 4) {
+        uint16_t length = (frame[2] << 8) | frame[3];
+        if (length != PMS7003_DATA_LENGTH && length != PMS7003_REPLY_LENGTH) {
+            corruptedFrames++;
+            loseSync();
+        } else {
+            hunting = false;
+        }
+        return false;
+    }
+
+    uint16_t length = (frame[2] << 8) | frame[3];
+    if (frameIndex < 4 + length) {
+        return false;
+    }
+
+    frameIndex = 0;
+    if (!checksumValid(frame, length)) {
+        corruptedFrames++;
+        return false;
+    }
+    if (length == PMS7003_REPLY_LENGTH) {
+        return false;  // Acknowledgement of a mode/sleep command, carries no data
+    }
+    processPMSFrame(frame);
+    return true;
+}
+
+// Decodes buffered bytes until one frame completes. Call repeatedly until it
+// returns false to consume every buffered frame.
+bool PMS7003Sensor::read() {
+    uint8_t incomingByte;
+    newDataAvailable = false;
+
+    while (rxRing.pop(incomingByte)) {
+        if (decodeByte(incomingByte)) {
+            // The frame's last byte arrived before everything still queued behind it
+            unsigned long queuedMs = (rxRing.size() * PMS7003_BYTE_TIME_US) / 1000;
+            data.timestamp = lastRxAt - queuedMs;
+            framesDecoded++;
+            newDataAvailable = true;
+            return true;
         }
     }
-    
+
     return false;  // Return false if no complete frame was read
 }
 
-void PMS7003Sensor::processPMSFrame(uint8_t* buffer) {
-    // Verify valid PMS7003 data frame
-    if (buffer[0] != 0x42 || buffer[1] != 0x4D) {
-        return;
+// The last two bytes of a frame are the sum of all the bytes before them
+bool PMS7003Sensor::checksumValid(const uint8_t* buffer, uint16_t length) {
+    uint16_t checksum = 0;
+    for (uint8_t i = 0; i < 4 + length - 2; i++) {
+        checksum += buffer[i];
     }
+    return checksum == ((buffer[4 + length - 2] << 8) | buffer[4 + length - 1]);
+}
 
-    // Extract PM values (Standard Atmosphere values)
-    pm1_0  = (buffer[10] << 8) | buffer[11];
-    pm2_5  = (buffer[12] << 8) | buffer[13];
-    pm10   = (buffer[14] << 8) | buffer[15];
+// Decodes all 13 data words of a checksum-verified frame
+void PMS7003Sensor::processPMSFrame(uint8_t* buffer) {
+    auto word = [buffer](uint8_t index) -> uint16_t {
+        return (buffer[4 + 2 * index] << 8) | buffer[5 + 2 * index];
+    };
+
+    data.pm1_0_cf1 = word(0);
+    data.pm2_5_cf1 = word(1);
+    data.pm10_cf1 = word(2);
+    data.pm1_0 = word(3);
+    data.pm2_5 = word(4);
+    data.pm10 = word(5);
+    data.particles_0_3um = word(6);
+    data.particles_0_5um = word(7);
+    data.particles_1_0um = word(8);
+    data.particles_2_5um = word(9);
+    data.particles_5_0um = word(10);
+    data.particles_10um = word(11);
+    data.version = buffer[28];
+    data.errorCode = buffer[29];
 }
 
 bool PMS7003Sensor::hasNewData() { 
     return newDataAvailable; 
 }
 
-int PMS7003Sensor::getPM1_0() { 
-    return pm1_0; 
+const PMS7003Data& PMS7003Sensor::getData() {
+    return data;
+}
+
+unsigned long PMS7003Sensor::getTimestamp() {
+    return data.timestamp;
+}
+
+PMS7003Stats PMS7003Sensor::getStats() {
+    return {bytesReceived, framesDecoded, resyncs, overruns, corruptedFrames};
+}
+
+void PMS7003Sensor::printStats() {
+    PMS7003Stats stats = getStats();
+    Serial.print("PMS7003: "); Serial.print(stats.bytesReceived); Serial.print(" bytes | ");
+    Serial.print(stats.framesDecoded); Serial.print(" frames | ");
+    Serial.print(stats.resyncs); Serial.print(" resyncs | ");
+    Serial.print(stats.overruns); Serial.print(" overruns | ");
+    Serial.print(stats.corruptedFrames); Serial.println(" corrupted");
+}
+
+uint16_t PMS7003Sensor::getPM1_0() { 
+    return data.pm1_0; 
 }
 
-int PMS7003Sensor::getPM2_5() { 
-    return pm2_5; 
+uint16_t PMS7003Sensor::getPM2_5() { 
+    return data.pm2_5; 
 }
 
-int PMS7003Sensor::getPM10() { 
-    return pm10; 
+uint16_t PMS7003Sensor::getPM10() { 
+    return data.pm10; 
 } 
@@ -1,101 +1,338 @@
 #include "include/sensors/scd41_sensor.h"
+#include "include/lib/event_log.h"
 
 // Initialize static members
 SCD4x SCD41Sensor::scd41;
-int SCD41Sensor::co2 = 0;
-float SCD41Sensor::temperatureC = 0;
-float SCD41Sensor::humidity = 0;
+uint16_t SCD41Sensor::co2 = 0;
+int16_t SCD41Sensor::temperature = 0;
+uint16_t SCD41Sensor::humidity = 0;
+uint8_t SCD41Sensor::mode = SCD41_MODE;
+bool SCD41Sensor::measuring = false;
+unsigned long SCD41Sensor::measurementDue = 0;
+unsigned long SCD41Sensor::shotStartedAt = 0;
+unsigned long SCD41Sensor::stoppedAt = 0;
+unsigned long SCD41Sensor::pollDelay = SCD41_PERIODIC_INTERVAL;
+uint8_t SCD41Sensor::consecutiveFailures = 0;
+uint8_t SCD41Sensor::queuedCommands = 0;
+RTC_STATE_ATTR bool SCD41Sensor::poweredDown = false;
+bool SCD41Sensor::discardNext = false;
+SCD41Stats SCD41Sensor::stats = {};
+std::atomic<uint8_t> SCD41Sensor::pendingCommands(0);
+uint8_t SCD41Sensor::requestedMode = SCD41_MODE;
+uint32_t SCD41Sensor::requestedPressure = 0;
+uint16_t SCD41Sensor::requestedAltitude = 0;
+uint16_t SCD41Sensor::requestedReference = 0;
 
-float SCD41Sensor::celsiusToFahrenheit(float celsius) {
-    return (celsius * 9.0 / 5.0) + 32.0;
+void SCD41Sensor::begin() {
+    if (!I2CBus::acquire(I2C_DEVICE_SCD41)) {
+        LOG_EVENT(SCD41_BUS_BUSY);
+        return;
+    }
+    if (poweredDown) {
+        wakeUp();
+    }
+    // Leave the sensor idle; read() starts the configured mode
+    bool found = scd41.begin(false);
+    if (found && SCD41_SENSOR_ALTITUDE != 0) {
+        scd41.setSensorAltitude(SCD41_SENSOR_ALTITUDE);
+    }
+    I2CBus::release(I2C_DEVICE_SCD41, found);
+    stoppedAt = millis();
+
+    if (!found) {
+        LOG_EVENT(SCD41_NOT_FOUND);
+        return;
+    }
+    LOG_EVENT(SCD41_READY, mode);
 }
 
-void SCD41Sensor::begin() {
-    Wire.begin();  // Ensure I2C is initialized
-    delay(100);    // Give devices time to initialize
-    
-    if (!scd41.begin()) {
-        Serial.println("Could not find a valid SCD41 sensor, check wiring!");
+// The sensor does not acknowledge wake_up, and the library cannot send a
+// command before begin(), so it goes out directly
+void SCD41Sensor::wakeUp() {
+    Wire.beginTransmission(SCD4x_ADDRESS);
+    Wire.write(0x36);
+    Wire.write(0xF6);
+    Wire.endTransmission();
+    delay(SCD41_WAKE_TIME);
+    poweredDown = false;
+    discardNext = mode == SCD41_MODE_SINGLE_SHOT;
+}
+
+// Stopping a periodic measurement blocks for SCD41_STOP_TIME, which is
+// acceptable on the way into deep sleep. A single shot still running makes
+// the sensor ignore power_down; it then stays idle at about 0.2 mA.
+void SCD41Sensor::powerDown() {
+    if (!I2CBus::acquire(I2C_DEVICE_SCD41)) {
         return;
     }
-    Serial.println("SCD41 sensor initialized");
+    if (measuring && mode != SCD41_MODE_SINGLE_SHOT) {
+        scd41.stopPeriodicMeasurement(SCD41_STOP_TIME);
+        measuring = false;
+    }
+    poweredDown = scd41.powerDown();
+    I2CBus::release(I2C_DEVICE_SCD41, poweredDown);
+    if (!poweredDown) {
+        LOG_EVENT(SCD41_POWER_DOWN_FAILED);
+    }
+}
 
-    // Start periodic measurements
-    scd41.startPeriodicMeasurement();
+unsigned long SCD41Sensor::modeInterval() {
+    switch (mode) {
+        case SCD41_MODE_LOW_POWER: return SCD41_LOW_POWER_INTERVAL;
+        case SCD41_MODE_SINGLE_SHOT: return SCD41_SINGLE_SHOT_TIME;
+        default: return SCD41_PERIODIC_INTERVAL;
+    }
 }
 
-bool SCD41Sensor::read() {
-    static unsigned long lastRead = 0;
-    static bool measurementStarted = false;
-    static unsigned long lastError = 0;
-    
-    // Ensure periodic measurement is started
-    if (!measurementStarted) {
-        if (!scd41.startPeriodicMeasurement()) {
-            Serial.println("Failed to start SCD41 periodic measurement");
-            return false;
-        }
-        measurementStarted = true;
-        lastRead = millis();
+// Called with the bus held
+bool SCD41Sensor::startMeasurement(unsigned long now) {
+    bool started;
+    switch (mode) {
+        case SCD41_MODE_LOW_POWER: started = scd41.startLowPowerPeriodicMeasurement(); break;
+        case SCD41_MODE_SINGLE_SHOT: started = scd41.measureSingleShot(); break;
+        default: started = scd41.startPeriodicMeasurement(); break;
+    }
+    if (!started) {
+        LOG_EVENT(SCD41_START_FAILED);
         return false;
     }
-    
-    // Wait at least 5 seconds between reads
-    if (millis() - lastRead < 5000) {
+    measuring = true;
+    shotStartedAt = now;
+    measurementDue = now + modeInterval();
+    return true;
+}
+
+// Skips the library's blocking settle time; read() waits SCD41_STOP_TIME
+// before sending the next command
+void SCD41Sensor::stopMeasurement(unsigned long now) {
+    scd41.stopPeriodicMeasurement(0);
+    measuring = false;
+    stoppedAt = now;
+}
+
+// Mode changes, altitude and forced recalibration are only accepted while
+// the sensor is idle. Called with the bus held.
+void SCD41Sensor::applyIdleCommands() {
+    if (queuedCommands & COMMAND_REINIT) {
+        if (!scd41.reInit()) {
+            stats.commandFailures++;
+            LOG_EVENT(SCD41_REINIT_FAILED);
+        }
+    }
+    if (queuedCommands & COMMAND_ALTITUDE) {
+        if (!scd41.setSensorAltitude(requestedAltitude)) {
+            stats.commandFailures++;
+            LOG_EVENT(SCD41_ALTITUDE_REJECTED);
+        }
+    }
+    if (queuedCommands & COMMAND_FRC) {
+        float correction = 0;
+        if (scd41.performForcedRecalibration(requestedReference, &correction)) {
+            stats.lastFrcCorrection = correction;
+            LOG_EVENT(SCD41_RECALIBRATED, requestedReference, lroundf(correction));
+        } else {
+            stats.commandFailures++;
+            LOG_EVENT(SCD41_FRC_FAILED);
+        }
+    }
+    if (queuedCommands & COMMAND_MODE) {
+        mode = requestedMode;
+        measurementDue = millis();
+        LOG_EVENT(SCD41_MODE, mode);
+    }
+    queuedCommands &= ~IDLE_COMMANDS;
+}
+
+// Returns true when a new sample was read. Data-ready is polled from shortly
+// before a sample is due, so the schedule follows the sensor's own clock.
+bool SCD41Sensor::read() {
+    unsigned long now = millis();
+    queuedCommands |= pendingCommands.exchange(0, std::memory_order_acquire);
+
+    if (!I2CBus::acquire(I2C_DEVICE_SCD41)) {
+        pollDelay = SCD41_BUS_RETRY;
         return false;
     }
-    
-    // Try to read measurement
-    if (scd41.readMeasurement()) {
-        co2 = scd41.getCO2();
-        temperatureC = scd41.getTemperature();
-        humidity = scd41.getHumidity();
-        lastRead = millis();
-        return true;
-    }
-    
-    // If read fails, try to recover
-    if (millis() - lastError > 30000) {  // Only try recovery every 30 seconds
-        Serial.println("SCD41 read failed, attempting recovery...");
-        lastError = millis();
-        
-        // Stop periodic measurement
-        scd41.stopPeriodicMeasurement();
-        delay(100);
-        
-        // Reinitialize I2C
-        Wire.end();
-        delay(100);
-        Wire.begin();
-        delay(100);
-        
-        // Restart sensor
-        if (!scd41.begin()) {
-            Serial.println("SCD41 recovery failed - sensor not found");
+
+    // Pressure compensation is accepted in every state
+    if (queuedCommands & COMMAND_PRESSURE) {
+        queuedCommands &= ~COMMAND_PRESSURE;
+        if (!scd41.setAmbientPressure(requestedPressure)) {
+            stats.commandFailures++;
+            LOG_EVENT(SCD41_PRESSURE_REJECTED);
+        }
+    }
+
+    // A single shot in progress is allowed to finish
+    if ((queuedCommands & IDLE_COMMANDS) && !(measuring && mode == SCD41_MODE_SINGLE_SHOT)) {
+        if (measuring) {
+            stopMeasurement(now);
+        }
+        if (now - stoppedAt < SCD41_STOP_TIME) {
+            I2CBus::release(I2C_DEVICE_SCD41, true);
+            pollDelay = SCD41_STOP_TIME - (now - stoppedAt);
             return false;
         }
-        
-        // Restart periodic measurement
-        if (!scd41.startPeriodicMeasurement()) {
-            Serial.println("SCD41 recovery failed - could not start measurement");
+        applyIdleCommands();
+        now = millis();
+    }
+
+    if (!measuring) {
+        long wait = 0;
+        if (now - stoppedAt < SCD41_STOP_TIME) {
+            wait = SCD41_STOP_TIME - (now - stoppedAt);
+        } else if (mode == SCD41_MODE_SINGLE_SHOT) {
+            wait = (long)(measurementDue - now);
+        }
+        if (wait > 0) {
+            I2CBus::release(I2C_DEVICE_SCD41, true);
+            pollDelay = wait;
             return false;
         }
-        
-        measurementStarted = true;
-        lastRead = millis();
+        bool started = startMeasurement(now);
+        I2CBus::release(I2C_DEVICE_SCD41, started);
+        pollDelay = started ? modeInterval() - SCD41_READY_MARGIN : SCD41_STOP_TIME;
+        if (!started) {
+            stoppedAt = now;
+        }
+        return false;
+    }
+
+    if (!scd41.getDataReadyStatus()) {
+        stats.notReady++;
+        bool timedOut = (long)(now - measurementDue) > (long)modeInterval();
+        if (timedOut) {
+            stats.timeouts++;
+            stats.recoveries++;
+            LOG_EVENT(SCD41_OVERDUE);
+            stopMeasurement(now);
+        }
+        I2CBus::release(I2C_DEVICE_SCD41, !timedOut);
+        pollDelay = timedOut ? SCD41_STOP_TIME : SCD41_READY_RETRY;
+        return false;
+    }
+
+    // A single bad transfer is retried on the next poll; the measurement is
+    // only restarted if reads keep failing. The bus itself is only cleared by
+    // I2CBus if SDA is stuck, so the other devices are unaffected.
+    if (!scd41.readMeasurement()) {
+        stats.readFailures++;
+        bool restart = ++consecutiveFailures >= SCD41_FAILURE_LIMIT;
+        if (restart) {
+            LOG_EVENT(SCD41_READS_FAILING);
+            stats.recoveries++;
+            consecutiveFailures = 0;
+            stopMeasurement(now);
+        }
+        I2CBus::release(I2C_DEVICE_SCD41, false);
+        pollDelay = restart ? SCD41_STOP_TIME : SCD41_READY_RETRY;
+        return false;
+    }
+    I2CBus::release(I2C_DEVICE_SCD41, true);
+
+    if (discardNext) {
+        // Its replacement is started right away
+        discardNext = false;
+        measuring = false;
+        measurementDue = now;
+        pollDelay = 0;
+        return false;
+    }
+
+    // Scaled once here; the library only hands out floats
+    co2 = scd41.getCO2();
+    temperature = (int16_t)lroundf(scd41.getTemperature() * 100);
+    humidity = (uint16_t)lroundf(scd41.getHumidity() * 100);
+    consecutiveFailures = 0;
+    stats.measurements++;
+
+    if (mode == SCD41_MODE_SINGLE_SHOT) {
+        measuring = false;
+        measurementDue = shotStartedAt + SCD41_SINGLE_SHOT_INTERVAL;
+        long wait = (long)(measurementDue - now);
+        pollDelay = wait > 0 ? wait : 0;
+    } else {
+        measurementDue = now + modeInterval();
+        pollDelay = modeInterval() - SCD41_READY_MARGIN;
+    }
+    return true;
+}
+
+unsigned long SCD41Sensor::nextPollDelay() {
+    return pollDelay;
+}
+
+unsigned long SCD41Sensor::sampleInterval() {
+    return mode == SCD41_MODE_SINGLE_SHOT ? SCD41_SINGLE_SHOT_INTERVAL : modeInterval();
+}
+
+void SCD41Sensor::reset() {
+    queueCommand(COMMAND_REINIT);
+}
+
+uint16_t SCD41Sensor::getCO2() {
+    return co2;
+}
+
+int16_t SCD41Sensor::getTemperature() {
+    return temperature;
+}
+
+uint16_t SCD41Sensor::getHumidity() {
+    return humidity;
+}
+
+void SCD41Sensor::queueCommand(Command command) {
+    pendingCommands.fetch_or(command, std::memory_order_release);
+}
+
+void SCD41Sensor::setMode(uint8_t newMode) {
+    if (newMode > SCD41_MODE_SINGLE_SHOT) {
+        return;
     }
-    
-    return false;
+    requestedMode = newMode;
+    queueCommand(COMMAND_MODE);
+}
+
+void SCD41Sensor::setAmbientPressure(float hPa) {
+    requestedPressure = (uint32_t)(hPa * 100.0f);
+    queueCommand(COMMAND_PRESSURE);
+}
+
+void SCD41Sensor::setAltitude(uint16_t meters) {
+    requestedAltitude = meters;
+    queueCommand(COMMAND_ALTITUDE);
 }
 
-int SCD41Sensor::getCO2() { 
-    return co2; 
+void SCD41Sensor::forceRecalibration(uint16_t referencePpm) {
+    requestedReference = referencePpm;
+    queueCommand(COMMAND_FRC);
+}
+
+uint8_t SCD41Sensor::getMode() {
+    return mode;
+}
+
+const char* SCD41Sensor::modeName(uint8_t mode) {
+    switch (mode) {
+        case SCD41_MODE_PERIODIC: return "periodic";
+        case SCD41_MODE_LOW_POWER: return "low-power";
+        case SCD41_MODE_SINGLE_SHOT: return "single-shot";
+        default: return "unknown";
+    }
 }
 
-float SCD41Sensor::getTemperatureF() { 
-    return celsiusToFahrenheit(temperatureC); 
+const SCD41Stats& SCD41Sensor::getStats() {
+    return stats;
 }
 
-float SCD41Sensor::getHumidity() { 
-    return humidity; 
-} 
+void SCD41Sensor::printStats() {
+    Serial.print("SCD41 ("); Serial.print(modeName(mode)); Serial.print("): ");
+    Serial.print(stats.measurements); Serial.print(" measurements | ");
+    Serial.print(stats.notReady); Serial.print(" not ready | ");
+    Serial.print(stats.readFailures); Serial.print(" read failures | ");
+    Serial.print(stats.timeouts); Serial.print(" timeouts | ");
+    Serial.print(stats.recoveries); Serial.print(" recoveries | ");
+    Serial.print(stats.commandFailures); Serial.print(" rejected commands | last FRC ");
+    Serial.print(stats.lastFrcCorrection, 0); Serial.println(" ppm");
+}
\ No newline at end of file
@@ -1,44 +1,238 @@
 #include "include/sensors/sgp30_sensor.h"
+#include "include/lib/event_log.h"
 
 // Initialize static members
 Adafruit_SGP30 SGP30Sensor::sgp;
-float SGP30Sensor::tvoc = 0;
-float SGP30Sensor::h2 = 0;
-float SGP30Sensor::ethanol = 0;
+Preferences SGP30Sensor::prefs;
+uint16_t SGP30Sensor::tvoc = 0;
+uint16_t SGP30Sensor::h2 = 0;
+uint16_t SGP30Sensor::ethanol = 0;
 bool SGP30Sensor::initialized = false;
+bool SGP30Sensor::baselineRestored = false;
+unsigned long SGP30Sensor::startedAt = 0;
+unsigned long SGP30Sensor::lastMeasurement = 0;
+uint16_t SGP30Sensor::humidityTicks = 0;
+uint32_t SGP30Sensor::pendingHumidity = 0;
+uint16_t SGP30Sensor::savedECO2Baseline = 0;
+uint16_t SGP30Sensor::savedTVOCBaseline = 0;
+RTC_STATE_ATTR bool SGP30Sensor::baselineHeld = false;
+RTC_STATE_ATTR bool SGP30Sensor::heldBaselineValid = false;
+RTC_STATE_ATTR uint16_t SGP30Sensor::heldECO2Baseline = 0;
+RTC_STATE_ATTR uint16_t SGP30Sensor::heldTVOCBaseline = 0;
+RTC_STATE_ATTR uint32_t SGP30Sensor::heldLearningMillis = 0;
+SGP30Stats SGP30Sensor::stats = {};
 
 void SGP30Sensor::begin() {
-    if (!sgp.begin()) {
-        Serial.println("SGP30 sensor not found!");
+    if (!I2CBus::acquire(I2C_DEVICE_SGP30)) {
+        LOG_EVENT(SGP30_BUS_BUSY);
         return;
     }
-    Serial.println("SGP30 sensor found!");
+    bool found = sgp.begin();
+    I2CBus::release(I2C_DEVICE_SGP30, found);
+
+    if (!found) {
+        LOG_EVENT(SGP30_NOT_FOUND);
+        return;
+    }
+    LOG_EVENT(SGP30_READY);
     initialized = true;
+    startedAt = millis();
+    prefs.begin("sgp30", false);
+    restoreBaseline();
+}
+
+// Avoids the sensor's soft reset, which is an I2C general call that would
+// also reset every other device on the bus
+void SGP30Sensor::reset() {
+    if (!initialized) {
+        begin();
+        return;
+    }
+    if (!I2CBus::acquire(I2C_DEVICE_SGP30)) {
+        return;
+    }
+    bool ok = sgp.IAQinit();
+    I2CBus::release(I2C_DEVICE_SGP30, ok);
+    if (!ok) {
+        return;
+    }
+    startedAt = millis();
+    lastMeasurement = 0;
+    humidityTicks = 0;  // Resent with the next SCD41 sample
+    baselineRestored = false;
+    restoreBaseline();
+}
+
+unsigned long SGP30Sensor::sampleInterval() {
+    return SGP30_MEASURE_INTERVAL;
+}
+
+// IAQinit has just run, which is when a saved baseline must be written
+// back; otherwise the sensor needs a 12-hour burn-in. A baseline held
+// through deep sleep is newer than the one in NVS and wins.
+void SGP30Sensor::restoreBaseline() {
+    bool haveSaved = prefs.isKey("eco2_base") && prefs.isKey("tvoc_base");
+    if (haveSaved) {
+        savedECO2Baseline = prefs.getUShort("eco2_base");
+        savedTVOCBaseline = prefs.getUShort("tvoc_base");
+    }
+    if (!baselineHeld && !haveSaved) {
+        LOG_EVENT(SGP30_NO_BASELINE);
+        return;
+    }
+
+    if (!I2CBus::acquire(I2C_DEVICE_SGP30)) {
+        return;
+    }
+    bool ok = baselineHeld ? sgp.setIAQBaseline(heldECO2Baseline, heldTVOCBaseline)
+                           : sgp.setIAQBaseline(savedECO2Baseline, savedTVOCBaseline);
+    I2CBus::release(I2C_DEVICE_SGP30, ok);
+
+    if (baselineHeld) {
+        baselineRestored = ok && heldBaselineValid;
+        if (!ok) {
+            baselineHeld = false;
+            heldLearningMillis = 0;
+        }
+    } else {
+        baselineRestored = ok;
+    }
+    LOG_EVENT(SGP30_BASELINE, ok);
+}
+
+// Learning time carried through deep sleep counts towards the burn-in
+bool SGP30Sensor::baselineValid() {
+    return baselineRestored || heldLearningMillis + (millis() - startedAt) >= SGP30_BASELINE_WARMUP;
+}
+
+void SGP30Sensor::holdBaseline() {
+    if (!initialized || !I2CBus::acquire(I2C_DEVICE_SGP30)) {
+        return;
+    }
+    uint16_t eco2Base, tvocBase;
+    bool ok = sgp.getIAQBaseline(&eco2Base, &tvocBase);
+    I2CBus::release(I2C_DEVICE_SGP30, ok);
+    if (!ok) {
+        return;
+    }
+    heldBaselineValid = baselineValid();
+    heldLearningMillis = heldBaselineValid ? 0 : heldLearningMillis + (millis() - startedAt);
+    heldECO2Baseline = eco2Base;
+    heldTVOCBaseline = tvocBase;
+    baselineHeld = true;
+}
+
+// A baseline learned from scratch is only written once it is valid, and NVS
+// is only touched when the value moved
+void SGP30Sensor::saveBaseline() {
+    if (!initialized || !baselineValid()) {
+        return;
+    }
+    if (!I2CBus::acquire(I2C_DEVICE_SGP30)) {
+        return;
+    }
+    uint16_t eco2Base, tvocBase;
+    bool ok = sgp.getIAQBaseline(&eco2Base, &tvocBase);
+    I2CBus::release(I2C_DEVICE_SGP30, ok);
+
+    if (!ok || (eco2Base == savedECO2Baseline && tvocBase == savedTVOCBaseline)) {
+        return;
+    }
+    prefs.putUShort("eco2_base", eco2Base);
+    prefs.putUShort("tvoc_base", tvocBase);
+    savedECO2Baseline = eco2Base;
+    savedTVOCBaseline = tvocBase;
+    baselineRestored = true;
+    stats.baselineSaves++;
+}
+
+// Converts the SCD41's temperature and RH to absolute humidity (Magnus
+// formula, as in the SGP30 datasheet) and queues it for the next measurement
+void SGP30Sensor::setHumidity(int16_t temperature, uint16_t relativeHumidity) {
+    float temperatureC = temperature / 100.0f;
+    float saturation = 6.112f * expf(17.62f * temperatureC / (243.12f + temperatureC));  // hPa
+    float gramsPerM3 = 216.7f * (relativeHumidity / 10000.0f * saturation / (273.15f + temperatureC));
+    gramsPerM3 = constrain(gramsPerM3, 0.0f, 255.99f);
+
+    // The sensor only resolves 1/256 g/m³, so smaller changes are not sent
+    uint16_t ticks = (uint16_t)(gramsPerM3 * 256.0f);
+    if (ticks == humidityTicks || ticks == 0) {
+        return;
+    }
+    humidityTicks = ticks;
+    pendingHumidity = (uint32_t)(gramsPerM3 * 1000.0f);
 }
 
-void SGP30Sensor::read() {
-    if (!initialized) return;
+bool SGP30Sensor::read() {
+    if (!initialized) return false;
+
+    if (!I2CBus::acquire(I2C_DEVICE_SGP30)) {
+        stats.failures++;
+        return false;
+    }
+
+    // The dynamic baseline algorithm assumes a measurement every second
+    unsigned long now = millis();
+    if (lastMeasurement != 0) {
+        long offset = (long)(now - lastMeasurement) - SGP30_MEASURE_INTERVAL;
+        uint32_t jitter = offset < 0 ? -offset : offset;
+        if (jitter > stats.maxJitterMillis) {
+            stats.maxJitterMillis = jitter;
+        }
+        if (jitter > SGP30_TIMING_TOLERANCE) {
+            stats.lateMeasurements++;
+        }
+    }
+    lastMeasurement = now;
 
-    if (sgp.IAQmeasure()) {
+    if (pendingHumidity != 0 && sgp.setHumidity(pendingHumidity)) {
+        pendingHumidity = 0;
+        stats.humidityUpdates++;
+    }
+
+    bool ok = sgp.IAQmeasure();
+    if (ok) {
         tvoc = sgp.TVOC;
         // Get raw H2 and ethanol values
-        if (sgp.IAQmeasureRaw()) {
+        ok = sgp.IAQmeasureRaw();
+        if (ok) {
             h2 = sgp.rawH2;
             ethanol = sgp.rawEthanol;
         }
+    }
+    I2CBus::release(I2C_DEVICE_SGP30, ok);
+
+    if (ok) {
+        stats.measurements++;
     } else {
-        Serial.println("Measurement failed");
+        stats.failures++;
+        LOG_EVENT(SGP30_MEASURE_FAILED);
     }
+    return ok;
 }
 
-float SGP30Sensor::getTVOC() {
+uint16_t SGP30Sensor::getTVOC() {
     return tvoc;
 }
 
-float SGP30Sensor::getH2() {
+uint16_t SGP30Sensor::getH2() {
     return h2;
 }
 
-float SGP30Sensor::getEthanol() {
+uint16_t SGP30Sensor::getEthanol() {
     return ethanol;
-} 
\ No newline at end of file
+} 
+
+const SGP30Stats& SGP30Sensor::getStats() {
+    return stats;
+}
+
+void SGP30Sensor::printStats() {
+    Serial.print("SGP30: "); Serial.print(stats.measurements); Serial.print(" measurements | ");
+    Serial.print(stats.failures); Serial.print(" failed | ");
+    Serial.print(stats.lateMeasurements); Serial.print(" off the 1 s grid (max ");
+    Serial.print(stats.maxJitterMillis); Serial.print(" ms) | ");
+    Serial.print(stats.humidityUpdates); Serial.print(" humidity updates | ");
+    Serial.print(stats.baselineSaves); Serial.print(" baseline saves | baseline ");
+    Serial.println(baselineRestored ? "valid" : "learning");
+}
\ No newline at end of file
@@ -0,0 +1,34 @@
+#ifndef TEST_BENCH_H
+#define TEST_BENCH_H
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+#include "sim.h"
+#include "alloc_counter.h"
+
+#define TCP_IP_HEADER_BYTES 40  // IPv4 + TCP without options, per segment
+
+// Value below which p percent of the samples fall; sorts in place
+template <typename T>
+inline T percentile(std::vector<T>& samples, double p) {
+    if (samples.empty()) {
+        return T();
+    }
+    std::sort(samples.begin(), samples.end());
+    return samples[std::min(samples.size() - 1, (size_t)(p / 100.0 * samples.size()))];
+}
+
+inline uint64_t hostNanos() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Bytes of the PUBLISH packet that carried a message, plus its PUBACK
+inline size_t mqttWireBytes(const MQTTMessage& message) {
+    size_t remaining = 2 + message.topic.size() + (message.qos > 0 ? 2 : 0) + message.payload.size();
+    size_t lengthBytes = remaining < 128 ? 1 : remaining < 16384 ? 2 : 3;
+    return 1 + lengthBytes + remaining + (message.qos > 0 ? 4 : 0);
+}
+
+#endif // TEST_BENCH_H
@@ -0,0 +1,84 @@
+// Aggregator update cost, memory, and the accuracy of its single-precision
+// Welford state over a full 24 h window of the typical air trace, against
+// exact statistics of the same samples
+#include <cmath>
+#include "sim.h"
+#include "bench.h"
+#include "check.h"
+#include "include/lib/aggregator.h"
+#include "include/lib/metrics.h"
+
+#define BENCH_DAY 86400000UL
+#define BENCH_TICK 1000UL  // SGP30 and active-mode PMS7003 rate
+#define BENCH_SCD41_INTERVAL 5000UL
+
+static const DataTopic TOPICS[AGG_METRIC_COUNT] = {TOPIC_TEMPERATURE, TOPIC_HUMIDITY, TOPIC_CO2, TOPIC_PM1_0,
+                                                   TOPIC_PM2_5, TOPIC_PM10, TOPIC_TVOC};
+
+// Exact reference: integer samples summed in long double
+struct Exact {
+    uint32_t count;
+    long double sum, sumSquares;
+};
+
+static Exact exact[AGG_METRIC_COUNT];
+static uint64_t addNanos, adds;
+
+static void add(AggregateMetric metric, int32_t value) {
+    uint64_t started = hostNanos();
+    Aggregator::add(metric, value);
+    addNanos += hostNanos() - started;
+    adds++;
+    exact[metric].count++;
+    exact[metric].sum += value;
+    exact[metric].sumSquares += (long double)value * value;
+}
+
+int main() {
+    Aggregator::begin();
+    uint64_t rollNanos = 0;
+    uint32_t rolls = 0;
+
+    for (unsigned long now = 0; now < BENCH_DAY; now += BENCH_TICK) {
+        Air air = Sim::typicalAir(now);
+        if (now % BENCH_SCD41_INTERVAL == 0) {
+            add(AGG_TEMPERATURE, lroundf(air.temperature * 100));
+            add(AGG_HUMIDITY, lroundf(air.humidity * 100));
+            add(AGG_CO2, air.co2);
+        }
+        add(AGG_PM1_0, air.pm1_0);
+        add(AGG_PM2_5, air.pm2_5);
+        add(AGG_PM10, air.pm10);
+        add(AGG_TVOC, air.tvoc);
+
+        uint64_t started = hostNanos();
+        Aggregator::roll(now + BENCH_TICK);
+        rollNanos += hostNanos() - started;
+        rolls++;
+    }
+    CHECK(Aggregator::takeCompleted(WINDOW_24H));
+
+    printf("Aggregator: %zu bytes of window state, %.1f ns per add(), %.1f ns per roll()\n",
+           Aggregator::stateBytes(), (double)addNanos / adds, (double)rollNanos / rolls);
+    printf("  %-12s %8s %14s %14s %14s %14s\n", "metric", "samples", "mean", "mean error", "sd",
+           "sd error");
+    for (uint8_t m = 0; m < AGG_METRIC_COUNT; m++) {
+        const WindowStats& stats = Aggregator::get(WINDOW_24H, (AggregateMetric)m);
+        const MetricDescriptor& metric = METRICS[TOPICS[m]];
+        const Exact& e = exact[m];
+        long double mean = e.sum / e.count;
+        long double variance = (e.sumSquares - e.sum * mean) / (e.count - 1);
+        double exactMean = (double)mean * metric.scale + metric.offset;
+        double exactStddev = sqrt((double)variance) * metric.scale;
+        double meanError = fabs(stats.mean - exactMean);
+        double stddevError = fabs(stats.stddev - exactStddev);
+        printf("  %-12s %8u %14.4f %14.6f %14.4f %14.6f\n", Aggregator::metricName((AggregateMetric)m),
+               stats.count, exactMean, meanError, exactStddev, stddevError);
+
+        // Published with at most two decimals; the error must not show
+        CHECK(stats.count == e.count);
+        CHECK(meanError < 0.005);
+        CHECK(stddevError < 0.005);
+    }
+    return CHECK_RESULT();
+}
@@ -0,0 +1,143 @@
+// Data bus cost per sample: a day of the typical air trace published at the
+// sensors' own rates into a full subscriber table of four sinks, each with
+// its own topic filter and interval, and dispatched after every sensor
+// batch as the acquisition worker does. The sinks take their changed topics
+// and read them back, so both sides of the bus are timed.
+#include "sim.h"
+#include "bench.h"
+#include "check.h"
+#include "include/lib/data_bus.h"
+#include "include/lib/enhanced_aqi.h"
+
+#define BENCH_DURATION (24 * 3600000UL)
+#define BENCH_TICK 1000UL              // SGP30 and active-mode PMS7003 rate
+#define BENCH_SCD41_INTERVAL 5000UL
+
+struct Sink {
+    const char* name;
+    TopicMask topics;
+    unsigned long minInterval;
+    int8_t id;
+    uint32_t notifications;
+    bool woken;
+    uint32_t readings;
+    int64_t checksum;  // Keeps the reads from being optimized away
+};
+
+static Sink sinks[DATA_BUS_MAX_SUBSCRIBERS] = {
+    {"display", METRIC_DISPLAY_TOPICS, 500, -1, 0, false, 0, 0},
+    {"serial", TOPIC_ALL, 10000, -1, 0, false, 0, 0},
+    {"mqtt", TOPIC_ALL, 5000, -1, 0, false, 0, 0},
+    {"logger", PMS7003_TOPICS, 0, -1, 0, false, 0, 0},
+};
+
+static uint64_t sinkNanos;
+
+// What a woken sink does on its own worker: take the changes and read them
+static void drain(Sink& sink) {
+    if (!sink.woken) {
+        return;
+    }
+    sink.woken = false;
+    uint64_t started = hostNanos();
+    TopicMask changed = DataBus::take(sink.id);
+    for (uint8_t t = 0; t < TOPIC_COUNT; t++) {
+        if (changed & TOPIC_BIT(t)) {
+            Reading reading = DataBus::read((DataTopic)t);
+            sink.checksum += reading.value;
+            sink.readings++;
+        }
+    }
+    sinkNanos += hostNanos() - started;
+}
+
+template <int N>
+static void notify() {
+    sinks[N].notifications++;
+    sinks[N].woken = true;
+}
+
+static const BusNotify NOTIFY[DATA_BUS_MAX_SUBSCRIBERS] = {notify<0>, notify<1>, notify<2>, notify<3>};
+
+static uint64_t publishNanos, dispatchNanos, samples, batches;
+
+struct Sample {
+    DataTopic topic;
+    int32_t value;
+};
+
+// One sensor's readings and the dispatch after them, timed as a whole so
+// the clock reads do not swamp a single publish()
+template <size_t N>
+static void publishBatch(const Sample (&batch)[N]) {
+    unsigned long now = millis();
+    uint64_t started = hostNanos();
+    for (const Sample& sample : batch) {
+        DataBus::publish(sample.topic, sample.value, QUALITY_GOOD, now);
+    }
+    uint64_t published = hostNanos();
+    DataBus::dispatch();
+    uint64_t dispatched = hostNanos();
+    publishNanos += published - started;
+    dispatchNanos += dispatched - published;
+    samples += N;
+    batches++;
+}
+
+int main() {
+    for (uint8_t i = 0; i < DATA_BUS_MAX_SUBSCRIBERS; i++) {
+        sinks[i].id = DataBus::subscribe(sinks[i].topics, sinks[i].minInterval, NOTIFY[i]);
+        CHECK(sinks[i].id == i);
+    }
+    CHECK(DataBus::subscribe(TOPIC_ALL, 0, nullptr) == -1);  // Table full
+
+    uint64_t allocations = AllocCounter::count();
+    for (unsigned long now = 0; now < BENCH_DURATION; now += BENCH_TICK) {
+        Air air = Sim::typicalAir(now);
+        if (now % BENCH_SCD41_INTERVAL == 0) {
+            publishBatch({{TOPIC_TEMPERATURE, (int32_t)lroundf(air.temperature * 100)},
+                          {TOPIC_HUMIDITY, (int32_t)lroundf(air.humidity * 100)},
+                          {TOPIC_CO2, air.co2}});
+        }
+        publishBatch({{TOPIC_TVOC, air.tvoc}, {TOPIC_H2, air.h2}, {TOPIC_ETHANOL, air.ethanol}});
+        publishBatch({{TOPIC_PM1_0, air.pm1_0},
+                      {TOPIC_PM2_5, air.pm2_5},
+                      {TOPIC_PM10, air.pm10},
+                      {TOPIC_AQI, air.pm2_5 * 4},
+                      {TOPIC_AQI_24H, air.pm2_5 * 4},
+                      {TOPIC_AQI_POLLUTANT, (int32_t)Pollutant::PM2_5}});
+
+        for (Sink& sink : sinks) {
+            drain(sink);
+        }
+        Sim::advance(BENCH_TICK);
+    }
+    allocations = AllocCounter::count() - allocations;
+
+    uint64_t readings = 0;
+    printf("Data bus, %llu samples in %llu batches over 24 h, %d subscribers\n", (unsigned long long)samples,
+           (unsigned long long)batches, DATA_BUS_MAX_SUBSCRIBERS);
+    printf("  publish()  %.1f ns per sample\n", (double)publishNanos / samples);
+    printf("  dispatch() %.1f ns per batch, %.1f ns per sample\n", (double)dispatchNanos / batches,
+           (double)dispatchNanos / samples);
+    printf("  writer total %.1f ns per sample\n", (double)(publishNanos + dispatchNanos) / samples);
+    printf("  %-8s %14s %10s\n", "sink", "notifications", "readings");
+    for (const Sink& sink : sinks) {
+        printf("  %-8s %14u %10u\n", sink.name, sink.notifications, sink.readings);
+        readings += sink.readings;
+    }
+    printf("  readers %.1f ns per reading taken, %llu allocations\n", (double)sinkNanos / readings,
+           (unsigned long long)allocations);
+
+    const DataBusStats& stats = DataBus::getStats();
+    CHECK(stats.published == samples);
+    CHECK(stats.dispatches == batches);
+    // Each sink hears at most once per interval, and no change is lost
+    CHECK(sinks[0].notifications <= BENCH_DURATION / sinks[0].minInterval + 1);
+    CHECK(sinks[1].notifications <= BENCH_DURATION / sinks[1].minInterval + 1);
+    CHECK(sinks[2].notifications <= BENCH_DURATION / sinks[2].minInterval + 1);
+    CHECK(sinks[3].notifications == BENCH_DURATION / BENCH_TICK);
+    CHECK(sinks[1].readings == sinks[1].notifications * TOPIC_COUNT);  // Every topic changes within 10 s
+    CHECK(allocations == 0);
+    return CHECK_RESULT();
+}
@@ -0,0 +1,86 @@
+// State reporting cost of the batched document against one topic per
+// metric. Built twice: bench_mqtt_state with the default MQTT_BATCHED_STATE
+// and bench_mqtt_state_per_topic with MQTT_BATCHED_STATE=0.
+//
+// A simulated day gives the state traffic the broker actually sees with
+// change-of-value reporting; then publishState() is timed on its own with
+// every metric included.
+#include "sim.h"
+#include "bench.h"
+#include "check.h"
+#include "include/lib/mqtt_client.h"
+#include "include/lib/data_bus.h"
+
+#define BENCH_DURATION (24 * 3600000UL)
+#define BENCH_CALLS 2000
+#define BENCH_ACK_WAIT 50  // Virtual ms for the broker's PUBACKs to come back
+
+void setup();
+void loop();
+
+static bool isStateTopic(const std::string& topic) {
+    const std::string prefix = "homeassistant/sensor/esp32_", suffix = "/state";
+    return topic.compare(0, prefix.size(), prefix) == 0 && topic.size() > suffix.size() &&
+           topic.compare(topic.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+struct Traffic {
+    size_t messages;
+    uint64_t mqttBytes;
+    uint64_t wireBytes;  // With a TCP/IP header per packet
+};
+
+static Traffic stateTraffic(size_t from) {
+    Traffic traffic = {};
+    const std::vector<MQTTMessage>& messages = FakeBroker::messages();
+    for (size_t i = from; i < messages.size(); i++) {
+        if (isStateTopic(messages[i].topic)) {
+            size_t bytes = mqttWireBytes(messages[i]);
+            traffic.messages++;
+            traffic.mqttBytes += bytes;
+            traffic.wireBytes += bytes + TCP_IP_HEADER_BYTES * (messages[i].qos > 0 ? 2 : 1);
+        }
+    }
+    return traffic;
+}
+
+int main() {
+    printf("State reporting, %s\n", MQTT_BATCHED_STATE ? "batched document" : "one topic per metric");
+
+    setup();
+    loop();
+    Sim::runFor(BENCH_DURATION);
+    Traffic day = stateTraffic(0);
+    printf("  24 h: %zu messages, %llu MQTT bytes, %llu bytes with TCP/IP headers\n", day.messages,
+           (unsigned long long)day.mqttBytes, (unsigned long long)day.wireBytes);
+
+    SensorSnapshot snapshot;
+    DataBus::snapshot(snapshot);
+    uint32_t timestamp = (uint32_t)time(nullptr);
+    std::vector<uint64_t> nanos;
+    nanos.reserve(BENCH_CALLS);
+    uint64_t allocations = 0;
+    size_t before = FakeBroker::messages().size();
+    uint32_t failures = 0;
+    for (int i = 0; i < BENCH_CALLS; i++) {
+        uint64_t count = AllocCounter::count();
+        uint64_t started = hostNanos();
+        failures += !MQTTClient::publishState(snapshot, timestamp);
+        nanos.push_back(hostNanos() - started);
+        allocations += AllocCounter::count() - count;
+
+        Sim::advance(BENCH_ACK_WAIT);
+        MQTTClient::loop();
+    }
+    Traffic calls = stateTraffic(before);
+    printf("  publishState(): p50 %.2f us, p99 %.2f us, %.2f allocations per call\n", percentile(nanos, 50) / 1e3,
+           percentile(nanos, 99) / 1e3, (double)allocations / BENCH_CALLS);
+    printf("  per report: %.1f messages, %.1f MQTT bytes, %.1f bytes with TCP/IP headers\n",
+           (double)calls.messages / BENCH_CALLS, (double)calls.mqttBytes / BENCH_CALLS,
+           (double)calls.wireBytes / BENCH_CALLS);
+
+    CHECK(day.messages > 0);
+    CHECK(failures == 0);
+    CHECK(allocations == 0);
+    return CHECK_RESULT();
+}
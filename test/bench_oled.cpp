@@ -0,0 +1,106 @@
+// OLED traffic over a simulated day of the typical air trace with the
+// display kept on: I2C bytes per hour of the retained-mode display against
+// a full-frame display() for every update, and the bus time they take.
+//
+// The button is pressed again whenever the five-minute timeout turns the
+// display off. The seconds in which it switches off or back on carry the
+// panel init and a full first frame; they are counted as wakes, apart from
+// the steady-state rate.
+#include "sim.h"
+#include "bench.h"
+#include "check.h"
+#include "include/lib/oled_display.h"
+
+#define BENCH_BOOT_TIME 60000UL
+#define BENCH_HOURS 24
+#define BENCH_STEP 1000UL  // Virtual ms between looks at the display
+#define BENCH_I2C_BITS_PER_BYTE 9  // Eight data bits and the ACK
+
+void setup();
+void loop();
+
+struct Hour {
+    uint64_t bytes;
+    uint32_t updates;
+    uint32_t onSteps;
+};
+
+static double busMillis(uint64_t bytes) {
+    return bytes * BENCH_I2C_BITS_PER_BYTE * 1000.0 / I2C_BUS_CLOCK;
+}
+
+int main() {
+    setup();
+    loop();
+    Sim::runFor(BENCH_BOOT_TIME);
+
+    // What printStats() compares against: 1024 pixel bytes, a control byte
+    // per chunk, the six addressing commands and their control bytes
+    uint32_t fullFrame = SCREEN_WIDTH * OLED_PAGES;
+    fullFrame += (fullFrame + OLED_I2C_CHUNK - 2) / (OLED_I2C_CHUNK - 1) + 12;
+
+    Hour hours[BENCH_HOURS] = {};
+    uint64_t wakeBytes = 0;
+    uint32_t wakes = 0;
+    const uint32_t steps = 3600000UL / BENCH_STEP;
+    for (uint32_t hour = 0; hour < BENCH_HOURS; hour++) {
+        for (uint32_t step = 0; step < steps; step++) {
+            bool pressed = false;
+            if (!isOledOn()) {
+                Sim::pressButton();
+                pressed = true;
+            }
+            uint64_t bytes = Wire.busBytes[SCREEN_ADDRESS];
+            uint32_t updates = OLEDDisplay::getStats().updates;
+            Sim::runFor(BENCH_STEP);
+            bytes = Wire.busBytes[SCREEN_ADDRESS] - bytes;
+            updates = OLEDDisplay::getStats().updates - updates;
+
+            if (pressed || !isOledOn()) {
+                wakeBytes += bytes;
+                wakes += pressed;
+            } else {
+                hours[hour].bytes += bytes;
+                hours[hour].updates += updates;
+                hours[hour].onSteps++;
+            }
+        }
+    }
+
+    uint64_t bytes = 0, updates = 0, onSteps = 0, peakBytes = 0;
+    uint32_t peakHour = 0;
+    printf("OLED traffic, display on, typical air trace\n");
+    printf("  %-6s %9s %9s %12s %12s\n", "hour", "updates", "bytes/h", "full redraw", "bus ms/h");
+    for (uint32_t hour = 0; hour < BENCH_HOURS; hour++) {
+        const Hour& h = hours[hour];
+        double scale = (double)steps / h.onSteps;  // Back to a full hour of display-on time
+        uint64_t perHour = (uint64_t)(h.bytes * scale);
+        printf("  %-6u %9.0f %9llu %12.0f %12.1f\n", hour, h.updates * scale, (unsigned long long)perHour,
+               (double)h.updates * fullFrame * scale, busMillis(perHour));
+        bytes += h.bytes;
+        updates += h.updates;
+        onSteps += h.onSteps;
+        if (perHour > peakBytes) {
+            peakBytes = perHour;
+            peakHour = hour;
+        }
+    }
+
+    double onHours = onSteps / (double)steps;
+    double bytesPerHour = bytes / onHours;
+    double fullPerHour = (double)updates * fullFrame / onHours;
+    printf("  average: %.0f updates, %.0f bytes (%.1f ms of bus time) per hour; peak %llu bytes in hour %u\n",
+           updates / onHours, bytesPerHour, busMillis(bytesPerHour), (unsigned long long)peakBytes, peakHour);
+    printf("  full-frame redraw: %.0f bytes (%.1f ms of bus time) per hour, %.1fx the incremental traffic\n",
+           fullPerHour, busMillis(fullPerHour), fullPerHour / bytesPerHour);
+    printf("  %u wakes: %.0f bytes each for the panel init and first frame\n", wakes,
+           wakes ? (double)wakeBytes / wakes : 0.0);
+
+    CHECK(Sim::restarts() == 0);
+    CHECK(updates > 0);
+    CHECK(wakes > 0);
+    // Only the changed characters of a few lines go out per update; the
+    // raw H2 and ethanol lines move on most of them
+    CHECK(bytesPerHour * 5 < fullPerHour);
+    return CHECK_RESULT();
+}
@@ -0,0 +1,78 @@
+// Encode cost and size of the state document in each payload format. Built
+// three times like test_payload_encoder: bench_payload_encoder (JSON),
+// bench_payload_encoder_cbor and bench_payload_encoder_msgpack.
+//
+// The document has the fields MQTTClient::publishState() writes, filled
+// from a firmware snapshot after boot with the suspect mask set, so it is
+// the full 15-field version.
+#include "sim.h"
+#include "bench.h"
+#include "check.h"
+#include "include/lib/payload_encoder.h"
+#include "include/lib/mqtt_client.h"
+#include "include/lib/data_bus.h"
+#include "include/lib/enhanced_aqi.h"
+
+#define BENCH_BOOT_TIME 60000UL
+#define BENCH_CALLS 20000
+
+void setup();
+void loop();
+
+static char buffer[MQTT_STATE_BUFFER_SIZE];
+
+static size_t encode(const SensorSnapshot& s, const float* values, uint32_t timestamp, uint32_t sequence) {
+    PayloadEncoder doc(buffer, sizeof(buffer));
+    doc.begin();
+    doc.add("ts", (long)timestamp);
+    doc.add("seq", (long)sequence);
+    for (uint8_t t = 0; t < TOPIC_COUNT; t++) {
+        const MetricDescriptor& metric = METRICS[t];
+        if (metric.kind == METRIC_TEXT) {
+            doc.add(metric.key, EnhancedAQI::pollutantName((Pollutant)(int)values[t]));
+        } else if (metric.decimals == 0) {
+            doc.add(metric.key, lroundf(values[t]));
+        } else {
+            doc.add(metric.key, values[t], metric.decimals);
+        }
+    }
+    doc.add("suspect", (long)s.suspect);
+    doc.end();
+    return doc.ok() ? doc.length() : 0;
+}
+
+int main() {
+    setup();
+    loop();
+    Sim::runFor(BENCH_BOOT_TIME);
+
+    SensorSnapshot snapshot;
+    DataBus::snapshot(snapshot);
+    snapshot.suspect = 1U << TOPIC_TVOC;
+    float values[TOPIC_COUNT];
+    for (uint8_t t = 0; t < TOPIC_COUNT; t++) {
+        values[t] = metricValue(snapshot, (DataTopic)t);
+    }
+    uint32_t timestamp = (uint32_t)time(nullptr);
+
+    std::vector<uint64_t> nanos;
+    nanos.reserve(BENCH_CALLS);
+    size_t bytes = 0;
+    uint32_t failures = 0;
+    uint64_t count = AllocCounter::count();
+    for (uint32_t i = 0; i < BENCH_CALLS; i++) {
+        uint64_t started = hostNanos();
+        bytes = encode(snapshot, values, timestamp + i, i);
+        nanos.push_back(hostNanos() - started);
+        failures += bytes == 0;
+    }
+    uint64_t allocations = AllocCounter::count() - count;
+
+    printf("State document, %s: %zu bytes, encode p50 %.0f ns, p99 %.0f ns, %llu allocations\n",
+           PayloadEncoder::formatName(), bytes, (double)percentile(nanos, 50), (double)percentile(nanos, 99),
+           (unsigned long long)allocations);
+
+    CHECK(failures == 0);
+    CHECK(allocations == 0);
+    return CHECK_RESULT();
+}
@@ -0,0 +1,145 @@
+// Report by exception against the fixed cadence it replaced: the typical
+// air trace is replayed through ReportFilter at REPORT_CHECK_INTERVAL, the
+// way publishMQTT() drives it, and through a plain report every
+// MQTT_UPDATE_INTERVAL. Both are scored on state messages per day and on
+// how long after the air crosses a threshold the consumer sees it.
+//
+// Snapshots are built straight from the trace, with the NowCast AQI fed the
+// way the acquisition worker feeds it, so the figures are the filter's
+// alone, without the sensors' own sampling delays.
+#include "sim.h"
+#include "bench.h"
+#include "check.h"
+#include "include/lib/report_filter.h"
+#include "include/lib/scheduler.h"
+#include "include/lib/mqtt_client.h"
+#include "include/lib/enhanced_aqi.h"
+#include "include/lib/metrics.h"
+
+#define BENCH_DAY 86400000UL
+
+// A moment the consumer should hear about: the metric crossing a level
+struct Event {
+    const char* name;
+    DataTopic topic;
+    float level;
+    bool rising;
+};
+
+static const Event EVENTS[] = {
+    {"PM2.5 above 35 ug/m3 (cooking)", TOPIC_PM2_5, 35, true},
+    {"PM2.5 back below 12 ug/m3", TOPIC_PM2_5, 12, false},
+    {"AQI above 50 (moderate)", TOPIC_AQI, 50, true},
+    {"CO2 above 800 ppm (evening)", TOPIC_CO2, 800, true},
+    {"CO2 above 600 ppm (morning)", TOPIC_CO2, 600, true},
+    {"TVOC above 250 ppb (cooking)", TOPIC_TVOC, 250, true},
+};
+
+#define EVENT_COUNT (sizeof(EVENTS) / sizeof(EVENTS[0]))
+
+struct Policy {
+    const char* name;
+    uint32_t messages;
+    SensorSnapshot reported;      // What the consumer last saw
+    unsigned long crossedAt[EVENT_COUNT];
+    unsigned long detectedAt[EVENT_COUNT];
+};
+
+static bool beyond(const Event& event, const SensorSnapshot& s) {
+    float value = metricValue(s, event.topic);
+    return event.rising ? value > event.level : value < event.level;
+}
+
+static SensorSnapshot snapshotAt(unsigned long now) {
+    Air air = Sim::typicalAir(now);
+    SensorSnapshot s;
+    s.sample.temperature = (int16_t)lroundf(air.temperature * 100);
+    s.sample.humidity = (uint16_t)lroundf(air.humidity * 100);
+    s.sample.co2 = air.co2;
+    s.sample.pm1_0 = air.pm1_0;
+    s.sample.pm2_5 = air.pm2_5;
+    s.sample.pm10 = air.pm10;
+    s.sample.tvoc = air.tvoc;
+    s.sample.h2 = air.h2;
+    s.sample.ethanol = air.ethanol;
+    EnhancedAQI::addSample(air.pm2_5, air.pm10, now);
+    AQIResult aqi = EnhancedAQI::nowcastAQI();
+    s.sample.aqi = aqi.index;
+    s.sample.pollutant = (uint16_t)aqi.dominant;
+    return s;
+}
+
+// The first crossing in the day, and the first report after it that shows it
+static void track(Policy& policy, const SensorSnapshot& air, unsigned long now, bool reporting) {
+    if (reporting) {
+        policy.messages++;
+        policy.reported = air;
+    }
+    for (size_t e = 0; e < EVENT_COUNT; e++) {
+        // PM2.5 falling back only counts once it has risen
+        bool armed = EVENTS[e].rising || policy.crossedAt[0] != ULONG_MAX;
+        if (armed && policy.crossedAt[e] == ULONG_MAX && beyond(EVENTS[e], air)) {
+            policy.crossedAt[e] = now;
+        }
+        if (policy.crossedAt[e] != ULONG_MAX && policy.detectedAt[e] == ULONG_MAX &&
+            beyond(EVENTS[e], policy.reported)) {
+            policy.detectedAt[e] = now;
+        }
+    }
+}
+
+static void reset(Policy& policy, const char* name) {
+    policy = {};
+    policy.name = name;
+    for (size_t e = 0; e < EVENT_COUNT; e++) {
+        policy.crossedAt[e] = policy.detectedAt[e] = ULONG_MAX;
+    }
+}
+
+int main() {
+    Policy onChange, fixed;
+    reset(onChange, "on change");
+    reset(fixed, "fixed 60 s");
+    ReportFilter::begin();
+    EnhancedAQI::begin();
+
+    for (unsigned long now = 0; now < BENCH_DAY; now += REPORT_CHECK_INTERVAL) {
+        SensorSnapshot air = snapshotAt(now);
+
+        // As publishMQTT() with the batched document: any due metric sends all
+        uint16_t metrics = ReportFilter::due(air, now);
+        if (metrics != 0) {
+            ReportFilter::commit(air, MQTT_BATCHED_STATE ? REPORT_ALL : metrics, now);
+        }
+        track(onChange, air, now, metrics != 0);
+        track(fixed, air, now, now % MQTT_UPDATE_INTERVAL == 0);
+    }
+
+    printf("State reports over a day of the typical air trace, checked every %u ms\n", REPORT_CHECK_INTERVAL);
+    printf("  %-12s %10s\n", "policy", "messages");
+    for (const Policy* policy : {&onChange, &fixed}) {
+        printf("  %-12s %10u\n", policy->name, policy->messages);
+    }
+    printf("  %-34s %14s %14s\n", "detection latency", onChange.name, fixed.name);
+    double latencySum[2] = {}, latencyMax[2] = {};
+    for (size_t e = 0; e < EVENT_COUNT; e++) {
+        double latency[2];
+        const Policy* policies[2] = {&onChange, &fixed};
+        for (int p = 0; p < 2; p++) {
+            latency[p] = (policies[p]->detectedAt[e] - policies[p]->crossedAt[e]) / 1000.0;
+            latencySum[p] += latency[p];
+            latencyMax[p] = std::max(latencyMax[p], latency[p]);
+        }
+        printf("  %-34s %12.0f s %12.0f s\n", EVENTS[e].name, latency[0], latency[1]);
+
+        CHECK(onChange.crossedAt[e] != ULONG_MAX);
+        CHECK(onChange.detectedAt[e] != ULONG_MAX && fixed.detectedAt[e] != ULONG_MAX);
+    }
+    printf("  %-34s %12.1f s %12.1f s\n", "mean", latencySum[0] / EVENT_COUNT, latencySum[1] / EVENT_COUNT);
+
+    // The deadbands trade some latency on slow drifts for far fewer messages;
+    // the heartbeat bounds how stale any metric can get
+    CHECK(onChange.messages * 4 < fixed.messages);
+    CHECK(latencyMax[0] <= REPORT_HEARTBEAT / 1000.0);
+    return CHECK_RESULT();
+}
@@ -0,0 +1,54 @@
+// A simulated day of the firmware: boots it through setup() and loop(),
+// runs the workers for 24 hours of virtual time against the typical air
+// trace and reports the host cost of each worker iteration and the heap
+// allocations made after boot.
+#include "sim.h"
+#include "bench.h"
+#include "check.h"
+#include "include/lib/mqtt_client.h"
+
+#define BENCH_BOOT_TIME 60000UL        // Connect, discovery and first readings
+#define BENCH_DURATION (24 * 3600000UL)
+
+void setup();
+void loop();
+
+static void report(const char* phase) {
+    printf("%s\n", phase);
+    printf("  %-12s %9s %9s %9s %9s %9s %9s %12s\n", "worker", "iters", "p50 us", "p90 us", "p99 us",
+           "p99.9 us", "max us", "allocs");
+    for (size_t i = 0; i < Sim::taskCount(); i++) {
+        TaskStats& stats = Sim::taskStats(i);
+        std::vector<uint32_t> nanos = stats.iterationNanos;
+        printf("  %-12s %9zu %9.1f %9.1f %9.1f %9.1f %9.1f %12llu\n", stats.name, nanos.size(),
+               percentile(nanos, 50) / 1e3, percentile(nanos, 90) / 1e3, percentile(nanos, 99) / 1e3,
+               percentile(nanos, 99.9) / 1e3, percentile(nanos, 100) / 1e3, (unsigned long long)stats.allocations);
+    }
+}
+
+int main() {
+    setup();
+    loop();
+    Sim::runFor(BENCH_BOOT_TIME);
+    report("Boot (first minute)");
+    Sim::resetTaskStats();
+
+    Sim::runFor(BENCH_DURATION);
+    report("Steady state (24 h)");
+
+    uint64_t allocations = 0;
+    for (size_t i = 0; i < Sim::taskCount(); i++) {
+        allocations += Sim::taskStats(i).allocations;
+    }
+    const MQTTStats& mqtt = MQTTClient::getStats();
+    printf("Allocations after boot: %llu (%.1f per hour)\n", (unsigned long long)allocations,
+           allocations / (BENCH_DURATION / 3600000.0));
+    printf("MQTT: %u publishes, %u failures, %u bytes | broker: %zu messages, %u connects, %llu bytes in\n",
+           mqtt.publishes, mqtt.failures, mqtt.bytes, FakeBroker::messages().size(), FakeBroker::connects(),
+           (unsigned long long)FakeBroker::bytesReceived());
+
+    CHECK(Sim::restarts() == 0);
+    CHECK(FakeBroker::connects() == 1);
+    CHECK(mqtt.publishes > 0);
+    return CHECK_RESULT();
+}
@@ -0,0 +1,147 @@
+// Fixed-point sample pipeline against the float snapshot and 30-byte flash
+// record it replaced: the size of each layout, of the offline log at
+// TELEMETRY_STORE_CAPACITY, and the time one reading takes through both
+// paths, sensor value to snapshot to stored record to published float.
+//
+// Times are the host's and only the ratio carries over. Both paths round
+// the SCD41 floats once, so the per-reading cost is close, with the fixed
+// path a little slower for packing the AQI bit-fields; the gain is the
+// record size.
+#include "sim.h"
+#include "bench.h"
+#include "check.h"
+#include "include/lib/telemetry_store.h"
+
+#define BENCH_READINGS 4096
+#define BENCH_ROUNDS 200
+
+// Layouts before the change
+struct LegacySnapshot {
+    float temperatureF;
+    float humidity;
+    int co2, pm1_0, pm2_5, pm10, aqi, aqi24h;
+    int aqiPollutant;
+    float tvoc, h2, ethanol;
+    uint16_t suspect;
+};
+
+struct __attribute__((packed)) LegacyStoredSample {
+    uint32_t sequence;
+    uint32_t timestamp;
+    int16_t temperatureF;
+    uint16_t humidity, co2, pm1_0, pm2_5, pm10, aqi, tvoc, h2, ethanol;
+    uint8_t flags;
+    uint8_t reserved;
+};
+
+// What the drivers hand over
+struct RawReading {
+    float temperatureC, humidity;  // SparkFun SCD4x reports floats
+    uint16_t co2, pm1_0, pm2_5, pm10, tvoc, h2, ethanol;
+};
+
+static volatile float sink;  // Keeps the results from being optimized away
+
+// Float snapshot, converted to °F at the driver, scaled into the flash
+// record and back out for publishing
+static void legacyPath(const RawReading& r, uint32_t now, LegacyStoredSample& stored) {
+    LegacySnapshot s = {};
+    s.temperatureF = r.temperatureC * 1.8f + 32.0f;
+    s.humidity = r.humidity;
+    s.co2 = r.co2;
+    s.pm1_0 = r.pm1_0;
+    s.pm2_5 = r.pm2_5;
+    s.pm10 = r.pm10;
+    s.aqi = r.pm2_5 * 2;
+    s.tvoc = r.tvoc;
+    s.h2 = r.h2;
+    s.ethanol = r.ethanol;
+
+    stored.sequence = now;
+    stored.timestamp = now;
+    stored.temperatureF = (int16_t)lroundf(s.temperatureF * 100);
+    stored.humidity = (uint16_t)lroundf(s.humidity * 100);
+    stored.co2 = s.co2;
+    stored.pm1_0 = s.pm1_0;
+    stored.pm2_5 = s.pm2_5;
+    stored.pm10 = s.pm10;
+    stored.aqi = s.aqi;
+    stored.tvoc = (uint16_t)s.tvoc;
+    stored.h2 = (uint16_t)s.h2;
+    stored.ethanol = (uint16_t)s.ethanol;
+    stored.flags = 0;
+    stored.reserved = 0;
+
+    LegacySnapshot out = {};
+    out.temperatureF = stored.temperatureF / 100.0f;
+    out.humidity = stored.humidity / 100.0f;
+    out.co2 = stored.co2;
+    sink += out.temperatureF + out.humidity + out.co2;
+}
+
+// Integers from the driver on, one copy into the flash record and a float
+// only for the published value
+static void fixedPath(const RawReading& r, uint32_t now, StoredSample& stored) {
+    SampleRecord s = {};
+    s.temperature = (int16_t)lroundf(r.temperatureC * 100);
+    s.humidity = (uint16_t)lroundf(r.humidity * 100);
+    s.co2 = r.co2;
+    s.pm1_0 = r.pm1_0;
+    s.pm2_5 = r.pm2_5;
+    s.pm10 = r.pm10;
+    s.aqi = r.pm2_5 * 2;
+    s.tvoc = r.tvoc;
+    s.h2 = r.h2;
+    s.ethanol = r.ethanol;
+
+    stored.sequence = now;
+    stored.record = s;
+    stored.record.timestamp = now;
+
+    sink += fixedToFloat(stored.record.temperature, SAMPLE_SCALE_CENTI_CELSIUS_F) +
+            fixedToFloat(stored.record.humidity, SAMPLE_SCALE_CENTI) + stored.record.co2;
+}
+
+template <typename Stored, typename Path>
+static double timePath(const std::vector<RawReading>& readings, Path path) {
+    std::vector<Stored> ring(readings.size());
+    uint64_t started = hostNanos();
+    for (int round = 0; round < BENCH_ROUNDS; round++) {
+        for (size_t i = 0; i < readings.size(); i++) {
+            path(readings[i], (uint32_t)(round * readings.size() + i), ring[i]);
+        }
+    }
+    return (double)(hostNanos() - started) / ((double)BENCH_ROUNDS * readings.size());
+}
+
+int main() {
+    std::vector<RawReading> readings(BENCH_READINGS);
+    for (size_t i = 0; i < readings.size(); i++) {
+        RawReading& r = readings[i];
+        r.temperatureC = 18.0f + (i % 700) * 0.01f;
+        r.humidity = 35.0f + (i % 3000) * 0.01f;
+        r.co2 = 420 + i % 1600;
+        r.pm1_0 = i % 40;
+        r.pm2_5 = i % 60;
+        r.pm10 = i % 90;
+        r.tvoc = i % 600;
+        r.h2 = 13000 + i % 500;
+        r.ethanol = 18000 + i % 500;
+    }
+
+    printf("Sizes (bytes)\n");
+    printf("  snapshot values  float %3zu  fixed %3zu\n", sizeof(LegacySnapshot), sizeof(SampleRecord));
+    printf("  flash record     float %3zu  fixed %3zu\n", sizeof(LegacyStoredSample), sizeof(StoredSample));
+    printf("  %d-record log    float %6zu  fixed %6zu\n", TELEMETRY_STORE_CAPACITY,
+           TELEMETRY_STORE_CAPACITY * sizeof(LegacyStoredSample), TELEMETRY_STORE_CAPACITY * sizeof(StoredSample));
+
+    double legacy = timePath<LegacyStoredSample>(readings, legacyPath);
+    double fixed = timePath<StoredSample>(readings, fixedPath);
+    printf("Per reading, sensor to stored record to published value (ns)\n");
+    printf("  float %.1f  fixed %.1f  (%.2fx)\n", legacy, fixed, legacy / fixed);
+
+    CHECK(sizeof(StoredSample) == sizeof(uint32_t) + sizeof(SampleRecord));
+    CHECK(sizeof(SampleRecord) < sizeof(LegacySnapshot));
+    CHECK(sizeof(StoredSample) <= sizeof(LegacyStoredSample));
+    return CHECK_RESULT();
+}
@@ -0,0 +1,20 @@
+#ifndef TEST_CHECK_H
+#define TEST_CHECK_H
+
+#include <stdio.h>
+
+// Minimal assertions: a failed CHECK prints its location and the test keeps
+// going; main() returns CHECK_RESULT() so ctest sees the failure
+static int checkFailures = 0;
+
+#define CHECK(condition)                                                        \
+    do {                                                                        \
+        if (!(condition)) {                                                     \
+            fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+            checkFailures++;                                                    \
+        }                                                                       \
+    } while (0)
+
+#define CHECK_RESULT() (checkFailures == 0 ? 0 : (fprintf(stderr, "%d checks failed\n", checkFailures), 1))
+
+#endif // TEST_CHECK_H
@@ -0,0 +1,124 @@
+// The steady-state paths promise not to touch the heap: the OLED update and
+// flush, the JSON writer and payload encoder, and every MQTT publish with
+// the session loop that takes its PUBACK. Each is driven from the test
+// after boot with the allocation counter watching.
+#include "sim.h"
+#include "check.h"
+#include "alloc_counter.h"
+#include "include/lib/oled_display.h"
+#include "include/lib/payload_encoder.h"
+#include "include/lib/mqtt_client.h"
+#include "include/lib/heap_monitor.h"
+#include "include/lib/sensor_health.h"
+
+#define TEST_BOOT_TIME 60000UL
+#define TEST_ROUNDS 200
+#define TEST_ACK_WAIT 50  // Virtual ms for the broker's PUBACKs to come back
+
+void setup();
+void loop();
+
+static uint64_t allocationsSince(uint64_t count) {
+    return AllocCounter::count() - count;
+}
+
+// New values for every shown metric, so each update redraws and flushes
+static void testDisplay() {
+    CHECK(isOledOn());
+    uint32_t updates = OLEDDisplay::getStats().updates;
+    uint32_t pages = OLEDDisplay::getStats().pagesFlushed;
+    uint64_t count = AllocCounter::count();
+    for (int round = 0; round < TEST_ROUNDS; round++) {
+        for (uint8_t topic = 0; topic < TOPIC_COUNT; topic++) {
+            if (METRIC_DISPLAY_TOPICS & (1U << topic)) {
+                DataBus::publish((DataTopic)topic, 2000 + round * 7 + topic, QUALITY_GOOD, millis());
+            }
+        }
+        OLEDDisplay::update();
+        while (OLEDDisplay::flush()) {
+        }
+    }
+    uint64_t allocations = allocationsSince(count);
+    printf("OLED: %u updates, %u pages flushed, %llu allocations\n", OLEDDisplay::getStats().updates - updates,
+           OLEDDisplay::getStats().pagesFlushed - pages, (unsigned long long)allocations);
+    CHECK(OLEDDisplay::getStats().updates - updates == TEST_ROUNDS);
+    CHECK(OLEDDisplay::getStats().pagesFlushed > pages);
+    CHECK(!OLEDDisplay::isDirty());
+    CHECK(allocations == 0);
+}
+
+static void testSerialization() {
+    char buffer[MQTT_STATE_BUFFER_SIZE];
+    size_t bytes = 0;
+    uint64_t count = AllocCounter::count();
+    for (int round = 0; round < TEST_ROUNDS; round++) {
+        JsonWriter json(buffer, sizeof(buffer));
+        json.beginObject();
+        json.add("uptime", (long)round);
+        json.add("temperature", 21.5f + round / 100.0f, 2);
+        json.beginObject("heap");
+        json.add("state", "ok");
+        json.endObject();
+        json.endObject();
+        CHECK(json.ok());
+
+        PayloadEncoder payload(buffer, sizeof(buffer));
+        payload.begin();
+        for (uint8_t topic = 0; topic < TOPIC_COUNT; topic++) {
+            payload.add(METRICS[topic].key, 1000.0f + round + topic, METRICS[topic].decimals);
+        }
+        payload.add("seq", (long)round);
+        payload.end();
+        CHECK(payload.ok());
+        bytes += json.length() + payload.length();
+    }
+    uint64_t allocations = allocationsSince(count);
+    printf("Serialization: %zu bytes written, %llu allocations\n", bytes, (unsigned long long)allocations);
+    CHECK(allocations == 0);
+}
+
+static void testPublish() {
+    SensorSnapshot snapshot;
+    DataBus::snapshot(snapshot);
+    AggregateReport report = {};
+    report.window = WINDOW_1M;
+    const TaskHealth health[] = {{"acquisition", 4096}, {"display", 2048}, {"network", 4096}};
+    SensorHealthInfo sensors[HEALTH_SENSOR_COUNT];
+    for (uint8_t i = 0; i < HEALTH_SENSOR_COUNT; i++) {
+        sensors[i] = SensorHealth::read((HealthSensor)i);
+    }
+
+    size_t received = FakeBroker::messages().size();
+    uint32_t failures = 0;
+    uint64_t count = AllocCounter::count();
+    for (int round = 0; round < TEST_ROUNDS; round++) {
+        uint32_t timestamp = (uint32_t)time(nullptr);
+        failures += !MQTTClient::publishState(snapshot, timestamp);
+        failures += !MQTTClient::publishAggregates(report);
+        failures += !MQTTClient::publishHealth(HeapMonitor::getStats(), health, 3);
+        failures += !MQTTClient::publishDiagnostics(sensors, HEALTH_SENSOR_COUNT);
+        failures += !MQTTClient::publish("homeassistant/sensor/esp32_airquality/test", "payload");
+
+        Sim::advance(TEST_ACK_WAIT);
+        MQTTClient::loop();
+    }
+    uint64_t allocations = allocationsSince(count);
+    size_t messages = FakeBroker::messages().size() - received;
+    printf("Publish: %zu messages, %u failures, %llu allocations\n", messages, failures,
+           (unsigned long long)allocations);
+    CHECK(failures == 0);
+    CHECK(messages == TEST_ROUNDS * 5);
+    CHECK(MQTTClient::inFlight() == 0);  // Every PUBACK taken by loop()
+    CHECK(allocations == 0);
+}
+
+int main() {
+    setup();
+    loop();
+    Sim::runFor(TEST_BOOT_TIME);
+
+    testDisplay();
+    testSerialization();
+    testPublish();
+    return CHECK_RESULT();
+}
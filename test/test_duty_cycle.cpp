@@ -0,0 +1,117 @@
+// Duty-cycled mode across deep sleeps: every boot takes one sample and
+// sleeps until the next slot, one WiFi session every DUTY_UPLOAD_EVERY
+// samples uploads them, and the samples wait in RTC memory through the
+// sleeps in between and through sessions that fail.
+#include <algorithm>
+#include "sim.h"
+#include "check.h"
+#include "include/lib/power_manager.h"
+#include "include/lib/mqtt_client.h"
+
+#define TEST_FIRST_CYCLE (DUTY_CYCLE_PERIOD - 1000UL)  // Into the first sleep
+#define TEST_OFFLINE_CYCLES 12
+#define TEST_RECOVERY_CYCLES (DUTY_MAX_UPLOAD_BACKOFF + 2)
+
+void setup();
+void loop();
+
+static void boot() {
+    setup();
+    loop();
+}
+
+static void runCycles(uint32_t cycles) {
+    Sim::runFor(cycles * DUTY_CYCLE_PERIOD);
+}
+
+// The seq field of every backfill document the broker received
+static std::vector<uint32_t> backfillSequences() {
+    std::vector<uint32_t> sequences;
+    for (const MQTTMessage& message : FakeBroker::messages()) {
+        if (message.topic != MQTT_BACKFILL_TOPIC) {
+            continue;
+        }
+        std::string payload(message.payload.begin(), message.payload.end());
+        size_t at = payload.find("\"seq\":");
+        CHECK(at != std::string::npos);
+        if (at != std::string::npos) {
+            sequences.push_back((uint32_t)strtoul(payload.c_str() + at + 6, nullptr, 10));
+        }
+    }
+    return sequences;
+}
+
+// Power-on: one sample, uploaded right away, then sleep
+static void testFirstBoot() {
+    Sim::runFor(TEST_FIRST_CYCLE);
+    const DutyCycleStats& stats = PowerManager::getStats();
+    CHECK(Sim::deepSleeps() == 1);
+    CHECK(Sim::stopped());
+    CHECK(stats.cycles == 1);
+    CHECK(stats.uploads == 1);
+    CHECK(PowerManager::pendingSamples() == 0);
+    CHECK(FakeBroker::count(MQTT_BACKFILL_TOPIC) == 1);
+    CHECK(FakeBroker::count(MQTT_STATE_TOPIC) == 1);
+}
+
+// Sample and sleep, with the samples collected in RTC memory until the
+// upload cycle
+static void testSampleUploadSleep() {
+    const DutyCycleStats& stats = PowerManager::getStats();
+    for (uint8_t held = 1; held < DUTY_UPLOAD_EVERY; held++) {
+        runCycles(1);
+        CHECK(stats.cycles == 1U + held);
+        CHECK(PowerManager::pendingSamples() == held);
+    }
+    CHECK(FakeBroker::count(MQTT_BACKFILL_TOPIC) == 1);
+    CHECK(stats.uploads == 1);
+
+    runCycles(1);
+    printf("%u cycles: %u uploads, awake %u ms at most\n", stats.cycles, stats.uploads, stats.maxAwakeMillis);
+    CHECK(Sim::deepSleeps() == stats.cycles);
+    CHECK(stats.uploads == 2);
+    CHECK(PowerManager::pendingSamples() == 0);
+    CHECK(FakeBroker::count(MQTT_BACKFILL_TOPIC) == 1U + DUTY_UPLOAD_EVERY);
+    CHECK(FakeBroker::count(MQTT_STATE_TOPIC) == 2);
+    CHECK(stats.maxAwakeMillis < DUTY_SAMPLE_TIMEOUT + DUTY_UPLOAD_TIMEOUT);
+}
+
+// Failed sessions back off and keep every sample; once WiFi is back they
+// all reach the broker, in a contiguous sequence
+static void testOfflineSamplesKept() {
+    const DutyCycleStats& stats = PowerManager::getStats();
+    FakeNetwork::setWiFiAvailable(false);
+    uint8_t held = PowerManager::pendingSamples();
+    runCycles(TEST_OFFLINE_CYCLES);
+    printf("Offline for %u cycles: %u samples held, %u failed sessions\n", TEST_OFFLINE_CYCLES,
+           PowerManager::pendingSamples(), stats.uploadFailures);
+    CHECK(PowerManager::pendingSamples() == held + TEST_OFFLINE_CYCLES);
+    CHECK(stats.uploadFailures > 0);
+    CHECK(stats.uploadFailures < TEST_OFFLINE_CYCLES / DUTY_UPLOAD_EVERY + 3);  // Backed off
+    CHECK(stats.samplesSpilled == 0);
+
+    FakeNetwork::setWiFiAvailable(true);
+    runCycles(TEST_RECOVERY_CYCLES);
+    CHECK(PowerManager::pendingSamples() < DUTY_UPLOAD_EVERY);
+
+    std::vector<uint32_t> sequences = backfillSequences();
+    std::sort(sequences.begin(), sequences.end());
+    CHECK(sequences.size() == stats.cycles - PowerManager::pendingSamples());
+    for (size_t i = 0; i < sequences.size(); i++) {
+        if (sequences[i] != i + 1) {
+            printf("Sequence %zu is %u\n", i + 1, sequences[i]);
+            CHECK(sequences[i] == i + 1);
+            break;
+        }
+    }
+}
+
+int main() {
+    Sim::wakeFromSleep(boot);
+    boot();
+
+    testFirstBoot();
+    testSampleUploadSleep();
+    testOfflineSamplesKept();
+    return CHECK_RESULT();
+}
@@ -0,0 +1,90 @@
+// US EPA AQI against the reference values of the 2024 PM2.5 revision and
+// the PM10 table, at every breakpoint edge and with the EPA's truncation
+// (PM2.5 to 0.1 ug/m3, PM10 to 1 ug/m3)
+#include "sim.h"
+#include "check.h"
+#include "include/lib/enhanced_aqi.h"
+
+struct Reference {
+    float concentration;
+    uint16_t index;
+};
+
+static const Reference EPA_PM2_5_REFERENCE[] = {
+    {0.0f, 0},     {4.5f, 25},    {9.0f, 50},    {9.1f, 51},    {12.0f, 56},   {20.0f, 71},
+    {35.4f, 100},  {35.5f, 101},  {50.0f, 137},  {55.4f, 150},  {55.5f, 151},  {125.4f, 200},
+    {125.5f, 201}, {225.4f, 300}, {225.5f, 301}, {325.4f, 500}, {500.0f, 500},
+    // Truncated to 0.1 before the lookup
+    {9.05f, 50},   {9.09f, 50},   {35.45f, 100}, {35.49f, 100}, {55.49f, 150}, {125.49f, 200},
+};
+
+static const Reference EPA_PM10_REFERENCE[] = {
+    {0, 0},     {54, 50},   {55, 51},   {100, 73},  {154, 100}, {155, 101}, {254, 150}, {255, 151},
+    {354, 200}, {355, 201}, {424, 300}, {425, 301}, {604, 500}, {800, 500},
+    // Truncated to whole ug/m3
+    {54.9f, 50}, {154.9f, 100}, {354.99f, 200},
+};
+
+static void testSubIndex() {
+    for (const Reference& r : EPA_PM2_5_REFERENCE) {
+        uint16_t index = EnhancedAQI::subIndex(Pollutant::PM2_5, r.concentration, AQIStandard::US_EPA);
+        if (index != r.index) {
+            fprintf(stderr, "PM2.5 %.2f: %u, expected %u\n", r.concentration, index, r.index);
+        }
+        CHECK(index == r.index);
+    }
+    for (const Reference& r : EPA_PM10_REFERENCE) {
+        uint16_t index = EnhancedAQI::subIndex(Pollutant::PM10, r.concentration, AQIStandard::US_EPA);
+        if (index != r.index) {
+            fprintf(stderr, "PM10 %.2f: %u, expected %u\n", r.concentration, index, r.index);
+        }
+        CHECK(index == r.index);
+    }
+
+    CHECK(EnhancedAQI::subIndex(Pollutant::PM2_5, -1.0f, AQIStandard::US_EPA) == 0);
+    CHECK(EnhancedAQI::subIndex(Pollutant::PM2_5, NAN, AQIStandard::US_EPA) == 0);
+    CHECK(EnhancedAQI::subIndex(Pollutant::None, 50.0f, AQIStandard::US_EPA) == 0);
+}
+
+// Every 0.1 ug/m3 step up the scale, so no float edge drops a value into
+// the wrong row
+static void testMonotonic() {
+    for (Pollutant pollutant : {Pollutant::PM2_5, Pollutant::PM10}) {
+        uint16_t previous = 0;
+        for (int tenths = 0; tenths <= 7000; tenths++) {
+            uint16_t index = EnhancedAQI::subIndex(pollutant, tenths / 10.0f, AQIStandard::US_EPA);
+            CHECK(index >= previous && index <= previous + 3);
+            previous = index;
+        }
+        CHECK(previous == 500);
+    }
+}
+
+// The index before NowCast has two hours is the combination of the current
+// hour's averages, which exercises combine() through the public interface
+static AQIResult combined(float pm2_5, float pm10) {
+    EnhancedAQI::begin();
+    EnhancedAQI::addSample(pm2_5, pm10, millis());
+    return EnhancedAQI::nowcastAQI(AQIStandard::US_EPA);
+}
+
+static void testCombine() {
+    AQIResult result = combined(35.5f, 54);  // 101 against 50
+    CHECK(result.index == 101 && result.dominant == Pollutant::PM2_5);
+
+    result = combined(9.0f, 155);  // 50 against 101
+    CHECK(result.index == 101 && result.dominant == Pollutant::PM10);
+
+    result = combined(9.0f, 54);  // Tie goes to PM2.5
+    CHECK(result.index == 50 && result.dominant == Pollutant::PM2_5);
+
+    result = combined(0, 0);
+    CHECK(result.index == 0 && result.dominant == Pollutant::None);
+}
+
+int main() {
+    testSubIndex();
+    testMonotonic();
+    testCombine();
+    return CHECK_RESULT();
+}
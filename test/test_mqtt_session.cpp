@@ -0,0 +1,155 @@
+// Delivery guarantees against the fake broker: inbound QoS1 messages are
+// acknowledged even when they do not fit the receive buffer, and stored
+// backfill records leave the offline log only once their PUBACKs arrive.
+#include "sim.h"
+#include "check.h"
+#include <WiFi.h>
+#include "include/lib/mqtt_client.h"
+#include "include/lib/telemetry_store.h"
+#include "include/lib/scheduler.h"
+
+#define TEST_BOOT_TIME 60000UL
+#define TEST_OUTAGE (4 * 3600000UL)  // Long enough to store more records than the QoS1 window
+#define TEST_DELIVERY_TIME (2 * MQTT_LOOP_INTERVAL)
+#define TEST_DRAIN_TIME (10 * 60000UL)
+#define TEST_TOPIC "homeassistant/sensor/esp32_airquality/inbound"
+#define TEST_IDLE_TIME (MQTT_WRITE_STALL_TIMEOUT + 5000UL)
+
+void setup();
+void loop();
+
+// A session of its own, before the firmware boots: after an idle stretch
+// longer than the stall timeout, a socket that is briefly full must not
+// make loop() drop a healthy connection
+static void testIdleThenFullSocket() {
+    WiFi.begin("test", "test");
+    Sim::advance(5000);
+    WiFiClient client;
+    MQTTSession session(client);
+    session.setKeepAlive(60);  // No PINGREQ during the idle stretch
+    CHECK(session.connect("broker", 1883, "stall-test", nullptr, nullptr));
+
+    Sim::advance(TEST_IDLE_TIME);
+    CHECK(session.loop());
+    FakeBroker::stallWrites(2);  // The publish and the next loop() both find it full
+    const uint8_t payload[] = "idle";
+    CHECK(session.publish(TEST_TOPIC, payload, sizeof(payload) - 1));
+    CHECK(session.hasPendingWrites());
+
+    Sim::advance(MQTT_FLUSH_INTERVAL);
+    CHECK(session.loop());
+    CHECK(session.hasPendingWrites());
+    Sim::advance(MQTT_FLUSH_INTERVAL);
+    CHECK(session.loop());
+    CHECK(!session.hasPendingWrites());
+    CHECK(session.getStats().stalls == 0);
+    CHECK(FakeBroker::count(TEST_TOPIC) == 1);
+    session.disconnect();
+    WiFi.disconnect();
+}
+
+// A PUBACK for an older publish frees its slot for a newer one while a
+// publish in between is still waiting; the reconnect must resend the
+// waiting one before the newer one
+static void testResendInSendOrder() {
+    WiFi.begin("test", "test");
+    Sim::advance(5000);
+    WiFiClient client;
+    MQTTSession session(client);
+    CHECK(session.connect("broker", 1883, "order-test", nullptr, nullptr));
+
+    const uint8_t a[] = "a", b[] = "b", c[] = "c";
+    CHECK(session.publish(TEST_TOPIC, a, 1, 1));  // Slot 0, its PUBACK already queued
+    FakeBroker::setAcknowledging(false);
+    CHECK(session.publish(TEST_TOPIC, b, 1, 1));  // Slot 1
+    Sim::advance(TEST_DELIVERY_TIME);
+    session.loop();
+    CHECK(session.inFlight() == 1);
+    CHECK(session.publish(TEST_TOPIC, c, 1, 1));  // Slot 0 again
+
+    FakeBroker::disconnect();
+    FakeBroker::setAcknowledging(true);
+    FakeBroker::clearMessages();
+    CHECK(session.connect("broker", 1883, "order-test", nullptr, nullptr));
+    Sim::advance(TEST_DELIVERY_TIME);
+    session.loop();
+    const std::vector<MQTTMessage>& messages = FakeBroker::messages();
+    CHECK(messages.size() == 2);
+    if (messages.size() == 2) {
+        CHECK(messages[0].dup && messages[0].payload[0] == 'b');
+        CHECK(messages[1].dup && messages[1].payload[0] == 'c');
+    }
+    CHECK(session.inFlight() == 0);
+    session.disconnect();
+    WiFi.disconnect();
+    FakeBroker::clearMessages();
+}
+
+// A retained config or command larger than MQTT_RX_BUFFER_SIZE is skipped,
+// but the broker would resend it on every reconnect without a PUBACK
+static void testOversizedPublishAcknowledged() {
+    static uint8_t payload[4 * MQTT_RX_BUFFER_SIZE];
+    memset(payload, 'x', sizeof(payload));
+    uint32_t connects = FakeBroker::connects();
+
+    uint32_t pubacks = FakeBroker::pubacksReceived();
+    FakeBroker::send(TEST_TOPIC, payload, sizeof(payload), 1, 0x1234);
+    Sim::runFor(TEST_DELIVERY_TIME);
+    CHECK(FakeBroker::pubacksReceived() == pubacks + 1);
+    CHECK(FakeBroker::lastPubackId() == 0x1234);
+
+    // The stream stays in step: a small message after it is acknowledged too
+    FakeBroker::send(TEST_TOPIC, payload, 16, 1, 0x1235);
+    Sim::runFor(TEST_DELIVERY_TIME);
+    CHECK(FakeBroker::pubacksReceived() == pubacks + 2);
+    CHECK(FakeBroker::lastPubackId() == 0x1235);
+
+    // QoS0 needs no acknowledgement at any size
+    FakeBroker::send(TEST_TOPIC, payload, sizeof(payload), 0, 0);
+    Sim::runFor(TEST_DELIVERY_TIME);
+    CHECK(FakeBroker::pubacksReceived() == pubacks + 2);
+    CHECK(FakeBroker::isConnected());
+    CHECK(FakeBroker::connects() == connects);
+}
+
+// While the broker withholds PUBACKs the backlog must not shrink, even
+// though records are being published; a reconnect resends them and the
+// acknowledgements then clear the log
+static void testBackfillWaitsForPubacks() {
+    FakeNetwork::setWiFiAvailable(false);
+    Sim::runFor(TEST_OUTAGE);
+    uint32_t backlog = TelemetryStore::backlog();
+    CHECK(backlog > MQTT_INFLIGHT_WINDOW);
+
+    FakeBroker::setAcknowledging(false);
+    size_t backfills = FakeBroker::count(MQTT_BACKFILL_TOPIC);
+    FakeNetwork::setWiFiAvailable(true);
+    Sim::runFor(TEST_DRAIN_TIME);
+    printf("Unacknowledged: %zu backfill messages sent, backlog %u -> %u\n",
+           FakeBroker::count(MQTT_BACKFILL_TOPIC) - backfills, backlog, TelemetryStore::backlog());
+    CHECK(FakeBroker::count(MQTT_BACKFILL_TOPIC) > backfills);
+    CHECK(TelemetryStore::backlog() >= backlog);
+    CHECK(MQTTClient::inFlight() == MQTT_INFLIGHT_WINDOW);
+
+    FakeBroker::setAcknowledging(true);
+    FakeBroker::disconnect();
+    Sim::runFor(TEST_DRAIN_TIME);
+    printf("Acknowledged: %zu backfill messages, backlog %u\n", FakeBroker::count(MQTT_BACKFILL_TOPIC) - backfills,
+           TelemetryStore::backlog());
+    CHECK(TelemetryStore::backlog() == 0);
+    CHECK(MQTTClient::inFlight() == 0);
+}
+
+int main() {
+    testIdleThenFullSocket();
+    testResendInSendOrder();
+
+    setup();
+    loop();
+    Sim::runFor(TEST_BOOT_TIME);
+    CHECK(FakeBroker::isConnected());
+
+    testOversizedPublishAcknowledged();
+    testBackfillWaitsForPubacks();
+    return CHECK_RESULT();
+}
@@ -0,0 +1,50 @@
+// Partial OLED flushes against a panel that stops acknowledging: a page
+// whose transfer failed must stay dirty and go out again once the panel
+// answers, or the stale pixels stay on screen until those characters change.
+#include "sim.h"
+#include "check.h"
+#include "include/lib/oled_display.h"
+#include "include/lib/data_bus.h"
+
+#define TEST_BOOT_TIME 60000UL
+
+void setup();
+void loop();
+
+// New values for every shown metric, so every row is redrawn
+static void changeShownMetrics(int32_t offset) {
+    for (uint8_t topic = 0; topic < TOPIC_COUNT; topic++) {
+        if (METRIC_DISPLAY_TOPICS & (1U << topic)) {
+            DataBus::publish((DataTopic)topic, 3000 + offset + topic, QUALITY_GOOD, millis());
+        }
+    }
+    OLEDDisplay::update();
+}
+
+int main() {
+    setup();
+    loop();
+    Sim::runFor(TEST_BOOT_TIME);
+    CHECK(isOledOn());
+    while (OLEDDisplay::flush()) {
+    }
+    CHECK(!OLEDDisplay::isDirty());
+
+    Sim::setI2CResponding(SCREEN_ADDRESS, false);
+    changeShownMetrics(11);
+    CHECK(OLEDDisplay::isDirty());
+    uint32_t pages = OLEDDisplay::getStats().pagesFlushed;
+    for (int i = 0; i < 2 * OLED_PAGES; i++) {
+        OLEDDisplay::flush();
+    }
+    CHECK(OLEDDisplay::getStats().pagesFlushed > pages);
+    CHECK(OLEDDisplay::isDirty());  // Nothing reached the panel
+
+    Sim::setI2CResponding(SCREEN_ADDRESS, true);
+    int flushes = 0;
+    while (OLEDDisplay::flush() && flushes < 2 * OLED_PAGES) {
+        flushes++;
+    }
+    CHECK(!OLEDDisplay::isDirty());
+    return CHECK_RESULT();
+}
@@ -0,0 +1,473 @@
+// PayloadEncoder round trips: documents are encoded, decoded again by an
+// independent reader for the format and compared field by field. Built three
+// times: test_payload_encoder with the default JSON, test_payload_encoder_cbor
+// and test_payload_encoder_msgpack with PAYLOAD_FORMAT set.
+//
+// Covers every integer width and string length class the encoders choose
+// between, floats including NaN, JSON escapes, the map header limits (the
+// MessagePack fixmap holds 15 pairs) and the firmware's own state document,
+// which is 14 fields, or 15 with the suspect mask.
+#include <climits>
+#include <cmath>
+#include <string>
+#include <vector>
+#include "sim.h"
+#include "check.h"
+#include "include/lib/payload_encoder.h"
+#include "include/lib/mqtt_client.h"
+#include "include/lib/data_bus.h"
+#include "include/lib/enhanced_aqi.h"
+
+#define TEST_BOOT_TIME 60000UL
+
+#if PAYLOAD_FORMAT == PAYLOAD_FORMAT_MSGPACK
+#define TEST_MAX_FIELDS 15  // fixmap
+#elif PAYLOAD_FORMAT == PAYLOAD_FORMAT_CBOR
+#define TEST_MAX_FIELDS 23  // Map header with the count in the initial byte
+#endif
+
+void setup();
+void loop();
+
+enum FieldType { FIELD_INTEGER, FIELD_FLOAT, FIELD_STRING, FIELD_NULL };
+
+struct Field {
+    std::string key;
+    FieldType type;
+    long long integer;
+    double number;
+    std::string text;
+};
+
+class Reader {
+private:
+    const uint8_t* data;
+    size_t length;
+    size_t pos = 0;
+    bool failed = false;
+
+public:
+    Reader(const uint8_t* data, size_t length) : data(data), length(length) {
+    }
+
+    bool ok() const {
+        return !failed;
+    }
+
+    bool atEnd() const {
+        return pos == length;
+    }
+
+    uint8_t peek() {
+        if (pos >= length) {
+            failed = true;
+            return 0;
+        }
+        return data[pos];
+    }
+
+    uint8_t next() {
+        uint8_t byte = peek();
+        pos += !failed;
+        return byte;
+    }
+
+    uint64_t bigEndian(uint8_t bytes) {
+        uint64_t value = 0;
+        while (bytes-- > 0) {
+            value = value << 8 | next();
+        }
+        return value;
+    }
+
+    std::string bytes(size_t n) {
+        if (n > length - pos) {
+            failed = true;
+            return std::string();
+        }
+        std::string text(reinterpret_cast<const char*>(data + pos), n);
+        pos += n;
+        return text;
+    }
+
+    float float32() {
+        uint32_t bits = (uint32_t)bigEndian(4);
+        float value;
+        memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+
+    void fail() {
+        failed = true;
+    }
+};
+
+#if PAYLOAD_FORMAT == PAYLOAD_FORMAT_JSON
+
+static std::string readString(Reader& in) {
+    std::string text;
+    if (in.next() != '"') {
+        in.fail();
+    }
+    while (in.ok() && in.peek() != '"') {
+        char c = in.next();
+        if (c == '\\') {
+            c = in.next();
+            if (c == 'u') {
+                c = (char)strtol(in.bytes(4).c_str(), nullptr, 16);
+            } else if (c != '"' && c != '\\') {
+                in.fail();
+            }
+        }
+        text += c;
+    }
+    in.next();
+    return text;
+}
+
+static bool decode(const uint8_t* data, size_t length, std::vector<Field>& fields) {
+    Reader in(data, length);
+    fields.clear();
+    if (in.next() != '{') {
+        return false;
+    }
+    while (in.ok() && in.peek() != '}') {
+        if (!fields.empty() && in.next() != ',') {
+            return false;
+        }
+        Field field = {};
+        field.key = readString(in);
+        if (in.next() != ':') {
+            return false;
+        }
+        if (in.peek() == '"') {
+            field.type = FIELD_STRING;
+            field.text = readString(in);
+        } else if (in.peek() == 'n') {
+            field.type = in.bytes(4) == "null" ? FIELD_NULL : (in.fail(), FIELD_NULL);
+        } else {
+            std::string number;
+            while (in.ok() && in.peek() != ',' && in.peek() != '}') {
+                number += (char)in.next();
+            }
+            char* end;
+            field.number = strtod(number.c_str(), &end);
+            field.integer = strtoll(number.c_str(), nullptr, 10);
+            field.type = number.find_first_of(".eE") == std::string::npos ? FIELD_INTEGER : FIELD_FLOAT;
+            if (number.empty() || *end != '\0') {
+                return false;
+            }
+        }
+        fields.push_back(field);
+    }
+    in.next();
+    return in.ok() && in.atEnd();
+}
+
+#elif PAYLOAD_FORMAT == PAYLOAD_FORMAT_CBOR
+
+static uint64_t argument(Reader& in, uint8_t initial) {
+    uint8_t info = initial & 0x1F;
+    if (info < 24) {
+        return info;
+    }
+    if (info > 27) {
+        in.fail();
+        return 0;
+    }
+    return in.bigEndian(1 << (info - 24));
+}
+
+static bool decodeValue(Reader& in, Field& field) {
+    uint8_t initial = in.next();
+    switch (initial >> 5) {
+        case 0:
+            field.type = FIELD_INTEGER;
+            field.integer = (long long)argument(in, initial);
+            break;
+        case 1:
+            field.type = FIELD_INTEGER;
+            field.integer = -1 - (long long)argument(in, initial);
+            break;
+        case 3:
+            field.type = FIELD_STRING;
+            field.text = in.bytes(argument(in, initial));
+            break;
+        case 7:
+            if (initial == 0xFA) {
+                field.type = FIELD_FLOAT;
+                field.number = in.float32();
+            } else if (initial == 0xF6) {
+                field.type = FIELD_NULL;
+            } else {
+                return false;
+            }
+            break;
+        default:
+            return false;
+    }
+    return in.ok();
+}
+
+static bool decode(const uint8_t* data, size_t length, std::vector<Field>& fields) {
+    Reader in(data, length);
+    fields.clear();
+    uint8_t initial = in.next();
+    if (initial >> 5 != 5) {
+        return false;
+    }
+    uint64_t count = argument(in, initial);
+    for (uint64_t i = 0; i < count; i++) {
+        Field key = {}, field = {};
+        if (!decodeValue(in, key) || key.type != FIELD_STRING || !decodeValue(in, field)) {
+            return false;
+        }
+        field.key = key.text;
+        fields.push_back(field);
+    }
+    return in.ok() && in.atEnd();
+}
+
+#else  // PAYLOAD_FORMAT_MSGPACK
+
+static bool decodeValue(Reader& in, Field& field) {
+    uint8_t initial = in.next();
+    field.type = FIELD_INTEGER;
+    if (initial < 0x80) {
+        field.integer = initial;
+    } else if (initial >= 0xE0) {
+        field.integer = (int8_t)initial;
+    } else if ((initial & 0xE0) == 0xA0) {
+        field.type = FIELD_STRING;
+        field.text = in.bytes(initial & 0x1F);
+    } else {
+        switch (initial) {
+            case 0xCC: field.integer = (uint8_t)in.bigEndian(1); break;
+            case 0xCD: field.integer = (uint16_t)in.bigEndian(2); break;
+            case 0xCE: field.integer = (uint32_t)in.bigEndian(4); break;
+            case 0xCF: field.integer = (long long)in.bigEndian(8); break;
+            case 0xD0: field.integer = (int8_t)in.bigEndian(1); break;
+            case 0xD1: field.integer = (int16_t)in.bigEndian(2); break;
+            case 0xD2: field.integer = (int32_t)in.bigEndian(4); break;
+            case 0xD3: field.integer = (long long)in.bigEndian(8); break;
+            case 0xD9: field.type = FIELD_STRING; field.text = in.bytes(in.bigEndian(1)); break;
+            case 0xDA: field.type = FIELD_STRING; field.text = in.bytes(in.bigEndian(2)); break;
+            case 0xCA: field.type = FIELD_FLOAT; field.number = in.float32(); break;
+            case 0xC0: field.type = FIELD_NULL; break;
+            default: return false;
+        }
+    }
+    return in.ok();
+}
+
+static bool decode(const uint8_t* data, size_t length, std::vector<Field>& fields) {
+    Reader in(data, length);
+    fields.clear();
+    uint8_t initial = in.next();
+    if ((initial & 0xF0) != 0x80) {
+        return false;
+    }
+    for (uint8_t i = 0; i < (initial & 0x0F); i++) {
+        Field key = {}, field = {};
+        if (!decodeValue(in, key) || key.type != FIELD_STRING || !decodeValue(in, field)) {
+            return false;
+        }
+        field.key = key.text;
+        fields.push_back(field);
+    }
+    return in.ok() && in.atEnd();
+}
+
+#endif
+
+static char buffer[1024];
+
+// Whole-number values; JSON has no separate float type for them to lose
+static bool sameInteger(const Field& field, long long value) {
+    return field.type == FIELD_INTEGER && field.integer == value;
+}
+
+// Binary formats carry the float bits; JSON the value rounded to decimals
+static bool sameFloat(const Field& field, float value, uint8_t decimals) {
+    if (std::isnan(value)) {
+        return PAYLOAD_FORMAT == PAYLOAD_FORMAT_JSON ? field.type == FIELD_NULL
+                                                     : field.type == FIELD_FLOAT && std::isnan(field.number);
+    }
+    if (PAYLOAD_FORMAT != PAYLOAD_FORMAT_JSON) {
+        return field.type == FIELD_FLOAT && (float)field.number == value;
+    }
+    double number = field.type == FIELD_INTEGER ? (double)field.integer : field.number;
+    return (field.type == FIELD_FLOAT || decimals == 0) && fabs(number - value) <= 0.5 * pow(10, -decimals) + 1e-6;
+}
+
+static void testIntegers() {
+    // Both sides of every width boundary of CBOR and MessagePack
+    static const long long VALUES[] = {
+        0, 1, 23, 24, 127, 128, 255, 256, 65535, 65536, 2147483647LL, 4294967295LL, 4294967296LL,
+        -1, -24, -25, -32, -33, -128, -129, -256, -257, -32768, -32769, -65536, -65537, INT32_MIN,
+        (long long)INT32_MIN - 1,
+    };
+    std::vector<Field> fields;
+    for (long long value : VALUES) {
+        if (value < LONG_MIN || value > LONG_MAX) {
+            continue;  // long is 32 bits on the ESP32; the host's is wider
+        }
+        PayloadEncoder doc(buffer, sizeof(buffer));
+        doc.begin();
+        doc.add("v", (long)value);
+        doc.end();
+        CHECK(doc.ok());
+        bool decoded = decode(doc.data(), doc.length(), fields);
+        CHECK(decoded && fields.size() == 1 && fields[0].key == "v");
+        if (!decoded || fields.size() != 1 || !sameInteger(fields[0], value)) {
+            fprintf(stderr, "integer %lld did not round-trip\n", value);
+            checkFailures++;
+        }
+    }
+}
+
+static void testFloats() {
+    static const float VALUES[] = {0.0f, -0.5f, 21.37f, 45.5f, 1e6f, -273.15f, 3.0e-5f, NAN};
+    std::vector<Field> fields;
+    for (float value : VALUES) {
+        for (uint8_t decimals : {0, 2}) {
+            PayloadEncoder doc(buffer, sizeof(buffer));
+            doc.begin();
+            doc.add("temperature", value, decimals);
+            doc.end();
+            CHECK(doc.ok());
+            bool decoded = decode(doc.data(), doc.length(), fields);
+            if (!decoded || fields.size() != 1 || fields[0].key != "temperature" ||
+                !sameFloat(fields[0], value, decimals)) {
+                fprintf(stderr, "float %g with %u decimals did not round-trip\n", value, decimals);
+                checkFailures++;
+            }
+        }
+    }
+}
+
+static void testStrings() {
+    // Every length class: fixstr/short, 8-bit and 16-bit lengths
+    std::vector<std::string> values = {"", "pm2_5", "quote \" backslash \\ tab \t newline \n"};
+    for (size_t length : {23, 24, 31, 32, 255, 256, 300}) {
+        values.push_back(std::string(length, 'x'));
+    }
+    std::vector<Field> fields;
+    for (const std::string& value : values) {
+        PayloadEncoder doc(buffer, sizeof(buffer));
+        doc.begin();
+        doc.add("text", value.c_str());
+        doc.end();
+        CHECK(doc.ok());
+        bool decoded = decode(doc.data(), doc.length(), fields);
+        if (!decoded || fields.size() != 1 || fields[0].type != FIELD_STRING || fields[0].text != value) {
+            fprintf(stderr, "string of %zu bytes did not round-trip\n", value.size());
+            checkFailures++;
+        }
+    }
+}
+
+static bool encodeFields(uint8_t count, std::vector<Field>& fields) {
+    static const char* const KEYS[] = {"k0", "k1", "k2", "k3", "k4", "k5", "k6", "k7", "k8", "k9", "k10", "k11",
+                                       "k12", "k13", "k14", "k15", "k16", "k17", "k18", "k19", "k20", "k21",
+                                       "k22", "k23", "k24"};
+    PayloadEncoder doc(buffer, sizeof(buffer));
+    doc.begin();
+    for (uint8_t i = 0; i < count; i++) {
+        doc.add(KEYS[i], (long)i * 1000);
+    }
+    doc.end();
+    return doc.ok() && decode(doc.data(), doc.length(), fields) && fields.size() == count;
+}
+
+static void testFieldLimit() {
+    std::vector<Field> fields;
+    CHECK(encodeFields(0, fields));
+#ifdef TEST_MAX_FIELDS
+    CHECK(encodeFields(TEST_MAX_FIELDS, fields));
+    CHECK(fields.back().key == "k" + std::to_string(TEST_MAX_FIELDS - 1));
+    CHECK(sameInteger(fields.back(), (TEST_MAX_FIELDS - 1) * 1000));
+    CHECK(!encodeFields(TEST_MAX_FIELDS + 1, fields));  // Reported, never a corrupt header
+#else
+    CHECK(encodeFields(25, fields));
+#endif
+}
+
+static void testOverflow() {
+    for (size_t capacity = 0; capacity < 24; capacity++) {
+        PayloadEncoder doc(buffer, capacity);
+        doc.begin();
+        doc.add("temperature", 21.5f, 2);
+        doc.add("pollutant", "pm2_5");
+        doc.end();
+        CHECK(!doc.ok());
+    }
+}
+
+// The firmware's state document, with and without the suspect mask
+static void checkStateDocument(const SensorSnapshot& snapshot, uint32_t timestamp) {
+    size_t before = FakeBroker::messages().size();
+    CHECK(MQTTClient::publishState(snapshot, timestamp));
+    Sim::advance(50);
+    MQTTClient::loop();
+    CHECK(FakeBroker::messages().size() == before + 1);
+    if (FakeBroker::messages().size() != before + 1) {
+        return;
+    }
+    const MQTTMessage& message = FakeBroker::messages().back();
+    CHECK(message.topic == MQTT_STATE_TOPIC);
+
+    std::vector<Field> fields;
+    CHECK(decode(message.payload.data(), message.payload.size(), fields));
+    size_t expected = 2 + TOPIC_COUNT + (snapshot.suspect != 0);
+    CHECK(fields.size() == expected);
+    if (fields.size() != expected) {
+        return;
+    }
+    CHECK(fields[0].key == "ts" && sameInteger(fields[0], timestamp));
+    CHECK(fields[1].key == "seq" && fields[1].type == FIELD_INTEGER);
+    for (uint8_t t = 0; t < TOPIC_COUNT; t++) {
+        const MetricDescriptor& metric = METRICS[t];
+        const Field& field = fields[2 + t];
+        float value = metricValue(snapshot, (DataTopic)t);
+        bool same;
+        if (metric.kind == METRIC_TEXT) {
+            same = field.type == FIELD_STRING && field.text == EnhancedAQI::pollutantName((Pollutant)(int)value);
+        } else if (metric.decimals == 0) {
+            same = sameInteger(field, lroundf(value));
+        } else {
+            same = sameFloat(field, value, metric.decimals);
+        }
+        if (field.key != metric.key || !same) {
+            fprintf(stderr, "state field %s did not round-trip\n", metric.key);
+            checkFailures++;
+        }
+    }
+    if (snapshot.suspect != 0) {
+        CHECK(fields.back().key == "suspect" && sameInteger(fields.back(), snapshot.suspect));
+    }
+}
+
+static void testStateDocument() {
+    setup();
+    loop();
+    Sim::runFor(TEST_BOOT_TIME);
+
+    SensorSnapshot snapshot;
+    DataBus::snapshot(snapshot);
+    snapshot.suspect = 0;
+    checkStateDocument(snapshot, (uint32_t)time(nullptr));
+    snapshot.suspect = (1U << TOPIC_PM2_5) | (1U << TOPIC_TVOC);
+    checkStateDocument(snapshot, (uint32_t)time(nullptr));
+}
+
+int main() {
+    printf("PayloadEncoder: %s\n", PayloadEncoder::formatName());
+    testIntegers();
+    testFloats();
+    testStrings();
+    testFieldLimit();
+    testOverflow();
+    testStateDocument();
+    return CHECK_RESULT();
+}
@@ -0,0 +1,144 @@
+// PMS7003 frame decoder against corrupted and adversarial byte streams,
+// fed through the UART the way the sensor's bytes arrive
+#include <random>
+#include "sim.h"
+#include "check.h"
+#include "include/sensors/pms7003_sensor.h"
+
+#define FUZZ_ROUNDS 20000
+#define FUZZ_MAX_GARBAGE 96
+
+static HardwareSerial* uart;
+
+static void feed(const std::vector<uint8_t>& bytes) {
+    uart->inject(bytes.data(), bytes.size());
+}
+
+static uint32_t decodeAll() {
+    uint32_t frames = 0;
+    while (PMS7003Sensor::read()) {
+        frames++;
+    }
+    return frames;
+}
+
+static void appendChecksum(std::vector<uint8_t>& frame) {
+    uint16_t checksum = 0;
+    for (uint8_t byte : frame) {
+        checksum += byte;
+    }
+    frame.push_back(checksum >> 8);
+    frame.push_back(checksum);
+}
+
+static std::vector<uint8_t> dataFrame(uint16_t pm2_5) {
+    std::vector<uint8_t> frame = {0x42, 0x4D, 0x00, PMS7003_DATA_LENGTH};
+    for (uint8_t i = 0; i < 13; i++) {
+        uint16_t word = i == 4 ? pm2_5 : i;
+        frame.push_back(word >> 8);
+        frame.push_back(word);
+    }
+    appendChecksum(frame);
+    return frame;
+}
+
+static std::vector<uint8_t> replyFrame(uint8_t command, uint8_t value) {
+    std::vector<uint8_t> frame = {0x42, 0x4D, 0x00, PMS7003_REPLY_LENGTH, command, value};
+    appendChecksum(frame);
+    return frame;
+}
+
+// A stray header with a bad length while hunting is part of the same loss
+// of sync, not a second one
+static void testResyncCountedOnce() {
+    PMS7003Stats before = PMS7003Sensor::getStats();
+    feed({0x00, 0x13});
+    feed({0x42, 0x4D, 0xFF, 0xFF});
+    feed({0x07, 0x42, 0x4D, 0x00});  // Header torn off by noise
+    feed({0x99});
+    feed(dataFrame(42));
+    CHECK(decodeAll() == 1);
+    CHECK(PMS7003Sensor::getPM2_5() == 42);
+
+    PMS7003Stats after = PMS7003Sensor::getStats();
+    CHECK(after.resyncs - before.resyncs == 1);
+    CHECK(after.corruptedFrames - before.corruptedFrames == 2);  // Both bad length fields
+}
+
+static void testReplyChecksum() {
+    PMS7003Stats before = PMS7003Sensor::getStats();
+    feed(replyFrame(0xE1, 0x01));
+    std::vector<uint8_t> bad = replyFrame(0xE4, 0x00);
+    bad[5] ^= 0x01;
+    feed(bad);
+    feed(dataFrame(7));
+    CHECK(decodeAll() == 1);
+    CHECK(PMS7003Sensor::getPM2_5() == 7);
+
+    PMS7003Stats after = PMS7003Sensor::getStats();
+    CHECK(after.corruptedFrames - before.corruptedFrames == 1);
+    CHECK(after.resyncs == before.resyncs);
+}
+
+// Random noise, torn frames and flipped bits, each followed by enough idle
+// bytes to finish any frame the noise started and then one clean frame,
+// which must always come through
+static void testFuzz() {
+    std::mt19937 random(0x5EED);
+    uint32_t decoded = 0, expected = 0;
+
+    for (int round = 0; round < FUZZ_ROUNDS; round++) {
+        std::vector<uint8_t> noise;
+        switch (random() % 4) {
+            case 0: {  // Random bytes
+                size_t length = random() % FUZZ_MAX_GARBAGE;
+                for (size_t i = 0; i < length; i++) {
+                    noise.push_back(random());
+                }
+                break;
+            }
+            case 1: {  // A frame cut short
+                std::vector<uint8_t> frame = dataFrame(random());
+                noise.assign(frame.begin(), frame.begin() + random() % frame.size());
+                break;
+            }
+            case 2: {  // A frame with one bit flipped
+                noise = dataFrame(random());
+                noise[random() % noise.size()] ^= 1 << (random() % 8);
+                break;
+            }
+            case 3: {  // Headers with random lengths
+                for (int i = random() % 4; i >= 0; i--) {
+                    noise.insert(noise.end(), {0x42, 0x4D, (uint8_t)random(), (uint8_t)random()});
+                }
+                break;
+            }
+        }
+        noise.insert(noise.end(), PMS7003_FRAME_LENGTH, 0x00);
+        feed(noise);
+        uint32_t fromNoise = decodeAll();
+
+        uint16_t pm2_5 = 1000 + round % 1000;
+        feed(dataFrame(pm2_5));
+        uint32_t frames = decodeAll();
+        CHECK(frames == 1);
+        CHECK(PMS7003Sensor::getPM2_5() == pm2_5);
+        decoded += fromNoise + frames;
+        expected++;
+    }
+
+    // A flipped bit can only get through if it hit a checksum-neutral spot,
+    // which a single flip never does
+    CHECK(decoded == expected);
+}
+
+int main() {
+    PMS7003Sensor::begin();
+    decodeAll();
+    uart = HardwareSerial::port(2);
+
+    testResyncCountedOnce();
+    testReplyChecksum();
+    testFuzz();
+    return CHECK_RESULT();
+}
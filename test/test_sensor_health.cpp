@@ -0,0 +1,101 @@
+// Staged recovery of one silent sensor: the SGP30 stops answering on the
+// shared I2C bus and must walk retry -> soft reset -> bus recovery -> failed,
+// be retried after SENSOR_FAILED_RETRY, and come back once it answers again.
+// The SCD41 and PMS7003 keep delivering throughout, so their readings must
+// stay good and the board must not ask for a reboot.
+#include <vector>
+#include "sim.h"
+#include "check.h"
+#include "include/lib/sensor_health.h"
+
+#define TEST_BOOT_TIME 60000UL
+#define TEST_STEP 1000UL  // Shorter than any stage, so every transition is seen
+#define TEST_SGP30_ADDRESS 0x58
+#define TEST_ESCALATION_TIME (4 * SENSOR_RECOVERY_STEP)
+#define TEST_RECOVERY_TIME (SENSOR_RECOVERY_STEP)
+
+void setup();
+void loop();
+
+struct Transition {
+    SensorState state;
+    RecoveryStage stage;
+};
+
+static std::vector<Transition> transitions;
+static uint32_t othersDisturbed = 0;  // Steps with another sensor not OK or its readings not good
+static uint32_t rebootRequests = 0;
+
+static bool topicsHaveQuality(TopicMask topics, ReadingQuality quality) {
+    for (uint8_t t = 0; t < TOPIC_COUNT; t++) {
+        if ((topics & TOPIC_BIT(t)) && DataBus::read((DataTopic)t).quality != quality) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Runs in small steps and records every change of the SGP30's state or stage
+static void runWatching(unsigned long millis) {
+    for (unsigned long elapsed = 0; elapsed < millis; elapsed += TEST_STEP) {
+        Sim::runFor(TEST_STEP);
+        SensorHealthInfo info = SensorHealth::read(HEALTH_SGP30);
+        if (transitions.empty() || transitions.back().state != info.state || transitions.back().stage != info.stage) {
+            transitions.push_back({info.state, info.stage});
+            printf("  %6.1f s: %s, %s\n", Sim::micros() / 1e6, SensorHealth::stateName(info.state),
+                   SensorHealth::stageName(info.stage));
+        }
+        if (SensorHealth::read(HEALTH_SCD41).state != SENSOR_OK || SensorHealth::read(HEALTH_PMS7003).state != SENSOR_OK ||
+            !topicsHaveQuality(SCD41_TOPICS | PMS7003_TOPICS, QUALITY_GOOD)) {
+            othersDisturbed++;
+        }
+        if (SensorHealth::rebootRequired()) {
+            rebootRequests++;
+        }
+    }
+}
+
+static bool transitionIs(size_t index, SensorState state, RecoveryStage stage) {
+    return index < transitions.size() && transitions[index].state == state && transitions[index].stage == stage;
+}
+
+int main() {
+    setup();
+    loop();
+    Sim::runFor(TEST_BOOT_TIME);
+    CHECK(SensorHealth::read(HEALTH_SGP30).state == SENSOR_OK);
+    CHECK(topicsHaveQuality(SGP30_TOPICS, QUALITY_GOOD));
+
+    // Escalation while it stays silent
+    Sim::setI2CResponding(TEST_SGP30_ADDRESS, false);
+    runWatching(TEST_ESCALATION_TIME);
+    CHECK(transitions.size() == 4);
+    CHECK(transitionIs(0, SENSOR_DEGRADED, STAGE_RETRY));
+    CHECK(transitionIs(1, SENSOR_RECOVERING, STAGE_SOFT_RESET));
+    CHECK(transitionIs(2, SENSOR_RECOVERING, STAGE_BUS_RECOVERY));  // No power pin, so no power cycle
+    CHECK(transitionIs(3, SENSOR_FAILED, STAGE_EXHAUSTED));
+    CHECK(SensorHealth::read(HEALTH_SGP30).resets == 2);
+    CHECK(topicsHaveQuality(SGP30_TOPICS, QUALITY_INVALID));
+
+    // A failed sensor goes through recovery again
+    runWatching(SENSOR_FAILED_RETRY);
+    CHECK(transitions.size() == 5);
+    CHECK(transitionIs(4, SENSOR_RECOVERING, STAGE_SOFT_RESET));
+    CHECK(SensorHealth::read(HEALTH_SGP30).resets == 3);
+
+    // Back once it answers
+    Sim::setI2CResponding(TEST_SGP30_ADDRESS, true);
+    runWatching(TEST_RECOVERY_TIME);
+    SensorHealthInfo info = SensorHealth::read(HEALTH_SGP30);
+    CHECK(info.state == SENSOR_OK);
+    CHECK(info.stage == STAGE_NONE);
+    CHECK(info.outages == 1);
+    CHECK(info.lastOutageMillis > SENSOR_FAILED_RETRY);
+    CHECK(topicsHaveQuality(SGP30_TOPICS, QUALITY_GOOD));
+
+    // The other sensors never noticed, and one sensor down is no reason to reboot
+    CHECK(othersDisturbed == 0);
+    CHECK(rebootRequests == 0);
+    CHECK(Sim::restarts() == 0);
+    return CHECK_RESULT();
+}
@@ -0,0 +1,74 @@
+// TaskQueue ordering, periodic re-arming and id reuse
+#include "sim.h"
+#include "check.h"
+#include "include/lib/task_queue.h"
+
+static int periodicRuns, oneShotRuns;
+
+static void periodic() {
+    periodicRuns++;
+}
+
+static void oneShot() {
+    oneShotRuns++;
+}
+
+// Ids wrap at INT8_MAX; a chain of one-shots must never be handed the id of
+// a periodic task that is still queued, or cancelling the one-shot would
+// cancel the periodic task instead
+static void testIdsSkipLiveTasks() {
+    TaskQueue queue;
+    int8_t periodicIds[3];
+    for (int8_t& id : periodicIds) {
+        id = queue.every(1000, periodic);
+        CHECK(id != TASK_INVALID_ID);
+    }
+
+    for (int i = 0; i < 3 * (INT8_MAX + 1); i++) {
+        int8_t id = queue.after(10, oneShot);
+        CHECK(id != TASK_INVALID_ID);
+        for (int8_t live : periodicIds) {
+            CHECK(id != live);
+        }
+        CHECK(queue.cancel(id));
+    }
+    CHECK(queue.size() == 3);
+    for (int8_t id : periodicIds) {
+        CHECK(queue.isScheduled(id));
+    }
+}
+
+// runDue() reads millis() after each callback, so the clock is moved
+// rather than passed in
+static void testDeadlineOrder() {
+    TaskQueue queue;
+    queue.every(1000, periodic);
+    queue.after(500, oneShot);
+    periodicRuns = oneShotRuns = 0;
+
+    CHECK(queue.runDue(millis()) == 500);  // The periodic task is due at once
+    CHECK(periodicRuns == 1 && oneShotRuns == 0);
+    Sim::advance(500);
+    CHECK(queue.runDue(millis()) == 500);
+    CHECK(oneShotRuns == 1 && queue.size() == 1);
+
+    // A late pass skips missed periods instead of bursting
+    Sim::advance(5000);
+    CHECK(queue.runDue(millis()) == 1000);
+    CHECK(periodicRuns == 2);
+}
+
+static void testCapacity() {
+    TaskQueue queue;
+    for (int i = 0; i < TASK_QUEUE_CAPACITY; i++) {
+        CHECK(queue.after(i, oneShot) != TASK_INVALID_ID);
+    }
+    CHECK(queue.after(0, oneShot) == TASK_INVALID_ID);
+}
+
+int main() {
+    testIdsSkipLiveTasks();
+    testDeadlineOrder();
+    testCapacity();
+    return CHECK_RESULT();
+}
@@ -0,0 +1,88 @@
+// Store-and-forward over a day offline: the firmware keeps running while
+// WiFi is gone, with the flash partition refusing writes for part of it.
+// Flash writes must stay within one per TELEMETRY_WRITE_BATCH readings, and
+// after the reconnect the broker must see every stored sequence number
+// exactly once, with no gaps.
+#include <algorithm>
+#include "sim.h"
+#include "check.h"
+#include "include/lib/telemetry_store.h"
+#include "include/lib/mqtt_client.h"
+
+#define TEST_BOOT_TIME 60000UL
+#define TEST_OUTAGE_BEFORE_FULL (10 * 3600000UL)
+#define TEST_FLASH_FULL (2 * 3600000UL)
+#define TEST_OUTAGE_AFTER_FULL (12 * 3600000UL)
+#define TEST_DRAIN_TIME (30 * 60000UL)
+#define TEST_READINGS_PER_DAY 1440  // One a minute, the most the store is sized for
+
+void setup();
+void loop();
+
+// The seq field of every backfill document the broker received
+static std::vector<uint32_t> backfillSequences() {
+    std::vector<uint32_t> sequences;
+    for (const MQTTMessage& message : FakeBroker::messages()) {
+        if (message.topic != MQTT_BACKFILL_TOPIC) {
+            continue;
+        }
+        std::string payload(message.payload.begin(), message.payload.end());
+        size_t at = payload.find("\"seq\":");
+        CHECK(at != std::string::npos);
+        if (at != std::string::npos) {
+            sequences.push_back((uint32_t)strtoul(payload.c_str() + at + 6, nullptr, 10));
+        }
+    }
+    return sequences;
+}
+
+int main() {
+    setup();
+    loop();
+    Sim::runFor(TEST_BOOT_TIME);
+    CHECK(FakeBroker::isConnected());
+
+    uint32_t flashWrites = TelemetryStore::getFlashWrites();
+    FakeNetwork::setWiFiAvailable(false);
+    Sim::runFor(TEST_OUTAGE_BEFORE_FULL);
+
+    // A full partition keeps the batch in RAM and drops what does not fit
+    uint32_t dropped = TelemetryStore::getDropped();
+    uint32_t writesBeforeFull = TelemetryStore::getFlashWrites();
+    FakeFlash::setFull(true);
+    Sim::runFor(TEST_FLASH_FULL);
+    CHECK(TelemetryStore::getFlashWrites() == writesBeforeFull);
+    CHECK(TelemetryStore::getDropped() > dropped);
+    FakeFlash::setFull(false);
+    Sim::runFor(TEST_OUTAGE_AFTER_FULL);
+
+    uint32_t backlog = TelemetryStore::backlog();
+    uint32_t outageWrites = TelemetryStore::getFlashWrites() - flashWrites;
+    printf("24 h offline: %u readings stored, %u flash writes, %u dropped while flash was full\n", backlog,
+           outageWrites, TelemetryStore::getDropped() - dropped);
+    CHECK(backlog > 0);
+    CHECK(outageWrites <= TEST_READINGS_PER_DAY / TELEMETRY_WRITE_BATCH);
+    CHECK(outageWrites <= backlog / TELEMETRY_WRITE_BATCH + 1);
+
+    uint32_t nvsWrites = FakeFlash::nvsWrites();
+    FakeNetwork::setWiFiAvailable(true);
+    Sim::runFor(TEST_DRAIN_TIME);
+    uint32_t ackWrites = FakeFlash::nvsWrites() - nvsWrites;
+    printf("Reconnected: backlog %u, %u NVS writes while draining\n", TelemetryStore::backlog(), ackWrites);
+    CHECK(TelemetryStore::backlog() == 0);
+    // The delivered position is saved once per drain pass, not per record
+    CHECK(ackWrites <= backlog / MQTT_INFLIGHT_WINDOW + 1);
+
+    // Every sequence from the first stored reading on, once each
+    std::vector<uint32_t> sequences = backfillSequences();
+    std::sort(sequences.begin(), sequences.end());
+    CHECK(sequences.size() >= backlog);
+    for (size_t i = 0; i < sequences.size(); i++) {
+        if (sequences[i] != i + 1) {
+            printf("Sequence %zu is %u\n", i + 1, sequences[i]);
+            CHECK(sequences[i] == i + 1);
+            break;
+        }
+    }
+    return CHECK_RESULT();
+}
@@ -0,0 +1,145 @@
+#!/usr/bin/env python3
+"""Estimates the daily charge drawn by the station in each power configuration.
+
+Walks one simulated day through the same schedule the firmware follows:
+continuous mode keeps everything powered, duty-cycled mode wakes once per
+period, samples every sensor, uploads every few samples and deep-sleeps in
+between, backing off after failed uploads like PowerManager does.
+
+Currents are typical datasheet values at 3.3 V and can be overridden on the
+command line; measure the real board before relying on the result.
+
+    python3 tools/energy_model.py
+    python3 tools/energy_model.py --battery 6000 --upload-failure 0.2
+"""
+
+import argparse
+import random
+
+# Supply currents in mA
+CURRENTS = {
+    "cpu_240": 40.0,         # ESP32 active, WiFi off
+    "cpu_80": 20.0,          # ESP32 active at DUTY_CPU_FREQUENCY
+    "light_sleep": 0.8,      # Automatic light sleep between deadlines
+    "deep_sleep": 0.01,      # Bare module; dev-board regulators and USB bridges add far more
+    "wifi_connected": 35.0,  # Associated with modem sleep, on top of the CPU
+    "wifi_connect": 110.0,   # Scan, association and DHCP, on top of the CPU
+    "pms_active": 60.0,      # Fan running
+    "pms_standby": 0.2,
+    "scd41_periodic": 15.0,
+    "scd41_low_power": 3.2,
+    "scd41_shot": 18.0,      # During the 5 s single shot
+    "scd41_idle": 0.2,
+    "scd41_power_down": 0.02,
+    "sgp30_measure": 48.0,   # Hot plate on
+    "oled": 8.0,             # Text screen
+}
+
+DAY = 86400.0
+
+# Timing in seconds, matching the firmware defaults
+PMS_WARMUP = 30.0
+PMS_FRAME = 1.0
+SCD41_SHOT = 5.0
+WIFI_CONNECT = 3.0
+UPLOAD_TRANSFER = 1.0
+UPLOAD_TIMEOUT = 20.0
+MAX_UPLOAD_BACKOFF = 8
+
+
+def continuous(c, scd41_mode, oled_hours):
+    """Average current with WiFi, the PMS7003 fan and the SGP30 always on."""
+    scd41 = {
+        "periodic": c["scd41_periodic"],
+        "low-power": c["scd41_low_power"],
+        "single-shot": (c["scd41_shot"] * SCD41_SHOT + c["scd41_idle"] * (60 - SCD41_SHOT)) / 60,
+    }[scd41_mode]
+    oled = c["oled"] * oled_hours / 24.0
+    return c["cpu_240"] + c["wifi_connected"] + c["pms_active"] + c["sgp30_measure"] + scd41 + oled
+
+
+def duty_cycled(c, period, upload_every, light_sleep, failure_rate, seed):
+    """Average current over one day of duty cycles, simulated cycle by cycle."""
+    rng = random.Random(seed)
+    cpu = c["light_sleep"] if light_sleep else c["cpu_80"]
+
+    charge = 0.0  # mA*s
+    elapsed = 0.0
+    since_upload = 0
+    until_upload = 0
+    failures = 0
+    uploads = 0
+    awake_total = 0.0
+
+    while elapsed < DAY:
+        # Sampling: the PMS7003 warm-up bounds the awake time; the SGP30 is
+        # powered for all of it, the SCD41 only for one single shot
+        awake = PMS_WARMUP + PMS_FRAME
+        charge += awake * (cpu + c["pms_active"] + c["sgp30_measure"])
+        charge += SCD41_SHOT * c["scd41_shot"] + (awake - SCD41_SHOT) * c["scd41_idle"]
+        # The 1 Hz SGP30 reads keep the CPU out of light sleep for a few ms each
+        if light_sleep:
+            charge += awake * 0.02 * (c["cpu_80"] - c["light_sleep"])
+
+        since_upload += 1
+        until_upload = max(until_upload - 1, 0)
+        if until_upload == 0 and (since_upload >= upload_every or failures > 0):
+            ok = rng.random() >= failure_rate
+            session = WIFI_CONNECT + UPLOAD_TRANSFER if ok else UPLOAD_TIMEOUT
+            charge += session * (c["cpu_80"] + c["wifi_connect"])
+            awake += session
+            if ok:
+                uploads += 1
+                since_upload = 0
+                failures = 0
+            else:
+                failures += 1
+                until_upload = min(1 << failures, MAX_UPLOAD_BACKOFF)
+
+        asleep = max(period - awake, 0.0)
+        charge += asleep * (c["deep_sleep"] + c["pms_standby"] + c["scd41_power_down"])
+        awake_total += awake
+        elapsed += period
+
+    return charge / elapsed, uploads, awake_total / elapsed
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--battery", type=float, default=3000, help="Battery capacity in mAh")
+    parser.add_argument("--upload-failure", type=float, default=0.05, help="Probability a WiFi session fails")
+    parser.add_argument("--seed", type=int, default=1)
+    parser.add_argument("--current", action="append", default=[], metavar="NAME=MA",
+                        help="Override a supply current, e.g. deep_sleep=0.15")
+    args = parser.parse_args()
+
+    currents = dict(CURRENTS)
+    for override in args.current:
+        name, value = override.split("=", 1)
+        if name not in currents:
+            parser.error("unknown current %s" % name)
+        currents[name] = float(value)
+
+    rows = []
+    for mode in ("periodic", "low-power", "single-shot"):
+        rows.append(("continuous, SCD41 %s, OLED 1 h/day" % mode, continuous(currents, mode, 1), None))
+    for period, upload_every in ((300, 6), (300, 12), (600, 6), (900, 4)):
+        for light_sleep in (False, True):
+            average, uploads, duty = duty_cycled(currents, period, upload_every, light_sleep,
+                                                 args.upload_failure, args.seed)
+            name = "duty %d min, upload every %d%s" % (period // 60, upload_every,
+                                                       ", light sleep" if light_sleep else "")
+            rows.append((name, average, (uploads, duty)))
+
+    print("%-48s %9s %10s %8s" % ("configuration", "avg mA", "mAh/day", "days"))
+    for name, average, extra in rows:
+        per_day = average * 24
+        print("%-48s %9.2f %10.1f %8.1f" % (name, average, per_day, args.battery / per_day), end="")
+        if extra:
+            print("   %d uploads/day, awake %.1f%%" % (extra[0], extra[1] * 100))
+        else:
+            print()
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,241 @@
+#!/usr/bin/env python3
+"""Decodes the binary event log the firmware writes to the serial port.
+
+Records are compact frames holding an event id and its integer arguments;
+the message formats live in include/lib/event_log.h and are read from there,
+so the decoder follows whatever the firmware was built with. Bytes outside
+a frame, such as the banner and the hourly statistics, are passed through
+as text.
+
+The same frames make up the MQTT log dump, requested by publishing to the
+log/get topic:
+
+    python3 tools/log_decode.py /dev/ttyUSB0
+    python3 tools/log_decode.py capture.bin --csv > events.csv
+    mosquitto_sub -t homeassistant/sensor/esp32_airquality/log -N | python3 tools/log_decode.py
+"""
+
+import argparse
+import csv
+import os
+import re
+import struct
+import sys
+
+ROOT = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..")
+SYNC = b"\x1e\xa5"
+HEADER = struct.Struct("<IHB")
+MAX_ARGS = 3
+LEVELS = {"OFF": "-", "ERROR": "E", "WARN": "W", "INFO": "I", "DEBUG": "D"}
+POLLUTANTS = ["none", "pm2_5", "pm10"]  # EnhancedAQI::pollutantName
+
+
+def macro_body(text, name):
+    """Continuation lines of a #define, joined."""
+    match = re.search(r"#define %s\(X\)((?:.*\\\n)*.*)" % name, text)
+    if not match:
+        sys.exit("%s not found" % name)
+    return match.group(1)
+
+
+def load_tables(root):
+    with open(os.path.join(root, "include/lib/event_log.h"), encoding="utf-8") as f:
+        log_header = f.read()
+    with open(os.path.join(root, "include/lib/metrics.h"), encoding="utf-8") as f:
+        metrics_header = f.read()
+    with open(os.path.join(root, "include/lib/sample_record.h"), encoding="utf-8") as f:
+        record_header = f.read()
+
+    modules = {}
+    for ident, name in re.findall(r'X\((\w+),\s*"([^"]*)"\)', macro_body(log_header, "LOG_MODULES")):
+        modules[ident] = name
+    events = []
+    for ident, module, level, fmt in re.findall(r'X\((\w+),\s*(\w+),\s*(\w+),\s*"([^"]*)"\)',
+                                                macro_body(log_header, "LOG_EVENTS")):
+        events.append((ident, modules[module], level, fmt))
+
+    # SAMPLE_SCALE_<name> scale, offset
+    scales = {}
+    for name, scale, offset in re.findall(r"#define SAMPLE_SCALE_(\w+) ([-\d.]+)f, ([-\d.]+)f", record_header):
+        scales[name] = (float(scale), float(offset))
+
+    # label (short), unit, decimals, kind and fixed-point scale, in DataTopic order
+    metrics = []
+    row = (r'X\(\w+,\s*"[^"]*",\s*"[^"]*",\s*"([^"]*)",\s*"([^"]*)",\s*"[^"]*",\s*(\d+),\s*-?\d+,\s*(\w+),'
+           r'\s*\w+,\s*[\w.]+,\s*(\w+),')
+    for label, unit, decimals, kind, scale in re.findall(row, macro_body(metrics_header, "METRIC_TABLE")):
+        metrics.append((label, unit, int(decimals), kind, scales[scale]))
+    return events, metrics
+
+
+def format_metric(metrics, topic, fixed):
+    if not 0 <= topic < len(metrics):
+        return ""
+    label, unit, decimals, kind, (scale, offset) = metrics[topic]
+    if kind == "TEXT":
+        value = POLLUTANTS[fixed] if 0 <= fixed < len(POLLUTANTS) else "none"
+    else:
+        value = "%.*f" % (decimals, fixed * scale + offset)
+    return "%s: %s %s" % (label, value, unit) if unit else "%s: %s" % (label, value)
+
+
+def render(fmt, args, metrics):
+    """Mirrors EventLog::format."""
+    out = []
+    i = 0
+    arg = 0
+    while i < len(fmt):
+        c = fmt[i]
+        if c != "%" or i + 1 == len(fmt):
+            out.append(c)
+            i += 1
+            continue
+        spec = fmt[i + 1]
+        value = args[arg] if arg < len(args) else 0
+        i += 2
+        if spec == "d":
+            out.append(str(value))
+        elif spec == "u":
+            out.append(str(value & 0xFFFFFFFF))
+        elif spec == "x":
+            out.append("%x" % (value & 0xFFFFFFFF))
+        elif spec == "i":
+            out.append(".".join(str((value >> shift) & 0xFF) for shift in (0, 8, 16, 24)))
+        elif spec == "m":
+            fixed = args[arg + 1] if arg + 1 < len(args) else 0
+            out.append(format_metric(metrics, value, fixed))
+            arg += 1
+        elif spec == "{":
+            end = fmt.find("}", i)
+            names = fmt[i:end if end >= 0 else len(fmt)].split("|")
+            out.append(names[max(value, 0)] if value < len(names) else "")
+            i = end + 1 if end >= 0 else len(fmt)
+        else:
+            out.append(spec)
+            continue
+        arg += 1
+    return "".join(out)
+
+
+def crc8(data):
+    crc = 0
+    for byte in data:
+        crc ^= byte
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x07) & 0xFF if crc & 0x80 else (crc << 1) & 0xFF
+    return crc
+
+
+class Decoder:
+    """Splits a byte stream into frames and pass-through text."""
+
+    def __init__(self, on_record, on_text):
+        self.buffer = bytearray()
+        self.on_record = on_record
+        self.on_text = on_text
+        self.bad_frames = 0
+
+    def feed(self, data):
+        self.buffer += data
+        while True:
+            start = self.buffer.find(SYNC)
+            if start < 0:
+                # Keep a trailing first sync byte, the second may follow
+                keep = 1 if self.buffer.endswith(SYNC[:1]) else 0
+                self.emit_text(len(self.buffer) - keep)
+                return
+            self.emit_text(start)
+            if len(self.buffer) < 2 + HEADER.size:
+                return
+            timestamp, event, argc = HEADER.unpack_from(self.buffer, 2)
+            if argc > MAX_ARGS:
+                self.reject()
+                continue
+            length = 2 + HEADER.size + 4 * argc + 1
+            if len(self.buffer) < length:
+                return
+            if crc8(self.buffer[2:length - 1]) != self.buffer[length - 1]:
+                self.reject()
+                continue
+            args = struct.unpack_from("<%di" % argc, self.buffer, 2 + HEADER.size)
+            del self.buffer[:length]
+            self.on_record(timestamp, event, list(args))
+
+    def reject(self):
+        # Not a frame after all: pass the sync bytes through and resync
+        self.bad_frames += 1
+        self.emit_text(2)
+
+    def emit_text(self, count):
+        if count > 0:
+            self.on_text(bytes(self.buffer[:count]))
+            del self.buffer[:count]
+
+    def finish(self):
+        self.emit_text(len(self.buffer))
+
+
+def open_input(path, baud):
+    if path == "-":
+        return sys.stdin.buffer
+    if path.startswith("/dev/") or path.upper().startswith("COM"):
+        try:
+            import serial
+        except ImportError:
+            sys.exit("reading a serial port needs pyserial")
+        return serial.Serial(path, baud, timeout=0.5)
+    return open(path, "rb")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("input", nargs="?", default="-", help="Capture file, serial port, or - for stdin")
+    parser.add_argument("--baud", type=int, default=115200)
+    parser.add_argument("--csv", action="store_true", help="One row per record; text is dropped")
+    parser.add_argument("--root", default=ROOT, help="Firmware tree whose headers describe the events")
+    args = parser.parse_args()
+
+    events, metrics = load_tables(args.root)
+    out = sys.stdout
+    writer = csv.writer(out) if args.csv else None
+    if writer:
+        writer.writerow(["millis", "level", "module", "event", "message", "args"])
+
+    def on_record(timestamp, event, values):
+        if event < len(events):
+            ident, module, level, fmt = events[event]
+            message = render(fmt, values, metrics)
+        else:
+            ident, module, level, message = "UNKNOWN_%d" % event, "?", "?", "unknown event %d" % event
+        if writer:
+            writer.writerow([timestamp, level.lower(), module, ident, message, " ".join(map(str, values))])
+        else:
+            out.write("[%d.%03d] %s %s: %s\n" % (timestamp // 1000, timestamp % 1000, LEVELS.get(level, "?"),
+                                                 module, message))
+        out.flush()
+
+    def on_text(data):
+        if not writer:
+            out.write(data.decode("utf-8", "replace").replace("\r\n", "\n"))
+            out.flush()
+
+    decoder = Decoder(on_record, on_text)
+    source = open_input(args.input, args.baud)
+    serial_port = hasattr(source, "in_waiting")
+    try:
+        while True:
+            # A serial port never ends; a pipe is decoded as it arrives
+            data = source.read(max(1, source.in_waiting)) if serial_port else source.read1(4096)
+            if data:
+                decoder.feed(data)
+            elif not serial_port:
+                break
+    except KeyboardInterrupt:
+        pass
+    decoder.finish()
+    if decoder.bad_frames:
+        sys.stderr.write("%d corrupt frames skipped\n" % decoder.bad_frames)
+
+
+if __name__ == "__main__":
+    main()